@@ -21,6 +21,7 @@ All rights reserved.
 #include "config.h"
 
 #include "dsi_debug.hpp"
+#include "dsi_alloc_audit.hpp"
 #if defined(DEBUG_FILE)
    #include "macros.h"
 #endif
@@ -1161,6 +1162,7 @@ DSI_THREAD_RETURN ANTFSClientChannel::ANTFSThreadStart(void *pvParameter_)
    #if defined(DEBUG_FILE)
       DSIDebug::ThreadInit("ANTFSClient");
    #endif
+   DSI_ALLOC_THREAD("ANTFSClient", DSI_ALLOC_ANTFS);
 
    ((ANTFSClientChannel *)pvParameter_)->ANTFSThread();
 
@@ -15,6 +15,7 @@ All rights reserved.
 #include "antfs_host.hpp"
 
 #include "dsi_debug.hpp"
+#include "dsi_alloc_audit.hpp"
 #if defined(DEBUG_FILE)
    #include "macros.h"
 #endif
@@ -411,6 +412,7 @@ DSI_THREAD_RETURN ANTFSHost::ANTFSThreadStart(void *pvParameter_)
    #if defined(DEBUG_FILE)
    DSIDebug::ThreadInit("ANTFSHostWrapper");
    #endif
+   DSI_ALLOC_THREAD("ANTFSHostWrapper", DSI_ALLOC_ANTFS);
 
    ((ANTFSHost *)pvParameter_)->ANTFSThread();
 
@@ -21,6 +21,7 @@ All rights reserved.
 #include "config.h"
 
 #include "dsi_debug.hpp"
+#include "dsi_alloc_audit.hpp"
 #if defined(DEBUG_FILE)
    #include "macros.h"
 #endif
@@ -1205,6 +1206,7 @@ DSI_THREAD_RETURN ANTFSHostChannel::ANTFSThreadStart(void *pvParameter_)
    #if defined(DEBUG_FILE)
    DSIDebug::ThreadInit("ANTFSHost");
    #endif
+   DSI_ALLOC_THREAD("ANTFSHost", DSI_ALLOC_ANTFS);
 
    ((ANTFSHostChannel *)pvParameter_)->ANTFSThread();
 
@@ -16,6 +16,7 @@ All rights reserved.
 #include "macros.h"
 #include "usb_device_list.hpp"
 #include "dsi_debug.hpp"
+#include "dsi_alloc_audit.hpp"
 
 #include <memory>
 
@@ -633,6 +634,7 @@ DSI_THREAD_RETURN USBDeviceHandleLibusb::ProcessThread(void* pvParameter_)
 {
    USBDeviceHandleLibusb* This = reinterpret_cast<USBDeviceHandleLibusb*>(pvParameter_);
    This->ReceiveThread();
+   DSI_ALLOC_THREAD("ant-libusb-rx", DSI_ALLOC_SERIAL);
 
    return 0;
 }
@@ -14,6 +14,7 @@ All rights reserved.
 #include "usb_device_handle_si.hpp"
 #include "macros.h"
 #include "dsi_debug.hpp"
+#include "dsi_alloc_audit.hpp"
 
 #if defined(_MSC_VER)
    #include "WinDevice.h"
@@ -738,6 +739,7 @@ DSI_THREAD_RETURN USBDeviceHandleSI::ProcessThread(void* pvParameter_)
 {
    USBDeviceHandleSI* This = reinterpret_cast<USBDeviceHandleSI*>(pvParameter_);
    This->ReceiveThread();
+   DSI_ALLOC_THREAD("ant-si-rx", DSI_ALLOC_SERIAL);
 
    return 0;
 }
@@ -15,6 +15,7 @@ All rights reserved.
 #include "config.h"
 
 #include "dsi_debug.hpp"
+#include "dsi_alloc_audit.hpp"
 #if defined(DEBUG_FILE)
    #include "macros.h"
 #endif
@@ -421,6 +422,13 @@ void DSIANTDevice::SetDebug(BOOL bDebugOn_, const char *pcDirectory_)
 
    DSIDebug::SetDebug(bDebugOn_);
 }
+
+///////////////////////////////////////////////////////////////////////
+void DSIANTDevice::SetDebug(BOOL bDebugOn_, const char *pcDirectory_, BOOL bBinary_)
+{
+   DSIDebug::SetBinary(bBinary_);
+   SetDebug(bDebugOn_, pcDirectory_);
+}
 #endif
 
 
@@ -580,6 +588,7 @@ DSI_THREAD_RETURN DSIANTDevice::RequestThreadStart(void *pvParameter_)
    #if defined(DEBUG_FILE)
    DSIDebug::ThreadInit("DSIANTDevice");
    #endif
+   DSI_ALLOC_THREAD("DSIANTDevice", DSI_ALLOC_FRAMER);
 
    ((DSIANTDevice*)pvParameter_)->RequestThread();
 
@@ -753,6 +762,7 @@ DSI_THREAD_RETURN DSIANTDevice::ReceiveThreadStart(void *pvParameter_)
    #if defined(DEBUG_FILE)
    DSIDebug::ThreadInit("ANTReceive");
    #endif
+   DSI_ALLOC_THREAD("ANTReceive", DSI_ALLOC_FRAMER);
 
    ((DSIANTDevice*)pvParameter_)->ReceiveThread();
 
@@ -801,18 +811,10 @@ void DSIANTDevice::ReceiveThread(void)
       {
          usMesgSize = pclANT->GetMessage(&stMessage, MESG_MAX_SIZE_VALUE);  //get the message to clear the error
          #if defined(DEBUG_FILE)
-         {
-            UCHAR aucString[256];
-
-            SNPRINTF((char *)aucString,256, "DSIANTDevice::RecvThread():  Framer Error %u .", stMessage.ucMessageID);
-            DSIDebug::ThreadWrite((char *)aucString);
+            DSIDebug::ThreadPrintf("DSIANTDevice::RecvThread():  Framer Error %u .", stMessage.ucMessageID);
 
             if(stMessage.ucMessageID == DSI_FRAMER_ANT_ESERIAL)
-            {
-               SNPRINTF((char *)aucString,256, "DSIANTDevice::RecvThread():  Serial Error %u .", stMessage.aucData[0]);
-               DSIDebug::ThreadWrite((char *)aucString);
-            }
-         }
+               DSIDebug::ThreadPrintf("DSIANTDevice::RecvThread():  Serial Error %u .", stMessage.aucData[0]);
          #endif
 
          DSIThread_MutexLock(&stMutexCriticalSection);
@@ -833,12 +835,7 @@ void DSIANTDevice::ReceiveThread(void)
 
          #if defined(DEBUG_FILE)
          if (usMesgSize == 0)
-         {
-            UCHAR aucString2[256];
-
-            SNPRINTF((char *)aucString2,256, "Rx msg reported size 0, dump:%u[0x%02X]...[0x%02X][0x%02X][0x%02X][0x%02X][0x%02X][0x%02X][0x%02X][0x%02X]", usMesgSize , stMessage.ucMessageID, stMessage.aucData[0], stMessage.aucData[1], stMessage.aucData[2], stMessage.aucData[3], stMessage.aucData[4], stMessage.aucData[5], stMessage.aucData[6], stMessage.aucData[7]);
-            DSIDebug::ThreadWrite((char *)aucString2);
-         }
+            DSIDebug::ThreadPrintf("Rx msg reported size 0, dump:%u[0x%02X]...[0x%02X][0x%02X][0x%02X][0x%02X][0x%02X][0x%02X][0x%02X][0x%02X]", usMesgSize , stMessage.ucMessageID, stMessage.aucData[0], stMessage.aucData[1], stMessage.aucData[2], stMessage.aucData[3], stMessage.aucData[4], stMessage.aucData[5], stMessage.aucData[6], stMessage.aucData[7]);
          #endif
 
          if(stMessage.ucMessageID == MESG_SERIAL_ERROR_ID)
@@ -253,6 +253,16 @@ class DSIANTDevice
       //                   debug logs. Set to NULL to use the working
       //                   directory as the default path.
       /////////////////////////////////////////////////////////////////
+
+      void SetDebug(BOOL bDebugOn_, const char *pcDirectory_, BOOL bBinary_);
+      /////////////////////////////////////////////////////////////////
+      // Enables debug files and chooses their format
+      // Parameters:
+      //    bDebugOn_:     Enable/disable debug logs.
+      //    *pcDirectory_: As above.
+      //    bBinary_:      Write one compact binary log, to be read
+      //                   with DebugLogDecoder, instead of text logs.
+      /////////////////////////////////////////////////////////////////
       #endif
 
 };
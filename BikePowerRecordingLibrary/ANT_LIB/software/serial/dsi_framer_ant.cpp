@@ -13,7 +13,10 @@ All rights reserved.
 #include "antdefines.h"
 #include "checksum.h"
 #include "dsi_thread.h"
+#include "macros.h"
 #include "dsi_framer_ant.hpp"
+#include "dsi_probe.h"
+#include "dsi_alloc_audit.hpp"
 
 #include <string.h>
 
@@ -58,6 +61,18 @@ DSIFramerANT::DSIFramerANT()
       bInitOkay = FALSE;
 
    pclResponseListStart = (ANTMessageResponse*)NULL;
+   pclTap = (DSISerialTap*)NULL;
+   pclTrace = (DSILatencyTrace*)NULL;
+   ullReadTime = 0;
+
+   acStatsLabels[0] = '\0';
+   pstStatMessages = (DSI_STAT*)NULL;
+   memset(apstStatChannelMessages, 0, sizeof(apstStatChannelMessages));
+   ulStatChannelsTried = 0;
+   pstStatQueueDepth = (DSI_STAT*)NULL;
+   pstStatQueueOverflows = (DSI_STAT*)NULL;
+   pstStatCrcErrors = (DSI_STAT*)NULL;
+   pstStatSerialErrors = (DSI_STAT*)NULL;
 
    Init((DSISerial*)NULL);
 }
@@ -79,6 +94,18 @@ DSIFramerANT::DSIFramerANT(DSISerial *pclSerial_) : DSIFramer(pclSerial_)
       bInitOkay = FALSE;
 
    pclResponseListStart = (ANTMessageResponse*)NULL;
+   pclTap = (DSISerialTap*)NULL;
+   pclTrace = (DSILatencyTrace*)NULL;
+   ullReadTime = 0;
+
+   acStatsLabels[0] = '\0';
+   pstStatMessages = (DSI_STAT*)NULL;
+   memset(apstStatChannelMessages, 0, sizeof(apstStatChannelMessages));
+   ulStatChannelsTried = 0;
+   pstStatQueueDepth = (DSI_STAT*)NULL;
+   pstStatQueueOverflows = (DSI_STAT*)NULL;
+   pstStatCrcErrors = (DSI_STAT*)NULL;
+   pstStatSerialErrors = (DSI_STAT*)NULL;
 
    Init(pclSerial_);
 }
@@ -102,6 +129,36 @@ void DSIFramerANT::SetCancelParameter(volatile BOOL *pbCancel_)
    pbCancel = pbCancel_;
 }
 
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::SetTap(DSISerialTap *pclTap_)
+{
+   pclTap = pclTap_;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::SetTrace(DSILatencyTrace *pclTrace_)
+{
+   pclTrace = pclTrace_;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::SetStats(const char *pcLabels_)
+{
+   pstStatMessages = (DSI_STAT*)NULL;
+   memset(apstStatChannelMessages, 0, sizeof(apstStatChannelMessages));
+   ulStatChannelsTried = 0;
+
+   SNPRINTF(acStatsLabels, sizeof(acStatsLabels), "%s", pcLabels_ ? pcLabels_ : "");
+
+   pstStatQueueDepth = DSIStats::Register("ant_framer_queue_depth", acStatsLabels, "Messages waiting to be read from the framer", DSI_STATS_GAUGE);
+   pstStatQueueOverflows = DSIStats::Register("ant_framer_queue_overflows_total", acStatsLabels, "Messages dropped because the framer queue was full");
+   pstStatCrcErrors = DSIStats::Register("ant_framer_crc_errors_total", acStatsLabels, "Messages dropped for a bad checksum");
+   pstStatSerialErrors = DSIStats::Register("ant_framer_serial_errors_total", acStatsLabels, "Errors reported by the serial port");
+
+   // Registered last, it gates the per message counting.
+   pstStatMessages = DSIStats::Register("ant_framer_messages_total", acStatsLabels, "Messages received");
+}
+
 ///////////////////////////////////////////////////////////////////////
 volatile BOOL* DSIFramerANT::GetCancelParameter()
 {
@@ -206,6 +263,7 @@ USHORT DSIFramerANT::WaitForMessage(ULONG ulMilliseconds_)
 USHORT DSIFramerANT::GetMessage(void *pvData_, USHORT usSize_)
 {
    USHORT usRetVal;
+   DSI_ALLOC_SCOPE(DSI_ALLOC_FRAMER);
 
    DSIThread_MutexLock(&stMutexCriticalSection);
 
@@ -238,9 +296,13 @@ USHORT DSIFramerANT::GetMessage(void *pvData_, USHORT usSize_)
          {
             ((ANT_MESSAGE *) pvData_)->ucMessageID = astMessageBuffer[usMessageTail].stANTMessage.ucMessageID;
             memcpy(((ANT_MESSAGE *) pvData_)->aucData, astMessageBuffer[usMessageTail].stANTMessage.aucData, usRetVal);
+
+            if (pclTrace)
+               pclTrace->MessageDequeued(usMessageTail);
          }
 
          usMessageTail++;                                   // Rollover of usMessageTail happens automagically because our buffer size is MAX_USHORT + 1.
+         DSIStats::Set(pstStatQueueDepth, (USHORT)(usMessageHead - usMessageTail));
       }
       else
       {
@@ -288,8 +350,44 @@ UCHAR DSIFramerANT::GetChannelNumber(ANT_MESSAGE* pstMessage)
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::ProcessByte(UCHAR ucByte_)
 {
+   // The serial receive thread hands bytes over as soon as it reads them.
+   if (pclTrace)
+      ullReadTime = DSIThread_GetSystemTimeMicroseconds();
+
+   if (pclTap)
+      pclTap->Append(&ucByte_, 1);
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   ParseByte(ucByte_);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Takes the lock once for the whole chunk rather than once per byte.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::ProcessBytes(UCHAR *pucData_, ULONG ulSize_)
+{
+   DSI_ALLOC_SCOPE(DSI_ALLOC_FRAMER);
+
+   if (pclTrace)
+      ullReadTime = DSIThread_GetSystemTimeMicroseconds();
+
+   if (pclTap)
+      pclTap->Append(pucData_, ulSize_);
+
    DSIThread_MutexLock(&stMutexCriticalSection);
 
+   for (ULONG i = 0; i < ulSize_; i++)
+      ParseByte(pucData_[i]);
+
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Must be called with stMutexCriticalSection locked.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::ParseByte(UCHAR ucByte_)
+{
    if (ucRxIndex == 0)                                      // If we are looking for the start of a message.
    {
       if (ucByte_ == MESG_TX_SYNC)                          // If it is a valid first byte.
@@ -335,6 +433,8 @@ void DSIFramerANT::ProcessByte(UCHAR ucByte_)
          else
          {
             // Set a serial error for the bad crc.
+            DSIStats::Add(pstStatCrcErrors);
+            DSI_PROBE2(crc_error, this, ucRxSize);
             ucSerialError = DSI_FRAMER_ANT_CRC_ERROR;
             ucError = DSI_FRAMER_ANT_ESERIAL;
             DSIThread_CondSignal(&stCondMessageReady);
@@ -349,13 +449,13 @@ void DSIFramerANT::ProcessByte(UCHAR ucByte_)
          ucRxIndex++;
       }
    }
-
-   DSIThread_MutexUnlock(&stMutexCriticalSection);
 }
 
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::Error(UCHAR ucError_)
 {
+   DSIStats::Add(pstStatSerialErrors);
+
    DSIThread_MutexLock(&stMutexCriticalSection);
 
    ucSerialError = ucError_;
@@ -1370,9 +1470,10 @@ BOOL DSIFramerANT::SendBurstDataPacket(UCHAR ucANTChannelSeq_, UCHAR *pucData_)
 ///////////////////////////////////////////////////////////////////////
 BOOL DSIFramerANT::SendAdvancedBurstDataPacket(UCHAR ucANTChannelSeq_, UCHAR *pucData_, UCHAR ucStdPcktsPerSerialMsg_)
 {
-   ANT_MESSAGE* stMessage = (ANT_MESSAGE*) NULL;
+   ANT_MESSAGE stStdMessage;
+   ANT_MESSAGE* stMessage = &stStdMessage;
    USHORT packetDataSize = (MESG_DATA_SIZE-1) * ucStdPcktsPerSerialMsg_;
-   if(!CreateAntMsg_wOptExtBuf(&stMessage, packetDataSize+1))  //reqMinSize = packetSize + seqNum
+   if((ULONG)(packetDataSize+1) > sizeof(stStdMessage.aucData) && !CreateAntMsg_wOptExtBuf(&stMessage, packetDataSize+1))  //reqMinSize = packetSize + seqNum
    {
       #if defined(DEBUG_FILE)
          DSIDebug::ThreadWrite("Framer->SendAdvancedBurstDataPacket(): Failed, ucStdPcktsPerSerialMsg too big for this part");
@@ -1385,7 +1486,8 @@ BOOL DSIFramerANT::SendAdvancedBurstDataPacket(UCHAR ucANTChannelSeq_, UCHAR *pu
    memcpy(&(stMessage->aucData[1]),pucData_, packetDataSize);
 
    BOOL result = WriteMessage(stMessage, 1 + packetDataSize);  //seqNum + (payloadLength*pcktsPerSerial)
-   delete[] stMessage;
+   if(stMessage != &stStdMessage)
+      delete[] stMessage;
    return result;
 }
 
@@ -1506,8 +1608,9 @@ ANTFRAMER_RETURN DSIFramerANT::SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR
    ANTMessageResponse *pclFailResponse = (ANTMessageResponse*)NULL;
    ANTMessageResponse *pclErrorResponse = (ANTMessageResponse*)NULL;
 
-   ANT_MESSAGE* stMessage = (ANT_MESSAGE*)NULL;
-   if(!CreateAntMsg_wOptExtBuf(&stMessage, ucMaxDataSize_))
+   ANT_MESSAGE stStdMessage;
+   ANT_MESSAGE* stMessage = &stStdMessage;
+   if(ucMaxDataSize_ > sizeof(stStdMessage.aucData) && !CreateAntMsg_wOptExtBuf(&stMessage, ucMaxDataSize_))
    {
       #if defined(DEBUG_FILE)
          DSIDebug::ThreadWrite("Framer->SetupBurstDataTransfer(): Failed, ucMaxDataSize_ too big for this part");
@@ -1628,7 +1731,8 @@ ANTFRAMER_RETURN DSIFramerANT::SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR
    delete pclPassResponse;
    delete pclFailResponse;
    delete pclErrorResponse;
-   delete[] stMessage;
+   if(stMessage != &stStdMessage)
+      delete[] stMessage;
 
    //Always return true with no timeout, so nobody relies on this return value
    if(ulResponseTime_ == 0)
@@ -2160,6 +2264,8 @@ void DSIFramerANT::ProcessMessage(void)
       }
    }
 
+   DSI_PROBE4(message, this, ucMessageID, ucSize, aucRxFifo[MESG_DATA_OFFSET]);
+
    if(ucMessageID == MESG_ADV_BURST_DATA_ID && bSplitAdvancedBursts) // split into normal burst messages.
    {
       #if defined(SERIAL_DEBUG)
@@ -2179,11 +2285,17 @@ void DSIFramerANT::ProcessMessage(void)
             astMessageBuffer[usMessageHead].stANTMessage.ucMessageID = MESG_BURST_DATA_ID;
             astMessageBuffer[usMessageHead].stANTMessage.aucData[0] = ucPrevSequenceNum | (aucRxFifo[MESG_DATA_OFFSET] & CHANNEL_NUMBER_MASK);
             memcpy(astMessageBuffer[usMessageHead].stANTMessage.aucData + 1, &aucRxFifo[MESG_DATA_OFFSET + 1 + i*8], 8);
+            if (pclTrace)
+               pclTrace->MessageFramed(usMessageHead, GetChannelNumber(&astMessageBuffer[usMessageHead].stANTMessage), ullReadTime);
             usMessageHead++;                                   // Rollover of usMessageHead happens automagically because our buffer size is MAX_USHORT + 1.
+            if (pstStatMessages)
+               CountQueued(&astMessageBuffer[(USHORT)(usMessageHead - 1)].stANTMessage);
          }
          else
          {
             ucError = DSI_FRAMER_ANT_EQUEUE_OVERFLOW;
+            DSIStats::Add(pstStatQueueOverflows);
+            DSI_PROBE2(queue_overflow, this, ucMessageID);
          }
 
          DSIThread_CondSignal(&stCondMessageReady);
@@ -2201,11 +2313,17 @@ void DSIFramerANT::ProcessMessage(void)
          astMessageBuffer[usMessageHead].ucSize = ucSize;
          astMessageBuffer[usMessageHead].stANTMessage.ucMessageID = ucMessageID;
          memcpy(astMessageBuffer[usMessageHead].stANTMessage.aucData, &aucRxFifo[MESG_DATA_OFFSET], ucSize);
+         if (pclTrace)
+            pclTrace->MessageFramed(usMessageHead, GetChannelNumber(&astMessageBuffer[usMessageHead].stANTMessage), ullReadTime);
          usMessageHead++;                                   // Rollover of usMessageHead happens automagically because our buffer size is MAX_USHORT + 1.
+         if (pstStatMessages)
+            CountQueued(&astMessageBuffer[(USHORT)(usMessageHead - 1)].stANTMessage);
       }
       else
       {
          ucError = DSI_FRAMER_ANT_EQUEUE_OVERFLOW;
+         DSIStats::Add(pstStatQueueOverflows);
+         DSI_PROBE2(queue_overflow, this, ucMessageID);
       }
 
       DSIThread_CondSignal(&stCondMessageReady);
@@ -2216,6 +2334,38 @@ void DSIFramerANT::ProcessMessage(void)
    }
 }
 
+///////////////////////////////////////////////////////////////////////
+// Must be called with stMutexCriticalSection locked.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::CountQueued(ANT_MESSAGE *pstMessage_)
+{
+   UCHAR ucChannel = GetChannelNumber(pstMessage_);
+
+   DSIStats::Add(pstStatMessages);
+   DSIStats::Set(pstStatQueueDepth, (USHORT)(usMessageHead - usMessageTail));
+
+   if (ucChannel > CHANNEL_NUMBER_MASK)
+      return;
+
+   if ((ulStatChannelsTried & (1UL << ucChannel)) == 0)
+   {
+      // Only the first message on a channel registers, and readers of
+      // the registry never take its lock.
+      char acLabels[DSI_STATS_MAX_LABELS];
+
+      ulStatChannelsTried |= 1UL << ucChannel;
+
+      if (acStatsLabels[0] != '\0')
+         SNPRINTF(acLabels, sizeof(acLabels), "%s,channel=\"%u\"", acStatsLabels, ucChannel);
+      else
+         SNPRINTF(acLabels, sizeof(acLabels), "channel=\"%u\"", ucChannel);
+
+      apstStatChannelMessages[ucChannel] = DSIStats::Register("ant_framer_channel_messages_total", acLabels, "Messages received on each ANT channel");
+   }
+
+   DSIStats::Add(apstStatChannelMessages[ucChannel]);
+}
+
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::CheckResponseList(void)
 {
@@ -2506,6 +2656,7 @@ BOOL DSIFramerANT::GetDeviceUSBVID(USHORT& usVid_)
    return(pclSerial->GetDeviceVID(usVid_));
 }
 
+///Only called for messages that don't fit a standard ANT_MESSAGE, which the senders keep on the stack.
 ///Allocates a new standard ANT_MESSAGE struct which must be deleted after use.
 BOOL DSIFramerANT::CreateAntMsg_wOptExtBuf(ANT_MESSAGE **ppstExtBufAntMsg_, ULONG ulReqMinDataSize_)
 {
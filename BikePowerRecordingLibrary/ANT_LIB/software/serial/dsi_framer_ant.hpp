@@ -14,6 +14,9 @@ All rights reserved.
 #include "antmessage.h"
 #include "antdefines.h"
 #include "dsi_framer.hpp"
+#include "dsi_serial_tap.hpp"
+#include "dsi_latency_trace.hpp"
+#include "dsi_stats.hpp"
 #include "dsi_thread.h"
 
 
@@ -99,15 +102,30 @@ class DSIFramerANT : public DSIFramer
       DSI_CONDITION_VAR stCondResponseReady;
 
       ANTMessageResponse *pclResponseListStart;
+      DSISerialTap *pclTap;
+      DSILatencyTrace *pclTrace;
+      ULLONG ullReadTime;                                   // When the bytes being parsed were read, if tracing (us)
+
+      char acStatsLabels[DSI_STATS_MAX_LABELS];             // Labels of this framer's stats; empty if not registered
+      DSI_STAT *pstStatMessages;
+      DSI_STAT *apstStatChannelMessages[CHANNEL_NUMBER_MASK + 1];   // Registered as each channel is first heard
+      ULONG ulStatChannelsTried;                            // One bit per channel that has tried to register
+      DSI_STAT *pstStatQueueDepth;
+      DSI_STAT *pstStatQueueOverflows;
+      DSI_STAT *pstStatCrcErrors;
+      DSI_STAT *pstStatSerialErrors;
+
+      void CountQueued(ANT_MESSAGE *pstMessage_);
 
       USHORT GetMessageSize(void);
       void ProcessMessage(void);
+      void ParseByte(UCHAR ucByte_);
       void CheckResponseList(void);
       BOOL SendCommand(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize_, ULONG ulResponseTime_ = 0);
       BOOL SendFSCommand(FS_MESSAGE *pstFSMessage_, USHORT usMessageSize_, UCHAR* pucFSResponse, ULONG ulResponseTime_ = 0);
       ANTFRAMER_RETURN SetupAckDataTransfer(UCHAR ucMessageID_, UCHAR ucANTChannel_, UCHAR *pucData_, UCHAR ucMaxDataSize_, ULONG ulResponseTime_  = 0);
       ANTFRAMER_RETURN SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR ucANTChannel_, UCHAR * pucData_, ULONG ulSize_,UCHAR ucMaxDataSize_, ULONG ulResponseTime_ = 0);
-      virtual BOOL CreateAntMsg_wOptExtBuf(ANT_MESSAGE **ppstExtBufAntMsg_, ULONG ulReqMinDataSize_);  ///Default implementation allocates a new standard ANT_MESSAGE struct which must be free() after use. Subclassed framers use this to allocate additional (overflow) buffer space.
+      virtual BOOL CreateAntMsg_wOptExtBuf(ANT_MESSAGE **ppstExtBufAntMsg_, ULONG ulReqMinDataSize_);  ///Called when a message is too big for a standard ANT_MESSAGE. Default implementation allocates a new standard ANT_MESSAGE struct which must be delete[] after use. Subclassed framers use this to allocate additional (overflow) buffer space.
 
    public:
 
@@ -127,8 +145,35 @@ class DSIFramerANT : public DSIFramer
       // undefined.
       /////////////////////////////////////////////////////////////////
 
+      void SetTap(DSISerialTap *pclTap_);
+      /////////////////////////////////////////////////////////////////
+      // Records every received byte in a raw serial capture.  Set to
+      // NULL to stop recording.  The serial port must be closed
+      // before the tap is.
+      /////////////////////////////////////////////////////////////////
+
+      void SetTrace(DSILatencyTrace *pclTrace_);
+      /////////////////////////////////////////////////////////////////
+      // Times received messages through the framer and into the
+      // application.  The trace must be initialized.  Set to NULL to
+      // stop tracing; the serial port must be closed before the
+      // trace is deleted.
+      /////////////////////////////////////////////////////////////////
+
+      void SetStats(const char *pcLabels_);
+      /////////////////////////////////////////////////////////////////
+      // Registers the framer's counters (messages per channel, queue
+      // depth and overflows, CRC and serial errors) with DSIStats,
+      // which must be initialized.
+      // Parameters:
+      //    *pcLabels_:       Labels that tell this framer apart from
+      //                      others in the process, eg. port="0".
+      // Call before the serial port is opened.
+      /////////////////////////////////////////////////////////////////
+
       // Inherited methods.
       void ProcessByte(UCHAR ucByte_);
+      void ProcessBytes(UCHAR *pucData_, ULONG ulSize_);
       void Error(UCHAR ucError_);
 
       BOOL WriteMessage(void *pstANTMessage_, USHORT usMessageSize_);
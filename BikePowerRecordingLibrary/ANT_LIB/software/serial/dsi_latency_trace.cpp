@@ -0,0 +1,253 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#include "defines.h"
+#include "dsi_latency_trace.hpp"
+#include "dsi_thread.h"
+#include "dsi_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define SUB_BUCKETS              ((ULONG) 1 << DSI_LATENCY_SUB_BUCKET_BITS)
+#define MAX_LATENCY              (((ULONG) 1 << DSI_LATENCY_MAX_BITS) - 1)
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+DSILatencyTrace::DSILatencyTrace()
+{
+   paullReadTime = (ULLONG*)NULL;
+   paullFramedTime = (ULLONG*)NULL;
+   paucChannel = (UCHAR*)NULL;
+   pastHistograms = (DSI_LATENCY_HISTOGRAM (*)[DSI_LATENCY_CHANNELS + 1])NULL;
+   ullPendingReadTime = 0;
+   ullPendingDequeuedTime = 0;
+   ucPendingChannel = MAX_UCHAR;
+}
+
+///////////////////////////////////////////////////////////////////////
+DSILatencyTrace::~DSILatencyTrace()
+{
+   DSI_FREE(paullReadTime);
+   DSI_FREE(paullFramedTime);
+   DSI_FREE(paucChannel);
+   DSI_FREE(pastHistograms);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSILatencyTrace::Init()
+{
+   if (pastHistograms == NULL)
+   {
+      paullReadTime = (ULLONG*)DSI_MALLOC(DSI_LATENCY_QUEUE_SIZE * sizeof(ULLONG));
+      paullFramedTime = (ULLONG*)DSI_MALLOC(DSI_LATENCY_QUEUE_SIZE * sizeof(ULLONG));
+      paucChannel = (UCHAR*)DSI_MALLOC(DSI_LATENCY_QUEUE_SIZE);
+      pastHistograms = (DSI_LATENCY_HISTOGRAM (*)[DSI_LATENCY_CHANNELS + 1])DSI_MALLOC(DSI_LATENCY_STAGES * sizeof(*pastHistograms));
+
+      if (paullReadTime == NULL || paullFramedTime == NULL || paucChannel == NULL || pastHistograms == NULL)
+      {
+         DSI_FREE(paullReadTime);
+         DSI_FREE(paullFramedTime);
+         DSI_FREE(paucChannel);
+         DSI_FREE(pastHistograms);
+         paullReadTime = (ULLONG*)NULL;
+         paullFramedTime = (ULLONG*)NULL;
+         paucChannel = (UCHAR*)NULL;
+         pastHistograms = (DSI_LATENCY_HISTOGRAM (*)[DSI_LATENCY_CHANNELS + 1])NULL;
+         return FALSE;
+      }
+   }
+
+   Reset();
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSILatencyTrace::Reset()
+{
+   if (pastHistograms == NULL)
+      return;
+
+   memset(pastHistograms, 0, DSI_LATENCY_STAGES * sizeof(*pastHistograms));
+   for (UCHAR i = 0; i < DSI_LATENCY_STAGES; i++)
+   {
+      for (UCHAR j = 0; j <= DSI_LATENCY_CHANNELS; j++)
+         pastHistograms[i][j].ulMin = MAX_ULONG;
+   }
+
+   ullPendingReadTime = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSILatencyTrace::MessageFramed(USHORT usSlot_, UCHAR ucChannel_, ULLONG ullReadTime_)
+{
+   if (pastHistograms == NULL)
+      return;
+
+   ULLONG ullNow = DSIThread_GetSystemTimeMicroseconds();
+
+   paullReadTime[usSlot_] = ullReadTime_;
+   paullFramedTime[usSlot_] = ullNow;
+   paucChannel[usSlot_] = ucChannel_;
+
+   Add(DSI_LATENCY_READ_TO_FRAMED, ucChannel_, ullNow - ullReadTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSILatencyTrace::MessageDequeued(USHORT usSlot_)
+{
+   if (pastHistograms == NULL)
+      return;
+
+   ULLONG ullNow = DSIThread_GetSystemTimeMicroseconds();
+   UCHAR ucChannel = paucChannel[usSlot_];
+
+   Add(DSI_LATENCY_FRAMED_TO_DEQUEUED, ucChannel, ullNow - paullFramedTime[usSlot_]);
+   Add(DSI_LATENCY_READ_TO_DEQUEUED, ucChannel, ullNow - paullReadTime[usSlot_]);
+
+   ullPendingReadTime = paullReadTime[usSlot_];
+   ullPendingDequeuedTime = ullNow;
+   ucPendingChannel = ucChannel;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSILatencyTrace::RecordEmitted()
+{
+   if (pastHistograms == NULL || ullPendingReadTime == 0)
+      return;
+
+   ULLONG ullNow = DSIThread_GetSystemTimeMicroseconds();
+
+   Add(DSI_LATENCY_DEQUEUED_TO_EMITTED, ucPendingChannel, ullNow - ullPendingDequeuedTime);
+   Add(DSI_LATENCY_READ_TO_EMITTED, ucPendingChannel, ullNow - ullPendingReadTime);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSILatencyTrace::GetPercentiles(UCHAR ucStage_, UCHAR ucChannel_, DSI_LATENCY_PERCENTILES *pstPercentiles_)
+{
+   DSI_LATENCY_HISTOGRAM stSnapshot;
+
+   if (pastHistograms == NULL || ucStage_ >= DSI_LATENCY_STAGES || (ucChannel_ >= DSI_LATENCY_CHANNELS && ucChannel_ != DSI_LATENCY_ALL_CHANNELS))
+      return FALSE;
+
+   // Work from a copy so the percentiles agree with each other.
+   memcpy(&stSnapshot, &pastHistograms[ucStage_][ucChannel_ == DSI_LATENCY_ALL_CHANNELS ? DSI_LATENCY_CHANNELS : ucChannel_], sizeof(stSnapshot));
+
+   // The count is bumped after the bucket, so recount from the buckets.
+   stSnapshot.ulCount = 0;
+   for (ULONG i = 0; i < DSI_LATENCY_BUCKETS; i++)
+      stSnapshot.ulCount += stSnapshot.aulCounts[i];
+
+   memset(pstPercentiles_, 0, sizeof(DSI_LATENCY_PERCENTILES));
+   if (stSnapshot.ulCount == 0)
+      return TRUE;
+
+   pstPercentiles_->ulCount = stSnapshot.ulCount;
+   pstPercentiles_->ulMin = stSnapshot.ulMin;
+   pstPercentiles_->ulMax = stSnapshot.ulMax;
+   pstPercentiles_->ulMean = (ULONG)(stSnapshot.ullSum / stSnapshot.ulCount);
+   pstPercentiles_->ulP50 = GetPercentile(&stSnapshot, 50.0);
+   pstPercentiles_->ulP90 = GetPercentile(&stSnapshot, 90.0);
+   pstPercentiles_->ulP99 = GetPercentile(&stSnapshot, 99.0);
+   pstPercentiles_->ulP999 = GetPercentile(&stSnapshot, 99.9);
+
+   return TRUE;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Adds a sample to its channel and to the all channels histogram.
+///////////////////////////////////////////////////////////////////////
+void DSILatencyTrace::Add(UCHAR ucStage_, UCHAR ucChannel_, ULLONG ullLatency_)
+{
+   // Clocks are monotonic, but stamps taken on different cores can be
+   // a hair out of order.
+   ULONG ulLatency = (ULONG)MIN(ullLatency_, (ULLONG)MAX_LATENCY);
+   if ((SLLONG)ullLatency_ < 0)
+      ulLatency = 0;
+
+   if (ucChannel_ < DSI_LATENCY_CHANNELS)
+      AddTo(&pastHistograms[ucStage_][ucChannel_], ulLatency);
+
+   AddTo(&pastHistograms[ucStage_][DSI_LATENCY_CHANNELS], ulLatency);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSILatencyTrace::AddTo(DSI_LATENCY_HISTOGRAM *pstHistogram_, ULONG ulLatency_)
+{
+   pstHistogram_->aulCounts[GetBucket(ulLatency_)]++;
+   pstHistogram_->ullSum += ulLatency_;
+
+   if (ulLatency_ < pstHistogram_->ulMin)
+      pstHistogram_->ulMin = ulLatency_;
+   if (ulLatency_ > pstHistogram_->ulMax)
+      pstHistogram_->ulMax = ulLatency_;
+
+   pstHistogram_->ulCount++;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Values below 2 * SUB_BUCKETS have a bucket each.  Above that, each
+// power of two is split into SUB_BUCKETS buckets.
+///////////////////////////////////////////////////////////////////////
+ULONG DSILatencyTrace::GetBucket(ULONG ulLatency_)
+{
+   ULONG ulShift = 0;
+
+   while ((ulLatency_ >> ulShift) >= 2 * SUB_BUCKETS)
+      ulShift++;
+
+   return (ulShift * SUB_BUCKETS) + (ulLatency_ >> ulShift);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Returns the highest value that falls in a bucket.
+///////////////////////////////////////////////////////////////////////
+ULONG DSILatencyTrace::GetBucketValue(ULONG ulBucket_)
+{
+   if (ulBucket_ < 2 * SUB_BUCKETS)
+      return ulBucket_;
+
+   ULONG ulShift = (ulBucket_ / SUB_BUCKETS) - 1;
+   ULONG ulSubBucket = (ulBucket_ % SUB_BUCKETS) + SUB_BUCKETS;
+
+   return ((ulSubBucket + 1) << ulShift) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSILatencyTrace::GetPercentile(const DSI_LATENCY_HISTOGRAM *pstHistogram_, double dPercentile_)
+{
+   ULONG ulTarget = (ULONG)((dPercentile_ / 100.0) * pstHistogram_->ulCount + 0.5);
+   ULONG ulSeen = 0;
+
+   if (ulTarget == 0)
+      ulTarget = 1;
+
+   for (ULONG i = 0; i < DSI_LATENCY_BUCKETS; i++)
+   {
+      ulSeen += pstHistogram_->aulCounts[i];
+      if (ulSeen >= ulTarget)
+         return MIN(GetBucketValue(i), pstHistogram_->ulMax);
+   }
+
+   return pstHistogram_->ulMax;
+}
@@ -0,0 +1,147 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_LATENCY_TRACE_HPP)
+#define DSI_LATENCY_TRACE_HPP
+
+#include "types.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+// Stages measured for each received message.  "Read" is when the chunk
+// that completed the message was handed to the framer by the serial
+// receive thread, "framed" when the message was queued, "dequeued" when
+// GetMessage() returned it and "emitted" when the application reported a
+// record built from it with RecordEmitted().
+#define DSI_LATENCY_READ_TO_FRAMED        ((UCHAR) 0)
+#define DSI_LATENCY_FRAMED_TO_DEQUEUED    ((UCHAR) 1)
+#define DSI_LATENCY_DEQUEUED_TO_EMITTED   ((UCHAR) 2)
+#define DSI_LATENCY_READ_TO_DEQUEUED      ((UCHAR) 3)
+#define DSI_LATENCY_READ_TO_EMITTED       ((UCHAR) 4)
+#define DSI_LATENCY_STAGES                ((UCHAR) 5)
+
+#define DSI_LATENCY_CHANNELS              ((UCHAR) 32)      // CHANNEL_NUMBER_MASK + 1
+#define DSI_LATENCY_ALL_CHANNELS          ((UCHAR) 0xFF)    // Every message, including those that aren't about a channel
+
+// Log-linear buckets, as in an HDR histogram: 16 sub-buckets for each
+// power of two, so a value is known to within 1/16 (about 6%), from 1 us
+// up to about 18 minutes.
+#define DSI_LATENCY_SUB_BUCKET_BITS       4
+#define DSI_LATENCY_MAX_BITS              30
+#define DSI_LATENCY_BUCKETS               ((DSI_LATENCY_MAX_BITS - DSI_LATENCY_SUB_BUCKET_BITS + 1) << DSI_LATENCY_SUB_BUCKET_BITS)
+
+#define DSI_LATENCY_QUEUE_SIZE            ((ULONG) 65536)   // Matches the framer's message queue
+
+typedef struct
+{
+   ULONG ulCount;
+   ULONG ulMin;                                             // All in us
+   ULONG ulMax;
+   ULONG ulMean;
+   ULONG ulP50;
+   ULONG ulP90;
+   ULONG ulP99;
+   ULONG ulP999;
+} DSI_LATENCY_PERCENTILES;
+
+typedef struct
+{
+   ULONG aulCounts[DSI_LATENCY_BUCKETS];
+   ULONG ulCount;
+   ULONG ulMin;
+   ULONG ulMax;
+   ULLONG ullSum;
+} DSI_LATENCY_HISTOGRAM;
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// Times each received message through the stages between the serial read
+// and the record handed to the application, and keeps a latency histogram
+// per stage and per channel.  Attach it to a framer with
+// DSIFramerANT::SetTrace().
+//
+// Each histogram is only written by one thread: the serial receive thread
+// for READ_TO_FRAMED, the thread calling GetMessage() for the others, so
+// nothing is locked.  A snapshot taken while messages are arriving may miss
+// the samples in flight.
+class DSILatencyTrace
+{
+   private:
+
+      ULLONG *paullReadTime;                                // Per framer queue slot
+      ULLONG *paullFramedTime;
+      UCHAR *paucChannel;
+
+      ULLONG ullPendingReadTime;                            // The message last returned by GetMessage()
+      ULLONG ullPendingDequeuedTime;
+      UCHAR ucPendingChannel;
+
+      DSI_LATENCY_HISTOGRAM (*pastHistograms)[DSI_LATENCY_CHANNELS + 1];   // [stage][channel], the last channel is all of them
+
+      void Add(UCHAR ucStage_, UCHAR ucChannel_, ULLONG ullLatency_);
+      static void AddTo(DSI_LATENCY_HISTOGRAM *pstHistogram_, ULONG ulLatency_);
+      static ULONG GetBucket(ULONG ulLatency_);
+      static ULONG GetBucketValue(ULONG ulBucket_);
+      static ULONG GetPercentile(const DSI_LATENCY_HISTOGRAM *pstHistogram_, double dPercentile_);
+
+   public:
+      DSILatencyTrace();
+      ~DSILatencyTrace();
+
+      BOOL Init();
+      /////////////////////////////////////////////////////////////////
+      // Allocates the histograms and the per message timestamps.
+      // Returns TRUE if successful.
+      /////////////////////////////////////////////////////////////////
+
+      void Reset();
+      /////////////////////////////////////////////////////////////////
+      // Clears the histograms.
+      /////////////////////////////////////////////////////////////////
+
+      void MessageFramed(USHORT usSlot_, UCHAR ucChannel_, ULLONG ullReadTime_);
+      /////////////////////////////////////////////////////////////////
+      // Called by the framer as it queues a message.
+      // Parameters:
+      //    usSlot_:          The message's slot in the framer queue.
+      //    ucChannel_:       Its channel, or MAX_UCHAR if it has none.
+      //    ullReadTime_:     When the bytes that completed it were
+      //                      read (us).
+      /////////////////////////////////////////////////////////////////
+
+      void MessageDequeued(USHORT usSlot_);
+      /////////////////////////////////////////////////////////////////
+      // Called by the framer as GetMessage() returns a message.
+      /////////////////////////////////////////////////////////////////
+
+      void RecordEmitted();
+      /////////////////////////////////////////////////////////////////
+      // Called by the application from its record callback (eg. the
+      // PowerRecordReceiver), on the thread that called GetMessage(),
+      // to time the message it is handling through to the record.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL GetPercentiles(UCHAR ucStage_, UCHAR ucChannel_, DSI_LATENCY_PERCENTILES *pstPercentiles_);
+      /////////////////////////////////////////////////////////////////
+      // Takes a snapshot of one histogram.
+      // Parameters:
+      //    ucStage_:         A DSI_LATENCY_ stage.
+      //    ucChannel_:       A channel, or DSI_LATENCY_ALL_CHANNELS.
+      //    *pstPercentiles_: Receives the count, min, max, mean and
+      //                      percentiles, in us.
+      // Returns FALSE if the stage or channel is invalid.
+      /////////////////////////////////////////////////////////////////
+};
+
+#endif // !defined(DSI_LATENCY_TRACE_HPP)
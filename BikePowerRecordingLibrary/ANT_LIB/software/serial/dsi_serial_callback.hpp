@@ -28,6 +28,21 @@ class DSISerialCallback
       //    ucByte_:          The byte to process.
       /////////////////////////////////////////////////////////////////
 
+      virtual void ProcessBytes(UCHAR *pucData_, ULONG ulSize_)
+      {
+         for (ULONG i = 0; i < ulSize_; i++)
+            ProcessByte(pucData_[i]);
+      }
+      /////////////////////////////////////////////////////////////////
+      // Processes a block of received bytes.  Serial classes that
+      // read in chunks should call this rather than ProcessByte so
+      // that callbacks can handle the whole chunk at once.
+      // Parameters:
+      //    *pucData_:        A pointer to the received bytes.  The
+      //                      buffer is only valid during the call.
+      //    ulSize_:          The number of bytes in *pucData_.
+      /////////////////////////////////////////////////////////////////
+
       virtual void Error(UCHAR ucError_) = 0;
       /////////////////////////////////////////////////////////////////
       // Signals an error.
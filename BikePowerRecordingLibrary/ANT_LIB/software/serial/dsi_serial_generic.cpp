@@ -13,6 +13,8 @@ All rights reserved.
 #include "types.h"
 #include "defines.h"
 #include "macros.h"
+#include "dsi_probe.h"
+#include "dsi_alloc_audit.hpp"
 
 #include "usb_device_handle.hpp"
 
@@ -77,6 +79,8 @@ DSISerialGeneric::~DSISerialGeneric()
 
 BOOL DSISerialGeneric::AutoInit()
 {
+   DSI_ALLOC_SCOPE(DSI_ALLOC_USB);
+
    Close();
    if (pclDevice)
       delete pclDevice;
@@ -177,6 +181,7 @@ ULONG DSISerialGeneric::GetDeviceSerialNumber()
 ///////////////////////////////////////////////////////////////////////
 BOOL DSISerialGeneric::GetDeviceUSBInfo(UCHAR ucDevice_, UCHAR* pucProductString_, UCHAR* pucSerialString_, USHORT usBufferSize_)
 {
+   DSI_ALLOC_SCOPE(DSI_ALLOC_USB);
 
    const ANTDeviceList clDeviceList = USBDeviceHandle::GetAllDevices();
    if(clDeviceList.GetSize() <= ucDevice_)
@@ -235,6 +240,8 @@ BOOL DSISerialGeneric::GetDeviceSerialString(UCHAR* pucSerialString_, USHORT usB
 ///////////////////////////////////////////////////////////////////////
 BOOL DSISerialGeneric::Open(void)
 {
+   DSI_ALLOC_SCOPE(DSI_ALLOC_USB);
+
    // Make sure all handles are reset before opening again.
    Close();
 
@@ -372,8 +379,8 @@ void DSISerialGeneric::ReceiveThread(void)
       switch(eStatus)
       {
          case USBError::NONE:
-            for(ULONG i=0; i<ulRxBytesRead; i++)
-               pclCallback->ProcessByte(aucData[i]);
+            DSI_PROBE2(serial_read, ucDeviceNumber, ulRxBytesRead);
+            pclCallback->ProcessBytes(aucData, ulRxBytesRead);
             break;
 
          case USBError::DEVICE_GONE:
@@ -401,6 +408,8 @@ void DSISerialGeneric::ReceiveThread(void)
 DSI_THREAD_RETURN DSISerialGeneric::ProcessThread(void* pvParameter_)
 {
    DSISerialGeneric* This = (DSISerialGeneric*)pvParameter_;
+   DSIThread_SetThreadName("ant-serial-rx");
+   DSI_ALLOC_THREAD("ant-serial-rx", DSI_ALLOC_SERIAL);
    This->ReceiveThread();
    return 0;
 }
@@ -411,6 +420,8 @@ DSI_THREAD_RETURN DSISerialGeneric::ProcessThread(void* pvParameter_)
 // However, because the behavior is not fully understood and we aren't receiving complaints (beyond the cpu usage of this reset) we are leaving things 'as-is'
 void DSISerialGeneric::USBReset(void)
 {
+   DSI_ALLOC_SCOPE(DSI_ALLOC_USB);
+
    //If the user specified a device number instead of a USBDevice instance, then grab it from the list
    const USBDevice* pclTempDevice = pclDevice;
    if(pclDevice == NULL)
@@ -13,6 +13,7 @@ All rights reserved.
 #include "dsi_serial_libusb.hpp"
 #include "defines.h"
 #include "macros.h"
+#include "dsi_alloc_audit.hpp"
 
 #include "usb_device_handle_libusb.hpp"
 
@@ -315,17 +316,18 @@ UCHAR DSISerialLibusb::GetDeviceNumber()
 void DSISerialLibusb::ReceiveThread()
 {
 
+   UCHAR aucRxData[255];
+
    while(!bStopReceiveThread)
    {
 
-      UCHAR ucRxByte;
       ULONG ulRxBytesRead;
-      USBError::Enum eStatus = pclDeviceHandle->Read(&ucRxByte, 1, ulRxBytesRead, 1000);
+      USBError::Enum eStatus = pclDeviceHandle->Read(aucRxData, sizeof(aucRxData), ulRxBytesRead, 1000);
 
       switch(eStatus)
       {
          case USBError::NONE:
-            pclCallback->ProcessByte(ucRxByte);
+            pclCallback->ProcessBytes(aucRxData, ulRxBytesRead);   // Nothing if the read timed out
             break;
 
          case USBError::DEVICE_GONE:
@@ -353,6 +355,7 @@ void DSISerialLibusb::ReceiveThread()
 DSI_THREAD_RETURN DSISerialLibusb::ProcessThread(void *pvParameter_)
 {
    DSISerialLibusb *This = (DSISerialLibusb *) pvParameter_;
+   DSI_ALLOC_THREAD("ant-libusb-rx", DSI_ALLOC_SERIAL);
    This->ReceiveThread();
    return 0;
 }
@@ -0,0 +1,256 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#include "defines.h"
+#include "dsi_serial_loopback.hpp"
+#include "dsi_alloc_audit.hpp"
+
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////
+DSISerialLoopback::DSISerialLoopback()
+{
+   hReceiveThread = (DSI_THREAD_ID)NULL;
+   bStopReceiveThread = TRUE;
+   ulHead = 0;
+   ulTail = 0;
+   pclDevice = (DSISerialLoopbackDevice*)NULL;
+   ucDeviceNumber = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Destructor
+///////////////////////////////////////////////////////////////////////
+DSISerialLoopback::~DSISerialLoopback()
+{
+   Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialLoopback::AutoInit()
+{
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialLoopback::Init(ULONG /*ulBaud_*/, UCHAR ucDeviceNumber_)
+{
+   ucDeviceNumber = ucDeviceNumber_;
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialLoopback::SetDevice(DSISerialLoopbackDevice *pclDevice_)
+{
+   pclDevice = pclDevice_;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Starts the receive thread.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialLoopback::Open(void)
+{
+   // Make sure all handles are reset before opening again.
+   Close();
+
+   if (pclCallback == NULL)
+      return FALSE;
+
+   if (DSIThread_MutexInit(&stMutexCriticalSection) != DSI_THREAD_ENONE)
+      return FALSE;
+
+   if (DSIThread_CondInit(&stCondDataReady) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stCondSpaceReady) != DSI_THREAD_ENONE)
+   {
+      DSIThread_CondDestroy(&stCondDataReady);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stEventReceiveThreadExit) != DSI_THREAD_ENONE)
+   {
+      DSIThread_CondDestroy(&stCondSpaceReady);
+      DSIThread_CondDestroy(&stCondDataReady);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   ulHead = 0;
+   ulTail = 0;
+   bStopReceiveThread = FALSE;
+
+   hReceiveThread = DSIThread_CreateThread(&DSISerialLoopback::ProcessThread, this);
+   if (hReceiveThread == NULL)
+   {
+      bStopReceiveThread = TRUE;
+      DSIThread_CondDestroy(&stEventReceiveThreadExit);
+      DSIThread_CondDestroy(&stCondSpaceReady);
+      DSIThread_CondDestroy(&stCondDataReady);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Kills the receive thread.  Queued bytes are discarded.
+///////////////////////////////////////////////////////////////////////
+void DSISerialLoopback::Close(BOOL /*bReset*/)
+{
+   if (hReceiveThread)
+   {
+      DSIThread_MutexLock(&stMutexCriticalSection);
+      if (bStopReceiveThread == FALSE)
+      {
+         bStopReceiveThread = TRUE;
+         DSIThread_CondBroadcast(&stCondDataReady);
+         DSIThread_CondBroadcast(&stCondSpaceReady);
+
+         if (DSIThread_CondTimedWait(&stEventReceiveThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+         {
+            // We were unable to stop the thread normally.
+            DSIThread_DestroyThread(hReceiveThread);
+         }
+      }
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+      DSIThread_ReleaseThreadID(hReceiveThread);
+      hReceiveThread = (DSI_THREAD_ID)NULL;
+
+      DSIThread_CondDestroy(&stEventReceiveThreadExit);
+      DSIThread_CondDestroy(&stCondSpaceReady);
+      DSIThread_CondDestroy(&stCondDataReady);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Passes the bytes straight to the device.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialLoopback::WriteBytes(void *pvData_, USHORT usSize_)
+{
+   if (hReceiveThread == NULL || pvData_ == NULL)
+      return FALSE;
+
+   if (pclDevice)
+      pclDevice->HostBytes((UCHAR*)pvData_, usSize_);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialLoopback::DeviceWrite(UCHAR *pucData_, ULONG ulSize_)
+{
+   if (hReceiveThread == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   while (ulSize_ && !bStopReceiveThread)
+   {
+      ULONG ulFree = DSI_SERIAL_LOOPBACK_FIFO_SIZE - (ulHead - ulTail);
+      ULONG ulOffset = ulHead & (DSI_SERIAL_LOOPBACK_FIFO_SIZE - 1);
+      ULONG ulCopy;
+
+      if (ulFree == 0)
+      {
+         DSIThread_CondTimedWait(&stCondSpaceReady, &stMutexCriticalSection, 1000);
+         continue;
+      }
+
+      ulCopy = MIN(ulSize_, ulFree);
+      ulCopy = MIN(ulCopy, DSI_SERIAL_LOOPBACK_FIFO_SIZE - ulOffset);
+
+      memcpy(&aucFifo[ulOffset], pucData_, ulCopy);
+      ulHead += ulCopy;
+      pucData_ += ulCopy;
+      ulSize_ -= ulCopy;
+
+      DSIThread_CondSignal(&stCondDataReady);
+   }
+
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return (ulSize_ == 0);
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialLoopback::GetDeviceSerialNumber()
+{
+   return 0xFFFFFFFF; // unsupported
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSISerialLoopback::GetDeviceNumber()
+{
+   return ucDeviceNumber;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// The callback reads straight out of the FIFO.  The space is only
+// released once it returns, so the device can't overwrite it.
+///////////////////////////////////////////////////////////////////////
+void DSISerialLoopback::ReceiveThread(void)
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   while (!bStopReceiveThread)
+   {
+      ULONG ulOffset;
+      ULONG ulSize;
+
+      if (ulHead == ulTail)
+      {
+         DSIThread_CondTimedWait(&stCondDataReady, &stMutexCriticalSection, 1000);
+         continue;
+      }
+
+      ulOffset = ulTail & (DSI_SERIAL_LOOPBACK_FIFO_SIZE - 1);
+      ulSize = MIN(ulHead - ulTail, DSI_SERIAL_LOOPBACK_FIFO_SIZE - ulOffset);
+      ulSize = MIN(ulSize, DSI_SERIAL_LOOPBACK_CHUNK_SIZE);
+
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+      pclCallback->ProcessBytes(&aucFifo[ulOffset], ulSize);
+      DSIThread_MutexLock(&stMutexCriticalSection);
+
+      ulTail += ulSize;
+      DSIThread_CondSignal(&stCondSpaceReady);
+   }
+
+   bStopReceiveThread = TRUE;
+   DSIThread_CondSignal(&stEventReceiveThreadExit);        // Set an event to alert the main process that Rx thread is finished and can be closed.
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_RETURN DSISerialLoopback::ProcessThread(void *pvParameter_)
+{
+   DSISerialLoopback *This = (DSISerialLoopback *) pvParameter_;
+   DSIThread_SetThreadName("ant-loopback-rx");
+   DSI_ALLOC_THREAD("ant-loopback-rx", DSI_ALLOC_SERIAL);
+   This->ReceiveThread();
+   return 0;
+}
@@ -0,0 +1,95 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_SERIAL_LOOPBACK_HPP)
+#define DSI_SERIAL_LOOPBACK_HPP
+
+#include "types.h"
+#include "dsi_thread.h"
+#include "dsi_serial.hpp"
+#include "dsi_serial_callback.hpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define DSI_SERIAL_LOOPBACK_FIFO_SIZE     ((ULONG) 65536)  // Must be a power of two
+#define DSI_SERIAL_LOOPBACK_CHUNK_SIZE    ((ULONG) 255)    // Largest block passed to the callback, as for a USB read
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// The far end of a loopback port, usually a simulated stick.
+class DSISerialLoopbackDevice
+{
+   public:
+      virtual ~DSISerialLoopbackDevice(){}
+
+      virtual void HostBytes(UCHAR *pucData_, ULONG ulSize_) = 0;
+      /////////////////////////////////////////////////////////////////
+      // Receives the bytes written by the host.  Called on the
+      // writing thread.
+      /////////////////////////////////////////////////////////////////
+};
+
+// An in-memory serial port.  Bytes from the device are queued in a FIFO
+// and delivered to the callback in chunks by a receive thread, so the
+// framer sees the same threading as with a real stick.
+class DSISerialLoopback : public DSISerial
+{
+   private:
+
+      DSI_THREAD_ID hReceiveThread;                         // Handle for the receive thread.
+      DSI_MUTEX stMutexCriticalSection;                     // Protects the FIFO.
+      DSI_CONDITION_VAR stCondDataReady;                    // Signalled when the device queues bytes.
+      DSI_CONDITION_VAR stCondSpaceReady;                   // Signalled when the receive thread frees space.
+      DSI_CONDITION_VAR stEventReceiveThreadExit;           // Event to signal the receive thread has ended.
+      BOOL bStopReceiveThread;                              // Flag to stop the receive thread.
+
+      UCHAR aucFifo[DSI_SERIAL_LOOPBACK_FIFO_SIZE];
+      ULONG ulHead;                                         // Free running write index
+      ULONG ulTail;                                         // Free running read index
+
+      DSISerialLoopbackDevice *pclDevice;
+      UCHAR ucDeviceNumber;
+
+      // Private Member Functions
+      void ReceiveThread();
+      static DSI_THREAD_RETURN ProcessThread(void *pvParameter_);
+
+   public:
+      DSISerialLoopback();
+      ~DSISerialLoopback();
+
+      void SetDevice(DSISerialLoopbackDevice *pclDevice_);
+      /////////////////////////////////////////////////////////////////
+      // Attaches the far end of the port.  Bytes written by the host
+      // are passed to it.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL DeviceWrite(UCHAR *pucData_, ULONG ulSize_);
+      /////////////////////////////////////////////////////////////////
+      // Queues bytes for the host.  Blocks while the FIFO is full.
+      // Returns FALSE if the port is not open.
+      /////////////////////////////////////////////////////////////////
+
+      // Methods inherited from the base class:
+      BOOL AutoInit();
+      ULONG GetDeviceSerialNumber();
+
+      BOOL Init(ULONG ulBaud_, UCHAR ucDeviceNumber_);
+      BOOL Open();
+      void Close(BOOL bReset = FALSE);
+      BOOL WriteBytes(void *pvData_, USHORT usSize_);
+      UCHAR GetDeviceNumber();
+};
+
+#endif // !defined(DSI_SERIAL_LOOPBACK_HPP)
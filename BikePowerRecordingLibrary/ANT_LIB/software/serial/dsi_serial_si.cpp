@@ -11,6 +11,7 @@ All rights reserved.
 #include "defines.h"
 #include "dsi_serial_si.hpp"
 #include "macros.h"
+#include "dsi_alloc_audit.hpp"
 
 #include "usb_device_handle_si.hpp"
 
@@ -314,18 +315,18 @@ UCHAR DSISerialSI::GetDeviceNumber()
 ///////////////////////////////////////////////////////////////////////
 void DSISerialSI::ReceiveThread(void)
 {
-   UCHAR ucRxByte;
+   UCHAR aucRxData[255];
    ULONG ulRxBytesRead;
 
    while(!bStopReceiveThread)
    {
 
-      USBError::Enum eStatus = pclDeviceHandle->Read(&ucRxByte, 1, ulRxBytesRead, 1000);
+      USBError::Enum eStatus = pclDeviceHandle->Read(aucRxData, sizeof(aucRxData), ulRxBytesRead, 1000);
 
       switch(eStatus)
       {
          case USBError::NONE:
-            pclCallback->ProcessByte(ucRxByte);
+            pclCallback->ProcessBytes(aucRxData, ulRxBytesRead);
             break;
 
          case USBError::DEVICE_GONE:
@@ -353,6 +354,7 @@ void DSISerialSI::ReceiveThread(void)
 DSI_THREAD_RETURN DSISerialSI::ProcessThread(void *pvParameter_)
 {
    DSISerialSI *This = (DSISerialSI *) pvParameter_;
+   DSI_ALLOC_THREAD("ant-si-rx", DSI_ALLOC_SERIAL);
    This->ReceiveThread();
    return 0;
 }
@@ -0,0 +1,415 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#include "defines.h"
+#include "dsi_serial_tap.hpp"
+#include "macros.h"
+#include "dsi_alloc_audit.hpp"
+#include "dsi_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////
+DSISerialTap::DSISerialTap()
+{
+   pucRing = (UCHAR*)NULL;
+   ulRingSize = 0;
+   ulHead = 0;
+   ulTail = 0;
+   ulTailSnapshot = 0;
+   ulLostBytes = 0;
+   ulTotalLostBytes = 0;
+   ullStartTime = 0;
+   pfFile = (FILE*)NULL;
+   hFlushThread = (DSI_THREAD_ID)NULL;
+   bStopFlushThread = TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Destructor
+///////////////////////////////////////////////////////////////////////
+DSISerialTap::~DSISerialTap()
+{
+   Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTap::Open(const char *pcFileName_, ULONG ulRingSize_)
+{
+   Close();
+
+   ulRingSize = 1024;
+   while (ulRingSize < ulRingSize_)
+      ulRingSize <<= 1;
+
+   pucRing = (UCHAR*)DSI_MALLOC(ulRingSize);
+   if (pucRing == NULL)
+      return FALSE;
+
+   pfFile = FOPEN(pcFileName_, "wb");
+   if (pfFile == NULL)
+   {
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+      return FALSE;
+   }
+
+   if (fwrite(DSI_SERIAL_TAP_MAGIC, 1, DSI_SERIAL_TAP_MAGIC_SIZE, pfFile) != DSI_SERIAL_TAP_MAGIC_SIZE)
+   {
+      fclose(pfFile);
+      pfFile = (FILE*)NULL;
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+      return FALSE;
+   }
+
+   if (DSIThread_MutexInit(&stMutexCriticalSection) != DSI_THREAD_ENONE)
+   {
+      fclose(pfFile);
+      pfFile = (FILE*)NULL;
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stCondFlush) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      fclose(pfFile);
+      pfFile = (FILE*)NULL;
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stEventFlushThreadExit) != DSI_THREAD_ENONE)
+   {
+      DSIThread_CondDestroy(&stCondFlush);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      fclose(pfFile);
+      pfFile = (FILE*)NULL;
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+      return FALSE;
+   }
+
+   ulHead = 0;
+   ulTail = 0;
+   ulTailSnapshot = 0;
+   ulLostBytes = 0;
+   ulTotalLostBytes = 0;
+   ullStartTime = DSIThread_GetSystemTimeMicroseconds();
+
+   bStopFlushThread = FALSE;
+   hFlushThread = DSIThread_CreateThread(&DSISerialTap::ProcessThread, this);
+   if (hFlushThread == NULL)
+   {
+      bStopFlushThread = TRUE;
+      DSIThread_CondDestroy(&stEventFlushThreadExit);
+      DSIThread_CondDestroy(&stCondFlush);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      fclose(pfFile);
+      pfFile = (FILE*)NULL;
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// The receiver must have stopped appending before the tap is closed.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTap::Close()
+{
+   if (hFlushThread)
+   {
+      DSIThread_MutexLock(&stMutexCriticalSection);
+      if (bStopFlushThread == FALSE)
+      {
+         bStopFlushThread = TRUE;
+         DSIThread_CondSignal(&stCondFlush);
+
+         if (DSIThread_CondTimedWait(&stEventFlushThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+         {
+            // We were unable to stop the thread normally.
+            DSIThread_DestroyThread(hFlushThread);
+         }
+      }
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+      DSIThread_ReleaseThreadID(hFlushThread);
+      hFlushThread = (DSI_THREAD_ID)NULL;
+
+      Flush();
+
+      DSIThread_CondDestroy(&stEventFlushThreadExit);
+      DSIThread_CondDestroy(&stCondFlush);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+   }
+
+   if (pfFile)
+   {
+      fclose(pfFile);
+      pfFile = (FILE*)NULL;
+   }
+
+   if (pucRing)
+   {
+      DSI_FREE(pucRing);
+      pucRing = (UCHAR*)NULL;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+// The chunk is copied into space the flush thread has already given
+// up, so the lock is only taken to publish the new head.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTap::Append(const UCHAR *pucData_, ULONG ulSize_)
+{
+   ULONG ulNeeded;
+   ULONG ulIndex;
+   ULLONG ullTime;
+
+   if (pucRing == NULL || ulSize_ == 0)
+      return;
+
+   ulNeeded = DSI_SERIAL_TAP_RECORD_HEADER_SIZE + ulSize_;
+   if (ulLostBytes)
+      ulNeeded += DSI_SERIAL_TAP_RECORD_HEADER_SIZE + DSI_SERIAL_TAP_LOST_SIZE;
+
+   if (ulSize_ > MAX_USHORT || ulNeeded > ulRingSize - (ulHead - ulTailSnapshot))
+   {
+      ulLostBytes += ulSize_;
+      ulTotalLostBytes += ulSize_;
+      return;
+   }
+
+   ullTime = GetTime();
+   ulIndex = ulHead;
+
+   if (ulLostBytes)
+   {
+      UCHAR aucLost[DSI_SERIAL_TAP_LOST_SIZE];
+
+      aucLost[0] = (UCHAR)(ulLostBytes & 0xFF);
+      aucLost[1] = (UCHAR)((ulLostBytes >> 8) & 0xFF);
+      aucLost[2] = (UCHAR)((ulLostBytes >> 16) & 0xFF);
+      aucLost[3] = (UCHAR)((ulLostBytes >> 24) & 0xFF);
+
+      PutHeader(ulIndex, ullTime, 0);
+      Put(ulIndex + DSI_SERIAL_TAP_RECORD_HEADER_SIZE, aucLost, DSI_SERIAL_TAP_LOST_SIZE);
+      ulIndex += DSI_SERIAL_TAP_RECORD_HEADER_SIZE + DSI_SERIAL_TAP_LOST_SIZE;
+      ulLostBytes = 0;
+   }
+
+   PutHeader(ulIndex, ullTime, (USHORT)ulSize_);
+   Put(ulIndex + DSI_SERIAL_TAP_RECORD_HEADER_SIZE, pucData_, ulSize_);
+   ulIndex += DSI_SERIAL_TAP_RECORD_HEADER_SIZE + ulSize_;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   ulHead = ulIndex;
+   ulTailSnapshot = ulTail;
+   if (ulHead - ulTail > ulRingSize / 2)
+      DSIThread_CondSignal(&stCondFlush);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialTap::GetLostBytes()
+{
+   return ulTotalLostBytes;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTap::Replay(const char *pcFileName_, DSISerialCallback *pclCallback_, BOOL bRealTime_)
+{
+   UCHAR aucHeader[DSI_SERIAL_TAP_RECORD_HEADER_SIZE];
+   UCHAR *pucChunk;
+   FILE *pfReplay;
+   BOOL bFirst = TRUE;
+   BOOL bSuccess = TRUE;
+   ULLONG ullFirstTime = 0;
+   ULLONG ullReplayStart = 0;
+
+   pfReplay = FOPEN(pcFileName_, "rb");
+   if (pfReplay == NULL)
+      return FALSE;
+
+   if (fread(aucHeader, 1, DSI_SERIAL_TAP_MAGIC_SIZE, pfReplay) != DSI_SERIAL_TAP_MAGIC_SIZE ||
+       memcmp(aucHeader, DSI_SERIAL_TAP_MAGIC, DSI_SERIAL_TAP_MAGIC_SIZE) != 0)
+   {
+      fclose(pfReplay);
+      return FALSE;
+   }
+
+   pucChunk = (UCHAR*)DSI_MALLOC(MAX_USHORT);
+   if (pucChunk == NULL)
+   {
+      fclose(pfReplay);
+      return FALSE;
+   }
+
+   while (fread(aucHeader, 1, DSI_SERIAL_TAP_RECORD_HEADER_SIZE, pfReplay) == DSI_SERIAL_TAP_RECORD_HEADER_SIZE)
+   {
+      ULLONG ullTime = 0;
+      USHORT usSize;
+
+      for (UCHAR i = 0; i < 8; i++)
+         ullTime |= (ULLONG)aucHeader[i] << (8 * i);
+      usSize = (USHORT)(aucHeader[8] | ((USHORT)aucHeader[9] << 8));
+
+      if (usSize == 0)
+      {
+         // Lost bytes; the framer resynchronizes on its own.
+         if (fread(pucChunk, 1, DSI_SERIAL_TAP_LOST_SIZE, pfReplay) != DSI_SERIAL_TAP_LOST_SIZE)
+         {
+            bSuccess = FALSE;
+            break;
+         }
+         continue;
+      }
+
+      if (fread(pucChunk, 1, usSize, pfReplay) != usSize)
+      {
+         bSuccess = FALSE;                                  // Truncated record
+         break;
+      }
+
+      if (bRealTime_)
+      {
+         if (bFirst)
+         {
+            ullFirstTime = ullTime;
+            ullReplayStart = DSIThread_GetSystemTimeMicroseconds();
+            bFirst = FALSE;
+         }
+         else
+         {
+            ULLONG ullDue = ullTime - ullFirstTime;
+            ULLONG ullElapsed = DSIThread_GetSystemTimeMicroseconds() - ullReplayStart;
+
+            if (ullDue >= ullElapsed + 1000)
+               DSIThread_Sleep((ULONG)((ullDue - ullElapsed) / 1000));
+         }
+      }
+
+      pclCallback_->ProcessBytes(pucChunk, usSize);
+   }
+
+   DSI_FREE(pucChunk);
+   fclose(pfReplay);
+
+   return bSuccess;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Microseconds since Open().
+///////////////////////////////////////////////////////////////////////
+ULLONG DSISerialTap::GetTime()
+{
+   return DSIThread_GetSystemTimeMicroseconds() - ullStartTime;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialTap::Put(ULONG ulIndex_, const UCHAR *pucData_, ULONG ulSize_)
+{
+   ULONG ulOffset = ulIndex_ & (ulRingSize - 1);
+   ULONG ulFirst = MIN(ulSize_, ulRingSize - ulOffset);
+
+   memcpy(&pucRing[ulOffset], pucData_, ulFirst);
+   if (ulFirst < ulSize_)
+      memcpy(pucRing, &pucData_[ulFirst], ulSize_ - ulFirst);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialTap::PutHeader(ULONG ulIndex_, ULLONG ullTime_, USHORT usSize_)
+{
+   UCHAR aucHeader[DSI_SERIAL_TAP_RECORD_HEADER_SIZE];
+
+   for (UCHAR i = 0; i < 8; i++)
+      aucHeader[i] = (UCHAR)((ullTime_ >> (8 * i)) & 0xFF);
+   aucHeader[8] = (UCHAR)(usSize_ & 0xFF);
+   aucHeader[9] = (UCHAR)(usSize_ >> 8);
+
+   Put(ulIndex_, aucHeader, DSI_SERIAL_TAP_RECORD_HEADER_SIZE);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Writes everything published so far.  Records are stored in the ring
+// in file format, so this is at most two fwrite calls.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTap::Flush()
+{
+   ULONG ulFlushHead;
+   ULONG ulFlushTail;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   ulFlushHead = ulHead;
+   ulFlushTail = ulTail;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   if (ulFlushHead == ulFlushTail)
+      return;
+
+   while (ulFlushTail != ulFlushHead)
+   {
+      ULONG ulOffset = ulFlushTail & (ulRingSize - 1);
+      ULONG ulSize = MIN(ulFlushHead - ulFlushTail, ulRingSize - ulOffset);
+
+      fwrite(&pucRing[ulOffset], 1, ulSize, pfFile);
+      ulFlushTail += ulSize;
+   }
+   fflush(pfFile);
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   ulTail = ulFlushTail;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialTap::FlushThread()
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   while (!bStopFlushThread)
+   {
+      DSIThread_CondTimedWait(&stCondFlush, &stMutexCriticalSection, DSI_SERIAL_TAP_FLUSH_INTERVAL);
+
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+      Flush();
+      DSIThread_MutexLock(&stMutexCriticalSection);
+   }
+
+   DSIThread_CondSignal(&stEventFlushThreadExit);           // Set an event to alert the main process that the thread is finished and can be closed.
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_RETURN DSISerialTap::ProcessThread(void *pvParameter_)
+{
+   DSISerialTap *This = (DSISerialTap *) pvParameter_;
+   DSIThread_SetThreadName("ant-tap-flush");
+   DSI_ALLOC_THREAD("ant-tap-flush", DSI_ALLOC_DEBUG);
+   This->FlushThread();
+   return 0;
+}
@@ -0,0 +1,119 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_SERIAL_TAP_HPP)
+#define DSI_SERIAL_TAP_HPP
+
+#include "types.h"
+#include "dsi_thread.h"
+#include "dsi_serial_callback.hpp"
+
+#include <stdio.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+// Capture file layout (all fields little endian):
+//    File header:   "DSITAP" 0x01 0x00
+//    Record:        [8 byte time (us)][2 byte size][size bytes received]
+//    Lost bytes:    [8 byte time (us)][2 byte 0][4 byte count]
+// A lost bytes record is written when the ring was full and chunks had
+// to be discarded.
+#define DSI_SERIAL_TAP_MAGIC              "DSITAP\x01\x00"
+#define DSI_SERIAL_TAP_MAGIC_SIZE         8
+#define DSI_SERIAL_TAP_RECORD_HEADER_SIZE 10
+#define DSI_SERIAL_TAP_LOST_SIZE          4
+
+#define DSI_SERIAL_TAP_DEFAULT_RING_SIZE  ((ULONG) 1 << 20)
+#define DSI_SERIAL_TAP_FLUSH_INTERVAL     ((ULONG) 250)     // ms
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// Captures the raw bytes received from a stick.  Each chunk is copied once
+// into a ring allocated up front, and a background thread writes the ring
+// out to a capture file that can be replayed into a framer later.
+class DSISerialTap
+{
+   private:
+
+      UCHAR *pucRing;
+      ULONG ulRingSize;                                     // A power of two
+      ULONG ulHead;                                         // Free running write index, owned by the receive thread
+      ULONG ulTail;                                         // Free running read index, owned by the flush thread
+      ULONG ulTailSnapshot;                                 // ulTail as last seen by the receive thread
+      ULONG ulLostBytes;                                    // Bytes discarded since the last lost bytes record
+      ULONG ulTotalLostBytes;
+      ULLONG ullStartTime;                                  // us
+
+      FILE *pfFile;
+
+      DSI_THREAD_ID hFlushThread;                           // Handle for the flush thread.
+      DSI_MUTEX stMutexCriticalSection;                     // Protects the ring indices.
+      DSI_CONDITION_VAR stCondFlush;                        // Signalled when the ring is half full.
+      DSI_CONDITION_VAR stEventFlushThreadExit;             // Event to signal the flush thread has ended.
+      BOOL bStopFlushThread;
+
+      ULLONG GetTime();
+      void Put(ULONG ulIndex_, const UCHAR *pucData_, ULONG ulSize_);
+      void PutHeader(ULONG ulIndex_, ULLONG ullTime_, USHORT usSize_);
+      void Flush();
+      void FlushThread();
+      static DSI_THREAD_RETURN ProcessThread(void *pvParameter_);
+
+   public:
+      DSISerialTap();
+      ~DSISerialTap();
+
+      BOOL Open(const char *pcFileName_, ULONG ulRingSize_ = DSI_SERIAL_TAP_DEFAULT_RING_SIZE);
+      /////////////////////////////////////////////////////////////////
+      // Creates the capture file and starts the flush thread.
+      // Parameters:
+      //    *pcFileName_:     The capture file.  It is overwritten.
+      //    ulRingSize_:      Size of the ring, rounded up to a power
+      //                      of two.
+      // Returns TRUE if successful.
+      /////////////////////////////////////////////////////////////////
+
+      void Close();
+      /////////////////////////////////////////////////////////////////
+      // Writes out whatever is left in the ring and closes the file.
+      /////////////////////////////////////////////////////////////////
+
+      void Append(const UCHAR *pucData_, ULONG ulSize_);
+      /////////////////////////////////////////////////////////////////
+      // Records a received chunk.  Only one thread may append.  If
+      // the ring is full the chunk is counted as lost.  Does nothing
+      // if the tap is not open.
+      /////////////////////////////////////////////////////////////////
+
+      ULONG GetLostBytes();
+      /////////////////////////////////////////////////////////////////
+      // Returns the number of bytes discarded since Open().
+      /////////////////////////////////////////////////////////////////
+
+      static BOOL Replay(const char *pcFileName_, DSISerialCallback *pclCallback_, BOOL bRealTime_ = FALSE);
+      /////////////////////////////////////////////////////////////////
+      // Feeds a capture file to a callback (usually a framer) chunk
+      // by chunk, exactly as the bytes were received.
+      // Parameters:
+      //    *pcFileName_:     The capture file.
+      //    *pclCallback_:    Receives the chunks through
+      //                      ProcessBytes().
+      //    bRealTime_:       If TRUE the original spacing between
+      //                      chunks is kept.  Otherwise the file is
+      //                      replayed as fast as possible.
+      // Returns FALSE if the file can't be read or is not a capture.
+      /////////////////////////////////////////////////////////////////
+};
+
+#endif // !defined(DSI_SERIAL_TAP_HPP)
@@ -0,0 +1,750 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#if defined(DSI_TYPES_LINUX)
+#include "defines.h"
+#include "dsi_serial_tty.hpp"
+#include "macros.h"
+#include "dsi_alloc_audit.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/uio.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+// Completion user data: [type][slot][buffer]
+#define TTY_OP_READ                    ((ULONG) 1)
+#define TTY_OP_CANCEL                  ((ULONG) 2)
+#define TTY_OP_WAKE                    ((ULONG) 3)
+
+#define TTY_USER_DATA(op, slot, buffer)   (((op) << 16) | ((ULONG)(slot) << 8) | (ULONG)(buffer))
+#define TTY_USER_DATA_OP(data)            ((ULONG)((data) >> 16) & 0xFF)
+#define TTY_USER_DATA_SLOT(data)          ((UCHAR)(((data) >> 8) & 0xFF))
+#define TTY_USER_DATA_BUFFER(data)        ((UCHAR)((data) & 0xFF))
+
+typedef struct
+{
+   DSISerialTTY *pclDevice;                                 // Slot owner when the completion was collected
+   UCHAR ucSlot;
+   UCHAR ucBuffer;
+   int iResult;                                             // Bytes read, 0 if the device went away, -1 if it can't be read again
+} TTY_COMPLETION;
+
+DSISerialTTYRing *DSISerialTTYRing::pclInstance = (DSISerialTTYRing*)NULL;
+DSI_MUTEX DSISerialTTYRing::stMutexInstance = PTHREAD_MUTEX_INITIALIZER;
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// DSISerialTTYRing
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+DSISerialTTYRing::DSISerialTTYRing()
+{
+   hCompletionThread = (DSI_THREAD_ID)NULL;
+   hCompletionThreadIDNum = (DSI_THREAD_IDNUM)0;
+   bCompletionThreadRunning = FALSE;
+   bStopCompletionThread = TRUE;
+   bDeleteOnExit = FALSE;
+   ulReferences = 0;
+
+   for (UCHAR i = 0; i < DSI_SERIAL_TTY_MAX_DEVICES; i++)
+   {
+      apclDevices[i] = (DSISerialTTY*)NULL;
+      aucPending[i] = 0;
+      abRemoving[i] = FALSE;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+DSISerialTTYRing::~DSISerialTTYRing()
+{
+   Stop();
+}
+
+///////////////////////////////////////////////////////////////////////
+DSISerialTTYRing* DSISerialTTYRing::Attach()
+{
+   DSISerialTTYRing *pclRing;
+
+   DSIThread_MutexLock(&stMutexInstance);
+
+   if (pclInstance == NULL)
+   {
+      pclInstance = new DSISerialTTYRing();
+      if (!pclInstance->Start())
+      {
+         delete pclInstance;
+         pclInstance = (DSISerialTTYRing*)NULL;
+      }
+   }
+
+   if (pclInstance)
+      pclInstance->ulReferences++;
+
+   pclRing = pclInstance;
+   DSIThread_MutexUnlock(&stMutexInstance);
+
+   return pclRing;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialTTYRing::Detach()
+{
+   DSIThread_MutexLock(&stMutexInstance);
+
+   if (pclInstance && --pclInstance->ulReferences == 0)
+   {
+      if (pclInstance->IsCompletionThread())
+      {
+         // Closed from a callback.  The thread can't wait for itself
+         // to exit, so it deletes the ring once the callback returns.
+         DSIThread_MutexLock(&pclInstance->stMutexSubmit);
+         pclInstance->bStopCompletionThread = TRUE;
+         pclInstance->bDeleteOnExit = TRUE;
+         DSIThread_MutexUnlock(&pclInstance->stMutexSubmit);
+      }
+      else
+      {
+         delete pclInstance;
+      }
+      pclInstance = (DSISerialTTYRing*)NULL;
+   }
+
+   DSIThread_MutexUnlock(&stMutexInstance);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Sets up the ring, registers every read buffer with it and starts
+// the completion thread.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTYRing::Start()
+{
+   struct iovec astIov[DSI_SERIAL_TTY_MAX_DEVICES * DSI_SERIAL_TTY_BUFFERS];
+
+   if (io_uring_queue_init(DSI_SERIAL_TTY_RING_ENTRIES, &stRing, 0) < 0)
+      return FALSE;
+
+   for (ULONG i = 0; i < DSI_SERIAL_TTY_MAX_DEVICES * DSI_SERIAL_TTY_BUFFERS; i++)
+   {
+      astIov[i].iov_base = aaucBuffers[i];
+      astIov[i].iov_len = DSI_SERIAL_TTY_BUFFER_SIZE;
+   }
+
+   if (io_uring_register_buffers(&stRing, astIov, DSI_SERIAL_TTY_MAX_DEVICES * DSI_SERIAL_TTY_BUFFERS) < 0)
+   {
+      io_uring_queue_exit(&stRing);
+      return FALSE;
+   }
+
+   if (DSIThread_MutexInit(&stMutexSubmit) != DSI_THREAD_ENONE)
+   {
+      io_uring_queue_exit(&stRing);
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stCondReadsDone) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&stMutexSubmit);
+      io_uring_queue_exit(&stRing);
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stEventCompletionThreadExit) != DSI_THREAD_ENONE)
+   {
+      DSIThread_CondDestroy(&stCondReadsDone);
+      DSIThread_MutexDestroy(&stMutexSubmit);
+      io_uring_queue_exit(&stRing);
+      return FALSE;
+   }
+
+   bStopCompletionThread = FALSE;
+   hCompletionThread = DSIThread_CreateThread(&DSISerialTTYRing::ProcessThread, this);
+   if (hCompletionThread == NULL)
+   {
+      bStopCompletionThread = TRUE;
+      DSIThread_CondDestroy(&stEventCompletionThreadExit);
+      DSIThread_CondDestroy(&stCondReadsDone);
+      DSIThread_MutexDestroy(&stMutexSubmit);
+      io_uring_queue_exit(&stRing);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Wakes the completion thread with a no-op and waits for it to exit.
+// All devices have been removed by the time the last reference goes.
+// On the completion thread itself (see Detach()) the thread has
+// already finished its loop.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTTYRing::Stop()
+{
+   if (hCompletionThread == NULL)
+      return;
+
+   DSIThread_MutexLock(&stMutexSubmit);
+   if (bStopCompletionThread == FALSE && !IsCompletionThread())
+   {
+      struct io_uring_sqe *pstSqe;
+
+      bStopCompletionThread = TRUE;
+
+      pstSqe = io_uring_get_sqe(&stRing);
+      if (pstSqe)
+      {
+         io_uring_prep_nop(pstSqe);
+         io_uring_sqe_set_data64(pstSqe, TTY_USER_DATA(TTY_OP_WAKE, 0, 0));
+         io_uring_submit(&stRing);
+      }
+
+      if (DSIThread_CondTimedWait(&stEventCompletionThreadExit, &stMutexSubmit, 3000) != DSI_THREAD_ENONE)
+      {
+         // We were unable to stop the thread normally.
+         DSIThread_DestroyThread(hCompletionThread);
+      }
+   }
+   DSIThread_MutexUnlock(&stMutexSubmit);
+
+   DSIThread_ReleaseThreadID(hCompletionThread);
+   hCompletionThread = (DSI_THREAD_ID)NULL;
+
+   DSIThread_CondDestroy(&stEventCompletionThreadExit);
+   DSIThread_CondDestroy(&stCondReadsDone);
+   DSIThread_MutexDestroy(&stMutexSubmit);
+
+   io_uring_unregister_buffers(&stRing);
+   io_uring_queue_exit(&stRing);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTYRing::AddDevice(DSISerialTTY *pclDevice_)
+{
+   BOOL bSuccess = FALSE;
+
+   DSIThread_MutexLock(&stMutexSubmit);
+
+   for (UCHAR i = 0; i < DSI_SERIAL_TTY_MAX_DEVICES; i++)
+   {
+      if (apclDevices[i] == NULL)
+      {
+         apclDevices[i] = pclDevice_;
+         aucPending[i] = 0;
+         abRemoving[i] = FALSE;
+         pclDevice_->ucSlot = i;
+
+         bSuccess = PostRead(i, 0);
+         if (bSuccess)
+            io_uring_submit(&stRing);
+         else
+            apclDevices[i] = (DSISerialTTY*)NULL;
+         break;
+      }
+   }
+
+   DSIThread_MutexUnlock(&stMutexSubmit);
+
+   return bSuccess;
+}
+
+///////////////////////////////////////////////////////////////////////
+// The slot is only freed once the completion thread has dropped its
+// references, so a completion in progress never finds it reused.  If
+// the wait times out the slot is left to the completion thread, which
+// doesn't touch a device that is being removed.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTTYRing::RemoveDevice(DSISerialTTY *pclDevice_)
+{
+   UCHAR ucSlot = pclDevice_->ucSlot;
+
+   DSIThread_MutexLock(&stMutexSubmit);
+
+   if (ucSlot < DSI_SERIAL_TTY_MAX_DEVICES && apclDevices[ucSlot] == pclDevice_ && !abRemoving[ucSlot])
+   {
+      abRemoving[ucSlot] = TRUE;
+      pclDevice_->ucSlot = 0xFF;
+
+      if (aucPending[ucSlot] == 0)
+      {
+         apclDevices[ucSlot] = (DSISerialTTY*)NULL;
+         abRemoving[ucSlot] = FALSE;
+      }
+      else
+      {
+         // A read on a quiet tty never completes on its own.
+         struct io_uring_sqe *pstSqe = io_uring_get_sqe(&stRing);
+         if (pstSqe)
+         {
+            io_uring_prep_cancel_fd(pstSqe, pclDevice_->iFile, 0);
+            io_uring_sqe_set_data64(pstSqe, TTY_USER_DATA(TTY_OP_CANCEL, ucSlot, 0));
+            io_uring_submit(&stRing);
+         }
+
+         // From the device's own callback, the callback holds the slot
+         // until it returns, so there is nothing to wait for here.
+         if (!IsCompletionThread())
+         {
+            while (apclDevices[ucSlot] == pclDevice_ && !bStopCompletionThread)
+            {
+               if (DSIThread_CondTimedWait(&stCondReadsDone, &stMutexSubmit, 3000) != DSI_THREAD_ENONE)
+                  break;
+            }
+         }
+      }
+   }
+
+   DSIThread_MutexUnlock(&stMutexSubmit);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Queues a read into one of the slot's registered buffers.  The
+// caller holds stMutexSubmit and submits.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTYRing::PostRead(UCHAR ucSlot_, UCHAR ucBuffer_)
+{
+   DSISerialTTY *pclDevice = apclDevices[ucSlot_];
+   USHORT usIndex = ucSlot_ * DSI_SERIAL_TTY_BUFFERS + ucBuffer_;
+   struct io_uring_sqe *pstSqe = io_uring_get_sqe(&stRing);
+
+   if (pstSqe == NULL)
+      return FALSE;
+
+   io_uring_prep_read_fixed(pstSqe, pclDevice->iFile, aaucBuffers[usIndex], DSI_SERIAL_TTY_BUFFER_SIZE, 0, usIndex);
+   io_uring_sqe_set_data64(pstSqe, TTY_USER_DATA(TTY_OP_READ, ucSlot_, ucBuffer_));
+   aucPending[ucSlot_]++;
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Re-arms a stick from the completion thread.  If the submission
+// queue is full, what is queued goes in first to make room.  The
+// caller holds stMutexSubmit and submits.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTYRing::RepostRead(UCHAR ucSlot_, UCHAR ucBuffer_)
+{
+   if (PostRead(ucSlot_, ucBuffer_))
+      return TRUE;
+
+   io_uring_submit(&stRing);
+   return PostRead(ucSlot_, ucBuffer_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Drops a reference on a slot.  A slot being removed is freed with
+// its last reference.  The caller holds stMutexSubmit.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTTYRing::ReleaseSlot(UCHAR ucSlot_)
+{
+   if (--aucPending[ucSlot_] == 0)
+   {
+      if (abRemoving[ucSlot_])
+      {
+         apclDevices[ucSlot_] = (DSISerialTTY*)NULL;
+         abRemoving[ucSlot_] = FALSE;
+      }
+
+      DSIThread_CondBroadcast(&stCondReadsDone);
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+// The id is only compared while the thread runs.  Before it has been
+// stored, or once the thread is gone and the id may be reused, no
+// caller can be on the completion thread.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTYRing::IsCompletionThread()
+{
+   return bCompletionThreadRunning && DSIThread_CompareThreads(hCompletionThreadIDNum, DSIThread_GetCurrentThreadIDNum());
+}
+
+///////////////////////////////////////////////////////////////////////
+// Reaps completions in batches.  Only one read per stick is in flight
+// so the bytes arrive in order; the next buffer is posted before the
+// filled one is handed to the callback so the stick is never left
+// without a read.  All reposts of a batch go in with one submit, so a
+// stick has at most one completion per batch.
+//
+// Each collected completion holds a reference on its slot until its
+// callback has returned, so the slot keeps its owner even if the
+// callback closes the device.  Nothing is delivered to a device once
+// it is being removed.  A stick that can't be re-armed gets an EREAD
+// error after its bytes, as it won't be read again.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTYRing::CompletionThread()
+{
+   BOOL bDelete;
+   TTY_COMPLETION astCompletions[DSI_SERIAL_TTY_RING_ENTRIES];
+
+   DSIThread_MutexLock(&stMutexSubmit);
+   hCompletionThreadIDNum = DSIThread_GetCurrentThreadIDNum();
+   bCompletionThreadRunning = TRUE;
+   DSIThread_MutexUnlock(&stMutexSubmit);
+
+   while (!bStopCompletionThread)
+   {
+      struct io_uring_cqe *pstCqe;
+      unsigned uHead;
+      ULONG ulCompletions = 0;
+      ULONG ulReaped = 0;
+
+      if (io_uring_wait_cqe(&stRing, &pstCqe) < 0)
+         continue;                                          // Interrupted
+
+      DSIThread_MutexLock(&stMutexSubmit);
+
+      io_uring_for_each_cqe(&stRing, uHead, pstCqe)
+      {
+         ULONG ulData = (ULONG)io_uring_cqe_get_data64(pstCqe);
+         UCHAR ucSlot = TTY_USER_DATA_SLOT(ulData);
+         UCHAR ucBuffer = TTY_USER_DATA_BUFFER(ulData);
+         DSISerialTTY *pclDevice;
+         BOOL bRearmed = TRUE;
+
+         ulReaped++;
+
+         if (TTY_USER_DATA_OP(ulData) != TTY_OP_READ)
+            continue;
+
+         pclDevice = apclDevices[ucSlot];
+         if (pclDevice == NULL)
+            continue;
+
+         if (!abRemoving[ucSlot])
+         {
+            if (pstCqe->res > 0)
+            {
+               bRearmed = RepostRead(ucSlot, (ucBuffer + 1) % DSI_SERIAL_TTY_BUFFERS);
+
+               // Hold the slot until the callback has run.
+               aucPending[ucSlot]++;
+               astCompletions[ulCompletions].pclDevice = pclDevice;
+               astCompletions[ulCompletions].ucSlot = ucSlot;
+               astCompletions[ulCompletions].ucBuffer = ucBuffer;
+               astCompletions[ulCompletions].iResult = pstCqe->res;
+               ulCompletions++;
+            }
+            else if (pstCqe->res == -EINTR || pstCqe->res == -EAGAIN)
+            {
+               bRearmed = RepostRead(ucSlot, ucBuffer);
+            }
+            else if (pstCqe->res != -ECANCELED)
+            {
+               // EOF or an I/O error: the stick has been unplugged.
+               aucPending[ucSlot]++;
+               astCompletions[ulCompletions].pclDevice = pclDevice;
+               astCompletions[ulCompletions].ucSlot = ucSlot;
+               astCompletions[ulCompletions].ucBuffer = ucBuffer;
+               astCompletions[ulCompletions].iResult = 0;
+               ulCompletions++;
+            }
+
+            if (!bRearmed)
+            {
+               aucPending[ucSlot]++;
+               astCompletions[ulCompletions].pclDevice = pclDevice;
+               astCompletions[ulCompletions].ucSlot = ucSlot;
+               astCompletions[ulCompletions].ucBuffer = ucBuffer;
+               astCompletions[ulCompletions].iResult = -1;
+               ulCompletions++;
+            }
+         }
+
+         // The completed read's own reference.
+         ReleaseSlot(ucSlot);
+      }
+
+      io_uring_cq_advance(&stRing, ulReaped);
+      io_uring_submit(&stRing);
+
+      DSIThread_MutexUnlock(&stMutexSubmit);
+
+      // Callbacks run without the lock so they are free to write to the stick.
+      for (ULONG i = 0; i < ulCompletions; i++)
+      {
+         DSISerialTTY *pclDevice = astCompletions[i].pclDevice;
+
+         if (astCompletions[i].iResult > 0)
+            pclDevice->pclCallback->ProcessBytes(aaucBuffers[astCompletions[i].ucSlot * DSI_SERIAL_TTY_BUFFERS + astCompletions[i].ucBuffer], (ULONG)astCompletions[i].iResult);
+         else if (astCompletions[i].iResult == 0)
+            pclDevice->pclCallback->Error(DSI_SERIAL_DEVICE_GONE);
+         else
+            pclDevice->pclCallback->Error(DSI_SERIAL_EREAD);
+      }
+
+      if (ulCompletions)
+      {
+         DSIThread_MutexLock(&stMutexSubmit);
+         for (ULONG i = 0; i < ulCompletions; i++)
+            ReleaseSlot(astCompletions[i].ucSlot);
+         DSIThread_MutexUnlock(&stMutexSubmit);
+      }
+   }
+
+   DSIThread_MutexLock(&stMutexSubmit);
+      bStopCompletionThread = TRUE;
+      bCompletionThreadRunning = FALSE;
+      bDelete = bDeleteOnExit;
+      DSIThread_CondBroadcast(&stCondReadsDone);
+      DSIThread_CondSignal(&stEventCompletionThreadExit);    // Set an event to alert the main process that the thread is finished and can be closed.
+   DSIThread_MutexUnlock(&stMutexSubmit);
+
+   // Once the event is set the ring may be gone, unless it is ours to delete.
+   return bDelete;
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_RETURN DSISerialTTYRing::ProcessThread(void *pvParameter_)
+{
+   DSISerialTTYRing *This = (DSISerialTTYRing *) pvParameter_;
+   DSIThread_SetThreadName("ant-tty-ring");
+   DSI_ALLOC_THREAD("ant-tty-ring", DSI_ALLOC_SERIAL);
+
+   // The last reference went from one of the ring's own callbacks.
+   if (This->CompletionThread())
+      delete This;
+
+   return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// DSISerialTTY
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////
+DSISerialTTY::DSISerialTTY()
+{
+   acDevicePath[0] = NUL;
+   iFile = -1;
+   ucDeviceNumber = 0xFF;
+   ulBaud = 0;
+   pclRing = (DSISerialTTYRing*)NULL;
+   ucSlot = 0xFF;
+   bMutexInit = FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Destructor
+///////////////////////////////////////////////////////////////////////
+DSISerialTTY::~DSISerialTTY()
+{
+   Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTY::AutoInit()
+{
+   return FALSE; // unsupported
+}
+
+///////////////////////////////////////////////////////////////////////
+// Initializes the object for /dev/ttyUSB<ucDeviceNumber_>.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTY::Init(ULONG ulBaud_, UCHAR ucDeviceNumber_)
+{
+   ulBaud = ulBaud_;
+   ucDeviceNumber = ucDeviceNumber_;
+   SNPRINTF(acDevicePath, sizeof(acDevicePath), "/dev/ttyUSB%u", ucDeviceNumber_);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTY::Init(ULONG ulBaud_, const char *pcDevicePath_)
+{
+   if (pcDevicePath_ == NULL || strlen(pcDevicePath_) >= sizeof(acDevicePath))
+      return FALSE;
+
+   ulBaud = ulBaud_;
+   ucDeviceNumber = 0;
+   STRNCPY(acDevicePath, pcDevicePath_, sizeof(acDevicePath));
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Opens the tty and posts it to the shared ring.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTY::Open(void)
+{
+   // Make sure all handles are reset before opening again.
+   Close();
+
+   if (pclCallback == NULL || acDevicePath[0] == NUL)
+      return FALSE;
+
+   if (DSIThread_MutexInit(&stMutexWrite) != DSI_THREAD_ENONE)
+      return FALSE;
+   bMutexInit = TRUE;
+
+   iFile = open(acDevicePath, O_RDWR | O_NOCTTY | O_CLOEXEC);
+   if (iFile < 0)
+   {
+      Close();
+      return FALSE;
+   }
+
+   if (!ConfigurePort())
+   {
+      Close();
+      return FALSE;
+   }
+
+   pclRing = DSISerialTTYRing::Attach();
+   if (pclRing == NULL)
+   {
+      Close();
+      return FALSE;
+   }
+
+   if (!pclRing->AddDevice(this))
+   {
+      DSISerialTTYRing::Detach();
+      pclRing = (DSISerialTTYRing*)NULL;
+      Close();
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Closes the tty.  The callback is not called after this returns.
+///////////////////////////////////////////////////////////////////////
+void DSISerialTTY::Close(BOOL /*bReset*/)
+{
+   if (pclRing)
+   {
+      pclRing->RemoveDevice(this);
+      DSISerialTTYRing::Detach();
+      pclRing = (DSISerialTTYRing*)NULL;
+   }
+
+   if (iFile >= 0)
+   {
+      tcflush(iFile, TCIOFLUSH);
+      close(iFile);
+      iFile = -1;
+   }
+
+   if (bMutexInit)
+   {
+      DSIThread_MutexDestroy(&stMutexWrite);
+      bMutexInit = FALSE;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Writes usSize_ bytes to the tty.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTY::WriteBytes(void *pvData_, USHORT usSize_)
+{
+   UCHAR *pucData = (UCHAR*)pvData_;
+   USHORT usWritten = 0;
+
+   if (iFile < 0 || pvData_ == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexWrite);
+   while (usWritten < usSize_)
+   {
+      ssize_t iResult = write(iFile, &pucData[usWritten], usSize_ - usWritten);
+
+      if (iResult < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         break;
+      }
+      usWritten += (USHORT)iResult;
+   }
+   DSIThread_MutexUnlock(&stMutexWrite);
+
+   if (usWritten < usSize_)
+   {
+      pclCallback->Error(DSI_SERIAL_EWRITE);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialTTY::GetDeviceSerialNumber()
+{
+   return 0xFFFFFFFF; // unsupported
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSISerialTTY::GetDeviceNumber()
+{
+   return ucDeviceNumber;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Raw 8N1, no flow control.  A read returns as soon as any bytes are
+// available.  Only the standard termios rates are supported.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialTTY::ConfigurePort()
+{
+   struct termios stTermios;
+   speed_t tSpeed;
+
+   switch (ulBaud)
+   {
+      case 4800:     tSpeed = B4800;      break;
+      case 9600:     tSpeed = B9600;      break;
+      case 19200:    tSpeed = B19200;     break;
+      case 38400:    tSpeed = B38400;     break;
+      case 57600:    tSpeed = B57600;     break;
+      case 115200:   tSpeed = B115200;    break;
+      case 230400:   tSpeed = B230400;    break;
+      case 460800:   tSpeed = B460800;    break;
+      case 921600:   tSpeed = B921600;    break;
+      default:
+         return FALSE;
+   }
+
+   if (tcgetattr(iFile, &stTermios) != 0)
+      return FALSE;
+
+   cfmakeraw(&stTermios);
+   stTermios.c_cflag |= (CLOCAL | CREAD);
+   stTermios.c_cflag &= ~(CSTOPB | CRTSCTS);
+   stTermios.c_cc[VMIN] = 1;
+   stTermios.c_cc[VTIME] = 0;
+
+   if (cfsetispeed(&stTermios, tSpeed) != 0 || cfsetospeed(&stTermios, tSpeed) != 0)
+      return FALSE;
+
+   if (tcsetattr(iFile, TCSANOW, &stTermios) != 0)
+      return FALSE;
+
+   tcflush(iFile, TCIOFLUSH);
+
+   return TRUE;
+}
+
+#endif //defined(DSI_TYPES_LINUX)
@@ -0,0 +1,150 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_SERIAL_TTY_HPP)
+#define DSI_SERIAL_TTY_HPP
+
+#include "types.h"
+
+#if defined(DSI_TYPES_LINUX) // The tty module uses io_uring and is only supported on linux
+#include "dsi_thread.h"
+#include "dsi_serial.hpp"
+#include "dsi_serial_callback.hpp"
+
+#include <liburing.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define DSI_SERIAL_TTY_MAX_DEVICES     32                   // Number of sticks that can share the ring
+#define DSI_SERIAL_TTY_BUFFERS         2                    // Read buffers per stick (one is always posted)
+#define DSI_SERIAL_TTY_BUFFER_SIZE     512
+#define DSI_SERIAL_TTY_RING_ENTRIES    (DSI_SERIAL_TTY_MAX_DEVICES * DSI_SERIAL_TTY_BUFFERS * 2)
+
+#define DSI_SERIAL_TTY_PATH_SIZE       64
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+class DSISerialTTY;
+
+// One io_uring shared by every open DSISerialTTY.  The read buffers of all
+// sticks are registered with the ring once, and a single thread reaps the
+// completions and passes each buffer straight to the owning stick's callback.
+class DSISerialTTYRing
+{
+   private:
+
+      struct io_uring stRing;
+      UCHAR aaucBuffers[DSI_SERIAL_TTY_MAX_DEVICES * DSI_SERIAL_TTY_BUFFERS][DSI_SERIAL_TTY_BUFFER_SIZE];
+      DSISerialTTY *apclDevices[DSI_SERIAL_TTY_MAX_DEVICES];  // Slot owners; a slot stays taken until its references go
+      UCHAR aucPending[DSI_SERIAL_TTY_MAX_DEVICES];         // Read in flight plus a callback in progress
+      BOOL abRemoving[DSI_SERIAL_TTY_MAX_DEVICES];          // Owner closed; its callback is not called again
+
+      DSI_THREAD_ID hCompletionThread;                      // Handle for the completion thread.
+      DSI_THREAD_IDNUM hCompletionThreadIDNum;
+      BOOL bCompletionThreadRunning;                        // Set once hCompletionThreadIDNum has been stored
+      DSI_MUTEX stMutexSubmit;                              // Serializes access to the submission queue and device table.
+      DSI_CONDITION_VAR stCondReadsDone;                    // Signalled as devices lose their last pending read.
+      DSI_CONDITION_VAR stEventCompletionThreadExit;        // Event to signal the completion thread has ended.
+      BOOL bStopCompletionThread;
+      BOOL bDeleteOnExit;                                   // Last reference went from a callback; the thread deletes the ring
+      ULONG ulReferences;
+
+      static DSISerialTTYRing *pclInstance;
+      static DSI_MUTEX stMutexInstance;
+
+      DSISerialTTYRing();
+      ~DSISerialTTYRing();
+
+      BOOL Start();
+      void Stop();
+      BOOL PostRead(UCHAR ucSlot_, UCHAR ucBuffer_);
+      BOOL RepostRead(UCHAR ucSlot_, UCHAR ucBuffer_);
+      void ReleaseSlot(UCHAR ucSlot_);
+      BOOL IsCompletionThread();
+      BOOL CompletionThread();
+      static DSI_THREAD_RETURN ProcessThread(void *pvParameter_);
+
+   public:
+
+      static DSISerialTTYRing* Attach();
+      /////////////////////////////////////////////////////////////////
+      // Returns the shared ring, creating it on first use.
+      // Returns NULL if io_uring could not be set up.
+      /////////////////////////////////////////////////////////////////
+
+      static void Detach();
+      /////////////////////////////////////////////////////////////////
+      // Releases a reference from Attach().  The ring is torn down
+      // when the last reference goes.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL AddDevice(DSISerialTTY *pclDevice_);
+      /////////////////////////////////////////////////////////////////
+      // Takes a free slot for an open tty and posts its first read.
+      // Returns FALSE if all slots are taken.
+      /////////////////////////////////////////////////////////////////
+
+      void RemoveDevice(DSISerialTTY *pclDevice_);
+      /////////////////////////////////////////////////////////////////
+      // Cancels the device's pending read and waits for it to
+      // complete.  The device's callback is not called after this
+      // returns.  Called from the device's own callback it doesn't
+      // wait; the slot is freed once the callback returns.
+      /////////////////////////////////////////////////////////////////
+};
+
+class DSISerialTTY : public DSISerial
+{
+   private:
+
+      char acDevicePath[DSI_SERIAL_TTY_PATH_SIZE];
+      int iFile;
+      UCHAR ucDeviceNumber;
+      ULONG ulBaud;
+
+      DSISerialTTYRing *pclRing;
+      UCHAR ucSlot;                                         // Index in the ring's device table
+      DSI_MUTEX stMutexWrite;
+      BOOL bMutexInit;
+
+      BOOL ConfigurePort();
+
+   public:
+      DSISerialTTY();
+      ~DSISerialTTY();
+
+      BOOL Init(ULONG ulBaud_, const char *pcDevicePath_);
+      /////////////////////////////////////////////////////////////////
+      // Initializes the object with an explicit tty path.
+      // Parameters:
+      //    ulBaud_:          The baud rate of the stick.
+      //    *pcDevicePath_:   The tty, eg. "/dev/ttyUSB0".
+      /////////////////////////////////////////////////////////////////
+
+      // Methods inherited from the base class:
+      BOOL AutoInit();
+      ULONG GetDeviceSerialNumber();
+
+      BOOL Init(ULONG ulBaud_, UCHAR ucDeviceNumber_);      // Uses /dev/ttyUSB<ucDeviceNumber_>
+      BOOL Open();
+      void Close(BOOL bReset = FALSE);
+      BOOL WriteBytes(void *pvData_, USHORT usSize_);
+      UCHAR GetDeviceNumber();
+
+      friend class DSISerialTTYRing;
+};
+
+#endif // defined(DSI_TYPES_LINUX)
+
+#endif // !defined(DSI_SERIAL_TTY_HPP)
@@ -11,6 +11,7 @@ All rights reserved.
 #include "defines.h"
 #include "dsi_serial_vcp.hpp"
 #include "macros.h"
+#include "dsi_alloc_audit.hpp"
 
 //#include "usb_device_handle_si.hpp"
 
@@ -315,9 +316,12 @@ UCHAR DSISerialVCP::GetDeviceNumber()
 ///////////////////////////////////////////////////////////////////////
 void DSISerialVCP::ReceiveThread(void)
 {
-   UCHAR ucRxByte;
+   UCHAR aucRxData[255];
    DWORD ulRxBytesRead;
+   DWORD ulRxBytesToRead;
    DWORD dwCommEvent;
+   DWORD dwCommErrors;
+   COMSTAT stComStat;
    OVERLAPPED osRead = {0};
 
 //   while (hComm == INVALID_HANDLE_VALUE);
@@ -335,9 +339,15 @@ void DSISerialVCP::ReceiveThread(void)
             if (osRead.hEvent == NULL)               // Error creating overlapped event handle.
                break;
 
-            if (ReadFile(hComm, &ucRxByte, 1, &ulRxBytesRead, &osRead))
+            // Reads have no timeout, so ask for what has already arrived,
+            // or wait for one byte if nothing has.
+            ulRxBytesToRead = 1;
+            if (ClearCommError(hComm, &dwCommErrors, &stComStat) && stComStat.cbInQue > 1)
+               ulRxBytesToRead = MIN(stComStat.cbInQue, (DWORD)sizeof(aucRxData));
+
+            if (ReadFile(hComm, aucRxData, ulRxBytesToRead, &ulRxBytesRead, &osRead))
             {
-               pclCallback->ProcessByte(ucRxByte);
+               pclCallback->ProcessBytes(aucRxData, ulRxBytesRead);
             }
             else
             {
@@ -356,7 +366,7 @@ void DSISerialVCP::ReceiveThread(void)
                      if (!GetOverlappedResult(hComm, &osRead, &ulRxBytesRead, TRUE))
                         pclCallback->Error(DSI_SERIAL_EREAD);
                      else
-                        pclCallback->ProcessByte(ucRxByte);
+                        pclCallback->ProcessBytes(aucRxData, ulRxBytesRead);
 
                   }
                }
@@ -382,6 +392,7 @@ void DSISerialVCP::ReceiveThread(void)
 DSI_THREAD_RETURN DSISerialVCP::ProcessThread(void *pvParameter_)
 {
    DSISerialVCP *This = (DSISerialVCP *) pvParameter_;
+   DSI_ALLOC_THREAD("ant-vcp-rx", DSI_ALLOC_SERIAL);
    This->ReceiveThread();
    return 0;
 }
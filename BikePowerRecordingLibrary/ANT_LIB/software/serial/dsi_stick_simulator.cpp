@@ -0,0 +1,578 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#include "defines.h"
+#include "dsi_stick_simulator.hpp"
+
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define SIM_BIKE_POWER_DEVICE_TYPE     ((UCHAR) 11)
+#define SIM_STARTUP_COMMAND_RESET      ((UCHAR) 0x20)
+#define SIM_RSSI_MEASUREMENT_TYPE      ((UCHAR) 0x20)
+#define SIM_RSSI_THRESHOLD             ((UCHAR) 0x80)
+
+#define SIM_EXT_FLAGS                  (ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID | ANT_LIB_CONFIG_MESG_OUT_INC_RSSI | ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP)
+#define SIM_TWO_PI                     (6.283185307179586)
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////
+DSIStickSimulator::DSIStickSimulator()
+{
+   hStreamThread = (DSI_THREAD_ID)NULL;
+   bStopStreamThread = TRUE;
+   pclLoopback = (DSISerialLoopback*)NULL;
+   usNumMeters = 0;
+   ulSpeedup = 1;
+   ulRandom = 1;
+   ulMessagesSent = 0;
+   ulMessagesLost = 0;
+   ucRxIndex = 0;
+   ucRxSize = 0;
+   usTxSize = 0;
+   bScanMode = FALSE;
+   ucLibConfig = 0;
+
+   for (UCHAR i = 0; i < DSI_SIMULATOR_MAX_CHANNELS; i++)
+   {
+      abChannelOpen[i] = FALSE;
+      ausChannelDeviceNumber[i] = 0;
+   }
+
+   DSIThread_MutexInit(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Destructor
+///////////////////////////////////////////////////////////////////////
+DSIStickSimulator::~DSIStickSimulator()
+{
+   Stop();
+   DSIThread_MutexDestroy(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStickSimulator::Init(ULONG ulSpeedup_, DSISerialLoopback *pclLoopback_)
+{
+   Stop();
+
+   if (ulSpeedup_ == 0)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   ulSpeedup = ulSpeedup_;
+   usNumMeters = 0;
+   ulMessagesSent = 0;
+   ulMessagesLost = 0;
+   ucRxIndex = 0;
+   usTxSize = 0;
+   bScanMode = FALSE;
+   ucLibConfig = 0;
+
+   for (UCHAR i = 0; i < DSI_SIMULATOR_MAX_CHANNELS; i++)
+   {
+      abChannelOpen[i] = FALSE;
+      ausChannelDeviceNumber[i] = 0;
+   }
+
+   pclLoopback = pclLoopback_;
+   if (pclLoopback)
+      pclLoopback->SetDevice(this);
+
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStickSimulator::AddMeter(const DSI_SIMULATOR_METER *pstMeter_)
+{
+   METER_STATE *pstMeter;
+
+   if (pstMeter_->usMessagePeriod == 0)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   if (usNumMeters >= DSI_SIMULATOR_MAX_METERS)
+   {
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   pstMeter = &astMeters[usNumMeters];
+   pstMeter->stConfig = *pstMeter_;
+   // Spread the meters across the first period so they don't all transmit at once.
+   pstMeter->ullNextTicks = (ULLONG)usNumMeters * 997 % pstMeter_->usMessagePeriod;
+   pstMeter->ucEventCount = 0;
+   pstMeter->usAccumulatedPower = 0;
+   pstMeter->ulMessages = 0;
+   usNumMeters++;
+
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStickSimulator::Start()
+{
+   Stop();
+
+   if (DSIThread_CondInit(&stEventStreamThreadExit) != DSI_THREAD_ENONE)
+      return FALSE;
+
+   bStopStreamThread = FALSE;
+   hStreamThread = DSIThread_CreateThread(&DSIStickSimulator::ProcessThread, this);
+   if (hStreamThread == NULL)
+   {
+      bStopStreamThread = TRUE;
+      DSIThread_CondDestroy(&stEventStreamThreadExit);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::Stop()
+{
+   if (hStreamThread == NULL)
+      return;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   if (bStopStreamThread == FALSE)
+   {
+      bStopStreamThread = TRUE;
+
+      if (DSIThread_CondTimedWait(&stEventStreamThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+      {
+         // We were unable to stop the thread normally.
+         DSIThread_DestroyThread(hStreamThread);
+      }
+   }
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   DSIThread_ReleaseThreadID(hStreamThread);
+   hStreamThread = (DSI_THREAD_ID)NULL;
+
+   DSIThread_CondDestroy(&stEventStreamThreadExit);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Frames the host's bytes the same way the stick does and runs each
+// complete command.
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::HostBytes(UCHAR *pucData_, ULONG ulSize_)
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   for (ULONG i = 0; i < ulSize_; i++)
+   {
+      UCHAR ucByte = pucData_[i];
+
+      if (ucRxIndex == 0)
+      {
+         if (ucByte == MESG_TX_SYNC)
+            aucRxFrame[ucRxIndex++] = ucByte;
+      }
+      else if (ucRxIndex == 1)
+      {
+         if (ucByte > MESG_MAX_SIZE_VALUE)
+         {
+            ucRxIndex = 0;                                  // Invalid size, so restart.
+         }
+         else
+         {
+            aucRxFrame[ucRxIndex++] = ucByte;
+            ucRxSize = ucByte + MESG_FRAME_SIZE;
+         }
+      }
+      else
+      {
+         aucRxFrame[ucRxIndex++] = ucByte;
+
+         if (ucRxIndex == ucRxSize)
+         {
+            UCHAR ucCheckSum = 0;
+
+            for (UCHAR j = 0; j < ucRxSize; j++)
+               ucCheckSum ^= aucRxFrame[j];
+
+            if (ucCheckSum == 0)
+               ProcessCommand(aucRxFrame[MESG_ID_OFFSET], &aucRxFrame[MESG_DATA_OFFSET], aucRxFrame[MESG_SIZE_OFFSET]);
+
+            ucRxIndex = 0;
+         }
+      }
+   }
+
+   Flush();
+
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::GetCounts(ULONG *pulSent_, ULONG *pulLost_)
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   *pulSent_ = ulMessagesSent;
+   *pulLost_ = ulMessagesLost;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Protected Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStickSimulator::Transmit(UCHAR *pucData_, USHORT usSize_)
+{
+   if (pclLoopback == NULL)
+      return FALSE;
+
+   return pclLoopback->DeviceWrite(pucData_, usSize_);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Channel setup commands all succeed.  Only the commands that change
+// what is streamed are tracked.
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::ProcessCommand(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucSize_)
+{
+   UCHAR ucChannel = (ucSize_ > 0) ? pucData_[0] : 0;
+   UCHAR aucResponse[MESG_CHANNEL_ID_SIZE];
+
+   switch (ucMessageID_)
+   {
+      case MESG_SYSTEM_RESET_ID:
+         for (UCHAR i = 0; i < DSI_SIMULATOR_MAX_CHANNELS; i++)
+         {
+            abChannelOpen[i] = FALSE;
+            ausChannelDeviceNumber[i] = 0;
+         }
+         bScanMode = FALSE;
+         ucLibConfig = 0;
+
+         aucResponse[0] = SIM_STARTUP_COMMAND_RESET;
+         QueueMessage(MESG_STARTUP_MESG_ID, aucResponse, MESG_STARTUP_MESG_SIZE);
+         return;
+
+      case MESG_OPEN_CHANNEL_ID:
+         if (ucChannel >= DSI_SIMULATOR_MAX_CHANNELS)
+         {
+            QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+         }
+         else if (abChannelOpen[ucChannel] || bScanMode)
+         {
+            QueueResponse(ucChannel, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+         }
+         else
+         {
+            abChannelOpen[ucChannel] = TRUE;
+            QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+         }
+         return;
+
+      case MESG_OPEN_RX_SCAN_ID:
+         if (abChannelOpen[0] || bScanMode)
+         {
+            QueueResponse(0, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+         }
+         else
+         {
+            bScanMode = TRUE;
+            QueueResponse(0, ucMessageID_, RESPONSE_NO_ERROR);
+         }
+         return;
+
+      case MESG_CLOSE_CHANNEL_ID:
+         if (ucChannel >= DSI_SIMULATOR_MAX_CHANNELS || (!abChannelOpen[ucChannel] && !(bScanMode && ucChannel == 0)))
+         {
+            QueueResponse(ucChannel, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+         }
+         else
+         {
+            abChannelOpen[ucChannel] = FALSE;
+            if (ucChannel == 0)
+               bScanMode = FALSE;
+            QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+            QueueResponse(ucChannel, 1, EVENT_CHANNEL_CLOSED);
+         }
+         return;
+
+      case MESG_CHANNEL_ID_ID:
+         if (ucChannel < DSI_SIMULATOR_MAX_CHANNELS && ucSize_ >= MESG_CHANNEL_ID_SIZE)
+            ausChannelDeviceNumber[ucChannel] = pucData_[1] | ((USHORT)pucData_[2] << 8);
+         QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+         return;
+
+      case MESG_ANTLIB_CONFIG_ID:
+         if (ucSize_ >= MESG_ANTLIB_CONFIG_SIZE)
+            ucLibConfig = pucData_[1];
+         QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+         return;
+
+      case MESG_REQUEST_ID:
+         if (ucSize_ < 2)
+            break;
+
+         if (pucData_[1] == MESG_CHANNEL_STATUS_ID && ucChannel < DSI_SIMULATOR_MAX_CHANNELS)
+         {
+            aucResponse[0] = ucChannel;
+            aucResponse[1] = (abChannelOpen[ucChannel] || (bScanMode && ucChannel == 0)) ? STATUS_TRACKING_CHANNEL : STATUS_ASSIGNED_CHANNEL;
+            QueueMessage(MESG_CHANNEL_STATUS_ID, aucResponse, MESG_CHANNEL_STATUS_SIZE);
+            return;
+         }
+         if (pucData_[1] == MESG_CHANNEL_ID_ID && ucChannel < DSI_SIMULATOR_MAX_CHANNELS)
+         {
+            aucResponse[0] = ucChannel;
+            aucResponse[1] = (UCHAR)(ausChannelDeviceNumber[ucChannel] & 0xFF);
+            aucResponse[2] = (UCHAR)(ausChannelDeviceNumber[ucChannel] >> 8);
+            aucResponse[3] = SIM_BIKE_POWER_DEVICE_TYPE;
+            aucResponse[4] = 0;
+            QueueMessage(MESG_CHANNEL_ID_ID, aucResponse, MESG_CHANNEL_ID_SIZE);
+            return;
+         }
+         break;
+
+      default:
+         QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+         return;
+   }
+
+   QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::QueueMessage(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucSize_)
+{
+   UCHAR ucCheckSum;
+   UCHAR *pucFrame;
+
+   if (usTxSize + ucSize_ + MESG_FRAME_SIZE > DSI_SIMULATOR_TX_BUFFER_SIZE)
+      Flush();
+
+   pucFrame = &aucTxBuffer[usTxSize];
+   pucFrame[0] = MESG_TX_SYNC;
+   pucFrame[MESG_SIZE_OFFSET] = ucSize_;
+   pucFrame[MESG_ID_OFFSET] = ucMessageID_;
+   memcpy(&pucFrame[MESG_DATA_OFFSET], pucData_, ucSize_);
+
+   ucCheckSum = 0;
+   for (UCHAR i = 0; i < ucSize_ + MESG_HEADER_SIZE; i++)
+      ucCheckSum ^= pucFrame[i];
+   pucFrame[ucSize_ + MESG_HEADER_SIZE] = ucCheckSum;
+
+   usTxSize += ucSize_ + MESG_FRAME_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::QueueResponse(UCHAR ucChannel_, UCHAR ucMessageID_, UCHAR ucCode_)
+{
+   UCHAR aucData[3];
+
+   aucData[0] = ucChannel_;
+   aucData[1] = ucMessageID_;
+   aucData[2] = ucCode_;
+
+   QueueMessage(MESG_RESPONSE_EVENT_ID, aucData, 3);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Builds the meter's next page as a broadcast message, with the
+// extended data the host asked for through the lib config.
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::QueuePowerPage(UCHAR ucChannel_, METER_STATE *pstMeter_)
+{
+   DSI_SIMULATOR_METER *pstConfig = &pstMeter_->stConfig;
+   UCHAR aucData[MESG_MAX_SIZE_VALUE];
+   UCHAR ucSize = MESG_DATA_SIZE;
+   UCHAR ucFlags = ucLibConfig & SIM_EXT_FLAGS;
+
+   aucData[0] = ucChannel_;
+
+   if (pstConfig->ucMeterType == DSI_SIMULATOR_CRANK_TORQUE && pstConfig->ucCadence)
+   {
+      // Crank events happen once per revolution; report the latest one.
+      ULONG ulRevolutions = (ULONG)(pstMeter_->ullNextTicks * pstConfig->ucCadence / (60 * DSI_SIMULATOR_CLOCK));
+      DOUBLE dTorque = pstConfig->usPower * 60.0 / (SIM_TWO_PI * pstConfig->ucCadence);
+      ULONG ulPeriod = (ULONG)((ULLONG)ulRevolutions * 60 * 2048 / pstConfig->ucCadence);
+      ULONG ulTorque = (ULONG)(ulRevolutions * dTorque * 32.0);
+
+      aucData[1] = DSI_SIMULATOR_CRANK_TORQUE;
+      aucData[2] = (UCHAR)ulRevolutions;
+      aucData[3] = (UCHAR)ulRevolutions;
+      aucData[4] = pstConfig->ucCadence;
+      aucData[5] = (UCHAR)(ulPeriod & 0xFF);
+      aucData[6] = (UCHAR)((ulPeriod >> 8) & 0xFF);
+      aucData[7] = (UCHAR)(ulTorque & 0xFF);
+      aucData[8] = (UCHAR)((ulTorque >> 8) & 0xFF);
+   }
+   else
+   {
+      pstMeter_->ucEventCount++;
+      pstMeter_->usAccumulatedPower += pstConfig->usPower;
+
+      aucData[1] = DSI_SIMULATOR_POWER_ONLY;
+      aucData[2] = pstMeter_->ucEventCount;
+      aucData[3] = 0xFF;                                    // Pedal power not used
+      aucData[4] = pstConfig->ucCadence;
+      aucData[5] = (UCHAR)(pstMeter_->usAccumulatedPower & 0xFF);
+      aucData[6] = (UCHAR)(pstMeter_->usAccumulatedPower >> 8);
+      aucData[7] = (UCHAR)(pstConfig->usPower & 0xFF);
+      aucData[8] = (UCHAR)(pstConfig->usPower >> 8);
+   }
+
+   if (ucFlags)
+   {
+      aucData[ucSize++] = ucFlags;
+
+      if (ucFlags & ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID)
+      {
+         aucData[ucSize++] = (UCHAR)(pstConfig->usDeviceNumber & 0xFF);
+         aucData[ucSize++] = (UCHAR)(pstConfig->usDeviceNumber >> 8);
+         aucData[ucSize++] = SIM_BIKE_POWER_DEVICE_TYPE;
+         aucData[ucSize++] = pstConfig->ucTransmissionType;
+      }
+
+      if (ucFlags & ANT_LIB_CONFIG_MESG_OUT_INC_RSSI)
+      {
+         aucData[ucSize++] = SIM_RSSI_MEASUREMENT_TYPE;
+         aucData[ucSize++] = (UCHAR)(SCHAR)(-40 - (SCHAR)(Random() % 40));
+         aucData[ucSize++] = SIM_RSSI_THRESHOLD;
+      }
+
+      if (ucFlags & ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP)
+      {
+         aucData[ucSize++] = (UCHAR)(pstMeter_->ullNextTicks & 0xFF);
+         aucData[ucSize++] = (UCHAR)((pstMeter_->ullNextTicks >> 8) & 0xFF);
+      }
+   }
+
+   QueueMessage(MESG_BROADCAST_DATA_ID, aucData, ucSize);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::Flush()
+{
+   if (usTxSize)
+   {
+      Transmit(aucTxBuffer, usTxSize);
+      usTxSize = 0;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSIStickSimulator::Random()
+{
+   ulRandom = ulRandom * 1103515245UL + 12345UL;
+   return (ulRandom >> 16) & 0x7FFF;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Advances the simulated clock from the host clock once a millisecond
+// and sends every message that fell due, batched into one transmit.
+///////////////////////////////////////////////////////////////////////
+void DSIStickSimulator::StreamThread()
+{
+   ULONG ulStartTime = DSIThread_GetSystemTime();
+
+   while (!bStopStreamThread)
+   {
+      ULLONG ullNow = (ULLONG)(DSIThread_GetSystemTime() - ulStartTime) * ulSpeedup * DSI_SIMULATOR_CLOCK / 1000;
+
+      DSIThread_MutexLock(&stMutexCriticalSection);
+
+      for (USHORT i = 0; i < usNumMeters; i++)
+      {
+         METER_STATE *pstMeter = &astMeters[i];
+
+         while (pstMeter->ullNextTicks <= ullNow)
+         {
+            UCHAR ucChannel = DSI_SIMULATOR_MAX_CHANNELS;
+
+            if (bScanMode)
+            {
+               ucChannel = 0;
+            }
+            else
+            {
+               for (UCHAR j = 0; j < DSI_SIMULATOR_MAX_CHANNELS; j++)
+               {
+                  // A wildcard channel pairs with the first meter.
+                  if (abChannelOpen[j] && (ausChannelDeviceNumber[j] == pstMeter->stConfig.usDeviceNumber || (ausChannelDeviceNumber[j] == 0 && i == 0)))
+                  {
+                     ucChannel = j;
+                     break;
+                  }
+               }
+            }
+
+            if (ucChannel < DSI_SIMULATOR_MAX_CHANNELS)
+            {
+               pstMeter->ulMessages++;
+
+               if (Random() % 100 < pstMeter->stConfig.ucLossPercent)
+               {
+                  // The message is lost but the meter carries on counting.
+                  if (pstMeter->stConfig.ucMeterType != DSI_SIMULATOR_CRANK_TORQUE)
+                  {
+                     pstMeter->ucEventCount++;
+                     pstMeter->usAccumulatedPower += pstMeter->stConfig.usPower;
+                  }
+                  ulMessagesLost++;
+               }
+               else
+               {
+                  QueuePowerPage(ucChannel, pstMeter);
+                  ulMessagesSent++;
+               }
+            }
+
+            pstMeter->ullNextTicks += pstMeter->stConfig.usMessagePeriod;
+         }
+      }
+
+      Flush();
+
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+      DSIThread_Sleep(1);
+   }
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+      bStopStreamThread = TRUE;
+      DSIThread_CondSignal(&stEventStreamThreadExit);       // Set an event to alert the main process that the thread is finished and can be closed.
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_RETURN DSIStickSimulator::ProcessThread(void *pvParameter_)
+{
+   DSIStickSimulator *This = (DSIStickSimulator *) pvParameter_;
+   DSIThread_SetThreadName("ant-simulator");
+   This->StreamThread();
+   return 0;
+}
@@ -0,0 +1,152 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_STICK_SIMULATOR_HPP)
+#define DSI_STICK_SIMULATOR_HPP
+
+#include "types.h"
+#include "antmessage.h"
+#include "antdefines.h"
+#include "dsi_thread.h"
+#include "dsi_serial_loopback.hpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define DSI_SIMULATOR_MAX_METERS          256
+#define DSI_SIMULATOR_MAX_CHANNELS        8
+#define DSI_SIMULATOR_TX_BUFFER_SIZE      4096
+
+#define DSI_SIMULATOR_CLOCK               ((ULONG) 32768)   // Simulated receiver clock (Hz)
+#define DSI_SIMULATOR_POWER_PERIOD        ((USHORT) 8182)   // Bike power message period (~4 Hz)
+
+#define DSI_SIMULATOR_POWER_ONLY          ((UCHAR) 0x10)    // Meter types, by the main data page sent
+#define DSI_SIMULATOR_CRANK_TORQUE        ((UCHAR) 0x12)
+
+typedef struct
+{
+   USHORT usDeviceNumber;
+   UCHAR ucTransmissionType;
+   UCHAR ucMeterType;                                       // DSI_SIMULATOR_POWER_ONLY or DSI_SIMULATOR_CRANK_TORQUE
+   USHORT usMessagePeriod;                                  // 1/32768 s
+   UCHAR ucLossPercent;                                     // Share of messages that are never sent
+   USHORT usPower;                                          // W
+   UCHAR ucCadence;                                         // rpm
+} DSI_SIMULATOR_METER;
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// A simulated ANT stick for load tests.  It answers channel setup commands
+// with MESG_RESPONSE_EVENT_ID and, once a channel is open (or the stick is
+// in continuous scan mode), streams framed bike power pages for every
+// simulated meter.  The simulated clock runs ulSpeedup times faster than
+// real time.
+class DSIStickSimulator : public DSISerialLoopbackDevice
+{
+   private:
+
+      typedef struct
+      {
+         DSI_SIMULATOR_METER stConfig;
+         ULLONG ullNextTicks;                               // Simulated time of the next message
+         UCHAR ucEventCount;
+         USHORT usAccumulatedPower;
+         ULONG ulMessages;                                  // Messages due, sent or lost
+      } METER_STATE;
+
+      METER_STATE astMeters[DSI_SIMULATOR_MAX_METERS];
+      USHORT usNumMeters;
+      ULONG ulSpeedup;
+      ULONG ulRandom;
+
+      // Stick state
+      BOOL abChannelOpen[DSI_SIMULATOR_MAX_CHANNELS];
+      USHORT ausChannelDeviceNumber[DSI_SIMULATOR_MAX_CHANNELS];
+      BOOL bScanMode;
+      UCHAR ucLibConfig;
+
+      // Host to stick framing
+      UCHAR aucRxFrame[MESG_MAX_SIZE_VALUE + MESG_FRAME_SIZE];
+      UCHAR ucRxIndex;
+      UCHAR ucRxSize;
+
+      UCHAR aucTxBuffer[DSI_SIMULATOR_TX_BUFFER_SIZE];
+      USHORT usTxSize;
+
+      DSISerialLoopback *pclLoopback;
+
+      DSI_THREAD_ID hStreamThread;
+      DSI_MUTEX stMutexCriticalSection;                     // Protects the stick state and the transmit buffer.
+      DSI_CONDITION_VAR stEventStreamThreadExit;
+      BOOL bStopStreamThread;
+
+      ULONG ulMessagesSent;
+      ULONG ulMessagesLost;
+
+      void ProcessCommand(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucSize_);
+      void QueueMessage(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucSize_);
+      void QueueResponse(UCHAR ucChannel_, UCHAR ucMessageID_, UCHAR ucCode_);
+      void QueuePowerPage(UCHAR ucChannel_, METER_STATE *pstMeter_);
+      void Flush();
+      ULONG Random();
+
+      void StreamThread();
+      static DSI_THREAD_RETURN ProcessThread(void *pvParameter_);
+
+   protected:
+
+      virtual BOOL Transmit(UCHAR *pucData_, USHORT usSize_);
+      /////////////////////////////////////////////////////////////////
+      // Sends framed bytes to the host.  The default implementation
+      // writes to the loopback port given to Init().  Override to
+      // use another transport (eg. a pty).
+      /////////////////////////////////////////////////////////////////
+
+   public:
+      DSIStickSimulator();
+      virtual ~DSIStickSimulator();
+
+      BOOL Init(ULONG ulSpeedup_, DSISerialLoopback *pclLoopback_ = (DSISerialLoopback*)NULL);
+      /////////////////////////////////////////////////////////////////
+      // Resets the stick and removes all meters.
+      // Parameters:
+      //    ulSpeedup_:       Simulated seconds per real second.
+      //    *pclLoopback_:    Port to attach to, or NULL if Transmit()
+      //                      is overridden.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL AddMeter(const DSI_SIMULATOR_METER *pstMeter_);
+      /////////////////////////////////////////////////////////////////
+      // Adds a simulated power meter.  Returns FALSE if the table is
+      // full.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL Start();
+      /////////////////////////////////////////////////////////////////
+      // Starts the simulated clock.
+      /////////////////////////////////////////////////////////////////
+
+      void Stop();
+
+      void HostBytes(UCHAR *pucData_, ULONG ulSize_);
+      /////////////////////////////////////////////////////////////////
+      // Feeds bytes written by the host to the stick.
+      /////////////////////////////////////////////////////////////////
+
+      void GetCounts(ULONG *pulSent_, ULONG *pulLost_);
+      /////////////////////////////////////////////////////////////////
+      // Returns the number of data messages sent and dropped so far.
+      /////////////////////////////////////////////////////////////////
+};
+
+#endif // !defined(DSI_STICK_SIMULATOR_HPP)
@@ -0,0 +1,51 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_ALLOC_H)
+#define DSI_ALLOC_H
+
+#include <stdlib.h>
+
+// Heap allocations made with malloc() and friends rather than operator new.
+//
+// Building with DSI_ALLOC_AUDIT routes them through counting versions, so
+// the allocation audit (see dsi_alloc_audit.hpp) sees them along with the
+// C++ allocations.  Without it they are the C library calls.  Memory from
+// DSI_MALLOC(), DSI_CALLOC() or DSI_REALLOC() must be released with
+// DSI_FREE().
+//
+// The C functions are exported so code that doesn't include the ANT_LIB
+// headers can route its own allocations to the audit (eg. POWER_MALLOC()
+// in PowerRecordingLib).
+
+#if defined(DSI_ALLOC_AUDIT)
+   #if defined(__cplusplus)
+   extern "C" {
+   #endif
+
+   void* DSIAlloc_Malloc(size_t size_);
+   void* DSIAlloc_Calloc(size_t count_, size_t size_);
+   void* DSIAlloc_Realloc(void *pvMemory_, size_t size_);
+   void DSIAlloc_Free(void *pvMemory_);
+
+   #if defined(__cplusplus)
+   }
+   #endif
+
+   #define DSI_MALLOC(size)                     DSIAlloc_Malloc(size)
+   #define DSI_CALLOC(count, size)              DSIAlloc_Calloc(count, size)
+   #define DSI_REALLOC(memory, size)            DSIAlloc_Realloc(memory, size)
+   #define DSI_FREE(memory)                     DSIAlloc_Free(memory)
+#else
+   #define DSI_MALLOC(size)                     malloc(size)
+   #define DSI_CALLOC(count, size)              calloc(count, size)
+   #define DSI_REALLOC(memory, size)            realloc(memory, size)
+   #define DSI_FREE(memory)                     free(memory)
+#endif
+
+#endif // !defined(DSI_ALLOC_H)
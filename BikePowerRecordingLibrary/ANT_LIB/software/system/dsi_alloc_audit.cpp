@@ -0,0 +1,422 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#include "defines.h"
+#include "macros.h"
+#include "dsi_alloc_audit.hpp"
+#include "dsi_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#if defined(_MSC_VER)
+   #include <windows.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#if defined(_MSC_VER)
+   #define THREAD_LOCAL                __declspec(thread)
+#else
+   #define THREAD_LOCAL                __thread
+#endif
+
+#define SHARED_SLOT                    (DSI_ALLOC_MAX_THREADS - 1)
+
+typedef struct
+{
+   char acName[DSI_ALLOC_MAX_NAME];                         // Empty until the thread calls SetThread()
+   volatile ULLONG aullAllocs[DSI_ALLOC_SUBSYSTEMS];
+   volatile ULLONG aullBytes[DSI_ALLOC_SUBSYSTEMS];
+   volatile ULLONG aullSteadyAllocs[DSI_ALLOC_SUBSYSTEMS];
+   volatile ULLONG ullFrees;
+} THREAD_COUNTS;
+
+static const char *apcSubsystemNames[DSI_ALLOC_SUBSYSTEMS] =
+   { "other", "serial", "framer", "usb", "antfs", "debug", "timer", "decoder" };
+
+static THREAD_COUNTS astThreads[DSI_ALLOC_MAX_THREADS];
+static volatile ULONG ulThreadCount = 0;                    // Slots handed out; may pass DSI_ALLOC_MAX_THREADS
+static volatile BOOL bSteady = FALSE;
+static DSI_ALLOC_HOOK fnSteadyHook = (DSI_ALLOC_HOOK)NULL;
+
+static THREAD_LOCAL THREAD_COUNTS *pstThreadCounts = (THREAD_COUNTS*)NULL;
+static THREAD_LOCAL UCHAR ucThreadSubsystem = DSI_ALLOC_OTHER;
+static THREAD_LOCAL BOOL bInHook = FALSE;
+
+
+//////////////////////////////////////////////////////////
+// Count Access
+//////////////////////////////////////////////////////////
+
+// The shared slot is counted into by several threads, so every count is
+// added atomically.
+static inline void AddCount(volatile ULLONG *pullCount_, ULLONG ullValue_)
+{
+#if defined(_MSC_VER)
+   InterlockedExchangeAdd64((volatile LONGLONG*)pullCount_, (LONGLONG)ullValue_);
+#else
+   __atomic_fetch_add(pullCount_, ullValue_, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline ULLONG LoadCount(volatile ULLONG *pullCount_)
+{
+#if defined(_MSC_VER)
+   return (ULLONG)InterlockedCompareExchange64((volatile LONGLONG*)pullCount_, 0, 0);
+#else
+   return __atomic_load_n(pullCount_, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline ULONG NextSlot()
+{
+#if defined(_MSC_VER)
+   return (ULONG)InterlockedIncrement((volatile LONG*)&ulThreadCount) - 1;
+#else
+   return __atomic_fetch_add(&ulThreadCount, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Function Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+static THREAD_COUNTS* GetThreadCounts();
+static void GetThreadName(ULONG ulSlot_, char *pcName_);
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIAllocAudit::IsEnabled()
+{
+#if defined(DSI_ALLOC_AUDIT)
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIAllocAudit::SetThread(const char *pcName_, UCHAR ucSubsystem_)
+{
+   THREAD_COUNTS *pstCounts = GetThreadCounts();
+
+   SetSubsystem(ucSubsystem_);
+
+   if (pstCounts != &astThreads[SHARED_SLOT] && pcName_ != NULL)
+   {
+      strncpy(pstCounts->acName, pcName_, DSI_ALLOC_MAX_NAME - 1);
+      pstCounts->acName[DSI_ALLOC_MAX_NAME - 1] = '\0';
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIAllocAudit::SetSubsystem(UCHAR ucSubsystem_)
+{
+   UCHAR ucPrevious = ucThreadSubsystem;
+
+   if (ucSubsystem_ < DSI_ALLOC_SUBSYSTEMS)
+      ucThreadSubsystem = ucSubsystem_;
+
+   return ucPrevious;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIAllocAudit::MarkSteady(DSI_ALLOC_HOOK fnHook_)
+{
+   fnSteadyHook = fnHook_;
+   bSteady = TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSIAllocAudit::Format(char *pcBuffer_, ULONG ulSize_)
+{
+   ULONG ulLength = 0;
+   int iLength;
+
+   if (ulSize_ == 0)
+      return 0;
+   pcBuffer_[0] = '\0';
+
+   if (!IsEnabled())
+   {
+      iLength = SNPRINTF(pcBuffer_, ulSize_, "Allocation audit not enabled (build with DSI_ALLOC_AUDIT)\n");
+      return (iLength < 0 || (ULONG)iLength >= ulSize_) ? 0 : (ULONG)iLength;
+   }
+
+   // Counting needs the allocation to go through operator new or DSI_MALLOC() (see dsi_alloc.h).
+   iLength = SNPRINTF(pcBuffer_, ulSize_, "Counts operator new, DSI_MALLOC() and POWER_MALLOC(); other malloc() calls (C library, system libraries) are not seen\n"
+      "%-24s %-9s %12s %14s %12s\n", "Thread", "Subsystem", "Allocs", "Bytes", bSteady ? "Steady" : "(starting)");
+   if (iLength < 0 || (ULONG)iLength >= ulSize_)
+      return 0;
+   ulLength = (ULONG)iLength;
+
+   ULONG ulThreads = MIN(ulThreadCount, (ULONG)DSI_ALLOC_MAX_THREADS);
+   for (ULONG i = 0; i < ulThreads; i++)
+   {
+      THREAD_COUNTS *pstCounts = &astThreads[i];
+      char acName[DSI_ALLOC_MAX_NAME];
+
+      GetThreadName(i, acName);
+
+      for (UCHAR j = 0; j < DSI_ALLOC_SUBSYSTEMS; j++)
+      {
+         ULLONG ullAllocs = LoadCount(&pstCounts->aullAllocs[j]);
+         if (ullAllocs == 0)
+            continue;
+
+         iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "%-24s %-9s %12llu %14llu %12llu\n", acName, apcSubsystemNames[j],
+            ullAllocs, LoadCount(&pstCounts->aullBytes[j]), LoadCount(&pstCounts->aullSteadyAllocs[j]));
+         if (iLength < 0 || ulLength + iLength >= ulSize_)
+            return ulLength;
+         ulLength += iLength;
+      }
+
+      iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "%-24s %-9s %12llu\n", acName, "(frees)", LoadCount(&pstCounts->ullFrees));
+      if (iLength < 0 || ulLength + iLength >= ulSize_)
+         return ulLength;
+      ulLength += iLength;
+   }
+
+   return ulLength;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSIAllocAudit::StatsCollector(void* /*pvContext_*/, char *pcBuffer_, ULONG ulSize_)
+{
+   static const char *apcNames[] = { "ant_alloc_total", "ant_alloc_bytes_total", "ant_alloc_steady_total" };
+   ULONG ulLength = 0;
+   int iLength;
+
+   if (!IsEnabled())
+      return 0;
+
+   ULONG ulThreads = MIN(ulThreadCount, (ULONG)DSI_ALLOC_MAX_THREADS);
+   for (int i = 0; i < (int)(sizeof(apcNames) / sizeof(apcNames[0])); i++)
+   {
+      iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "# TYPE %s counter\n", apcNames[i]);
+      if (iLength < 0 || ulLength + iLength >= ulSize_ - 1)
+         return ulLength;
+      ulLength += iLength;
+
+      for (ULONG j = 0; j < ulThreads; j++)
+      {
+         char acName[DSI_ALLOC_MAX_NAME];
+         GetThreadName(j, acName);
+
+         for (UCHAR k = 0; k < DSI_ALLOC_SUBSYSTEMS; k++)
+         {
+            ULLONG ullValue;
+
+            if (LoadCount(&astThreads[j].aullAllocs[k]) == 0)
+               continue;
+
+            if (i == 0)
+               ullValue = LoadCount(&astThreads[j].aullAllocs[k]);
+            else if (i == 1)
+               ullValue = LoadCount(&astThreads[j].aullBytes[k]);
+            else
+               ullValue = LoadCount(&astThreads[j].aullSteadyAllocs[k]);
+
+            iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "%s{thread=\"%s\",slot=\"%lu\",subsystem=\"%s\"} %llu\n",
+               apcNames[i], acName, j, apcSubsystemNames[k], ullValue);
+            if (iLength < 0 || ulLength + iLength >= ulSize_ - 1)
+               return ulLength;
+            ulLength += iLength;
+         }
+      }
+   }
+
+   return ulLength;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIAllocAudit::CountAlloc(ULONG ulSize_)
+{
+   if (bInHook)
+      return;
+
+   THREAD_COUNTS *pstCounts = GetThreadCounts();
+   UCHAR ucSubsystem = ucThreadSubsystem;
+
+   AddCount(&pstCounts->aullAllocs[ucSubsystem], 1);
+   AddCount(&pstCounts->aullBytes[ucSubsystem], ulSize_);
+
+   if (bSteady)
+   {
+      AddCount(&pstCounts->aullSteadyAllocs[ucSubsystem], 1);
+
+      DSI_ALLOC_HOOK fnHook = fnSteadyHook;
+      if (fnHook != NULL)
+      {
+         bInHook = TRUE;
+         fnHook(ucSubsystem, ulSize_);
+         bInHook = FALSE;
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIAllocAudit::CountFree()
+{
+   if (bInHook)
+      return;
+
+   AddCount(&GetThreadCounts()->ullFrees, 1);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Returns the calling thread's slot, taking the next one the first time
+// the thread allocates.  Doesn't allocate.
+///////////////////////////////////////////////////////////////////////
+static THREAD_COUNTS* GetThreadCounts()
+{
+   if (pstThreadCounts == NULL)
+   {
+      ULONG ulSlot = NextSlot();
+      pstThreadCounts = &astThreads[MIN(ulSlot, (ULONG)SHARED_SLOT)];
+   }
+
+   return pstThreadCounts;
+}
+
+///////////////////////////////////////////////////////////////////////
+static void GetThreadName(ULONG ulSlot_, char *pcName_)
+{
+   if (ulSlot_ == SHARED_SLOT && ulThreadCount > DSI_ALLOC_MAX_THREADS)
+   {
+      SNPRINTF(pcName_, DSI_ALLOC_MAX_NAME, "(other threads)");
+      return;
+   }
+
+   memcpy(pcName_, astThreads[ulSlot_].acName, DSI_ALLOC_MAX_NAME);
+   pcName_[DSI_ALLOC_MAX_NAME - 1] = '\0';
+
+   if (pcName_[0] == '\0')
+      SNPRINTF(pcName_, DSI_ALLOC_MAX_NAME, "thread %lu", ulSlot_);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Replacement Operators
+//////////////////////////////////////////////////////////////////////////////////
+
+#if defined(DSI_ALLOC_AUDIT)
+
+void* operator new(size_t size)
+{
+   DSIAllocAudit::CountAlloc((ULONG)size);
+
+   void *pvMemory = malloc(size != 0 ? size : 1);
+   if (pvMemory == NULL)
+      throw std::bad_alloc();
+
+   return pvMemory;
+}
+
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+   DSIAllocAudit::CountAlloc((ULONG)size);
+   return malloc(size != 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+   return operator new(size, std::nothrow);
+}
+
+void operator delete(void *pvMemory) throw()
+{
+   if (pvMemory == NULL)
+      return;
+
+   DSIAllocAudit::CountFree();
+   free(pvMemory);
+}
+
+void operator delete[](void *pvMemory) throw()
+{
+   operator delete(pvMemory);
+}
+
+void operator delete(void *pvMemory, const std::nothrow_t&) throw()
+{
+   operator delete(pvMemory);
+}
+
+void operator delete[](void *pvMemory, const std::nothrow_t&) throw()
+{
+   operator delete(pvMemory);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Counting C Allocation Functions (see dsi_alloc.h)
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+extern "C" void* DSIAlloc_Malloc(size_t size_)
+{
+   DSIAllocAudit::CountAlloc((ULONG)size_);
+   return malloc(size_);
+}
+
+///////////////////////////////////////////////////////////////////////
+extern "C" void* DSIAlloc_Calloc(size_t count_, size_t size_)
+{
+   DSIAllocAudit::CountAlloc((ULONG)(count_ * size_));
+   return calloc(count_, size_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Counts as an allocation and a free of the old block; growing in place
+// doesn't move, but can't be relied on.
+///////////////////////////////////////////////////////////////////////
+extern "C" void* DSIAlloc_Realloc(void *pvMemory_, size_t size_)
+{
+   if (size_ != 0)
+      DSIAllocAudit::CountAlloc((ULONG)size_);
+
+   void *pvResult = realloc(pvMemory_, size_);
+   if (pvMemory_ != NULL && (pvResult != NULL || size_ == 0))
+      DSIAllocAudit::CountFree();
+
+   return pvResult;
+}
+
+///////////////////////////////////////////////////////////////////////
+extern "C" void DSIAlloc_Free(void *pvMemory_)
+{
+   if (pvMemory_ == NULL)
+      return;
+
+   DSIAllocAudit::CountFree();
+   free(pvMemory_);
+}
+
+#endif // defined(DSI_ALLOC_AUDIT)
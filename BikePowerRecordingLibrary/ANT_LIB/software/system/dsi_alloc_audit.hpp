@@ -0,0 +1,127 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_ALLOC_AUDIT_HPP)
+#define DSI_ALLOC_AUDIT_HPP
+
+#include "types.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+// Subsystems allocations are charged to.  A thread's allocations go to its
+// own subsystem (see DSI_ALLOC_THREAD) unless a DSI_ALLOC_SCOPE says
+// otherwise.
+#define DSI_ALLOC_OTHER                ((UCHAR) 0)
+#define DSI_ALLOC_SERIAL               ((UCHAR) 1)          // Serial and USB receive threads
+#define DSI_ALLOC_FRAMER               ((UCHAR) 2)          // Framing, queueing and command responses
+#define DSI_ALLOC_USB                  ((UCHAR) 3)          // USB device lists and handles
+#define DSI_ALLOC_ANTFS                ((UCHAR) 4)
+#define DSI_ALLOC_DEBUG                ((UCHAR) 5)          // Debug logging and stats
+#define DSI_ALLOC_TIMER                ((UCHAR) 6)
+#define DSI_ALLOC_DECODER              ((UCHAR) 7)          // The application's message handling and the power decoders
+#define DSI_ALLOC_SUBSYSTEMS           ((UCHAR) 8)
+
+#define DSI_ALLOC_MAX_THREADS          64                   // Threads after this share the last slot
+#define DSI_ALLOC_MAX_NAME             24
+
+// Called for each allocation made after MarkSteady(), with the allocator
+// already excluded for the calling thread, so it may allocate (eg. print a
+// stack trace) without recursing.
+typedef void (*DSI_ALLOC_HOOK)(UCHAR ucSubsystem_, ULONG ulSize_);
+
+// Building with DSI_ALLOC_AUDIT replaces the global operator new and delete,
+// and the DSI_MALLOC() family, with counting versions.  Without it these cost nothing and the report
+// is empty.
+#if defined(DSI_ALLOC_AUDIT)
+   #define DSI_ALLOC_THREAD(name, subsystem)    DSIAllocAudit::SetThread(name, subsystem)
+   #define DSI_ALLOC_SCOPE(subsystem)           DSIAllocScope clAllocScope(subsystem)
+#else
+   #define DSI_ALLOC_THREAD(name, subsystem)
+   #define DSI_ALLOC_SCOPE(subsystem)
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// Counts heap allocations per thread and per subsystem, to find what still
+// allocates once the receive path is running.
+//
+// Each thread counts into its own slot, so counting takes no lock.  Slots
+// are never reused; a thread that exits keeps its counts.  Only operator
+// new and the DSI_MALLOC() family (see dsi_alloc.h) are counted; malloc()
+// called directly, eg. by the C library or system libraries, is not seen.
+class DSIAllocAudit
+{
+   public:
+      static BOOL IsEnabled();
+      /////////////////////////////////////////////////////////////////
+      // Returns TRUE if the library was built with DSI_ALLOC_AUDIT.
+      /////////////////////////////////////////////////////////////////
+
+      static void SetThread(const char *pcName_, UCHAR ucSubsystem_);
+      /////////////////////////////////////////////////////////////////
+      // Names the calling thread in the report and sets the subsystem
+      // its allocations are charged to.  Use DSI_ALLOC_THREAD() so it
+      // compiles out of normal builds.
+      /////////////////////////////////////////////////////////////////
+
+      static UCHAR SetSubsystem(UCHAR ucSubsystem_);
+      /////////////////////////////////////////////////////////////////
+      // Changes the calling thread's subsystem.
+      // Returns the previous one.
+      /////////////////////////////////////////////////////////////////
+
+      static void MarkSteady(DSI_ALLOC_HOOK fnHook_ = (DSI_ALLOC_HOOK)NULL);
+      /////////////////////////////////////////////////////////////////
+      // Marks the end of start up.  Allocations after this are also
+      // counted as steady state allocations, which should stay at zero
+      // on the receive path.
+      // Parameters:
+      //    fnHook_:          Called for each steady state allocation,
+      //                      or NULL.
+      /////////////////////////////////////////////////////////////////
+
+      static ULONG Format(char *pcBuffer_, ULONG ulSize_);
+      /////////////////////////////////////////////////////////////////
+      // Writes a table of the counts for each thread and subsystem
+      // that has allocated.
+      // Returns the number of characters written, not counting the
+      // NULL.
+      /////////////////////////////////////////////////////////////////
+
+      static ULONG StatsCollector(void *pvContext_, char *pcBuffer_, ULONG ulSize_);
+      /////////////////////////////////////////////////////////////////
+      // A DSI_STATS_COLLECTOR that writes the counts in the stats
+      // exposition format.  pvContext_ is unused.
+      /////////////////////////////////////////////////////////////////
+
+      static void CountAlloc(ULONG ulSize_);
+      static void CountFree();
+      /////////////////////////////////////////////////////////////////
+      // Used by the replacement operators and DSI_MALLOC().
+      /////////////////////////////////////////////////////////////////
+};
+
+// Charges the calling thread's allocations to a subsystem until it goes
+// out of scope.
+class DSIAllocScope
+{
+   private:
+      UCHAR ucPrevious;
+
+   public:
+      DSIAllocScope(UCHAR ucSubsystem_) { ucPrevious = DSIAllocAudit::SetSubsystem(ucSubsystem_); }
+      ~DSIAllocScope() { DSIAllocAudit::SetSubsystem(ucPrevious); }
+};
+
+#endif // !defined(DSI_ALLOC_AUDIT_HPP)
@@ -13,11 +13,16 @@ All rights reserved.
 
 #include "types.h"
 #include "dsi_thread.h"
+#include "dsi_debug_binary.hpp"
 #include "macros.h"
 #include "defines.h"
+#include "dsi_alloc_audit.hpp"
+#include "dsi_alloc.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 
 
 
@@ -28,6 +33,7 @@ All rights reserved.
 
 #define TRUNCATE_ERROR           " *** TRUNCATED! ***"
 #define WRITE_ERROR              "\n*** WRITE ERROR ***\n"
+#define DROPPED_ERROR            "\n*** ERROR: %lu LOG RECORDS DROPPED! ***\n"
 
 #define MAX_NAME_LENGTH          255
 #define MAX_PORTS                ((UCHAR)255)
@@ -49,6 +55,34 @@ All rights reserved.
 #define FLUSH_PERCENT            ((UCHAR)50)
 #define FLUSH_CHECK_PERIOD       ((ULONG)5000)
 
+//Log ring defines//
+
+#define LOG_RING_SIZE            ((ULONG)0x10000)  //Per logging thread, must be a power of two
+#define LOG_RING_MASK            (LOG_RING_SIZE - 1)
+#define MAX_RINGS                ((UCHAR)32)       //Threads that can log
+#define LOG_DRAIN_PERIOD         ((ULONG)100)      //milliseconds
+#define LOG_BUFFER_WAIT          ((UCHAR)100)      //MUTEX_UNLOCK_DELAY periods to wait for room in a Buffer
+
+#define RECORD_ALIGN             ((USHORT)8)
+#define MAX_RECORD_DATA          ((USHORT)(DSI_DEBUG_MAX_STRLEN * 2))
+#define MAX_SERIAL_BYTES         ((USHORT)((DSI_DEBUG_MAX_STRLEN - 2) / 4))  //More than this can't be printed on one line
+
+//Record types
+#define RECORD_PAD               ((UCHAR)0)        //Fills the end of the ring so no record wraps
+#define RECORD_TEXT              ((UCHAR)1)        //ThreadWrite(): the message
+#define RECORD_SERIAL            ((UCHAR)2)        //SerialWrite(): [USHORT header length][header][data]
+#define RECORD_FORMAT            ((UCHAR)3)        //ThreadPrintf(): the raw arguments, 8 bytes each; strings are [USHORT length][characters]
+
+//Binary log defines//
+
+#define BINARY_MAX_PAYLOAD       ((ULONG)(MAX_RECORD_DATA * 2))      //A record's payload is never bigger than its ring record
+
+#if defined(_MSC_VER)
+   #define THREAD_LOCAL          __declspec(thread)
+#else
+   #define THREAD_LOCAL          __thread
+#endif
+
 
 BOOL DSIDebug::bInitialized = FALSE;
 
@@ -62,8 +96,10 @@ class Buffer
    Buffer(UCHAR* pucFilename_, UCHAR* pucDirectory_);
    ~Buffer();
    BOOL Add(UCHAR* pucString_, ULONG ulSize_);
+   BOOL HasRoom(ULONG ulSize_);
 
    void SetEnable(BOOL bEnable_);
+   BOOL IsEnabled();
    BOOL SetDirectory(const UCHAR* pucDirectory_);
 
  private:
@@ -103,15 +139,56 @@ class Buffer
 };
 
 
+//////////////////////////////////////////////////////////
+// Log Ring Class Declaration
+//////////////////////////////////////////////////////////
+
+typedef struct
+{
+   USHORT usSize;                //Whole record, a multiple of RECORD_ALIGN
+   UCHAR ucType;
+   UCHAR ucDestination;          //Thread number, or the port for serial records
+   USHORT usDataSize;            //Bytes following the header
+   USHORT usSerialSize;          //RECORD_SERIAL: bytes passed to SerialWrite()
+   ULLONG ullTime;               //Microseconds
+   const char* pcFormat;         //RECORD_FORMAT: the format, which must be a string constant
+} LOG_RECORD;
+
+//Records written by one thread and read by the log writer thread.
+//Neither side locks; each only writes its own index.
+class LogRing
+{
+ public:
+   LogRing(DSI_THREAD_IDNUM hThreadIDNum_);
+
+   LOG_RECORD* Reserve(USHORT usDataSize_);
+   void Commit();
+   LOG_RECORD* Peek();
+   void Pop();
+
+   DSI_THREAD_IDNUM hThreadIDNum;
+   volatile ULONG ulDropped;     //Records lost because the ring was full; written by the logging thread
+   ULONG ulDroppedReported;      //Written by the log writer thread
+
+ private:
+   volatile ULONG ulHead;        //Free running; written by the logging thread
+   volatile ULONG ulTail;        //Free running; written by the log writer thread
+   ULONG ulReserved;             //ulHead once the reserved record is committed
+
+   ULLONG aullData[LOG_RING_SIZE / sizeof(ULLONG)];   //ULLONG to align the records
+};
+
+
 //////////////////////////////////////////////////////////
 // Private Declarations
 //////////////////////////////////////////////////////////
 
 typedef struct _TASK_PROP
 {
-   _TASK_PROP(DSI_THREAD_IDNUM hThreadIDNum_, UCHAR* pucFilename_, UCHAR* pucDirectory_)
+   _TASK_PROP(DSI_THREAD_IDNUM hThreadIDNum_, const char* pcName_, UCHAR* pucFilename_, UCHAR* pucDirectory_)
    {
       hThreadIDNum = hThreadIDNum_;
+      SNPRINTF(acName, sizeof(acName), "%s", pcName_);
       pclBuffer = new Buffer(pucFilename_, pucDirectory_);
    }
 
@@ -122,15 +199,25 @@ typedef struct _TASK_PROP
    }
 
    DSI_THREAD_IDNUM hThreadIDNum;
+   char acName[MAX_NAME_LENGTH+1];
    Buffer* pclBuffer;
 } THREAD_PROP;
 
 //Private Function Declarations
 BOOL FindThreadNum(UCHAR* pucNum_);
+static LogRing* GetThreadRing();
+static void WriteRecord(LOG_RECORD* pstRecord_);
+static BOOL OpenBinaryFile();
+static void CloseBinaryFile();
+static void WriteBinary(UCHAR ucType_, UCHAR ucRing_, UCHAR ucDestination_, ULLONG ullTime_, const UCHAR* pucPayload_, ULONG ulSize_);
+static ULONG GetBinaryStringID(const char* pcString_, USHORT usLength_, UCHAR ucRing_, ULLONG ullTime_);
+static void WriteBinaryRecord(LOG_RECORD* pstRecord_, UCHAR ucRing_);
+static void DrainRings();
+static DSI_THREAD_RETURN LogWriterThread(void* pvParam_);
 
 
 //Private Variables
-ULONG ulStartTime;
+ULLONG ullStartTime;
 BOOL bWriteEnable;
 Buffer* apclSerialBuffer[MAX_PORTS];
 THREAD_PROP* apstThread[MAX_THREADS];
@@ -141,6 +228,58 @@ UCHAR aucExecutablePath[MAX_NAME_LENGTH];
 DSI_MUTEX stThreadBufferMutex;
 DSI_MUTEX stSerialBufferMutex;
 
+static LogRing* apclRings[MAX_RINGS];
+static volatile ULONG ulRingCount;
+static ULONG ulRingGeneration;               //Changes on every Init() so stale thread ring pointers are dropped
+static DSI_MUTEX stRingMutex;                //Serializes adding rings
+
+static DSI_THREAD_ID hLogWriterThread;
+static BOOL bLogWriterExit;
+static DSI_MUTEX stLogWriterMutex;
+static DSI_CONDITION_VAR stLogWriterCond;    //Wakes the writer early when a ring is half full
+static DSI_CONDITION_VAR stLogWriterExitCond;
+
+//Binary log; only the log writer thread touches the file and the string table
+static volatile BOOL bBinary;
+static volatile ULONG ulBinaryGeneration;    //Changes when the file should be (re)opened
+static ULONG ulBinaryFileGeneration;
+static FILE* pfBinaryFile;
+static ULLONG ullBinaryLastTime;             //Time of the last record written, for the deltas
+static char* apcBinaryStrings[DSI_DEBUG_BINARY_STRINGS];
+static USHORT ausBinaryStringLength[DSI_DEBUG_BINARY_STRINGS];
+static BOOL abBinaryThreadNamed[MAX_THREADS];
+static volatile BOOL bBinarySession;          //Set by ResetTime() for the writer
+
+static THREAD_LOCAL LogRing* pclThreadRing = (LogRing*)NULL;
+static THREAD_LOCAL ULONG ulThreadRingGeneration = 0;
+static THREAD_LOCAL UCHAR ucCachedThreadNum = MAX_THREADS;   //The calling thread's entry in apstThread; MAX_THREADS if unknown
+
+
+//////////////////////////////////////////////////////////
+// Ring Index Access
+//////////////////////////////////////////////////////////
+
+static inline ULONG LoadAcquire(volatile ULONG* pulIndex_)
+{
+#if defined(_MSC_VER)
+   ULONG ulIndex = *pulIndex_;
+   MemoryBarrier();
+   return ulIndex;
+#else
+   return __atomic_load_n(pulIndex_, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void StoreRelease(volatile ULONG* pulIndex_, ULONG ulIndex_)
+{
+#if defined(_MSC_VER)
+   MemoryBarrier();
+   *pulIndex_ = ulIndex_;
+#else
+   __atomic_store_n(pulIndex_, ulIndex_, __ATOMIC_RELEASE);
+#endif
+}
+
 
 //////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////
@@ -159,7 +298,7 @@ BOOL DSIDebug::Init()
    if(bInitialized)
       return TRUE;
 
-   ulStartTime = DSIThread_GetSystemTime();
+   ullStartTime = DSIThread_GetSystemTimeMicroseconds();
    bWriteEnable = FALSE;
 
    //Get the Directory of the executable
@@ -172,8 +311,27 @@ BOOL DSIDebug::Init()
    for(UCHAR i=0; i<MAX_THREADS; i++)
       apstThread[i] = (THREAD_PROP*)NULL;
 
+   for(UCHAR i=0; i<MAX_RINGS; i++)
+      apclRings[i] = (LogRing*)NULL;
+   ulRingCount = 0;
+   ulRingGeneration++;
+
+   bBinary = FALSE;
+   pfBinaryFile = (FILE*)NULL;
+   ulBinaryFileGeneration = ulBinaryGeneration - 1;
+   bBinarySession = FALSE;
+   for(ULONG i=0; i<DSI_DEBUG_BINARY_STRINGS; i++)
+      apcBinaryStrings[i] = (char*)NULL;
+
    DSIThread_MutexInit(&stThreadBufferMutex);
    DSIThread_MutexInit(&stSerialBufferMutex);
+   DSIThread_MutexInit(&stRingMutex);
+
+   DSIThread_MutexInit(&stLogWriterMutex);
+   DSIThread_CondInit(&stLogWriterCond);
+   DSIThread_CondInit(&stLogWriterExitCond);
+   bLogWriterExit = FALSE;
+   hLogWriterThread = DSIThread_CreateThread(&LogWriterThread, NULL);
 
    bInitialized = TRUE;
    return TRUE;
@@ -187,6 +345,23 @@ void DSIDebug::Close()
 
    bWriteEnable = FALSE;
 
+   //Stop the log writer; it drains the rings on the way out
+   DSIThread_MutexLock(&stLogWriterMutex);
+   if(hLogWriterThread)
+   {
+      bLogWriterExit = TRUE;
+      DSIThread_CondSignal(&stLogWriterCond);
+
+      if(DSIThread_CondTimedWait(&stLogWriterExitCond, &stLogWriterMutex, 3000) != DSI_THREAD_ENONE)
+         DSIThread_DestroyThread(hLogWriterThread);
+
+      DSIThread_ReleaseThreadID(hLogWriterThread);
+      hLogWriterThread = (DSI_THREAD_ID)NULL;
+   }
+   DSIThread_MutexUnlock(&stLogWriterMutex);
+
+   CloseBinaryFile();
+
    //Clean up all the buffers
    DSIThread_MutexLock(&stSerialBufferMutex);
    for(UCHAR i=0; i<MAX_PORTS; i++)
@@ -210,11 +385,27 @@ void DSIDebug::Close()
    }
    DSIThread_MutexUnlock(&stThreadBufferMutex);
 
+   DSIThread_MutexLock(&stRingMutex);
+   ulRingCount = 0;
+   for(UCHAR i=0; i<MAX_RINGS; i++)
+   {
+      if(apclRings[i] != NULL)
+      {
+         delete apclRings[i];
+         apclRings[i] = (LogRing*)NULL;
+      }
+   }
+   DSIThread_MutexUnlock(&stRingMutex);
+
 
    DSIThread_Sleep(MUTEX_UNLOCK_DELAY);  //Wait for any functions that have the mutex to unlock them.
 
    DSIThread_MutexDestroy(&stThreadBufferMutex);
    DSIThread_MutexDestroy(&stSerialBufferMutex);
+   DSIThread_MutexDestroy(&stRingMutex);
+   DSIThread_MutexDestroy(&stLogWriterMutex);
+   DSIThread_CondDestroy(&stLogWriterCond);
+   DSIThread_CondDestroy(&stLogWriterExitCond);
 
    bInitialized = FALSE;
    return;
@@ -225,11 +416,17 @@ BOOL DSIDebug::ResetTime()
    if(!bInitialized)
       return FALSE;
 
-   ulStartTime = DSIThread_GetSystemTime();
+   ullStartTime = DSIThread_GetSystemTimeMicroseconds();
 
    if(!bWriteEnable)
        return FALSE;
 
+   if(bBinary)
+   {
+      bBinarySession = TRUE;
+      return TRUE;
+   }
+
    for(UCHAR i=0; i<MAX_THREADS; i++)
    {
       if(apstThread[i] != NULL)
@@ -266,6 +463,21 @@ BOOL DSIDebug::SetDirectory(const char* pcDirectory_)
          apclSerialBuffer[i]->SetDirectory(aucLogDirectory);
    }
 
+   ulBinaryGeneration++;
+   return TRUE;
+}
+
+BOOL DSIDebug::SetBinary(BOOL bBinary_)
+{
+   if(!bInitialized)
+      return FALSE;
+
+   if(bBinary != bBinary_)
+   {
+      bBinary = bBinary_;
+      ulBinaryGeneration++;
+   }
+
    return TRUE;
 }
 
@@ -306,7 +518,7 @@ BOOL DSIDebug::ThreadInit(const char* pucName_)
          SNPRINTF((char*)aucString, MAX_NAME_LENGTH+20, "ao_debug_Thread%u.txt", DSIThread_GetCurrentThreadIDNum());
       #endif
 
-   apstThread[ucThreadNum] = new THREAD_PROP(DSIThread_GetCurrentThreadIDNum(), aucString, aucLogDirectory);
+   apstThread[ucThreadNum] = new THREAD_PROP(DSIThread_GetCurrentThreadIDNum(), pucName_, aucString, aucLogDirectory);
 
    DSIThread_MutexUnlock(&stThreadBufferMutex);
 
@@ -331,21 +543,141 @@ BOOL DSIDebug::ThreadWrite(const char* pcMessage_)
    if(!FindThreadNum(&ucThreadNum))
       return FALSE;
 
-   if(apstThread[ucThreadNum] == NULL)
+   if(apstThread[ucThreadNum] == NULL || !apstThread[ucThreadNum]->pclBuffer->IsEnabled())
       return FALSE;
 
+   LogRing* pclRing = GetThreadRing();
+   if(pclRing == NULL)
+      return FALSE;
 
-   char acString[DSI_DEBUG_MAX_STRLEN];
-   ULONG ulCurrentTime = DSIThread_GetSystemTime();
+   //Longer messages are truncated when they are printed anyway
+   size_t uLength = strlen(pcMessage_);
+   USHORT usDataSize = (USHORT)MIN(uLength, (size_t)DSI_DEBUG_MAX_STRLEN);
 
-   SNPRINTF(acString, DSI_DEBUG_MAX_STRLEN, "%10.3f {%10lu}: %s\n", (ulCurrentTime-ulStartTime)/1000.0, ulCurrentTime, pcMessage_);
-   ULONG totalLen = strlen(acString);
+   LOG_RECORD* pstRecord = pclRing->Reserve(usDataSize);
+   if(pstRecord == NULL)
+      return FALSE;
 
-   //If we are too long, than overwrite the truncate error to the end
-   if(totalLen >= DSI_DEBUG_MAX_STRLEN-1)
-      SNPRINTF(acString + DSI_DEBUG_MAX_STRLEN - 2 - strlen(TRUNCATE_ERROR), strlen(TRUNCATE_ERROR)+2, "%s\n", TRUNCATE_ERROR);
+   pstRecord->ucType = RECORD_TEXT;
+   pstRecord->ucDestination = ucThreadNum;
+   pstRecord->ullTime = DSIThread_GetSystemTimeMicroseconds();
+   memcpy(pstRecord + 1, pcMessage_, usDataSize);
+   pclRing->Commit();
+
+   return TRUE;
+}
+
+BOOL DSIDebug::ThreadPrintf(const char* pcFormat_, ...)
+{
+   if(!bInitialized || pcFormat_ == NULL)
+      return FALSE;
+
+   if(!bWriteEnable)
+      return FALSE;
+
+   //Find the index of the proper thread property struct
+   UCHAR ucThreadNum;
+   if(!FindThreadNum(&ucThreadNum))
+      return FALSE;
 
-   return apstThread[ucThreadNum]->pclBuffer->Add((UCHAR*)acString, totalLen);
+   if(apstThread[ucThreadNum] == NULL || !apstThread[ucThreadNum]->pclBuffer->IsEnabled())
+      return FALSE;
+
+   LogRing* pclRing = GetThreadRing();
+   if(pclRing == NULL)
+      return FALSE;
+
+   //Pull the arguments off the stack as the format describes them.
+   //The string is only scanned here; it is formatted by the log writer.
+   UCHAR aucArgs[MAX_RECORD_DATA];
+   USHORT usArgSize = 0;
+   BOOL bText = FALSE;
+   va_list args;
+
+   va_start(args, pcFormat_);
+   for(const char* pcPos = pcFormat_; *pcPos != '\0';)
+   {
+      if(*pcPos != '%')
+      {
+         pcPos++;
+         continue;
+      }
+
+      char acSpec[DSI_DEBUG_MAX_SPEC_LENGTH];
+      UCHAR ucArgType;
+      pcPos += DSIDebugBinary::ParseConversion(pcPos, acSpec, &ucArgType);
+
+      SLLONG sllValue = 0;
+      double dValue = 0;
+      const char* pcString = (const char*)NULL;
+      switch(ucArgType)
+      {
+         case DSI_DEBUG_ARG_INT:     sllValue = va_arg(args, int); break;
+         case DSI_DEBUG_ARG_LONG:    sllValue = va_arg(args, long); break;
+         case DSI_DEBUG_ARG_LLONG:   sllValue = va_arg(args, SLLONG); break;
+         case DSI_DEBUG_ARG_POINTER: sllValue = (SLLONG)(size_t)va_arg(args, void*); break;
+         case DSI_DEBUG_ARG_DOUBLE:  dValue = va_arg(args, double); break;
+         case DSI_DEBUG_ARG_STRING:  pcString = va_arg(args, const char*); break;
+         case DSI_DEBUG_ARG_UNSUPPORTED: bText = TRUE; break;
+         default:          continue;
+      }
+
+      if(bText)
+         break;
+
+      //Arguments that don't fit are dropped; the printed line shows it
+      if(ucArgType == DSI_DEBUG_ARG_STRING)
+      {
+         if(pcString == NULL)
+            pcString = "(null)";
+
+         USHORT usLength = (USHORT)MIN(strlen(pcString), (size_t)DSI_DEBUG_MAX_STRLEN);
+         if(usArgSize + sizeof(USHORT) + usLength > MAX_RECORD_DATA)
+            break;
+
+         memcpy(&aucArgs[usArgSize], &usLength, sizeof(USHORT));
+         memcpy(&aucArgs[usArgSize + sizeof(USHORT)], pcString, usLength);
+         usArgSize += (USHORT)(sizeof(USHORT) + usLength);
+      }
+      else
+      {
+         if(usArgSize + sizeof(ULLONG) > MAX_RECORD_DATA)
+            break;
+
+         if(ucArgType == DSI_DEBUG_ARG_DOUBLE)
+            memcpy(&aucArgs[usArgSize], &dValue, sizeof(ULLONG));
+         else
+            memcpy(&aucArgs[usArgSize], &sllValue, sizeof(ULLONG));
+         usArgSize += sizeof(ULLONG);
+      }
+   }
+   va_end(args);
+
+   //The arguments can't be recorded, so the message is formatted now and logged as text
+   if(bText)
+   {
+      char acMessage[DSI_DEBUG_MAX_STRLEN];
+
+      va_start(args, pcFormat_);
+      VSNPRINTF(acMessage, sizeof(acMessage), pcFormat_, args);
+      va_end(args);
+      acMessage[sizeof(acMessage) - 1] = '\0';
+
+      return ThreadWrite(acMessage);
+   }
+
+   LOG_RECORD* pstRecord = pclRing->Reserve(usArgSize);
+   if(pstRecord == NULL)
+      return FALSE;
+
+   pstRecord->ucType = RECORD_FORMAT;
+   pstRecord->ucDestination = ucThreadNum;
+   pstRecord->ullTime = DSIThread_GetSystemTimeMicroseconds();
+   pstRecord->pcFormat = pcFormat_;
+   memcpy(pstRecord + 1, aucArgs, usArgSize);
+   pclRing->Commit();
+
+   return TRUE;
 }
 
 BOOL DSIDebug::ThreadEnable(BOOL bEnable_)
@@ -395,39 +727,38 @@ BOOL DSIDebug::SerialWrite(UCHAR ucPortNum_, const char* pcHeader_, UCHAR* pucDa
       DSIThread_MutexUnlock(&stSerialBufferMutex);
    }
 
-   if(apclSerialBuffer[ucPortNum_] == NULL || !bWriteEnable)
+   if(apclSerialBuffer[ucPortNum_] == NULL || !bWriteEnable || !apclSerialBuffer[ucPortNum_]->IsEnabled())
       return FALSE;
 
-   //Get the current time
-   ULONG ulCurrentTime = DSIThread_GetSystemTime();
+   LogRing* pclRing = GetThreadRing();
+   if(pclRing == NULL)
+      return FALSE;
 
-   //Compose the string
-   char acString[DSI_DEBUG_MAX_STRLEN];
-   SNPRINTF(acString, DSI_DEBUG_MAX_STRLEN, "%10.3f {%10lu} %s - %s", (ulCurrentTime-ulStartTime)/1000.0, ulCurrentTime, pcHeader_ != NULL ? (char*)pcHeader_ : "NULL", usSize_ == 0 ? "NO DATA\n" : "");
-   ULONG ulStringLength = strlen(acString);
+   //Copy the header and the bytes that can be printed; the log writer makes the hex dump
+   if(pcHeader_ == NULL)
+      pcHeader_ = "NULL";
+   if(pucData_ == NULL)
+      usSize_ = 0;
 
-   if(usSize_ != 0 && ulStringLength < (DSI_DEBUG_MAX_STRLEN - 6))   //6 is room to display at least one byte
-   {
-      //Write all the bytes we can and put '\n' on the last one
-      char* currentPos = acString + ulStringLength;
-      USHORT usMaxDataCount = (USHORT)MIN(usSize_, (DSI_DEBUG_MAX_STRLEN-2-ulStringLength)/4); //2 is room for the closing "\n\0"
-      for(USHORT i=0; i < usMaxDataCount-1; ++i)
-      {
-         SNPRINTF(currentPos, 5, "[%02X]", pucData_[i]);
-         currentPos += 4;
-      }
-      SNPRINTF(currentPos, 6, "[%02X]\n", pucData_[usMaxDataCount-1]);
+   USHORT usHeaderLength = (USHORT)MIN(strlen(pcHeader_), (size_t)(DSI_DEBUG_MAX_STRLEN-1));
+   USHORT usDataCount = MIN(usSize_, MAX_SERIAL_BYTES);
 
-      //Update our string length
-      ulStringLength += ((ULONG)usMaxDataCount*4) + 1; //4*bytes + '\n'
-   }
+   LOG_RECORD* pstRecord = pclRing->Reserve((USHORT)(sizeof(USHORT) + usHeaderLength + usDataCount));
+   if(pstRecord == NULL)
+      return FALSE;
 
-   //If we are too long, than overwrite the truncate error to the end
-   if(ulStringLength >= DSI_DEBUG_MAX_STRLEN-1)
-      SNPRINTF(acString + DSI_DEBUG_MAX_STRLEN - 2 - strlen(TRUNCATE_ERROR), strlen(TRUNCATE_ERROR)+2, "%s\n", TRUNCATE_ERROR);
+   UCHAR* pucRecordData = (UCHAR*)(pstRecord + 1);
+   pstRecord->ucType = RECORD_SERIAL;
+   pstRecord->ucDestination = ucPortNum_;
+   pstRecord->usSerialSize = usSize_;
+   pstRecord->ullTime = DSIThread_GetSystemTimeMicroseconds();
+   memcpy(pucRecordData, &usHeaderLength, sizeof(USHORT));
+   memcpy(pucRecordData + sizeof(USHORT), pcHeader_, usHeaderLength);
+   if(usDataCount)
+      memcpy(pucRecordData + sizeof(USHORT) + usHeaderLength, pucData_, usDataCount);
+   pclRing->Commit();
 
-   //Add the string to the buffer
-   return apclSerialBuffer[ucPortNum_]->Add((UCHAR*)acString, ulStringLength);
+   return TRUE;
 }
 
 BOOL DSIDebug::SerialEnable(UCHAR ucPortNum_, BOOL bEnable_)
@@ -460,6 +791,13 @@ BOOL FindThreadNum(UCHAR* pucNum_)
    if(pucNum_ == NULL)
       return FALSE;
 
+   //Once a thread has found its entry it keeps it until Close()
+   if(ulThreadRingGeneration == ulRingGeneration && ucCachedThreadNum < MAX_THREADS && apstThread[ucCachedThreadNum] != NULL)
+   {
+      *pucNum_ = ucCachedThreadNum;
+      return TRUE;
+   }
+
    UCHAR i;
    BOOL bNotFull = FALSE;
    DSI_THREAD_IDNUM hThreadIDNum = DSIThread_GetCurrentThreadIDNum();
@@ -470,6 +808,8 @@ BOOL FindThreadNum(UCHAR* pucNum_)
          if(DSIThread_CompareThreads(hThreadIDNum, apstThread[i]->hThreadIDNum))
          {
             *pucNum_ = i;
+            if(ulThreadRingGeneration == ulRingGeneration)
+               ucCachedThreadNum = i;
             return TRUE;
          }
       }
@@ -483,6 +823,575 @@ BOOL FindThreadNum(UCHAR* pucNum_)
    return bNotFull;
 }
 
+//Returns the calling thread's log ring, adding one the first time the
+//thread logs.  Returns NULL if every ring is taken.
+static LogRing* GetThreadRing()
+{
+   if(pclThreadRing != NULL && ulThreadRingGeneration == ulRingGeneration)
+      return pclThreadRing;
+
+   DSI_THREAD_IDNUM hThreadIDNum = DSIThread_GetCurrentThreadIDNum();
+   LogRing* pclRing = (LogRing*)NULL;
+
+   DSIThread_MutexLock(&stRingMutex);
+
+   //A thread ID is only reused once its thread has ended, so its ring can be taken over
+   for(ULONG i=0; i<ulRingCount; i++)
+   {
+      if(DSIThread_CompareThreads(hThreadIDNum, apclRings[i]->hThreadIDNum))
+      {
+         pclRing = apclRings[i];
+         break;
+      }
+   }
+
+   if(pclRing == NULL && ulRingCount < MAX_RINGS)
+   {
+      pclRing = new LogRing(hThreadIDNum);
+      apclRings[ulRingCount] = pclRing;
+      StoreRelease(&ulRingCount, ulRingCount + 1);
+   }
+
+   DSIThread_MutexUnlock(&stRingMutex);
+
+   if(pclRing == NULL)
+      return (LogRing*)NULL;
+
+   pclThreadRing = pclRing;
+   ulThreadRingGeneration = ulRingGeneration;
+   ucCachedThreadNum = MAX_THREADS;
+   return pclRing;
+}
+
+//Formats a record into its log line, the same as the old direct writes
+//did, and adds it to the destination file's buffer.
+static void WriteRecord(LOG_RECORD* pstRecord_)
+{
+   Buffer* pclBuffer;
+   const UCHAR* pucData = (const UCHAR*)(pstRecord_ + 1);
+   char acMessage[DSI_DEBUG_MAX_STRLEN];
+   char acString[DSI_DEBUG_MAX_STRLEN];
+   ULONG ulStringLength;
+   ULONG ulCurrentTime = (ULONG)(pstRecord_->ullTime / 1000);
+   double dElapsed = (double)(SLLONG)(pstRecord_->ullTime - ullStartTime) / 1000000.0;
+
+   if(pstRecord_->ucType == RECORD_SERIAL)
+   {
+      pclBuffer = apclSerialBuffer[pstRecord_->ucDestination];
+      if(pclBuffer == NULL)
+         return;
+
+      USHORT usHeaderLength;
+      memcpy(&usHeaderLength, pucData, sizeof(USHORT));
+      USHORT usDataCount = (USHORT)(pstRecord_->usDataSize - sizeof(USHORT) - usHeaderLength);
+      const UCHAR* pucSerialData = pucData + sizeof(USHORT) + usHeaderLength;
+
+      memcpy(acMessage, pucData + sizeof(USHORT), usHeaderLength);
+      acMessage[usHeaderLength] = '\0';
+
+      SNPRINTF(acString, DSI_DEBUG_MAX_STRLEN, "%10.3f {%10lu} %s - %s", dElapsed, ulCurrentTime, acMessage, pstRecord_->usSerialSize == 0 ? "NO DATA\n" : "");
+      ulStringLength = strlen(acString);
+
+      if(usDataCount != 0 && ulStringLength < (DSI_DEBUG_MAX_STRLEN - 6))   //6 is room to display at least one byte
+      {
+         //Write all the bytes we can and put '\n' on the last one
+         char* currentPos = acString + ulStringLength;
+         USHORT usMaxDataCount = (USHORT)MIN(usDataCount, (DSI_DEBUG_MAX_STRLEN-2-ulStringLength)/4); //2 is room for the closing "\n\0"
+         for(USHORT i=0; i < usMaxDataCount-1; ++i)
+         {
+            SNPRINTF(currentPos, 5, "[%02X]", pucSerialData[i]);
+            currentPos += 4;
+         }
+         SNPRINTF(currentPos, 6, "[%02X]\n", pucSerialData[usMaxDataCount-1]);
+
+         //Update our string length
+         ulStringLength += ((ULONG)usMaxDataCount*4) + 1; //4*bytes + '\n'
+      }
+   }
+   else
+   {
+      if(apstThread[pstRecord_->ucDestination] == NULL)
+         return;
+      pclBuffer = apstThread[pstRecord_->ucDestination]->pclBuffer;
+
+      if(pstRecord_->ucType == RECORD_TEXT)
+      {
+         memcpy(acMessage, pucData, MIN(pstRecord_->usDataSize, DSI_DEBUG_MAX_STRLEN-1));
+         acMessage[MIN(pstRecord_->usDataSize, DSI_DEBUG_MAX_STRLEN-1)] = '\0';
+      }
+      else
+      {
+         //RECORD_FORMAT: format one conversion at a time from the saved arguments
+         USHORT usArg = 0;
+         ULONG ulLength = 0;
+         const char* pcPos = pstRecord_->pcFormat;
+
+         acMessage[0] = '\0';
+         while(*pcPos != '\0' && ulLength < DSI_DEBUG_MAX_STRLEN - 1)
+         {
+            if(*pcPos != '%')
+            {
+               acMessage[ulLength++] = *pcPos++;
+               acMessage[ulLength] = '\0';
+               continue;
+            }
+
+            char acSpec[DSI_DEBUG_MAX_SPEC_LENGTH];
+            UCHAR ucArgType;
+            SLLONG sllValue = 0;
+            double dValue = 0;
+            char acArgString[DSI_DEBUG_MAX_STRLEN + 1];
+            pcPos += DSIDebugBinary::ParseConversion(pcPos, acSpec, &ucArgType);
+
+            if(ucArgType == DSI_DEBUG_ARG_STRING)
+            {
+               USHORT usLength;
+               if(usArg + sizeof(USHORT) > pstRecord_->usDataSize)
+                  break;                              //Argument didn't fit in the record
+               memcpy(&usLength, &pucData[usArg], sizeof(USHORT));
+               memcpy(acArgString, &pucData[usArg + sizeof(USHORT)], usLength);
+               acArgString[usLength] = '\0';
+               usArg += (USHORT)(sizeof(USHORT) + usLength);
+            }
+            else if(ucArgType != DSI_DEBUG_ARG_LITERAL && ucArgType != DSI_DEBUG_ARG_PERCENT)
+            {
+               if(usArg + sizeof(ULLONG) > pstRecord_->usDataSize)
+                  break;
+               memcpy(ucArgType == DSI_DEBUG_ARG_DOUBLE ? (void*)&dValue : (void*)&sllValue, &pucData[usArg], sizeof(ULLONG));
+               usArg += sizeof(ULLONG);
+            }
+
+            char* pcOut = acMessage + ulLength;
+            size_t uRoom = DSI_DEBUG_MAX_STRLEN - ulLength;
+            switch(ucArgType)
+            {
+               case DSI_DEBUG_ARG_INT:     SNPRINTF(pcOut, uRoom, acSpec, (int)sllValue); break;
+               case DSI_DEBUG_ARG_LONG:    SNPRINTF(pcOut, uRoom, acSpec, (long)sllValue); break;
+               case DSI_DEBUG_ARG_LLONG:   SNPRINTF(pcOut, uRoom, acSpec, sllValue); break;
+               case DSI_DEBUG_ARG_DOUBLE:  SNPRINTF(pcOut, uRoom, acSpec, dValue); break;
+               case DSI_DEBUG_ARG_POINTER: SNPRINTF(pcOut, uRoom, acSpec, (void*)(size_t)sllValue); break;
+               case DSI_DEBUG_ARG_STRING:  SNPRINTF(pcOut, uRoom, acSpec, acArgString); break;
+               case DSI_DEBUG_ARG_PERCENT: SNPRINTF(pcOut, uRoom, "%%"); break;
+               default:          SNPRINTF(pcOut, uRoom, "%s", acSpec); break;
+            }
+            ulLength += (ULONG)strlen(pcOut);
+         }
+
+         if(*pcPos != '\0' && ulLength < DSI_DEBUG_MAX_STRLEN - 1)
+            SNPRINTF(acMessage + ulLength, DSI_DEBUG_MAX_STRLEN - ulLength, "%s", TRUNCATE_ERROR);
+      }
+
+      SNPRINTF(acString, DSI_DEBUG_MAX_STRLEN, "%10.3f {%10lu}: %s\n", dElapsed, ulCurrentTime, acMessage);
+      ulStringLength = strlen(acString);
+   }
+
+   //If we are too long, than overwrite the truncate error to the end
+   if(ulStringLength >= DSI_DEBUG_MAX_STRLEN-1)
+      SNPRINTF(acString + DSI_DEBUG_MAX_STRLEN - 2 - strlen(TRUNCATE_ERROR), strlen(TRUNCATE_ERROR)+2, "%s\n", TRUNCATE_ERROR);
+
+   //Give the buffer's write thread a chance to catch up rather than overflow
+   for(UCHAR i=0; i<LOG_BUFFER_WAIT && pclBuffer->IsEnabled() && !pclBuffer->HasRoom(ulStringLength); i++)
+      DSIThread_Sleep(MUTEX_UNLOCK_DELAY);
+
+   pclBuffer->Add((UCHAR*)acString, ulStringLength);
+}
+
+//Opens the binary log in the log directory, once for each change of
+//directory or mode.  A new file starts with the header and needs the
+//strings and thread names sent again.
+static BOOL OpenBinaryFile()
+{
+   if(ulBinaryFileGeneration == ulBinaryGeneration)
+      return (pfBinaryFile != NULL);
+
+   CloseBinaryFile();
+   ulBinaryFileGeneration = ulBinaryGeneration;
+
+   char acPath[MAX_NAME_LENGTH + sizeof(DSI_DEBUG_BINARY_FILENAME)];
+   SNPRINTF(acPath, sizeof(acPath), "%s%s", aucLogDirectory, DSI_DEBUG_BINARY_FILENAME);
+   pfBinaryFile = FOPEN(acPath, "wb");
+   if(pfBinaryFile == NULL)
+      return FALSE;
+
+   UCHAR aucHeader[DSI_DEBUG_BINARY_MAGIC_SIZE + sizeof(ULLONG)];
+   memcpy(aucHeader, DSI_DEBUG_BINARY_MAGIC, DSI_DEBUG_BINARY_MAGIC_SIZE);
+   for(UCHAR i=0; i<sizeof(ULLONG); i++)
+      aucHeader[DSI_DEBUG_BINARY_MAGIC_SIZE + i] = (UCHAR)(ullStartTime >> (i * 8));
+   fwrite(aucHeader, sizeof(UCHAR), sizeof(aucHeader), pfBinaryFile);
+
+   ullBinaryLastTime = ullStartTime;
+   for(UCHAR i=0; i<MAX_THREADS; i++)
+      abBinaryThreadNamed[i] = FALSE;
+
+   return TRUE;
+}
+
+static void CloseBinaryFile()
+{
+   if(pfBinaryFile != NULL)
+   {
+      fclose(pfBinaryFile);
+      pfBinaryFile = (FILE*)NULL;
+   }
+
+   for(ULONG i=0; i<DSI_DEBUG_BINARY_STRINGS; i++)
+   {
+      if(apcBinaryStrings[i] != NULL)
+      {
+         DSI_FREE(apcBinaryStrings[i]);
+         apcBinaryStrings[i] = (char*)NULL;
+      }
+   }
+}
+
+//Writes one record to the binary log: the header, then the payload.
+static void WriteBinary(UCHAR ucType_, UCHAR ucRing_, UCHAR ucDestination_, ULLONG ullTime_, const UCHAR* pucPayload_, ULONG ulSize_)
+{
+   UCHAR aucHeader[2 + (2 * DSI_DEBUG_BINARY_MAX_VARINT)];
+   ULONG ulHeaderSize = 2;
+
+   aucHeader[0] = (UCHAR)(ucType_ | (ucRing_ << 3));
+   aucHeader[1] = ucDestination_;
+   ulHeaderSize += DSIDebugBinary::PutSignedVarint(&aucHeader[ulHeaderSize], (SLLONG)(ullTime_ - ullBinaryLastTime));
+   ulHeaderSize += DSIDebugBinary::PutVarint(&aucHeader[ulHeaderSize], ulSize_);
+   ullBinaryLastTime = ullTime_;
+
+   fwrite(aucHeader, sizeof(UCHAR), ulHeaderSize, pfBinaryFile);
+   if(ulSize_)
+      fwrite(pucPayload_, sizeof(UCHAR), ulSize_, pfBinaryFile);
+}
+
+//Returns the id of a format or serial header, sending the string first
+//if the decoder doesn't have it.  The id is a slot picked by hash; a
+//different string landing on it replaces the old one.
+static ULONG GetBinaryStringID(const char* pcString_, USHORT usLength_, UCHAR ucRing_, ULLONG ullTime_)
+{
+   ULONG ulHash = 2166136261UL;              //FNV-1a
+   for(USHORT i=0; i<usLength_; i++)
+      ulHash = (ULONG)(((ulHash ^ (UCHAR)pcString_[i]) * 16777619UL) & 0xFFFFFFFFUL);
+
+   ULONG ulID = ulHash % DSI_DEBUG_BINARY_STRINGS;
+   if(apcBinaryStrings[ulID] != NULL && ausBinaryStringLength[ulID] == usLength_ && memcmp(apcBinaryStrings[ulID], pcString_, usLength_) == 0)
+      return ulID;
+
+   if(apcBinaryStrings[ulID] != NULL)
+      DSI_FREE(apcBinaryStrings[ulID]);
+   apcBinaryStrings[ulID] = (char*)DSI_MALLOC(usLength_ + 1);
+   if(apcBinaryStrings[ulID] != NULL)
+   {
+      memcpy(apcBinaryStrings[ulID], pcString_, usLength_);
+      ausBinaryStringLength[ulID] = usLength_;
+   }
+
+   UCHAR aucPayload[DSI_DEBUG_BINARY_MAX_VARINT + DSI_DEBUG_MAX_STRLEN];
+   ULONG ulSize = DSIDebugBinary::PutVarint(aucPayload, ulID);
+   memcpy(&aucPayload[ulSize], pcString_, usLength_);
+   WriteBinary(DSI_DEBUG_BINARY_STRING, ucRing_, 0, ullTime_, aucPayload, ulSize + usLength_);
+
+   return ulID;
+}
+
+//Writes a record to the binary log.  Nothing is formatted; integer
+//arguments become varints and strings are sent once and then referred to.
+static void WriteBinaryRecord(LOG_RECORD* pstRecord_, UCHAR ucRing_)
+{
+   const UCHAR* pucData = (const UCHAR*)(pstRecord_ + 1);
+   UCHAR aucPayload[BINARY_MAX_PAYLOAD];
+   ULONG ulSize = 0;
+   UCHAR ucType;
+
+   if(!OpenBinaryFile())
+      return;
+
+   if(pstRecord_->ucType == RECORD_SERIAL)
+   {
+      USHORT usHeaderLength;
+      memcpy(&usHeaderLength, pucData, sizeof(USHORT));
+      ULONG ulHeaderID = GetBinaryStringID((const char*)pucData + sizeof(USHORT), usHeaderLength, ucRing_, pstRecord_->ullTime);
+      USHORT usDataCount = (USHORT)(pstRecord_->usDataSize - sizeof(USHORT) - usHeaderLength);
+
+      ucType = DSI_DEBUG_BINARY_SERIAL;
+      ulSize += DSIDebugBinary::PutVarint(&aucPayload[ulSize], pstRecord_->usSerialSize);
+      ulSize += DSIDebugBinary::PutVarint(&aucPayload[ulSize], ulHeaderID);
+      memcpy(&aucPayload[ulSize], pucData + sizeof(USHORT) + usHeaderLength, usDataCount);
+      ulSize += usDataCount;
+   }
+   else
+   {
+      THREAD_PROP* pstThread = apstThread[pstRecord_->ucDestination];
+      if(pstThread == NULL)
+         return;
+
+      if(!abBinaryThreadNamed[pstRecord_->ucDestination])
+      {
+         WriteBinary(DSI_DEBUG_BINARY_THREAD_NAME, ucRing_, pstRecord_->ucDestination, pstRecord_->ullTime, (const UCHAR*)pstThread->acName, (ULONG)strlen(pstThread->acName));
+         abBinaryThreadNamed[pstRecord_->ucDestination] = TRUE;
+      }
+
+      if(pstRecord_->ucType == RECORD_TEXT)
+      {
+         ucType = DSI_DEBUG_BINARY_TEXT;
+         ulSize = pstRecord_->usDataSize;
+         memcpy(aucPayload, pucData, ulSize);
+      }
+      else
+      {
+         //RECORD_FORMAT: recode the saved arguments in the order the format takes them
+         const char* pcFormat = pstRecord_->pcFormat;
+         USHORT usArg = 0;
+
+         ucType = DSI_DEBUG_BINARY_FORMAT;
+         ulSize += DSIDebugBinary::PutVarint(&aucPayload[ulSize], GetBinaryStringID(pcFormat, (USHORT)MIN(strlen(pcFormat), (size_t)(DSI_DEBUG_MAX_STRLEN-1)), ucRing_, pstRecord_->ullTime));
+
+         for(const char* pcPos = pcFormat; *pcPos != '\0';)
+         {
+            if(*pcPos != '%')
+            {
+               pcPos++;
+               continue;
+            }
+
+            char acSpec[DSI_DEBUG_MAX_SPEC_LENGTH];
+            UCHAR ucArgType;
+            pcPos += DSIDebugBinary::ParseConversion(pcPos, acSpec, &ucArgType);
+
+            if(ucArgType == DSI_DEBUG_ARG_STRING)
+            {
+               USHORT usLength;
+               if(usArg + sizeof(USHORT) > pstRecord_->usDataSize)
+                  break;                              //Argument didn't fit in the record
+               memcpy(&usLength, &pucData[usArg], sizeof(USHORT));
+               ulSize += DSIDebugBinary::PutVarint(&aucPayload[ulSize], usLength);
+               memcpy(&aucPayload[ulSize], &pucData[usArg + sizeof(USHORT)], usLength);
+               ulSize += usLength;
+               usArg += (USHORT)(sizeof(USHORT) + usLength);
+            }
+            else if(ucArgType == DSI_DEBUG_ARG_DOUBLE)
+            {
+               ULLONG ullBits;
+               if(usArg + sizeof(ULLONG) > pstRecord_->usDataSize)
+                  break;
+               memcpy(&ullBits, &pucData[usArg], sizeof(ULLONG));
+               for(UCHAR i=0; i<sizeof(ULLONG); i++)
+                  aucPayload[ulSize++] = (UCHAR)(ullBits >> (i * 8));
+               usArg += sizeof(ULLONG);
+            }
+            else if(ucArgType != DSI_DEBUG_ARG_LITERAL && ucArgType != DSI_DEBUG_ARG_PERCENT)
+            {
+               SLLONG sllValue;
+               if(usArg + sizeof(ULLONG) > pstRecord_->usDataSize)
+                  break;
+               memcpy(&sllValue, &pucData[usArg], sizeof(ULLONG));
+               ulSize += DSIDebugBinary::PutSignedVarint(&aucPayload[ulSize], sllValue);
+               usArg += sizeof(ULLONG);
+            }
+         }
+      }
+   }
+
+   WriteBinary(ucType, ucRing_, pstRecord_->ucDestination, pstRecord_->ullTime, aucPayload, ulSize);
+}
+
+//Writes out every record in the rings, oldest first across the threads,
+//so that each file stays in time order.
+static void DrainRings()
+{
+   ULONG ulCount = LoadAcquire(&ulRingCount);
+   BOOL bBinaryNow = bBinary;
+
+   if(!bBinaryNow && pfBinaryFile != NULL)
+      CloseBinaryFile();
+
+   if(bBinaryNow && bBinarySession && OpenBinaryFile())
+   {
+      bBinarySession = FALSE;
+      WriteBinary(DSI_DEBUG_BINARY_SESSION, 0, 0, ullStartTime, (const UCHAR*)NULL, 0);
+   }
+
+   for(ULONG i=0; i<ulCount; i++)
+   {
+      LogRing* pclRing = apclRings[i];
+      ULONG ulDropped = pclRing->ulDropped;
+
+      if(ulDropped != pclRing->ulDroppedReported && bBinaryNow)
+      {
+         if(OpenBinaryFile())
+         {
+            UCHAR aucPayload[DSI_DEBUG_BINARY_MAX_VARINT];
+            WriteBinary(DSI_DEBUG_BINARY_DROPPED, (UCHAR)i, 0, DSIThread_GetSystemTimeMicroseconds(), aucPayload,
+               DSIDebugBinary::PutVarint(aucPayload, ulDropped - pclRing->ulDroppedReported));
+         }
+         pclRing->ulDroppedReported = ulDropped;
+      }
+      else if(ulDropped != pclRing->ulDroppedReported)
+      {
+         //Reported in the owning thread's log, if it has one
+         for(UCHAR j=0; j<MAX_THREADS; j++)
+         {
+            if(apstThread[j] != NULL && DSIThread_CompareThreads(apstThread[j]->hThreadIDNum, pclRing->hThreadIDNum))
+            {
+               char acString[64];
+               SNPRINTF(acString, sizeof(acString), DROPPED_ERROR, ulDropped - pclRing->ulDroppedReported);
+               apstThread[j]->pclBuffer->Add((UCHAR*)acString, (ULONG)strlen(acString));
+               break;
+            }
+         }
+         pclRing->ulDroppedReported = ulDropped;
+      }
+   }
+
+   while(1)
+   {
+      ULONG ulOldest = 0;
+      LOG_RECORD* pstOldest = (LOG_RECORD*)NULL;
+
+      for(ULONG i=0; i<ulCount; i++)
+      {
+         LOG_RECORD* pstRecord = apclRings[i]->Peek();
+         if(pstRecord != NULL && (pstOldest == NULL || pstRecord->ullTime < pstOldest->ullTime))
+         {
+            ulOldest = i;
+            pstOldest = pstRecord;
+         }
+      }
+
+      if(pstOldest == NULL)
+         break;
+
+      if(bBinaryNow)
+         WriteBinaryRecord(pstOldest, (UCHAR)ulOldest);
+      else
+         WriteRecord(pstOldest);
+      apclRings[ulOldest]->Pop();
+   }
+
+   if(pfBinaryFile != NULL)
+      fflush(pfBinaryFile);
+}
+
+static DSI_THREAD_RETURN LogWriterThread(void* /*pvParam_*/)
+{
+   DSIThread_SetThreadName("dsi-debug-log");
+   DSI_ALLOC_THREAD("dsi-debug-log", DSI_ALLOC_DEBUG);
+
+   DSIThread_MutexLock(&stLogWriterMutex);
+   while(!bLogWriterExit)
+   {
+      DSIThread_MutexUnlock(&stLogWriterMutex);
+      DrainRings();
+      DSIThread_MutexLock(&stLogWriterMutex);
+
+      if(!bLogWriterExit)
+         DSIThread_CondTimedWait(&stLogWriterCond, &stLogWriterMutex, LOG_DRAIN_PERIOD);
+   }
+   DSIThread_MutexUnlock(&stLogWriterMutex);
+
+   DrainRings();
+
+   DSIThread_MutexLock(&stLogWriterMutex);
+      DSIThread_CondSignal(&stLogWriterExitCond);
+   DSIThread_MutexUnlock(&stLogWriterMutex);
+
+   return 0;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+////////                   Log Ring Class                         ////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+LogRing::LogRing(DSI_THREAD_IDNUM hThreadIDNum_)
+{
+   hThreadIDNum = hThreadIDNum_;
+   ulDropped = 0;
+   ulDroppedReported = 0;
+   ulHead = 0;
+   ulTail = 0;
+   ulReserved = 0;
+}
+
+//Called by the logging thread.  Returns room for a record with
+//usDataSize_ bytes after the header, or NULL if the ring is full.
+LOG_RECORD* LogRing::Reserve(USHORT usDataSize_)
+{
+   ULONG ulSize = (ULONG)((sizeof(LOG_RECORD) + usDataSize_ + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1));
+   ULONG ulHeadIndex = ulHead & LOG_RING_MASK;
+   ULONG ulPad = 0;
+
+   //Records never wrap; the end of the ring is skipped instead
+   if(LOG_RING_SIZE - ulHeadIndex < ulSize)
+      ulPad = LOG_RING_SIZE - ulHeadIndex;
+
+   if(ulHead + ulPad + ulSize - LoadAcquire(&ulTail) > LOG_RING_SIZE)
+   {
+      ulDropped++;
+      return (LOG_RECORD*)NULL;
+   }
+
+   if(ulPad)
+   {
+      LOG_RECORD* pstPad = (LOG_RECORD*)((UCHAR*)aullData + ulHeadIndex);
+      pstPad->usSize = (USHORT)ulPad;
+      pstPad->ucType = RECORD_PAD;
+      ulHeadIndex = 0;
+   }
+
+   LOG_RECORD* pstRecord = (LOG_RECORD*)((UCHAR*)aullData + ulHeadIndex);
+   pstRecord->usSize = (USHORT)ulSize;
+   pstRecord->usDataSize = usDataSize_;
+   pstRecord->usSerialSize = 0;
+   pstRecord->pcFormat = (const char*)NULL;
+
+   ulReserved = ulHead + ulPad + ulSize;
+   return pstRecord;
+}
+
+//Called by the logging thread to publish the record from Reserve().
+void LogRing::Commit()
+{
+   ULONG ulUsedBefore = ulHead - LoadAcquire(&ulTail);
+   ULONG ulUsedAfter = ulReserved - ulTail;
+
+   StoreRelease(&ulHead, ulReserved);
+
+   //Wake the writer early, once, as the ring passes half full
+   if(ulUsedBefore < LOG_RING_SIZE / 2 && ulUsedAfter >= LOG_RING_SIZE / 2)
+   {
+      DSIThread_MutexLock(&stLogWriterMutex);
+      DSIThread_CondSignal(&stLogWriterCond);
+      DSIThread_MutexUnlock(&stLogWriterMutex);
+   }
+}
+
+//Called by the log writer thread.  Returns the oldest record, or NULL
+//if the ring is empty.
+LOG_RECORD* LogRing::Peek()
+{
+   ULONG ulHeadSnapshot = LoadAcquire(&ulHead);
+
+   while(ulTail != ulHeadSnapshot)
+   {
+      LOG_RECORD* pstRecord = (LOG_RECORD*)((UCHAR*)aullData + (ulTail & LOG_RING_MASK));
+      if(pstRecord->ucType != RECORD_PAD)
+         return pstRecord;
+
+      StoreRelease(&ulTail, ulTail + pstRecord->usSize);
+   }
+
+   return (LOG_RECORD*)NULL;
+}
+
+//Called by the log writer thread to free the record from Peek().
+void LogRing::Pop()
+{
+   LOG_RECORD* pstRecord = (LOG_RECORD*)((UCHAR*)aullData + (ulTail & LOG_RING_MASK));
+   StoreRelease(&ulTail, ulTail + pstRecord->usSize);
+}
+
+
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -600,6 +1509,11 @@ void Buffer::SetEnable(BOOL bEnable_)
    }
 }
 
+BOOL Buffer::IsEnabled()
+{
+   return bEnable;
+}
+
 BOOL Buffer::SetDirectory(const UCHAR* pucDirectory_)
 {
    if(pucDirectory_ == NULL)
@@ -695,6 +1609,21 @@ BOOL Buffer::Add(UCHAR* pucString_, ULONG ulSize_)
 }
 
 
+//Called by the log writer thread
+//Returns TRUE if ulSize_ bytes can be added.  Otherwise asks for a flush.
+BOOL Buffer::HasRoom(ULONG ulSize_)
+{
+   DSIThread_MutexLock(&stInputMutex);
+   BOOL bRoom = (GetBufferCount() + ulSize_ <= BUFFER_SIZE);
+   DSIThread_MutexUnlock(&stInputMutex);
+
+   if(!bRoom)
+      SignalFlush();
+
+   return bRoom;
+}
+
+
 //////////////////////////////////////////////////////////
 // Private Definitions
 //////////////////////////////////////////////////////////
@@ -31,6 +31,7 @@ class DSIDebug
 
    static BOOL ThreadInit(const char* pucName_);
    static BOOL ThreadWrite(const char* pcMessage_);
+   static BOOL ThreadPrintf(const char* pcFormat_, ...);   //pcFormat_ must be a string constant; it is formatted later by the log writer
    static BOOL ThreadEnable(BOOL bEnable_);
 
    static BOOL SerialWrite(UCHAR ucPortNum_, const char* pcHeader_, UCHAR* pucData_, USHORT usSize_);
@@ -38,6 +39,7 @@ class DSIDebug
 
    static BOOL ResetTime();
    static BOOL SetDirectory(const char* pcDirectory_ = "");
+   static BOOL SetBinary(BOOL bBinary_);    //Log everything to one compact binary file (DSI_DEBUG_BINARY_FILENAME) instead of text files; read it with DebugLogDecoder
    static void SetDebug(BOOL bDebugOn_);
 
  private:
@@ -0,0 +1,141 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "types.h"
+#include "dsi_debug_binary.hpp"
+
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+USHORT DSIDebugBinary::ParseConversion(const char *pcFormat_, char *pcSpec_, UCHAR *pucArgType_)
+{
+   USHORT i = 1;
+   UCHAR ucLongs = 0;
+   BOOL bUnsupported = FALSE;
+
+   while(pcFormat_[i] != '\0' && strchr("-+ #0123456789.*", pcFormat_[i]) != NULL)
+   {
+      if(pcFormat_[i] == '*')
+         bUnsupported = TRUE;                               // Takes an int we don't record
+      i++;
+   }
+
+   while(pcFormat_[i] != '\0' && strchr("hlzjtL", pcFormat_[i]) != NULL)
+   {
+      if(pcFormat_[i] == 'l')
+         ucLongs++;
+      else if(pcFormat_[i] != 'h')
+         bUnsupported = TRUE;                               // Argument size we don't record
+      i++;
+   }
+
+   switch(pcFormat_[i])
+   {
+      case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+         *pucArgType_ = (ucLongs == 0) ? DSI_DEBUG_ARG_INT : ((ucLongs == 1) ? DSI_DEBUG_ARG_LONG : DSI_DEBUG_ARG_LLONG);
+         break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+         *pucArgType_ = DSI_DEBUG_ARG_DOUBLE;
+         break;
+      case 'n':
+         *pucArgType_ = DSI_DEBUG_ARG_UNSUPPORTED;
+         break;
+      case 'p':
+         *pucArgType_ = DSI_DEBUG_ARG_POINTER;
+         break;
+      case 's':
+         *pucArgType_ = DSI_DEBUG_ARG_STRING;
+         break;
+      case '%':
+         *pucArgType_ = DSI_DEBUG_ARG_PERCENT;
+         break;
+      default:
+         *pucArgType_ = DSI_DEBUG_ARG_LITERAL;
+         break;
+   }
+
+   if(bUnsupported && *pucArgType_ != DSI_DEBUG_ARG_LITERAL)
+      *pucArgType_ = DSI_DEBUG_ARG_UNSUPPORTED;
+
+   if(pcFormat_[i] != '\0')
+      i++;
+
+   if(i >= DSI_DEBUG_MAX_SPEC_LENGTH)
+   {
+      // Too long to copy; one that takes an argument can't be recorded
+      i = 1;
+      if(*pucArgType_ != DSI_DEBUG_ARG_PERCENT)
+         *pucArgType_ = (*pucArgType_ == DSI_DEBUG_ARG_LITERAL) ? DSI_DEBUG_ARG_LITERAL : DSI_DEBUG_ARG_UNSUPPORTED;
+   }
+
+   memcpy(pcSpec_, pcFormat_, i);
+   pcSpec_[i] = '\0';
+   return i;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIDebugBinary::PutVarint(UCHAR *pucDest_, ULLONG ullValue_)
+{
+   UCHAR ucSize = 0;
+
+   while(ullValue_ >= 0x80)
+   {
+      pucDest_[ucSize++] = (UCHAR)(ullValue_ | 0x80);
+      ullValue_ >>= 7;
+   }
+   pucDest_[ucSize++] = (UCHAR)ullValue_;
+
+   return ucSize;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIDebugBinary::PutSignedVarint(UCHAR *pucDest_, SLLONG sllValue_)
+{
+   // Small magnitudes of either sign take few bytes.
+   return PutVarint(pucDest_, ((ULLONG)sllValue_ << 1) ^ (ULLONG)(sllValue_ >> 63));
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIDebugBinary::GetVarint(const UCHAR *pucData_, ULONG ulSize_, ULONG *pulPos_, ULLONG *pullValue_)
+{
+   ULLONG ullValue = 0;
+   UCHAR ucShift = 0;
+
+   while(*pulPos_ < ulSize_ && ucShift < 64)
+   {
+      UCHAR ucByte = pucData_[(*pulPos_)++];
+
+      ullValue |= (ULLONG)(ucByte & 0x7F) << ucShift;
+      if((ucByte & 0x80) == 0)
+      {
+         *pullValue_ = ullValue;
+         return TRUE;
+      }
+      ucShift += 7;
+   }
+
+   return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIDebugBinary::GetSignedVarint(const UCHAR *pucData_, ULONG ulSize_, ULONG *pulPos_, SLLONG *psllValue_)
+{
+   ULLONG ullValue;
+
+   if(!GetVarint(pucData_, ulSize_, pulPos_, &ullValue))
+      return FALSE;
+
+   *psllValue_ = (SLLONG)(ullValue >> 1) ^ -(SLLONG)(ullValue & 1);
+   return TRUE;
+}
@@ -0,0 +1,116 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#ifndef DSI_DEBUG_BINARY_HPP
+#define DSI_DEBUG_BINARY_HPP
+
+#include "types.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+// Binary debug log, written by DSIDebug when SetBinary(TRUE) is used and read
+// by DebugLogDecoder.  All threads and ports go to one file, in time order.
+//
+// File header:   "DSIDBG" 0x01 0x00, then the start time (8 bytes, us, little endian)
+// Record:        [type | thread << 3][destination][time delta][payload size][payload]
+//
+// The time delta (us, from the previous record or the start time) is a signed
+// varint; sizes and ids are unsigned varints.  Strings (formats and serial
+// headers) are sent once with a STRING record and then referred to by id.  An
+// id may be redefined by a later STRING record.
+#define DSI_DEBUG_BINARY_MAGIC               "DSIDBG\x01\x00"
+#define DSI_DEBUG_BINARY_MAGIC_SIZE          8
+#define DSI_DEBUG_BINARY_FILENAME            "ao_debug.bin"
+
+#define DSI_DEBUG_BINARY_MAX_THREADS         32           // Logging threads, numbered from 0
+#define DSI_DEBUG_BINARY_STRINGS             1024         // String ids, 0 to DSI_DEBUG_BINARY_STRINGS-1
+#define DSI_DEBUG_BINARY_MAX_VARINT          10
+
+// Record types and their payloads.  The destination is the thread log number
+// (as set up by DSIDebug::ThreadInit) or, for serial records, the port.
+#define DSI_DEBUG_BINARY_STRING              ((UCHAR)0)   // [id][characters]
+#define DSI_DEBUG_BINARY_TEXT                ((UCHAR)1)   // [characters], from ThreadWrite()
+#define DSI_DEBUG_BINARY_SERIAL              ((UCHAR)2)   // [size passed to SerialWrite()][header id][bytes]
+#define DSI_DEBUG_BINARY_FORMAT              ((UCHAR)3)   // [format id][arguments], from ThreadPrintf()
+#define DSI_DEBUG_BINARY_THREAD_NAME         ((UCHAR)4)   // [characters], the name given to ThreadInit()
+#define DSI_DEBUG_BINARY_DROPPED             ((UCHAR)5)   // [records lost by the thread]
+#define DSI_DEBUG_BINARY_SESSION             ((UCHAR)6)   // [new start time, 8 bytes], from ResetTime()
+
+// ThreadPrintf() arguments, in the order of the format's conversions:
+//    Integers and pointers:  signed varint
+//    Floating point:         8 byte IEEE double, little endian
+//    Strings:                [length][characters]
+
+// Argument types of a printf conversion.
+#define DSI_DEBUG_ARG_LITERAL                ((UCHAR)0)   // Not a conversion we handle; printed as is
+#define DSI_DEBUG_ARG_PERCENT                ((UCHAR)1)
+#define DSI_DEBUG_ARG_INT                    ((UCHAR)2)
+#define DSI_DEBUG_ARG_LONG                   ((UCHAR)3)
+#define DSI_DEBUG_ARG_LLONG                  ((UCHAR)4)
+#define DSI_DEBUG_ARG_DOUBLE                 ((UCHAR)5)
+#define DSI_DEBUG_ARG_POINTER                ((UCHAR)6)
+#define DSI_DEBUG_ARG_STRING                 ((UCHAR)7)
+#define DSI_DEBUG_ARG_UNSUPPORTED            ((UCHAR)8)   // Takes arguments that can't be recorded ('*', z, j, t, L, n); never in a record
+
+#define DSI_DEBUG_MAX_SPEC_LENGTH            ((USHORT)32)
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// Encoding helpers shared by DSIDebug and the decoder.
+class DSIDebugBinary
+{
+   public:
+
+      static USHORT ParseConversion(const char *pcFormat_, char *pcSpec_, UCHAR *pucArgType_);
+      /////////////////////////////////////////////////////////////////
+      // Parses the printf conversion that starts at pcFormat_ (a '%').
+      // Parameters:
+      //    *pcFormat_:       The conversion.
+      //    *pcSpec_:         Receives a copy of the conversion; must
+      //                      hold DSI_DEBUG_MAX_SPEC_LENGTH characters.
+      //    *pucArgType_:     Receives the DSI_DEBUG_ARG_ type of the
+      //                      argument it takes.  Conversions that
+      //                      aren't printf's are printed as is.
+      //                      DSI_DEBUG_ARG_UNSUPPORTED for a '*' width
+      //                      or precision, the z, j, t and L sizes and
+      //                      %n: the format can't be recorded.
+      // Returns the length of the conversion.
+      /////////////////////////////////////////////////////////////////
+
+      static UCHAR PutVarint(UCHAR *pucDest_, ULLONG ullValue_);
+      /////////////////////////////////////////////////////////////////
+      // Writes an unsigned varint (7 bits a byte, low bits first).
+      // Returns the number of bytes written, at most
+      // DSI_DEBUG_BINARY_MAX_VARINT.
+      /////////////////////////////////////////////////////////////////
+
+      static UCHAR PutSignedVarint(UCHAR *pucDest_, SLLONG sllValue_);
+      /////////////////////////////////////////////////////////////////
+      // Writes a zigzag encoded signed varint.
+      /////////////////////////////////////////////////////////////////
+
+      static BOOL GetVarint(const UCHAR *pucData_, ULONG ulSize_, ULONG *pulPos_, ULLONG *pullValue_);
+      /////////////////////////////////////////////////////////////////
+      // Reads an unsigned varint at *pulPos_ and moves *pulPos_ past
+      // it.  Returns FALSE if the data ends first.
+      /////////////////////////////////////////////////////////////////
+
+      static BOOL GetSignedVarint(const UCHAR *pucData_, ULONG ulSize_, ULONG *pulPos_, SLLONG *psllValue_);
+      /////////////////////////////////////////////////////////////////
+      // Reads a zigzag encoded signed varint.
+      /////////////////////////////////////////////////////////////////
+};
+
+#endif // DSI_DEBUG_BINARY_HPP
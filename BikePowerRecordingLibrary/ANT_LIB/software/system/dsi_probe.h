@@ -0,0 +1,39 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_PROBE_H)
+#define DSI_PROBE_H
+
+// Static tracepoints for perf, bpftrace or SystemTap, eg.
+//    bpftrace -e 'usdt:./app:ant_lib:crc_error { @[arg0] = count(); }'
+//
+// Build with DSI_USDT defined (needs <sys/sdt.h>, from systemtap-sdt-dev)
+// to compile them in.  Each probe is then a single nop until a tracer
+// attaches; without DSI_USDT they compile to nothing.
+//
+// Provider ant_lib:
+//    message(framer, message id, size, first data byte)     A message was framed
+//    crc_error(framer, size)                                A message failed its checksum
+//    queue_overflow(framer, message id)                     The framer queue was full
+//    serial_read(port, bytes)                               The serial receive thread read from the device
+
+#if defined(DSI_USDT)
+   #include <sys/sdt.h>
+
+   #define DSI_PROBE1(name, a1)                    DTRACE_PROBE1(ant_lib, name, a1)
+   #define DSI_PROBE2(name, a1, a2)                DTRACE_PROBE2(ant_lib, name, a1, a2)
+   #define DSI_PROBE3(name, a1, a2, a3)            DTRACE_PROBE3(ant_lib, name, a1, a2, a3)
+   #define DSI_PROBE4(name, a1, a2, a3, a4)        DTRACE_PROBE4(ant_lib, name, a1, a2, a3, a4)
+#else
+   #define DSI_PROBE1(name, a1)
+   #define DSI_PROBE2(name, a1, a2)
+   #define DSI_PROBE3(name, a1, a2, a3)
+   #define DSI_PROBE4(name, a1, a2, a3, a4)
+#endif
+
+#endif // !defined(DSI_PROBE_H)
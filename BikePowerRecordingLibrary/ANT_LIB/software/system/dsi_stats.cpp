@@ -0,0 +1,429 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#include "types.h"
+#include "defines.h"
+#include "macros.h"
+#include "dsi_stats.hpp"
+#include "dsi_thread.h"
+#include "dsi_alloc_audit.hpp"
+#include "dsi_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(DSI_TYPES_LINUX) || defined(DSI_TYPES_MACINTOSH)
+   #include <sys/socket.h>
+   #include <sys/un.h>
+   #include <unistd.h>
+   #include <poll.h>
+   #include <errno.h>
+   #include <sys/time.h>
+   #define STATS_SOCKETS
+
+   #if !defined(MSG_NOSIGNAL)
+      #define MSG_NOSIGNAL             0                    // Mac OS; SO_NOSIGPIPE is set on the socket instead
+   #endif
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define BUFFER_SIZE                    ((ULONG) 1048576)    // Room for the registry and a few hundred devices from the collectors
+#define MAX_LINE                       ((ULONG) 256)
+#define POLL_INTERVAL                  250                  // ms between checks for the server being stopped
+#define SEND_TIMEOUT                   1                    // s a client may stall a snapshot for
+
+typedef struct
+{
+   DSI_STATS_COLLECTOR fnCollector;
+   void *pvContext;
+} COLLECTOR;
+
+static BOOL bInitialized = FALSE;
+static DSI_MUTEX stMutexRegister;                           // Serializes registration; never taken by readers
+
+static DSI_STAT astStats[DSI_STATS_MAX];
+static volatile ULONG ulStatCount = 0;                      // Entries below this are complete
+static COLLECTOR astCollectors[DSI_STATS_MAX_COLLECTORS];
+static volatile ULONG ulCollectorCount = 0;
+
+#if defined(STATS_SOCKETS)
+static DSI_THREAD_ID hServerThread;
+static DSI_MUTEX stMutexServer;
+static DSI_CONDITION_VAR stCondServerExit;
+static volatile BOOL bServerRunning = FALSE;
+static volatile BOOL bStopServer = FALSE;
+static int iListenSocket = -1;
+static char *pcServerBuffer = (char*)NULL;
+#endif
+
+
+//////////////////////////////////////////////////////////
+// Count Access
+//////////////////////////////////////////////////////////
+
+static inline ULONG LoadAcquire(volatile ULONG* pulCount_)
+{
+#if defined(_MSC_VER)
+   ULONG ulCount = *pulCount_;
+   MemoryBarrier();
+   return ulCount;
+#else
+   return __atomic_load_n(pulCount_, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void StoreRelease(volatile ULONG* pulCount_, ULONG ulCount_)
+{
+#if defined(_MSC_VER)
+   MemoryBarrier();
+   *pulCount_ = ulCount_;
+#else
+   __atomic_store_n(pulCount_, ulCount_, __ATOMIC_RELEASE);
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Function Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+#if defined(STATS_SOCKETS)
+static DSI_THREAD_RETURN ServerThreadStart(void *pvParameter_);
+static void ServerThread();
+static void StopServer();
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStats::Init()
+{
+   if (bInitialized)
+      return TRUE;
+
+   if (DSIThread_MutexInit(&stMutexRegister) != DSI_THREAD_ENONE)
+      return FALSE;
+
+#if defined(STATS_SOCKETS)
+   if (DSIThread_MutexInit(&stMutexServer) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&stMutexRegister);
+      return FALSE;
+   }
+
+   if (DSIThread_CondInit(&stCondServerExit) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&stMutexServer);
+      DSIThread_MutexDestroy(&stMutexRegister);
+      return FALSE;
+   }
+#endif
+
+   bInitialized = TRUE;
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStats::Close()
+{
+   if (!bInitialized)
+      return;
+
+#if defined(STATS_SOCKETS)
+   StopServer();
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_STAT* DSIStats::Register(const char *pcName_, const char *pcLabels_, const char *pcHelp_, UCHAR ucType_)
+{
+   DSI_STAT *pstStat = (DSI_STAT*)NULL;
+   ULONG ulCount;
+
+   if (!bInitialized)
+      return (DSI_STAT*)NULL;
+
+   if (pcLabels_ == NULL)
+      pcLabels_ = "";
+
+   DSIThread_MutexLock(&stMutexRegister);
+
+   ulCount = ulStatCount;
+   for (ULONG i = 0; i < ulCount; i++)
+   {
+      if (strcmp(astStats[i].acName, pcName_) == 0 && strcmp(astStats[i].acLabels, pcLabels_) == 0)
+      {
+         pstStat = &astStats[i];
+         break;
+      }
+   }
+
+   if (pstStat == NULL && ulCount < DSI_STATS_MAX)
+   {
+      pstStat = &astStats[ulCount];
+      SNPRINTF(pstStat->acName, sizeof(pstStat->acName), "%s", pcName_);
+      SNPRINTF(pstStat->acLabels, sizeof(pstStat->acLabels), "%s", pcLabels_);
+      pstStat->pcHelp = pcHelp_;
+      pstStat->ucType = ucType_;
+      pstStat->ullValue = 0;
+
+      // Publish the entry once it is complete.
+      StoreRelease(&ulStatCount, ulCount + 1);
+   }
+
+   DSIThread_MutexUnlock(&stMutexRegister);
+
+   return pstStat;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStats::AddCollector(DSI_STATS_COLLECTOR fnCollector_, void *pvContext_)
+{
+   BOOL bReturn = FALSE;
+
+   if (!bInitialized || fnCollector_ == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexRegister);
+
+   if (ulCollectorCount < DSI_STATS_MAX_COLLECTORS)
+   {
+      astCollectors[ulCollectorCount].fnCollector = fnCollector_;
+      astCollectors[ulCollectorCount].pvContext = pvContext_;
+      StoreRelease(&ulCollectorCount, ulCollectorCount + 1);
+      bReturn = TRUE;
+   }
+
+   DSIThread_MutexUnlock(&stMutexRegister);
+
+   return bReturn;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSIStats::Format(char *pcBuffer_, ULONG ulSize_)
+{
+   ULONG ulCount = LoadAcquire(&ulStatCount);
+   ULONG ulCollectors = LoadAcquire(&ulCollectorCount);
+   ULONG ulLength = 0;
+   char acLine[MAX_LINE];
+   int iLineLength;
+
+   if (ulSize_ == 0)
+      return 0;
+   pcBuffer_[0] = '\0';
+
+   // Each metric's samples must follow its HELP and TYPE lines, so group
+   // them by name; stats registered later (eg. a new channel) may share a
+   // name with earlier ones.
+   for (ULONG i = 0; i < ulCount; i++)
+   {
+      BOOL bFirst = TRUE;
+
+      for (ULONG j = 0; j < i; j++)
+      {
+         if (strcmp(astStats[j].acName, astStats[i].acName) == 0)
+         {
+            bFirst = FALSE;
+            break;
+         }
+      }
+
+      if (!bFirst)
+         continue;
+
+      iLineLength = SNPRINTF(acLine, sizeof(acLine), "# HELP %s %s\n# TYPE %s %s\n", astStats[i].acName, astStats[i].pcHelp ? astStats[i].pcHelp : "",
+         astStats[i].acName, astStats[i].ucType == DSI_STATS_GAUGE ? "gauge" : "counter");
+      if (iLineLength < 0 || ulLength + (ULONG)iLineLength >= ulSize_)
+         return ulLength;
+      memcpy(pcBuffer_ + ulLength, acLine, iLineLength + 1);
+      ulLength += iLineLength;
+
+      for (ULONG j = i; j < ulCount; j++)
+      {
+         if (strcmp(astStats[j].acName, astStats[i].acName) != 0)
+            continue;
+
+         if (astStats[j].acLabels[0] != '\0')
+            iLineLength = SNPRINTF(acLine, sizeof(acLine), "%s{%s} %llu\n", astStats[j].acName, astStats[j].acLabels, Get(&astStats[j]));
+         else
+            iLineLength = SNPRINTF(acLine, sizeof(acLine), "%s %llu\n", astStats[j].acName, Get(&astStats[j]));
+
+         if (iLineLength < 0 || ulLength + (ULONG)iLineLength >= ulSize_)
+            return ulLength;
+         memcpy(pcBuffer_ + ulLength, acLine, iLineLength + 1);
+         ulLength += iLineLength;
+      }
+   }
+
+   for (ULONG i = 0; i < ulCollectors; i++)
+   {
+      ulLength += astCollectors[i].fnCollector(astCollectors[i].pvContext, pcBuffer_ + ulLength, ulSize_ - ulLength);
+      if (ulLength >= ulSize_)
+      {
+         ulLength = ulSize_ - 1;
+         break;
+      }
+   }
+
+   pcBuffer_[ulLength] = '\0';
+   return ulLength;
+}
+
+#if defined(STATS_SOCKETS)
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStats::StartServer(const char *pcPath_)
+{
+   struct sockaddr_un stAddress;
+
+   if (!bInitialized || pcPath_ == NULL || strlen(pcPath_) >= sizeof(stAddress.sun_path))
+      return FALSE;
+
+   StopServer();
+
+   pcServerBuffer = (char*)DSI_MALLOC(BUFFER_SIZE);
+   if (pcServerBuffer == NULL)
+      return FALSE;
+
+   memset(&stAddress, 0, sizeof(stAddress));
+   stAddress.sun_family = AF_UNIX;
+   SNPRINTF(stAddress.sun_path, sizeof(stAddress.sun_path), "%s", pcPath_);
+
+   unlink(pcPath_);
+   iListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (iListenSocket < 0 || bind(iListenSocket, (struct sockaddr*)&stAddress, sizeof(stAddress)) != 0 || listen(iListenSocket, 4) != 0)
+   {
+      if (iListenSocket >= 0)
+         close(iListenSocket);
+      iListenSocket = -1;
+      DSI_FREE(pcServerBuffer);
+      pcServerBuffer = (char*)NULL;
+      return FALSE;
+   }
+
+   bStopServer = FALSE;
+   bServerRunning = TRUE;
+   hServerThread = DSIThread_CreateThread(ServerThreadStart, NULL);
+   if (hServerThread == NULL)
+   {
+      bServerRunning = FALSE;
+      close(iListenSocket);
+      iListenSocket = -1;
+      DSI_FREE(pcServerBuffer);
+      pcServerBuffer = (char*)NULL;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+static void StopServer()
+{
+   DSIThread_MutexLock(&stMutexServer);
+   if (bServerRunning)
+   {
+      bStopServer = TRUE;
+      while (bServerRunning)
+         DSIThread_CondTimedWait(&stCondServerExit, &stMutexServer, DSI_THREAD_INFINITE);
+      DSIThread_ReleaseThreadID(hServerThread);
+   }
+   DSIThread_MutexUnlock(&stMutexServer);
+
+   if (iListenSocket >= 0)
+   {
+      close(iListenSocket);
+      iListenSocket = -1;
+   }
+
+   DSI_FREE(pcServerBuffer);
+   pcServerBuffer = (char*)NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+static DSI_THREAD_RETURN ServerThreadStart(void* /*pvParameter_*/)
+{
+   DSIThread_SetThreadName("DSIStats");
+   DSI_ALLOC_THREAD("DSIStats", DSI_ALLOC_DEBUG);
+   ServerThread();
+   return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Answers each connection with a snapshot.  Formatting only reads the
+// registry, so a slow client holds up nothing but this thread.
+///////////////////////////////////////////////////////////////////////
+static void ServerThread()
+{
+   struct pollfd stPoll;
+
+   stPoll.fd = iListenSocket;
+   stPoll.events = POLLIN;
+
+   while (!bStopServer)
+   {
+      if (poll(&stPoll, 1, POLL_INTERVAL) <= 0)
+         continue;
+
+      int iClient = accept(iListenSocket, (struct sockaddr*)NULL, NULL);
+      if (iClient < 0)
+         continue;
+
+      ULONG ulLength = DSIStats::Format(pcServerBuffer, BUFFER_SIZE);
+      ULONG ulSent = 0;
+      struct timeval stTimeout = { SEND_TIMEOUT, 0 };
+
+      setsockopt(iClient, SOL_SOCKET, SO_SNDTIMEO, &stTimeout, sizeof(stTimeout));
+      #if defined(SO_NOSIGPIPE)
+      {
+         int iOn = 1;
+         setsockopt(iClient, SOL_SOCKET, SO_NOSIGPIPE, &iOn, sizeof(iOn));
+      }
+      #endif
+
+      while (ulSent < ulLength && !bStopServer)
+      {
+         ssize_t iSent = send(iClient, pcServerBuffer + ulSent, ulLength - ulSent, MSG_NOSIGNAL);
+         if (iSent < 0 && errno == EINTR)
+            continue;
+         if (iSent <= 0)
+            break;
+         ulSent += (ULONG)iSent;
+      }
+
+      close(iClient);
+   }
+
+   DSIThread_MutexLock(&stMutexServer);
+   bServerRunning = FALSE;
+   DSIThread_CondSignal(&stCondServerExit);
+   DSIThread_MutexUnlock(&stMutexServer);
+}
+
+#else
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIStats::StartServer(const char *pcPath_)
+{
+   // No Unix domain sockets; Format() can still be served another way.
+   return FALSE;
+}
+
+#endif // defined(STATS_SOCKETS)
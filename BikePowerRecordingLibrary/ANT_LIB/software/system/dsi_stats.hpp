@@ -0,0 +1,140 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(DSI_STATS_HPP)
+#define DSI_STATS_HPP
+
+#include "types.h"
+#include "dsi_thread.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define DSI_STATS_MAX                  ((ULONG) 512)        // Stats that can be registered
+#define DSI_STATS_MAX_NAME             48
+#define DSI_STATS_MAX_LABELS           48
+#define DSI_STATS_MAX_COLLECTORS       8
+
+#define DSI_STATS_COUNTER              ((UCHAR) 0)          // Only ever goes up
+#define DSI_STATS_GAUGE                ((UCHAR) 1)          // Goes up and down
+
+typedef struct
+{
+   char acName[DSI_STATS_MAX_NAME];                         // eg. ant_framer_crc_errors_total
+   char acLabels[DSI_STATS_MAX_LABELS];                     // eg. port="0"; empty if none
+   const char *pcHelp;                                      // Must be a string constant
+   UCHAR ucType;
+   volatile ULLONG ullValue;
+} DSI_STAT;
+
+// Writes extra exposition lines for stats kept outside the registry (eg.
+// the power decoders).  Called on the server thread for each scrape.
+// Returns the number of characters written, not counting the NULL.
+typedef ULONG (*DSI_STATS_COLLECTOR)(void *pvContext_, char *pcBuffer_, ULONG ulSize_);
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// A process wide registry of counters and gauges, served as text in the
+// Prometheus exposition format over a Unix domain socket.
+//
+// Components register their stats once and update them with relaxed atomic
+// operations.  Readers walk the registry without locking, so a scrape never
+// blocks the receive path; registering takes a lock the readers don't use.
+class DSIStats
+{
+   public:
+      static BOOL Init();
+      /////////////////////////////////////////////////////////////////
+      // Enables the registry.  Components only register stats while it
+      // is enabled, so call this before creating them.
+      // Returns TRUE if successful.
+      /////////////////////////////////////////////////////////////////
+
+      static void Close();
+      /////////////////////////////////////////////////////////////////
+      // Stops the server.  Registered stats stay valid.
+      /////////////////////////////////////////////////////////////////
+
+      static DSI_STAT* Register(const char *pcName_, const char *pcLabels_, const char *pcHelp_, UCHAR ucType_ = DSI_STATS_COUNTER);
+      /////////////////////////////////////////////////////////////////
+      // Adds a stat, or finds it if the name and labels are already
+      // registered.
+      // Parameters:
+      //    *pcName_:         Metric name.
+      //    *pcLabels_:       Labels without braces (eg. port="0"), or
+      //                      NULL.
+      //    *pcHelp_:         Description, a string constant.
+      //    ucType_:          DSI_STATS_COUNTER or DSI_STATS_GAUGE.
+      // Returns NULL if the registry isn't enabled or is full.  The
+      // update functions accept NULL, so callers don't need to check.
+      /////////////////////////////////////////////////////////////////
+
+      static BOOL AddCollector(DSI_STATS_COLLECTOR fnCollector_, void *pvContext_);
+      /////////////////////////////////////////////////////////////////
+      // Adds a function that writes its own lines after the registry.
+      // Returns FALSE if there are too many collectors.
+      /////////////////////////////////////////////////////////////////
+
+      static BOOL StartServer(const char *pcPath_);
+      /////////////////////////////////////////////////////////////////
+      // Serves the stats on a Unix domain socket.  Each connection
+      // receives one snapshot and is closed.
+      // Parameters:
+      //    *pcPath_:         Socket path.  An existing socket at this
+      //                      path is replaced.
+      // Returns FALSE if the socket couldn't be created, or on
+      // platforms without Unix domain sockets.
+      /////////////////////////////////////////////////////////////////
+
+      static ULONG Format(char *pcBuffer_, ULONG ulSize_);
+      /////////////////////////////////////////////////////////////////
+      // Writes the exposition text to a buffer, as served.
+      // Returns the number of characters written, not counting the
+      // NULL.  The output is truncated at a line if it doesn't fit.
+      /////////////////////////////////////////////////////////////////
+
+      static inline void Add(DSI_STAT *pstStat_, ULLONG ullValue_ = 1)
+      {
+         if (pstStat_ == NULL)
+            return;
+      #if defined(_MSC_VER)
+         InterlockedExchangeAdd64((volatile LONGLONG*)&pstStat_->ullValue, (LONGLONG)ullValue_);
+      #else
+         __atomic_fetch_add(&pstStat_->ullValue, ullValue_, __ATOMIC_RELAXED);
+      #endif
+      }
+
+      static inline void Set(DSI_STAT *pstStat_, ULLONG ullValue_)
+      {
+         if (pstStat_ == NULL)
+            return;
+      #if defined(_MSC_VER)
+         InterlockedExchange64((volatile LONGLONG*)&pstStat_->ullValue, (LONGLONG)ullValue_);
+      #else
+         __atomic_store_n(&pstStat_->ullValue, ullValue_, __ATOMIC_RELAXED);
+      #endif
+      }
+
+      static inline ULLONG Get(const DSI_STAT *pstStat_)
+      {
+         if (pstStat_ == NULL)
+            return 0;
+      #if defined(_MSC_VER)
+         return (ULLONG)InterlockedCompareExchange64((volatile LONGLONG*)&pstStat_->ullValue, 0, 0);
+      #else
+         return __atomic_load_n(&pstStat_->ullValue, __ATOMIC_RELAXED);
+      #endif
+      }
+};
+
+#endif // !defined(DSI_STATS_HPP)
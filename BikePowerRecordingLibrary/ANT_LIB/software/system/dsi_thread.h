@@ -270,6 +270,51 @@ void DSIThread_Sleep(ULONG ulMilliseconds);
     //    ulMilliseconds:      Number of milliseconds to sleep.
     ////////////////////////////////////////////////////////////////////
 
+ULLONG DSIThread_GetSystemTimeMicroseconds(void);
+    ////////////////////////////////////////////////////////////////////
+    // Gets the current monotonic time in microseconds.  The time is
+    // not affected by changes to the wall clock and only the
+    // difference between two readings is meaningful.
+    //
+    // Returns the current time in microseconds.
+    ////////////////////////////////////////////////////////////////////
+
+UCHAR DSIThread_SetThreadName(const char *pcName_);
+    ////////////////////////////////////////////////////////////////////
+    // Names the calling thread so it can be told apart in debuggers
+    // and in tools like top.
+    // Parameters:
+    //    *pcName_:            The name.  Linux keeps the first 15
+    //                         characters.
+    // Returns DSI_THREAD_ENONE if successful.  Otherwise, it returns
+    // the error code.
+    ////////////////////////////////////////////////////////////////////
+
+UCHAR DSIThread_SetThreadAffinity(ULONG ulCore_);
+    ////////////////////////////////////////////////////////////////////
+    // Pins the calling thread to one processor core.
+    // Parameters:
+    //    ulCore_:             The core, numbered from 0.
+    // Returns DSI_THREAD_ENONE if successful.  Returns
+    // DSI_THREAD_EINVALID if the core does not exist.  Otherwise, it
+    // returns DSI_THREAD_EOTHER.
+    ////////////////////////////////////////////////////////////////////
+
+UCHAR DSIThread_SetThreadRealTime(UCHAR ucPriority_);
+    ////////////////////////////////////////////////////////////////////
+    // Moves the calling thread to the real-time scheduling class
+    // (SCHED_FIFO on Linux, time critical priority on Windows) so it
+    // is not held up by ordinary threads.
+    // Parameters:
+    //    ucPriority_:         The real-time priority, 1 to 99.  0
+    //                         returns the thread to normal
+    //                         scheduling.
+    // Returns DSI_THREAD_ENONE if successful.  Returns
+    // DSI_THREAD_EINVALID if the priority is out of range.  Otherwise,
+    // it returns DSI_THREAD_EOTHER, for example when the process is
+    // not allowed to use real-time scheduling.
+    ////////////////////////////////////////////////////////////////////
+
 #if defined(__cplusplus)
    }
 #endif
@@ -0,0 +1,341 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+
+#include "types.h"
+#if defined(DSI_TYPES_LINUX)
+
+
+#include "dsi_thread.h"
+#include "macros.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define NSEC_PER_SEC             1000000000L
+#define NSEC_PER_MSEC            1000000L
+
+#define THREAD_NAME_SIZE         16                         // Including the terminator, as for pthread_setname_np()
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Adds a number of milliseconds to the current monotonic time.
+///////////////////////////////////////////////////////////////////////
+static void GetDeadline(struct timespec *pstDeadline_, ULONG ulMilliseconds_)
+{
+   clock_gettime(CLOCK_MONOTONIC, pstDeadline_);
+
+   pstDeadline_->tv_sec += ulMilliseconds_ / 1000;
+   pstDeadline_->tv_nsec += (long)(ulMilliseconds_ % 1000) * NSEC_PER_MSEC;
+   if (pstDeadline_->tv_nsec >= NSEC_PER_SEC)
+   {
+      pstDeadline_->tv_sec++;
+      pstDeadline_->tv_nsec -= NSEC_PER_SEC;
+   }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_MutexInit(DSI_MUTEX *pstMutex_)
+{
+   pthread_mutexattr_t stAttributes;
+   int iResult;
+
+   // Windows mutexes can be locked again by the thread that owns them,
+   // and the library relies on that.
+   if (pthread_mutexattr_init(&stAttributes) != 0)
+      return DSI_THREAD_EOTHER;
+
+   pthread_mutexattr_settype(&stAttributes, PTHREAD_MUTEX_RECURSIVE);
+   iResult = pthread_mutex_init(pstMutex_, &stAttributes);
+   pthread_mutexattr_destroy(&stAttributes);
+
+   if (iResult != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_MutexDestroy(DSI_MUTEX *pstMutex_)
+{
+   if (pthread_mutex_destroy(pstMutex_) != 0)
+      return DSI_THREAD_EBUSY;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_MutexLock(DSI_MUTEX *pstMutex_)
+{
+   if (pthread_mutex_lock(pstMutex_) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_MutexTryLock(DSI_MUTEX *pstMutex_)
+{
+   int iResult = pthread_mutex_trylock(pstMutex_);
+
+   if (iResult == 0)
+      return DSI_THREAD_ENONE;
+
+   if (iResult == EBUSY)
+      return DSI_THREAD_EBUSY;
+
+   return DSI_THREAD_EOTHER;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_MutexUnlock(DSI_MUTEX *pstMutex_)
+{
+   if (pthread_mutex_unlock(pstMutex_) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CondInit(DSI_CONDITION_VAR *pstConditionVariable_)
+{
+   pthread_condattr_t stAttributes;
+   int iResult;
+
+   // Timed waits are measured on the monotonic clock so that setting
+   // the wall clock can't stretch or cut short a wait.
+   if (pthread_condattr_init(&stAttributes) != 0)
+      return DSI_THREAD_EOTHER;
+
+   pthread_condattr_setclock(&stAttributes, CLOCK_MONOTONIC);
+   iResult = pthread_cond_init(pstConditionVariable_, &stAttributes);
+   pthread_condattr_destroy(&stAttributes);
+
+   if (iResult != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CondDestroy(DSI_CONDITION_VAR *pstConditionVariable_)
+{
+   if (pthread_cond_destroy(pstConditionVariable_) != 0)
+      return DSI_THREAD_EBUSY;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CondTimedWait(DSI_CONDITION_VAR *pstConditionVariable_, DSI_MUTEX *pstExternalMutex_, ULONG ulMilliseconds_)
+{
+   struct timespec stDeadline;
+   int iResult;
+
+   if (ulMilliseconds_ == DSI_THREAD_INFINITE)
+   {
+      iResult = pthread_cond_wait(pstConditionVariable_, pstExternalMutex_);
+   }
+   else
+   {
+      GetDeadline(&stDeadline, ulMilliseconds_);
+      iResult = pthread_cond_timedwait(pstConditionVariable_, pstExternalMutex_, &stDeadline);
+   }
+
+   if (iResult == 0)
+      return DSI_THREAD_ENONE;
+
+   if (iResult == ETIMEDOUT)
+      return DSI_THREAD_ETIMEDOUT;
+
+   return DSI_THREAD_EOTHER;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CondSignal(DSI_CONDITION_VAR *pstConditionVariable_)
+{
+   if (pthread_cond_signal(pstConditionVariable_) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CondBroadcast(DSI_CONDITION_VAR *pstConditionVariable_)
+{
+   if (pthread_cond_broadcast(pstConditionVariable_) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_ID DSIThread_CreateThread(DSI_THREAD_RETURN (*fnThreadStart_)(void *), void *pvParameter_)
+{
+   pthread_t hThread;
+
+   if (pthread_create(&hThread, NULL, fnThreadStart_, pvParameter_) != 0)
+      return 0;
+
+   return hThread;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_DestroyThread(DSI_THREAD_ID hThreadID_)
+{
+   if (pthread_cancel(hThreadID_) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_ReleaseThreadID(DSI_THREAD_ID hThreadID)
+{
+   if (pthread_detach(hThreadID) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_IDNUM DSIThread_GetCurrentThreadIDNum(void)
+{
+   return pthread_self();
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_CompareThreads(DSI_THREAD_IDNUM hThreadIDNum1, DSI_THREAD_IDNUM hThreadIDNum2)
+{
+   return (pthread_equal(hThreadIDNum1, hThreadIDNum2) != 0);
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSIThread_GetSystemTime(void)
+{
+   struct timespec stNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+   return (ULONG)stNow.tv_sec * 1000 + (ULONG)(stNow.tv_nsec / NSEC_PER_MSEC);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_GetWorkingDirectory(UCHAR* pucDirectory_, USHORT usLength_)
+{
+   if(pucDirectory_ == NULL)
+      return FALSE;
+
+   if(getcwd((char*)pucDirectory_, (size_t)(usLength_-1)) == NULL)
+       return FALSE;
+
+   SNPRINTF((char*)(&pucDirectory_[strlen((char*)pucDirectory_)]), 2, "/");
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIThread_Sleep(ULONG ulMilliseconds_)
+{
+   struct timespec stDeadline;
+
+   // An absolute deadline so that signals don't lengthen the sleep.
+   GetDeadline(&stDeadline, ulMilliseconds_);
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &stDeadline, NULL) == EINTR);
+   return;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULLONG DSIThread_GetSystemTimeMicroseconds(void)
+{
+   struct timespec stNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+   return (ULLONG)stNow.tv_sec * 1000000 + (ULLONG)(stNow.tv_nsec / 1000);
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_SetThreadName(const char *pcName_)
+{
+   char acName[THREAD_NAME_SIZE];
+
+   // pthread_setname_np() fails rather than truncating long names.
+   SNPRINTF(acName, sizeof(acName), "%s", pcName_);
+
+   if (pthread_setname_np(pthread_self(), acName) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_SetThreadAffinity(ULONG ulCore_)
+{
+   cpu_set_t stCores;
+   int iResult;
+
+   if (ulCore_ >= CPU_SETSIZE)
+      return DSI_THREAD_EINVALID;
+
+   CPU_ZERO(&stCores);
+   CPU_SET(ulCore_, &stCores);
+
+   iResult = pthread_setaffinity_np(pthread_self(), sizeof(stCores), &stCores);
+   if (iResult == EINVAL)
+      return DSI_THREAD_EINVALID;                           // The core is offline or outside the process cpuset.
+
+   if (iResult != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_SetThreadRealTime(UCHAR ucPriority_)
+{
+   struct sched_param stParam;
+   int iPolicy = SCHED_OTHER;
+
+   memset(&stParam, 0, sizeof(stParam));
+
+   if (ucPriority_ != 0)
+   {
+      if (ucPriority_ < sched_get_priority_min(SCHED_FIFO) || ucPriority_ > sched_get_priority_max(SCHED_FIFO))
+         return DSI_THREAD_EINVALID;
+
+      iPolicy = SCHED_FIFO;
+      stParam.sched_priority = ucPriority_;
+   }
+
+   // Needs CAP_SYS_NICE or an RLIMIT_RTPRIO allowance.
+   if (pthread_setschedparam(pthread_self(), iPolicy, &stParam) != 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+
+
+#endif //defined(DSI_TYPES_LINUX)
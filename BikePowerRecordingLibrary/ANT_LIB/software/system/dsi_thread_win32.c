@@ -311,6 +311,74 @@ void DSIThread_Sleep(ULONG ulMilliseconds_)
    return;
 }
 
+///////////////////////////////////////////////////////////////////////
+ULLONG DSIThread_GetSystemTimeMicroseconds(void)
+{
+   static LARGE_INTEGER stFrequency = {0};
+   LARGE_INTEGER stCounter;
+
+   if (stFrequency.QuadPart == 0)
+      QueryPerformanceFrequency(&stFrequency);              // Fixed at boot, so a racing first call is harmless.
+
+   QueryPerformanceCounter(&stCounter);
+
+   // Split to avoid overflowing the multiplication on long uptimes.
+   return (ULLONG)(stCounter.QuadPart / stFrequency.QuadPart) * 1000000
+      + (ULLONG)(stCounter.QuadPart % stFrequency.QuadPart) * 1000000 / (ULLONG)stFrequency.QuadPart;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_SetThreadName(const char *pcName_)
+{
+   // SetThreadDescription() is only in Windows 10 1607 and later.
+   typedef HRESULT (WINAPI *SET_THREAD_DESCRIPTION)(HANDLE, PCWSTR);
+   SET_THREAD_DESCRIPTION fnSetThreadDescription;
+   WCHAR awcName[64];
+
+   fnSetThreadDescription = (SET_THREAD_DESCRIPTION)GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription");
+   if (fnSetThreadDescription == NULL)
+      return DSI_THREAD_EOTHER;
+
+   if (MultiByteToWideChar(CP_ACP, 0, pcName_, -1, awcName, sizeof(awcName) / sizeof(awcName[0])) == 0)
+      return DSI_THREAD_EINVALID;
+
+   if (FAILED(fnSetThreadDescription(GetCurrentThread(), awcName)))
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_SetThreadAffinity(ULONG ulCore_)
+{
+   if (ulCore_ >= sizeof(DWORD_PTR) * 8)
+      return DSI_THREAD_EINVALID;
+
+   if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << ulCore_) == 0)
+      return DSI_THREAD_EINVALID;                           // Fails if the core is not in the process mask.
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_SetThreadRealTime(UCHAR ucPriority_)
+{
+   int iPriority = THREAD_PRIORITY_NORMAL;
+
+   if (ucPriority_ > 99)
+      return DSI_THREAD_EINVALID;
+
+   // Windows has no range to map onto; any real-time request gets the
+   // highest priority of the process class.
+   if (ucPriority_ != 0)
+      iPriority = THREAD_PRIORITY_TIME_CRITICAL;
+
+   if (SetThreadPriority(GetCurrentThread(), iPriority) == 0)
+      return DSI_THREAD_EOTHER;
+
+   return DSI_THREAD_ENONE;
+}
+
 
 
 #endif //defined(DSI_TYPES_WINDOWS)
@@ -9,9 +9,80 @@ All rights reserved.
 
 #include "types.h"
 #include "dsi_timer.hpp"
+#include "dsi_alloc_audit.hpp"
 #include <stdio.h>
 
 
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define WHEEL_MASK                     (DSI_TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_WORDS                    (DSI_TIMER_WHEEL_SLOTS / 64)
+#define WHEEL_NEVER                    ((ULLONG) -1)
+
+struct DSI_TIMER_ENTRY
+{
+   DSI_TIMER_ENTRY *pstNext;
+   DSI_TIMER_ENTRY **ppstPrev;                              // The pointer to this entry; NULL if it is not in a slot
+   ULLONG ullExpiry;                                        // Wheel tick (ms) the timer is due on
+   ULONG ulInterval;
+   BOOL bRecurring;
+   BOOL bRunning;                                           // The callback is in progress
+   BOOL bCancelled;                                         // The timer is being destroyed
+   BOOL bOrphaned;                                          // Destroyed while the callback ran; the wheel frees it
+   BOOL bFinished;                                          // A one shot timer has fired
+   DSI_THREAD_RETURN (*fnTimerFunc)(void *);
+   void *pvTimerFuncParameter;
+};
+
+// A hashed timing wheel.  Each timer sits in the slot of its expiry tick
+// modulo the wheel size, so adding and removing a timer is O(1).  A bitmap
+// of occupied slots lets the thread sleep straight to the next occupied
+// slot, so it wakes only when a timer is due or, for timers more than one
+// revolution away, once per revolution.
+class DSITimerWheel
+{
+   private:
+      DSI_TIMER_ENTRY *apstSlots[DSI_TIMER_WHEEL_SLOTS];
+      ULLONG aullOccupied[WHEEL_WORDS];                     // One bit per non-empty slot
+      ULLONG ullCurrentTick;                                // Next tick to be processed
+      ULLONG ullWakeTick;                                   // Tick the thread is sleeping until
+
+      DSI_THREAD_ID hWheelThread;                           // Handle for the wheel thread.
+      DSI_THREAD_IDNUM hWheelThreadIDNum;
+      DSI_MUTEX stMutexCriticalSection;                     // Protects the wheel and the entries.
+      DSI_MUTEX stMutexThread;                              // Serializes starting and stopping the thread.
+      DSI_CONDITION_VAR stCondWake;                         // Signalled when an earlier timer is added.
+      DSI_CONDITION_VAR stCondCallbackDone;                 // Signalled when a cancelled timer's callback returns.
+      DSI_CONDITION_VAR stEventWheelThreadExit;             // Event to signal the wheel thread has ended.
+      BOOL bStopWheelThread;
+      BOOL bInitDone;
+      ULONG ulReferences;                                   // Timers alive
+
+      static ULLONG GetTick();
+      BOOL IsWheelThread();
+      void Link(DSI_TIMER_ENTRY *pstEntry_);
+      void Unlink(DSI_TIMER_ENTRY *pstEntry_);
+      BOOL FindNextTick(ULLONG *pullTick_);
+      void Expire(ULLONG ullTick_, ULLONG ullNow_);
+      BOOL Start();
+      void Stop();
+      void Release();
+      void WheelThread();
+      static DSI_THREAD_RETURN ProcessThread(void *pvParameter_);
+
+   public:
+      DSITimerWheel();
+
+      BOOL Add(DSI_TIMER_ENTRY *pstEntry_);
+      void Remove(DSI_TIMER_ENTRY *pstEntry_);
+};
+
+// Lives for the life of the process; the thread only runs while timers exist.
+static DSITimerWheel clWheel;
+
+
 //////////////////////////////////////////////////////////////////////////////////
 // Public Class Functions
 //////////////////////////////////////////////////////////////////////////////////
@@ -26,129 +97,419 @@ DSITimer::DSITimer()
 
 DSITimer::DSITimer(DSI_THREAD_RETURN (*fnTimerFunc_)(void *), void *pvTimerFuncParameter_, ULONG ulInterval_, BOOL bRecurring_)
 {
-   fnTimerFunc = fnTimerFunc_;
-   pvTimerFuncParameter = pvTimerFuncParameter_;
-   ulInterval = ulInterval_;
-   bRecurring = bRecurring_;
-   bClosing = FALSE;
-   hTimerThread = (DSI_THREAD_ID)NULL;
+   pstEntry = (DSI_TIMER_ENTRY*)NULL;
 
-   if (DSIThread_MutexInit(&stMutexCriticalSection) != DSI_THREAD_ENONE)
-   {
-      fnTimerFunc = (void*(*)(void*))NULL;
+   if (fnTimerFunc_ == NULL)
       return;
-   }
 
-   if (DSIThread_CondInit(&stCondTimerThreadExit) != DSI_THREAD_ENONE)
+   pstEntry = new DSI_TIMER_ENTRY;
+   pstEntry->pstNext = (DSI_TIMER_ENTRY*)NULL;
+   pstEntry->ppstPrev = (DSI_TIMER_ENTRY**)NULL;
+   pstEntry->ullExpiry = 0;
+   pstEntry->ulInterval = ulInterval_;
+   pstEntry->bRecurring = bRecurring_;
+   pstEntry->bRunning = FALSE;
+   pstEntry->bCancelled = FALSE;
+   pstEntry->bOrphaned = FALSE;
+   pstEntry->bFinished = FALSE;
+   pstEntry->fnTimerFunc = fnTimerFunc_;
+   pstEntry->pvTimerFuncParameter = pvTimerFuncParameter_;
+
+   if (!clWheel.Add(pstEntry))
    {
-      DSIThread_MutexDestroy(&stMutexCriticalSection);
-      fnTimerFunc = (void*(*)(void*))NULL;
-      return;
+      delete pstEntry;
+      pstEntry = (DSI_TIMER_ENTRY*)NULL;
    }
-
-   if (DSIThread_CondInit(&stCondTimerWait) != DSI_THREAD_ENONE)
+}
+///////////////////////////////////////////////////////////////////////
+DSITimer::~DSITimer()
+{
+   if (pstEntry)
    {
-      DSIThread_MutexDestroy(&stMutexCriticalSection);
-      DSIThread_CondDestroy(&stCondTimerThreadExit);
-      fnTimerFunc = (void*(*)(void*))NULL;
-      return;
+      clWheel.Remove(pstEntry);                                           //Waits for a callback in progress
+      pstEntry = (DSI_TIMER_ENTRY*)NULL;
    }
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSITimer::NoError()
+{
+   if ((pstEntry != NULL) && (pstEntry->bFinished == FALSE))             //A one shot timer that has fired is no longer running
+      return TRUE;
+
+   return FALSE;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// DSITimerWheel
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+DSITimerWheel::DSITimerWheel()
+{
+   for (ULONG i = 0; i < DSI_TIMER_WHEEL_SLOTS; i++)
+      apstSlots[i] = (DSI_TIMER_ENTRY*)NULL;
+
+   for (ULONG i = 0; i < WHEEL_WORDS; i++)
+      aullOccupied[i] = 0;
 
+   ullCurrentTick = 0;
+   ullWakeTick = WHEEL_NEVER;
+   hWheelThread = (DSI_THREAD_ID)NULL;
+   hWheelThreadIDNum = (DSI_THREAD_IDNUM)0;
+   bStopWheelThread = TRUE;
+   ulReferences = 0;
 
-   hTimerThread = DSIThread_CreateThread(&DSITimer::TimerThreadStart, this);
-   if (hTimerThread == NULL)
+   // Runs during static initialization, before any thread can use the wheel.
+   bInitDone = FALSE;
+   if (DSIThread_MutexInit(&stMutexCriticalSection) != DSI_THREAD_ENONE)
+      return;
+
+   if (DSIThread_MutexInit(&stMutexThread) != DSI_THREAD_ENONE)
+      return;
+
+   if (DSIThread_CondInit(&stCondWake) != DSI_THREAD_ENONE)
+      return;
+
+   if (DSIThread_CondInit(&stCondCallbackDone) != DSI_THREAD_ENONE)
+      return;
+
+   if (DSIThread_CondInit(&stEventWheelThreadExit) != DSI_THREAD_ENONE)
+      return;
+
+   bInitDone = TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Schedules a new timer one interval from now, starting the wheel
+// thread if this is the first timer.
+///////////////////////////////////////////////////////////////////////
+BOOL DSITimerWheel::Add(DSI_TIMER_ENTRY *pstEntry_)
+{
+   if (!bInitDone)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexThread);
+   if (hWheelThread == NULL && !Start())
    {
-      DSIThread_MutexDestroy(&stMutexCriticalSection);
-      DSIThread_CondDestroy(&stCondTimerThreadExit);
-      DSIThread_CondDestroy(&stCondTimerWait);
-      fnTimerFunc = (void*(*)(void*))NULL;
+      DSIThread_MutexUnlock(&stMutexThread);
+      return FALSE;
    }
+   ulReferences++;
+   DSIThread_MutexUnlock(&stMutexThread);
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   pstEntry_->ullExpiry = GetTick() + pstEntry_->ulInterval;
+   Link(pstEntry_);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return TRUE;
 }
+
 ///////////////////////////////////////////////////////////////////////
-DSITimer::~DSITimer()
+// Cancels a timer and frees its entry.  If the callback is running on
+// another thread, waits for it to return, as the old per timer thread
+// did.  If the timer is destroyed from a callback, or the callback
+// doesn't return in time, the wheel frees the entry afterwards.
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::Remove(DSI_TIMER_ENTRY *pstEntry_)
 {
-   if (hTimerThread)
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   if (pstEntry_->bRunning)
    {
-      DSIThread_MutexLock(&stMutexCriticalSection);
-      bClosing = TRUE;                                                    //Set the exit flag
-      DSIThread_CondSignal(&stCondTimerWait);                             //Wake up the timer thread early if it is "sleeping"
+      pstEntry_->bCancelled = TRUE;
 
-      if (fnTimerFunc != NULL)                                            //This means the timer thread is still active
+      if (!IsWheelThread())
       {
-         if (DSIThread_CondTimedWait(&stCondTimerThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+         while (pstEntry_->bRunning)
          {
-            // We were unable to stop the thread normally, so kill it.
-            DSIThread_DestroyThread(hTimerThread);
+            if (DSIThread_CondTimedWait(&stCondCallbackDone, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+               break;
          }
       }
-      DSIThread_MutexUnlock(&stMutexCriticalSection);
-
-      DSIThread_ReleaseThreadID(hTimerThread);
-      hTimerThread = (DSI_THREAD_ID)NULL;
 
-      DSIThread_MutexDestroy(&stMutexCriticalSection);
-      DSIThread_CondDestroy(&stCondTimerThreadExit);
-      DSIThread_CondDestroy(&stCondTimerWait);
+      if (pstEntry_->bRunning)
+      {
+         pstEntry_->bOrphaned = TRUE;
+         DSIThread_MutexUnlock(&stMutexCriticalSection);
+         Release();
+         return;
+      }
    }
+
+   Unlink(pstEntry_);
+   delete pstEntry_;
+
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+   Release();
 }
 
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Class Functions
+//////////////////////////////////////////////////////////////////////////////////
+
 ///////////////////////////////////////////////////////////////////////
-BOOL DSITimer::NoError()
+ULLONG DSITimerWheel::GetTick()
 {
-   if ((fnTimerFunc != NULL) && (bClosing == FALSE))   //There was an error if the function pointer is set to NULL and we havent tried to close yet.
-      return TRUE;
+   return DSIThread_GetSystemTimeMicroseconds() / 1000;
+}
 
-   return FALSE;
+///////////////////////////////////////////////////////////////////////
+BOOL DSITimerWheel::IsWheelThread()
+{
+   return (hWheelThread != NULL) && DSIThread_CompareThreads(hWheelThreadIDNum, DSIThread_GetCurrentThreadIDNum());
 }
 
 ///////////////////////////////////////////////////////////////////////
-DSI_THREAD_RETURN DSITimer::TimerThreadStart(void *pvParameter_)
+// Puts an entry in the slot for its expiry.  An expiry that has
+// already been processed is moved up to the next tick.  The mutex must
+// be held.
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::Link(DSI_TIMER_ENTRY *pstEntry_)
 {
-   DSITimer *This = (DSITimer *) pvParameter_;
+   ULONG ulSlot;
 
-   This->TimerThread();
+   if (pstEntry_->ullExpiry < ullCurrentTick)
+      pstEntry_->ullExpiry = ullCurrentTick;
 
-   return 0;
+   ulSlot = (ULONG)(pstEntry_->ullExpiry & WHEEL_MASK);
+
+   pstEntry_->pstNext = apstSlots[ulSlot];
+   if (pstEntry_->pstNext)
+      pstEntry_->pstNext->ppstPrev = &pstEntry_->pstNext;
+   pstEntry_->ppstPrev = &apstSlots[ulSlot];
+   apstSlots[ulSlot] = pstEntry_;
+
+   aullOccupied[ulSlot / 64] |= (ULLONG)1 << (ulSlot % 64);
+
+   if (pstEntry_->ullExpiry < ullWakeTick)
+      DSIThread_CondSignal(&stCondWake);                    // Due before the thread would next wake
 }
 
 ///////////////////////////////////////////////////////////////////////
-void DSITimer::TimerThread(void)
+// Takes an entry out of its slot, if it is in one.  The mutex must be
+// held.
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::Unlink(DSI_TIMER_ENTRY *pstEntry_)
 {
-   ULONG ulWaitTime;
-   ULONG ulTargetTime = DSIThread_GetSystemTime();
+   ULONG ulSlot;
 
-   while(1) //We break on bClosing, but need to check it within the critical section
-   {
-      DSIThread_MutexLock(&stMutexCriticalSection);
-      if (bClosing)
-      {
-         DSIThread_MutexUnlock(&stMutexCriticalSection);
-         break;
-      }
+   if (pstEntry_->ppstPrev == NULL)
+      return;
+
+   *pstEntry_->ppstPrev = pstEntry_->pstNext;
+   if (pstEntry_->pstNext)
+      pstEntry_->pstNext->ppstPrev = pstEntry_->ppstPrev;
+   pstEntry_->pstNext = (DSI_TIMER_ENTRY*)NULL;
+   pstEntry_->ppstPrev = (DSI_TIMER_ENTRY**)NULL;
 
-      ulTargetTime += ulInterval;                                                //set the new target time
-      ulWaitTime = ulTargetTime - DSIThread_GetSystemTime();                     //figure out how long it is from now
+   ulSlot = (ULONG)(pstEntry_->ullExpiry & WHEEL_MASK);
+   if (apstSlots[ulSlot] == NULL)
+      aullOccupied[ulSlot / 64] &= ~((ULLONG)1 << (ulSlot % 64));
+}
+
+///////////////////////////////////////////////////////////////////////
+// Finds the first occupied slot at or after the current tick, within
+// one revolution.  Returns FALSE if the wheel is empty.
+///////////////////////////////////////////////////////////////////////
+BOOL DSITimerWheel::FindNextTick(ULLONG *pullTick_)
+{
+   ULONG ulStart = (ULONG)(ullCurrentTick & WHEEL_MASK);
+   ULONG ulWord = ulStart / 64;
+   ULLONG ullBits = aullOccupied[ulWord] & (~(ULLONG)0 << (ulStart % 64));
 
-      if (ulWaitTime && ulWaitTime < MAX_ULONG/2)                                //check if it we need to wait
+   // One extra word so the bits below ulStart in its word are seen
+   // after wrapping around.
+   for (ULONG i = 0; i <= WHEEL_WORDS; i++)
+   {
+      if (ullBits)
       {
-         if (DSIThread_CondTimedWait(&stCondTimerWait, &stMutexCriticalSection, ulWaitTime) != DSI_THREAD_ETIMEDOUT)   //wait till our next interval
+         ULONG ulSlot = ulWord * 64;
+         ULONG ulDistance;
+
+         while ((ullBits & 1) == 0)
          {
-            //If we get anything other than a timeout we will exit right away
-            bClosing = TRUE;
-            DSIThread_MutexUnlock(&stMutexCriticalSection);
-            break;
+            ullBits >>= 1;
+            ulSlot++;
          }
+
+         ulDistance = (ulSlot - ulStart) & WHEEL_MASK;
+         *pullTick_ = ullCurrentTick + ulDistance;
+         return TRUE;
       }
+
+      ulWord = (ulWord + 1) % WHEEL_WORDS;
+      ullBits = aullOccupied[ulWord];
+   }
+
+   return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Runs the callbacks of the timers that are due in a slot.  Timers in
+// the slot for a later revolution are left alone.  The mutex is
+// released around each callback.
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::Expire(ULLONG ullTick_, ULLONG ullNow_)
+{
+   ULONG ulSlot = (ULONG)(ullTick_ & WHEEL_MASK);
+
+   // Timers added from here on go to later ticks.
+   ullCurrentTick = ullTick_ + 1;
+
+   for (;;)
+   {
+      DSI_TIMER_ENTRY *pstEntry = apstSlots[ulSlot];
+
+      while (pstEntry && pstEntry->ullExpiry > ullNow_)
+         pstEntry = pstEntry->pstNext;
+
+      if (pstEntry == NULL || bStopWheelThread)
+         break;
+
+      Unlink(pstEntry);
+      pstEntry->bRunning = TRUE;
+
       DSIThread_MutexUnlock(&stMutexCriticalSection);
+      pstEntry->fnTimerFunc(pstEntry->pvTimerFuncParameter);
+      DSIThread_MutexLock(&stMutexCriticalSection);
+
+      pstEntry->bRunning = FALSE;
+
+      if (pstEntry->bOrphaned)
+      {
+         delete pstEntry;
+      }
+      else if (pstEntry->bCancelled)
+      {
+         DSIThread_CondBroadcast(&stCondCallbackDone);
+      }
+      else if (pstEntry->bRecurring)
+      {
+         pstEntry->ullExpiry += (pstEntry->ulInterval ? pstEntry->ulInterval : 1);   // Keeps to the original schedule
+         Link(pstEntry);
+      }
+      else
+      {
+         pstEntry->bFinished = TRUE;
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////
+// Starts the wheel thread.  stMutexThread must be held.
+///////////////////////////////////////////////////////////////////////
+BOOL DSITimerWheel::Start()
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bStopWheelThread = FALSE;
+   ullCurrentTick = GetTick();
+   ullWakeTick = WHEEL_NEVER;
+   hWheelThreadIDNum = (DSI_THREAD_IDNUM)0;                 // Set by the thread itself
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   hWheelThread = DSIThread_CreateThread(&DSITimerWheel::ProcessThread, this);
+   if (hWheelThread == NULL)
+   {
+      bStopWheelThread = TRUE;
+      return FALSE;
+   }
 
-      fnTimerFunc(pvTimerFuncParameter);                                         //Call the timer interval function
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Stops the wheel thread.  stMutexThread must be held.
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::Stop()
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bStopWheelThread = TRUE;
+   DSIThread_CondSignal(&stCondWake);
 
-      if (bRecurring == FALSE)
-         bClosing = TRUE;
+   if (DSIThread_CondTimedWait(&stEventWheelThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+   {
+      // We were unable to stop the thread normally, so kill it.
+      DSIThread_DestroyThread(hWheelThread);
    }
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   DSIThread_ReleaseThreadID(hWheelThread);
+   hWheelThread = (DSI_THREAD_ID)NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Drops a timer reference and stops the thread with the last one.  If
+// the last timer is destroyed by a callback, the idle thread is left
+// for the next timer or the next Release().
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::Release()
+{
+   DSIThread_MutexLock(&stMutexThread);
+
+   if (ulReferences)
+      ulReferences--;
+
+   if (ulReferences == 0 && hWheelThread != NULL && !IsWheelThread())
+      Stop();
+
+   DSIThread_MutexUnlock(&stMutexThread);
+}
 
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_RETURN DSITimerWheel::ProcessThread(void *pvParameter_)
+{
+   DSITimerWheel *This = (DSITimerWheel *) pvParameter_;
+
+   DSIThread_SetThreadName("dsi-timer");
+   DSI_ALLOC_THREAD("dsi-timer", DSI_ALLOC_TIMER);
+   This->WheelThread();
+
+   return 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSITimerWheel::WheelThread(void)
+{
    DSIThread_MutexLock(&stMutexCriticalSection);
-      fnTimerFunc = (void*(*)(void*))NULL;
-      DSIThread_CondSignal(&stCondTimerThreadExit);                       // Set an event to alert the main process that the timer thread is finished.
+   hWheelThreadIDNum = DSIThread_GetCurrentThreadIDNum();
+
+   while (!bStopWheelThread)
+   {
+      ULLONG ullNow = GetTick();
+      ULLONG ullTick;
+      ULONG ulWaitTime = DSI_THREAD_INFINITE;
+
+      while (!bStopWheelThread && FindNextTick(&ullTick) && ullTick <= ullNow)
+         Expire(ullTick, ullNow);
+
+      if (bStopWheelThread)
+         break;
+
+      if (FindNextTick(&ullTick))
+      {
+         ullNow = GetTick();
+         if (ullTick <= ullNow)
+            continue;                                       // A callback ran long
+
+         ullWakeTick = ullTick;
+         ulWaitTime = (ULONG)(ullTick - ullNow);
+      }
+      else
+      {
+         // Nothing scheduled; keep the current tick close to now so
+         // the next timer doesn't have to scan empty revolutions.
+         ullCurrentTick = ullNow + 1;
+         ullWakeTick = WHEEL_NEVER;
+      }
+
+      DSIThread_CondTimedWait(&stCondWake, &stMutexCriticalSection, ulWaitTime);
+      ullWakeTick = WHEEL_NEVER;
+   }
+
+   DSIThread_CondSignal(&stEventWheelThreadExit);           // Set an event to alert the main process that the wheel thread is finished.
    DSIThread_MutexUnlock(&stMutexCriticalSection);
 }
@@ -19,27 +19,22 @@ All rights reserved.
 // Public Definitions
 //////////////////////////////////////////////////////////////////////////////////
 
+#define DSI_TIMER_WHEEL_SLOTS          ((ULONG) 4096)       // One slot per millisecond, must be a power of two
 
 
 //////////////////////////////////////////////////////////////////////////////////
 // Public Class Prototypes
 //////////////////////////////////////////////////////////////////////////////////
 
+struct DSI_TIMER_ENTRY;
+
+// All timers share one thread that runs a hashed timing wheel (see
+// dsi_timer.cpp), so the callbacks of different timers never run at the
+// same time and should return quickly.
 class DSITimer
 {
    private:
-      DSI_THREAD_RETURN (*fnTimerFunc)(void *);
-      void *pvTimerFuncParameter;
-      BOOL bClosing;
-      DSI_MUTEX stMutexCriticalSection;
-      DSI_CONDITION_VAR stCondTimerWait;
-      DSI_CONDITION_VAR stCondTimerThreadExit;
-      DSI_THREAD_ID hTimerThread;
-      BOOL bRecurring;
-      ULONG ulInterval;
-
-      static DSI_THREAD_RETURN TimerThreadStart(void *pvParameter_);
-      void TimerThread(void);
+      DSI_TIMER_ENTRY *pstEntry;                            // The timer's place in the wheel
 
    public:
 
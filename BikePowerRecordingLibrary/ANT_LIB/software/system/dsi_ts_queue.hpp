@@ -9,28 +9,41 @@ All rights reserved.
 #ifndef DSI_TS_QUEUE_HPP
 #define DSI_TS_QUEUE_HPP
 
-#include <list>
-#include <queue>
-#include <deque>
+#define TS_QUEUE_DEFAULT_CAPACITY   ((ULONG) 8192)
 
 
 //NOTE: Make sure nobody is still using this queue when it is being destroyed!
-template < class T, class Container = std::deque<T> >
+//The elements are kept in a ring that is allocated up front and only grows
+//(doubling) when a burst overflows it, so once the queue has seen its
+//largest backlog pushing and popping never allocates.
+template < class T >
 class TSQueue  //thread-safe queue
 {
   public:
 
-   TSQueue()
+   TSQueue(ULONG ulCapacity_ = TS_QUEUE_DEFAULT_CAPACITY)
    {
       UCHAR ret;
+
+      ulCapacity = 1;
+      while(ulCapacity < ulCapacity_)
+         ulCapacity <<= 1;
+      ptRing = new T[ulCapacity];
+      ulHead = 0;
+      ulCount = 0;
+
       ret = DSIThread_CondInit(&stEventPush);
       if(ret != DSI_THREAD_ENONE)
+      {
+         delete[] ptRing;
          throw; //!!Need to throw something!
+      }
 
       ret = DSIThread_MutexInit(&stMutex);
       if(ret != DSI_THREAD_ENONE)
       {
          DSIThread_CondDestroy(&stEventPush);
+         delete[] ptRing;
          throw; //!!Need to throw something!
       }
 
@@ -41,6 +54,7 @@ class TSQueue  //thread-safe queue
    {
       DSIThread_MutexDestroy(&stMutex);
       DSIThread_CondDestroy(&stEventPush);
+      delete[] ptRing;
       return;
    }
 
@@ -49,7 +63,11 @@ class TSQueue  //thread-safe queue
    {
       DSIThread_MutexLock(&stMutex);
       {
-         clQueue.push(tElement_);
+         if(ulCount == ulCapacity)
+            Grow(ulCount + 1);
+
+         ptRing[(ulHead + ulCount) & (ulCapacity - 1)] = tElement_;
+         ulCount++;
          DSIThread_CondSignal(&stEventPush);
       }
       DSIThread_MutexUnlock(&stMutex);
@@ -63,8 +81,12 @@ class TSQueue  //thread-safe queue
 
       DSIThread_MutexLock(&stMutex);
       {
-         for(ULONG i=0; i<ulSize_; i++)      //!!would it be faster if we assigned or used an iterator instead of pushing?
-            clQueue.push(ptElementArray_[i]);
+         if(ulSize_ > ulCapacity - ulCount)
+            Grow(ulCount + ulSize_);
+
+         for(ULONG i=0; i<ulSize_; i++)
+            ptRing[(ulHead + ulCount + i) & (ulCapacity - 1)] = ptElementArray_[i];
+         ulCount += ulSize_;
          DSIThread_CondSignal(&stEventPush);
       }
       DSIThread_MutexUnlock(&stMutex);
@@ -77,19 +99,20 @@ class TSQueue  //thread-safe queue
    {
       DSIThread_MutexLock(&stMutex);
       {
-         if(clQueue.empty() == TRUE)
+         if(ulCount == 0)
          {
             UCHAR ret;
             ret = DSIThread_CondTimedWait(&stEventPush, &stMutex, ulWaitTime_);
-            if(ret != DSI_THREAD_ENONE)
+            if(ret != DSI_THREAD_ENONE || ulCount == 0)   //Woken without an element
             {
                DSIThread_MutexUnlock(&stMutex);
                return FALSE;
             }
          }
 
-         tElement_ = clQueue.front();
-         clQueue.pop();
+         tElement_ = ptRing[ulHead];
+         ulHead = (ulHead + 1) & (ulCapacity - 1);
+         ulCount--;
       }
       DSIThread_MutexUnlock(&stMutex);
 
@@ -104,30 +127,22 @@ class TSQueue  //thread-safe queue
 
       DSIThread_MutexLock(&stMutex);
       {
-         if(clQueue.empty() == TRUE)
+         if(ulCount == 0)
          {
             UCHAR ret;
             ret = DSIThread_CondTimedWait(&stEventPush, &stMutex, ulWaitTime_);
-            if(ret != DSI_THREAD_ENONE)
+            if(ret != DSI_THREAD_ENONE || ulCount == 0)   //Woken without an element
             {
                DSIThread_MutexUnlock(&stMutex);
                return 0;
             }
          }
 
-         size_t QueueSize = clQueue.size();
-
-         if (QueueSize > MAX_ULONG)
-            QueueSize = MAX_ULONG;
-
-         ULONG ulQueueSize = (ULONG)QueueSize;
-
-         ULONG ulSize = (ulMaxSize_ < ulQueueSize) ? ulMaxSize_ : ulQueueSize;  //MIN(ulMaxSize_, ulQueueSize);
+         ULONG ulSize = (ulMaxSize_ < ulCount) ? ulMaxSize_ : ulCount;  //MIN(ulMaxSize_, ulCount);
          for(ULONG i=0; i<ulSize; i++)
-         {
-            ptElementArray_[i] = clQueue.front();
-            clQueue.pop();
-         }
+            ptElementArray_[i] = ptRing[(ulHead + i) & (ulCapacity - 1)];
+         ulHead = (ulHead + ulSize) & (ulCapacity - 1);
+         ulCount -= ulSize;
          ulFinalSize = ulSize;
       }
       DSIThread_MutexUnlock(&stMutex);
@@ -140,7 +155,27 @@ class TSQueue  //thread-safe queue
    DSI_CONDITION_VAR stEventPush;
    DSI_MUTEX stMutex;
 
-   std::queue<T, Container> clQueue;
+   T* ptRing;
+   ULONG ulCapacity;    //Always a power of two
+   ULONG ulHead;        //Oldest element
+   ULONG ulCount;
+
+   //Call with the mutex held.
+   void Grow(ULONG ulMinCapacity_)
+   {
+      ULONG ulNewCapacity = ulCapacity;
+      while(ulNewCapacity < ulMinCapacity_)
+         ulNewCapacity <<= 1;
+
+      T* ptNewRing = new T[ulNewCapacity];
+      for(ULONG i=0; i<ulCount; i++)
+         ptNewRing[i] = ptRing[(ulHead + i) & (ulCapacity - 1)];
+
+      delete[] ptRing;
+      ptRing = ptNewRing;
+      ulCapacity = ulNewCapacity;
+      ulHead = 0;
+   }
 
 };
 
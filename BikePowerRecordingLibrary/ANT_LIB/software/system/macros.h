@@ -33,8 +33,10 @@ extern "C" {
 
 #if defined(_MSC_VER)
    #define FPRINTF                     fprintf_s
+   #define VSNPRINTF(dst, num, fmt, args)    vsnprintf_s(dst, num, _TRUNCATE, fmt, args)
 #else
    #define FPRINTF                     fprintf
+   #define VSNPRINTF(dst, num, fmt, args)    vsnprintf(dst, num, fmt, args)
 #endif
    ////////////////////////////////////////////////////////////////////
    // Parameters:
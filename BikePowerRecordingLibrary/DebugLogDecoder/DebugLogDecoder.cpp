@@ -0,0 +1,597 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+////////////////////////////////////////////////////////////////////////////////
+// DebugLogDecoder
+//
+// Reads the binary debug log written by DSIDebug::SetBinary(TRUE) and prints
+// it as the text logs would have been written, or as a timeline of the ANT
+// messages on each channel.
+//
+// Usage: DebugLogDecoder <file> [-p port] [-t thread] [-c]
+//
+//    file                 The binary log (ao_debug.bin)
+//    -p port              Only the serial records of a port
+//    -t thread            Only the records logged by a thread, given by its
+//                         ThreadInit() name or by the number printed for it
+//    -c                   Print a timeline of the "Tx" and "Rx" messages of
+//                         each channel, with the gaps between them
+//
+// Links with ANT_LIB (DebugLogDecoder.vcxproj, or "make DebugLogDecoder").
+////////////////////////////////////////////////////////////////////////////////
+
+#include "types.h"
+#include "antdefines.h"
+#include "antmessage.h"
+#include "dsi_debug_binary.hpp"
+#include "macros.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE_LENGTH             4096
+#define MAX_NAME_LENGTH             64
+#define MAX_PORTS                   256
+#define MAX_CHANNELS                (CHANNEL_NUMBER_MASK + 1)
+#define NO_FILTER                   -1
+
+#define DIRECTION_TX                0
+#define DIRECTION_RX                1
+
+// One record of the log.
+typedef struct
+{
+    UCHAR ucType;
+    UCHAR ucThread;                 // Logging thread the record came from
+    UCHAR ucDestination;            // Thread log number, or the port of a serial record
+    ULLONG ullTime;                 // us
+    const UCHAR *pucPayload;
+    ULONG ulSize;
+} RECORD;
+
+// The log and what has been learned from it so far.
+typedef struct
+{
+    UCHAR *pucFile;
+    ULONG ulFileSize;
+    ULONG ulPos;
+    ULLONG ullStartTime;
+    ULLONG ullTime;
+    char *apcStrings[DSI_DEBUG_BINARY_STRINGS];
+    char aacThreadNames[DSI_DEBUG_BINARY_MAX_THREADS][MAX_NAME_LENGTH];
+} DECODER;
+
+// Message counts and gaps for one message ID in one direction.
+typedef struct
+{
+    ULONG ulCount;
+    ULLONG ullFirst;
+    ULLONG ullLast;
+    ULLONG ullLongestGap;
+    double dLongestGapStart;        // s, in the session it was in
+} MESSAGE_STATS;
+
+////////////////////////////////////////////////////////////////////////////////
+// Starts reading the log from its beginning.
+////////////////////////////////////////////////////////////////////////////////
+static BOOL Rewind(DECODER *pstDecoder_)
+{
+    if (pstDecoder_->ulFileSize < DSI_DEBUG_BINARY_MAGIC_SIZE + sizeof(ULLONG) ||
+        memcmp(pstDecoder_->pucFile, DSI_DEBUG_BINARY_MAGIC, DSI_DEBUG_BINARY_MAGIC_SIZE) != 0)
+        return FALSE;
+
+    pstDecoder_->ullStartTime = 0;
+    for (UCHAR i = 0; i < sizeof(ULLONG); i++)
+        pstDecoder_->ullStartTime |= (ULLONG)pstDecoder_->pucFile[DSI_DEBUG_BINARY_MAGIC_SIZE + i] << (i * 8);
+
+    pstDecoder_->ullTime = pstDecoder_->ullStartTime;
+    pstDecoder_->ulPos = DSI_DEBUG_BINARY_MAGIC_SIZE + sizeof(ULLONG);
+
+    for (ULONG i = 0; i < DSI_DEBUG_BINARY_STRINGS; i++)
+    {
+        free(pstDecoder_->apcStrings[i]);
+        pstDecoder_->apcStrings[i] = (char*)NULL;
+    }
+
+    for (UCHAR i = 0; i < DSI_DEBUG_BINARY_MAX_THREADS; i++)
+        sprintf(pstDecoder_->aacThreadNames[i], "Thread%u", i);
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reads the next record.  Strings, thread names and new sessions are
+// remembered here as well as being returned.  Returns FALSE at the end of
+// the log, or where it is cut short.
+////////////////////////////////////////////////////////////////////////////////
+static BOOL ReadRecord(DECODER *pstDecoder_, RECORD *pstRecord_)
+{
+    const UCHAR *pucFile = pstDecoder_->pucFile;
+    ULONG ulFileSize = pstDecoder_->ulFileSize;
+    ULONG ulPos = pstDecoder_->ulPos;
+    SLLONG sllDelta;
+    ULLONG ullSize;
+
+    if (ulPos + 2 > ulFileSize)
+        return FALSE;
+
+    pstRecord_->ucType = pucFile[ulPos] & 0x07;
+    pstRecord_->ucThread = pucFile[ulPos] >> 3;
+    pstRecord_->ucDestination = pucFile[ulPos + 1];
+    ulPos += 2;
+
+    if (!DSIDebugBinary::GetSignedVarint(pucFile, ulFileSize, &ulPos, &sllDelta) ||
+        !DSIDebugBinary::GetVarint(pucFile, ulFileSize, &ulPos, &ullSize) ||
+        ullSize > ulFileSize - ulPos)
+        return FALSE;
+
+    pstDecoder_->ullTime += (ULLONG)sllDelta;
+    pstRecord_->ullTime = pstDecoder_->ullTime;
+    pstRecord_->pucPayload = &pucFile[ulPos];
+    pstRecord_->ulSize = (ULONG)ullSize;
+    pstDecoder_->ulPos = ulPos + (ULONG)ullSize;
+
+    if (pstRecord_->ucType == DSI_DEBUG_BINARY_STRING)
+    {
+        ULONG ulStart = 0;
+        ULLONG ullID;
+
+        if (DSIDebugBinary::GetVarint(pstRecord_->pucPayload, pstRecord_->ulSize, &ulStart, &ullID) && ullID < DSI_DEBUG_BINARY_STRINGS)
+        {
+            ULONG ulLength = pstRecord_->ulSize - ulStart;
+            char *pcString = (char*)malloc(ulLength + 1);
+
+            memcpy(pcString, &pstRecord_->pucPayload[ulStart], ulLength);
+            pcString[ulLength] = '\0';
+            free(pstDecoder_->apcStrings[ullID]);
+            pstDecoder_->apcStrings[ullID] = pcString;
+        }
+    }
+    else if (pstRecord_->ucType == DSI_DEBUG_BINARY_THREAD_NAME)
+    {
+        ULONG ulLength = pstRecord_->ulSize < MAX_NAME_LENGTH ? pstRecord_->ulSize : MAX_NAME_LENGTH - 1;
+
+        memcpy(pstDecoder_->aacThreadNames[pstRecord_->ucThread], pstRecord_->pucPayload, ulLength);
+        pstDecoder_->aacThreadNames[pstRecord_->ucThread][ulLength] = '\0';
+    }
+    else if (pstRecord_->ucType == DSI_DEBUG_BINARY_SESSION)
+    {
+        pstDecoder_->ullStartTime = pstRecord_->ullTime;
+    }
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns a string sent earlier in the log.
+////////////////////////////////////////////////////////////////////////////////
+static const char *GetString(DECODER *pstDecoder_, ULLONG ullID_)
+{
+    if (ullID_ >= DSI_DEBUG_BINARY_STRINGS || pstDecoder_->apcStrings[ullID_] == NULL)
+        return "(unknown)";
+
+    return pstDecoder_->apcStrings[ullID_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prints the time of a record the way the text logs do.
+////////////////////////////////////////////////////////////////////////////////
+static int FormatTime(DECODER *pstDecoder_, ULLONG ullTime_, char *pcLine_)
+{
+    double dElapsed = (double)(SLLONG)(ullTime_ - pstDecoder_->ullStartTime) / 1000000.0;
+
+    return sprintf(pcLine_, "%10.3f {%10lu}", dElapsed, (unsigned long)(ullTime_ / 1000));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rebuilds the ThreadPrintf() line of a FORMAT record.
+////////////////////////////////////////////////////////////////////////////////
+static void FormatArguments(DECODER *pstDecoder_, RECORD *pstRecord_, char *pcLine_, ULONG ulRoom_)
+{
+    const UCHAR *pucData = pstRecord_->pucPayload;
+    ULONG ulSize = pstRecord_->ulSize;
+    ULONG ulPos = 0;
+    ULONG ulLength = 0;
+    ULLONG ullFormat;
+
+    pcLine_[0] = '\0';
+    if (!DSIDebugBinary::GetVarint(pucData, ulSize, &ulPos, &ullFormat))
+        return;
+    for (const char *pcPos = GetString(pstDecoder_, ullFormat); *pcPos != '\0' && ulLength < ulRoom_ - 1;)
+    {
+        char acSpec[DSI_DEBUG_MAX_SPEC_LENGTH];
+        char acString[MAX_LINE_LENGTH];
+        UCHAR ucArgType;
+        SLLONG sllValue = 0;
+        double dValue = 0;
+
+        if (*pcPos != '%')
+        {
+            pcLine_[ulLength++] = *pcPos++;
+            pcLine_[ulLength] = '\0';
+            continue;
+        }
+
+        pcPos += DSIDebugBinary::ParseConversion(pcPos, acSpec, &ucArgType);
+
+        if (ucArgType == DSI_DEBUG_ARG_STRING)
+        {
+            ULLONG ullLength;
+
+            if (!DSIDebugBinary::GetVarint(pucData, ulSize, &ulPos, &ullLength) || ullLength > ulSize - ulPos || ullLength >= sizeof(acString))
+                break;
+            memcpy(acString, &pucData[ulPos], (size_t)ullLength);
+            acString[ullLength] = '\0';
+            ulPos += (ULONG)ullLength;
+        }
+        else if (ucArgType == DSI_DEBUG_ARG_DOUBLE)
+        {
+            ULLONG ullBits = 0;
+
+            if (ulPos + sizeof(ULLONG) > ulSize)
+                break;
+            for (UCHAR i = 0; i < sizeof(ULLONG); i++)
+                ullBits |= (ULLONG)pucData[ulPos++] << (i * 8);
+            memcpy(&dValue, &ullBits, sizeof(dValue));
+        }
+        else if (ucArgType != DSI_DEBUG_ARG_LITERAL && ucArgType != DSI_DEBUG_ARG_PERCENT)
+        {
+            if (!DSIDebugBinary::GetSignedVarint(pucData, ulSize, &ulPos, &sllValue))
+                break;
+        }
+
+        char *pcOut = pcLine_ + ulLength;
+        size_t uRoom = ulRoom_ - ulLength;
+        switch (ucArgType)
+        {
+            case DSI_DEBUG_ARG_INT:     SNPRINTF(pcOut, uRoom, acSpec, (int)sllValue); break;
+            case DSI_DEBUG_ARG_LONG:    SNPRINTF(pcOut, uRoom, acSpec, (long)sllValue); break;
+            case DSI_DEBUG_ARG_LLONG:   SNPRINTF(pcOut, uRoom, acSpec, sllValue); break;
+            case DSI_DEBUG_ARG_DOUBLE:  SNPRINTF(pcOut, uRoom, acSpec, dValue); break;
+            case DSI_DEBUG_ARG_POINTER: SNPRINTF(pcOut, uRoom, acSpec, (void*)(size_t)sllValue); break;
+            case DSI_DEBUG_ARG_STRING:  SNPRINTF(pcOut, uRoom, acSpec, acString); break;
+            case DSI_DEBUG_ARG_PERCENT: SNPRINTF(pcOut, uRoom, "%%"); break;
+            default:                    SNPRINTF(pcOut, uRoom, "%s", acSpec); break;
+        }
+        ulLength += (ULONG)strlen(pcOut);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prints a record the way its text log would have.  Returns FALSE for
+// records that have no line of their own.
+////////////////////////////////////////////////////////////////////////////////
+static BOOL FormatRecord(DECODER *pstDecoder_, RECORD *pstRecord_, char *pcLine_)
+{
+    int iLength;
+
+    switch (pstRecord_->ucType)
+    {
+        case DSI_DEBUG_BINARY_SERIAL:
+        {
+            ULONG ulPos = 0;
+            ULLONG ullSerialSize;
+            ULLONG ullHeader;
+
+            if (!DSIDebugBinary::GetVarint(pstRecord_->pucPayload, pstRecord_->ulSize, &ulPos, &ullSerialSize) ||
+                !DSIDebugBinary::GetVarint(pstRecord_->pucPayload, pstRecord_->ulSize, &ulPos, &ullHeader))
+                return FALSE;
+
+            iLength = sprintf(pcLine_, "Device%-10u", pstRecord_->ucDestination);
+            iLength += FormatTime(pstDecoder_, pstRecord_->ullTime, pcLine_ + iLength);
+            iLength += SNPRINTF(pcLine_ + iLength, MAX_LINE_LENGTH / 2, " %s - %s", GetString(pstDecoder_, ullHeader), ullSerialSize == 0 ? "NO DATA" : "");
+
+            for (; ulPos < pstRecord_->ulSize; ulPos++)
+                iLength += sprintf(pcLine_ + iLength, "[%02X]", pstRecord_->pucPayload[ulPos]);
+            return TRUE;
+        }
+
+        case DSI_DEBUG_BINARY_TEXT:
+        case DSI_DEBUG_BINARY_FORMAT:
+        {
+            char acMessage[MAX_LINE_LENGTH / 2];
+
+            if (pstRecord_->ucType == DSI_DEBUG_BINARY_TEXT)
+            {
+                ULONG ulLength = pstRecord_->ulSize < sizeof(acMessage) ? pstRecord_->ulSize : sizeof(acMessage) - 1;
+
+                memcpy(acMessage, pstRecord_->pucPayload, ulLength);
+                acMessage[ulLength] = '\0';
+            }
+            else
+            {
+                FormatArguments(pstDecoder_, pstRecord_, acMessage, sizeof(acMessage));
+            }
+
+            // Messages end with their own newline, as they are written to the text log.
+            iLength = (int)strlen(acMessage);
+            if (iLength > 0 && acMessage[iLength - 1] == '\n')
+                acMessage[iLength - 1] = '\0';
+
+            iLength = sprintf(pcLine_, "%-16s", pstDecoder_->aacThreadNames[pstRecord_->ucThread]);
+            iLength += FormatTime(pstDecoder_, pstRecord_->ullTime, pcLine_ + iLength);
+            sprintf(pcLine_ + iLength, ": %s", acMessage);
+            return TRUE;
+        }
+
+        case DSI_DEBUG_BINARY_DROPPED:
+        {
+            ULONG ulPos = 0;
+            ULLONG ullDropped = 0;
+
+            DSIDebugBinary::GetVarint(pstRecord_->pucPayload, pstRecord_->ulSize, &ulPos, &ullDropped);
+            iLength = sprintf(pcLine_, "%-16s", pstDecoder_->aacThreadNames[pstRecord_->ucThread]);
+            iLength += FormatTime(pstDecoder_, pstRecord_->ullTime, pcLine_ + iLength);
+            sprintf(pcLine_ + iLength, ": *** ERROR: %llu LOG RECORDS DROPPED! ***", (unsigned long long)ullDropped);
+            return TRUE;
+        }
+
+        case DSI_DEBUG_BINARY_SESSION:
+            sprintf(pcLine_, "New Session.");
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds the ANT message in a "Tx" or "Rx" serial record.  Returns FALSE for
+// other records and for messages that aren't about one channel.
+////////////////////////////////////////////////////////////////////////////////
+static BOOL GetChannelMessage(DECODER *pstDecoder_, RECORD *pstRecord_, UCHAR *pucDirection_, UCHAR *pucChannel_, const UCHAR **ppucMessage_, UCHAR *pucSize_)
+{
+    ULONG ulPos = 0;
+    ULLONG ullSerialSize;
+    ULLONG ullHeader;
+
+    if (pstRecord_->ucType != DSI_DEBUG_BINARY_SERIAL ||
+        !DSIDebugBinary::GetVarint(pstRecord_->pucPayload, pstRecord_->ulSize, &ulPos, &ullSerialSize) ||
+        !DSIDebugBinary::GetVarint(pstRecord_->pucPayload, pstRecord_->ulSize, &ulPos, &ullHeader))
+        return FALSE;
+
+    const char *pcHeader = GetString(pstDecoder_, ullHeader);
+    if (strcmp(pcHeader, "Tx") == 0)
+        *pucDirection_ = DIRECTION_TX;
+    else if (strcmp(pcHeader, "Rx") == 0)
+        *pucDirection_ = DIRECTION_RX;
+    else
+        return FALSE;
+
+    // [sync][size][ID][data...], channel messages have the channel first
+    const UCHAR *pucFrame = &pstRecord_->pucPayload[ulPos];
+    ULONG ulFrameSize = pstRecord_->ulSize - ulPos;
+    if (ulFrameSize < 4 || pucFrame[0] != MESG_TX_SYNC || pucFrame[1] == 0 || (ULONG)pucFrame[1] + 3 > ulFrameSize)
+        return FALSE;
+
+    switch (pucFrame[2])
+    {
+        case MESG_VERSION_ID:
+        case MESG_NETWORK_KEY_ID:
+        case MESG_SYSTEM_RESET_ID:
+        case MESG_CAPABILITIES_ID:
+        case MESG_GET_SERIAL_NUM_ID:
+        case MESG_STARTUP_MESG_ID:
+        case MESG_SERIAL_ERROR_ID:
+        case MESG_ANTLIB_CONFIG_ID:
+            return FALSE;
+        default:
+            break;
+    }
+
+    *pucChannel_ = pucFrame[3] & CHANNEL_NUMBER_MASK;
+    *ppucMessage_ = &pucFrame[2];
+    *pucSize_ = (UCHAR)(pucFrame[1] + 1);
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Prints the messages of each channel in turn, then how often each kind
+// arrived and the longest gap between them.
+////////////////////////////////////////////////////////////////////////////////
+static void PrintTimelines(DECODER *pstDecoder_, int iPort_)
+{
+    static BOOL abSeen[MAX_PORTS][MAX_CHANNELS];
+    static MESSAGE_STATS astStats[2][256];
+    RECORD stRecord;
+    UCHAR ucDirection;
+    UCHAR ucChannel;
+    const UCHAR *pucMessage;
+    UCHAR ucSize;
+
+    while (ReadRecord(pstDecoder_, &stRecord))
+    {
+        if (GetChannelMessage(pstDecoder_, &stRecord, &ucDirection, &ucChannel, &pucMessage, &ucSize))
+            abSeen[stRecord.ucDestination][ucChannel] = TRUE;
+    }
+
+    for (int iPort = 0; iPort < MAX_PORTS; iPort++)
+    {
+        if (iPort_ != NO_FILTER && iPort != iPort_)
+            continue;
+
+        for (int iChannel = 0; iChannel < MAX_CHANNELS; iChannel++)
+        {
+            ULLONG ullLast = 0;
+
+            if (!abSeen[iPort][iChannel])
+                continue;
+
+            memset(astStats, 0, sizeof(astStats));
+            printf("Device%d channel %d\n", iPort, iChannel);
+            printf("      time       gap  dir  ID  data\n");
+
+            Rewind(pstDecoder_);
+            while (ReadRecord(pstDecoder_, &stRecord))
+            {
+                if (stRecord.ucDestination != iPort ||
+                    !GetChannelMessage(pstDecoder_, &stRecord, &ucDirection, &ucChannel, &pucMessage, &ucSize) ||
+                    ucChannel != iChannel)
+                    continue;
+
+                printf("%10.3f %9.3f  %s  %02X  ",
+                    (double)(SLLONG)(stRecord.ullTime - pstDecoder_->ullStartTime) / 1000000.0,
+                    ullLast ? (double)(SLLONG)(stRecord.ullTime - ullLast) / 1000000.0 : 0.0,
+                    ucDirection == DIRECTION_TX ? "Tx" : "Rx", pucMessage[0]);
+                for (UCHAR i = 1; i < ucSize; i++)
+                    printf("[%02X]", pucMessage[i]);
+                printf("\n");
+                ullLast = stRecord.ullTime;
+
+                MESSAGE_STATS *pstStats = &astStats[ucDirection][pucMessage[0]];
+                if (pstStats->ulCount == 0)
+                {
+                    pstStats->ullFirst = stRecord.ullTime;
+                }
+                else if (stRecord.ullTime - pstStats->ullLast > pstStats->ullLongestGap)
+                {
+                    pstStats->ullLongestGap = stRecord.ullTime - pstStats->ullLast;
+                    pstStats->dLongestGapStart = (double)(SLLONG)(pstStats->ullLast - pstDecoder_->ullStartTime) / 1000000.0;
+                }
+                pstStats->ullLast = stRecord.ullTime;
+                pstStats->ulCount++;
+            }
+
+            for (UCHAR ucDir = 0; ucDir < 2; ucDir++)
+            {
+                for (int iID = 0; iID < 256; iID++)
+                {
+                    MESSAGE_STATS *pstStats = &astStats[ucDir][iID];
+
+                    if (pstStats->ulCount == 0)
+                        continue;
+
+                    printf("  %s %02X: %lu messages", ucDir == DIRECTION_TX ? "Tx" : "Rx", iID, pstStats->ulCount);
+                    if (pstStats->ulCount > 1)
+                        printf(", mean gap %.3f s, longest gap %.3f s after %.3f",
+                            (double)(pstStats->ullLast - pstStats->ullFirst) / 1000000.0 / (pstStats->ulCount - 1),
+                            (double)pstStats->ullLongestGap / 1000000.0,
+                            pstStats->dLongestGapStart);
+                    printf("\n");
+                }
+            }
+            printf("\n");
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returns the logging thread given by name or number, NO_FILTER if it's not
+// in the log.
+////////////////////////////////////////////////////////////////////////////////
+static int FindThread(DECODER *pstDecoder_, const char *pcThread_)
+{
+    RECORD stRecord;
+    char *pcEnd;
+    long lNumber = strtol(pcThread_, &pcEnd, 10);
+
+    if (*pcEnd == '\0' && lNumber >= 0 && lNumber < DSI_DEBUG_BINARY_MAX_THREADS)
+        return (int)lNumber;
+
+    // Names are only known once the log has named the thread
+    while (ReadRecord(pstDecoder_, &stRecord))
+    {
+        if (stRecord.ucType == DSI_DEBUG_BINARY_THREAD_NAME && strcmp(pstDecoder_->aacThreadNames[stRecord.ucThread], pcThread_) == 0)
+            return stRecord.ucThread;
+    }
+
+    return NO_FILTER;
+}
+
+int main(int argc, char **argv)
+{
+    static DECODER stDecoder;
+    int iPort = NO_FILTER;
+    int iThread = NO_FILTER;
+    const char *pcThread = (const char*)NULL;
+    BOOL bTimelines = FALSE;
+    FILE *pfFile;
+    long lSize;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <file> [-p port] [-t thread] [-c]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            iPort = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            pcThread = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0)
+            bTimelines = TRUE;
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    pfFile = fopen(argv[1], "rb");
+    if (pfFile == NULL)
+    {
+        printf("Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    fseek(pfFile, 0, SEEK_END);
+    lSize = ftell(pfFile);
+    fseek(pfFile, 0, SEEK_SET);
+
+    stDecoder.pucFile = (UCHAR*)malloc(lSize > 0 ? (size_t)lSize : 1);
+    stDecoder.ulFileSize = (ULONG)fread(stDecoder.pucFile, 1, (size_t)(lSize > 0 ? lSize : 0), pfFile);
+    fclose(pfFile);
+
+    if (!Rewind(&stDecoder))
+    {
+        printf("%s is not a binary debug log\n", argv[1]);
+        return 1;
+    }
+
+    if (bTimelines)
+    {
+        PrintTimelines(&stDecoder, iPort);
+        return 0;
+    }
+
+    if (pcThread != NULL)
+    {
+        iThread = FindThread(&stDecoder, pcThread);
+        if (iThread == NO_FILTER)
+        {
+            printf("No thread %s in the log\n", pcThread);
+            return 1;
+        }
+        Rewind(&stDecoder);
+    }
+
+    RECORD stRecord;
+    char acLine[MAX_LINE_LENGTH];
+    while (ReadRecord(&stDecoder, &stRecord))
+    {
+        if (stRecord.ucType != DSI_DEBUG_BINARY_SESSION)
+        {
+            if (iPort != NO_FILTER && (stRecord.ucType != DSI_DEBUG_BINARY_SERIAL || stRecord.ucDestination != iPort))
+                continue;
+            if (iThread != NO_FILTER && stRecord.ucThread != iThread)
+                continue;
+        }
+
+        if (FormatRecord(&stDecoder, &stRecord, acLine))
+            printf("%s\n", acLine);
+    }
+
+    if (stDecoder.ulPos != stDecoder.ulFileSize)
+        printf("*** Log ends in the middle of a record ***\n");
+
+    return 0;
+}
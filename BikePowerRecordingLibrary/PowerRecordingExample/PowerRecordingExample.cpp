@@ -14,6 +14,10 @@ All rights reserved.
 #include "dsi_thread.h"
 #include "dsi_serial_generic.hpp"
 #include "dsi_debug.hpp"
+#include "dsi_stats.hpp"
+#include "dsi_alloc_audit.hpp"
+#include "dsi_latency_trace.hpp"
+#include "macros.h"
 
 extern "C" {
 #include "PowerDecoder.h"
@@ -38,6 +42,8 @@ extern "C" {
 
 #define MESSAGE_TIMEOUT       (1000)
 
+#define USER_STATS_SOCKET     "/tmp/ant_power_stats.sock"   // Stats endpoint (where Unix domain sockets are available)
+
 // Indexes into message recieved from ANT
 #define MESSAGE_BUFFER_DATA1_INDEX ((UCHAR) 0)
 #define MESSAGE_BUFFER_DATA2_INDEX ((UCHAR) 1)
@@ -57,6 +63,8 @@ extern "C" {
 #define MESSAGE_BUFFER_DATA16_INDEX ((UCHAR) 15)
 
 FILE *fp1; // output file
+BOOL bStartupDone = FALSE; // records are flowing, so the receive path should no longer allocate
+DSILatencyTrace *pclLatencyTrace = (DSILatencyTrace*)NULL; // times messages from the serial read to the record
 
 ////////////////////////////////////////////////////////////////////////////////
 // main
@@ -75,6 +83,9 @@ FILE *fp1; // output file
 //
 // Comment to USB port 0, wild card device number, record at 1.0s intervals, from an event based power meter
 //
+// Adding "scan" as the last argument opens the receiver in continuous scan mode
+// and records every power meter in range rather than a single device.
+//
 // If the optional arguments are not supplied, the user will
 // be prompted to enter them after the program starts.
 //
@@ -91,6 +102,12 @@ int main(int argc, char **argv)
     UCHAR ucPowerMeterType = 254;
     DOUBLE dReSyncInterval = 0;
 
+    if (argc > 1 && strcmp(argv[argc - 1], "scan") == 0)
+    {
+        ucChannelType = CHANNEL_TYPE_SCAN;
+        argc--;
+    }
+
     if (argc == 6)
     {
         ucDeviceNumber = (UCHAR)atoi(argv[1]);
@@ -128,6 +145,7 @@ Example::Example()
     ucChannelType = CHANNEL_TYPE_INVALID;
     pclSerialObject = (DSISerialGeneric*)NULL;
     pclMessageObject = (DSIFramerANT*)NULL;
+    pstPowerScan = (POWERSCAN*)NULL;
     uiDSIThread = (DSI_THREAD_ID)NULL;
     bMyDone = FALSE;
     bDone = FALSE;
@@ -135,9 +153,7 @@ Example::Example()
     bBroadcasting = FALSE;
     bPowerDecoderInitialized = FALSE;
 
-    ulNewEventTime = 0;
-    usPreviousEventTime = 0;
-    previousRxTime = time(NULL);
+    RxTimeBase_Init(&stRxTimeBase, 0);
 
     ucPowerOnlyUpdateEventCount = 0;
     dRxTimeTePs = 0;
@@ -158,6 +174,9 @@ Example::~Example()
 
     if (pclSerialObject)
         delete pclSerialObject;
+
+    if (pstPowerScan)
+        delete pstPowerScan;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -284,6 +303,7 @@ BOOL Example::Init(UCHAR ucDeviceNumber_, UCHAR ucChannelType_, USHORT usAntDevi
     dRecordInterval = dRecordInterval_;
     dTimeBase = dTimeBase_;
     dReSyncInterval = dReSyncInterval_;
+    ucPowerMeterType = ucPowerMeterType_;
     SetPowerMeterType(ucPowerMeterType_);
 
     // Initialize Serial object.
@@ -304,6 +324,33 @@ BOOL Example::Init(UCHAR ucDeviceNumber_, UCHAR ucChannelType_, USHORT usAntDevi
     bStatus = pclMessageObject->Init();
     assert(bStatus);
 
+    // Time each message from the serial read through to the record.
+    pclLatencyTrace = new DSILatencyTrace();
+    if (pclLatencyTrace->Init())
+    {
+        pclMessageObject->SetTrace(pclLatencyTrace);
+    }
+    else
+    {
+        delete pclLatencyTrace;
+        pclLatencyTrace = (DSILatencyTrace*)NULL;
+    }
+
+    // Serve the framer and decoder counters.
+    if (DSIStats::Init())
+    {
+        char acLabels[DSI_STATS_MAX_LABELS];
+
+        SNPRINTF(acLabels, sizeof(acLabels), "port=\"%u\"", ucDeviceNumber_);
+        pclMessageObject->SetStats(acLabels);
+        DSIStats::AddCollector(&Example::DecoderStatsCollector, this);
+        if (DSIAllocAudit::IsEnabled())
+            DSIStats::AddCollector(&DSIAllocAudit::StatsCollector, NULL);
+
+        if (DSIStats::StartServer(USER_STATS_SOCKET))
+            printf("Serving stats on %s\n", USER_STATS_SOCKET);
+    }
+
     // Let Serial know about Framer.
     pclSerialObject->SetCallback(pclMessageObject);
 
@@ -326,7 +373,16 @@ BOOL Example::Init(UCHAR ucDeviceNumber_, UCHAR ucChannelType_, USHORT usAntDevi
     printf("Initialization was successful!\n"); fflush(stdout);
 
     fopen_s(&fp1, "Output.csv", "w");
-    fprintf(fp1, "Record Time, Rotations, Energy, Avg Cadence, Avg Power\n");
+    if (ucChannelType == CHANNEL_TYPE_SCAN)
+    {
+        pstPowerScan = new POWERSCAN;
+        assert(pstPowerScan);
+        fprintf(fp1, "Device Number, Transmission Type, Record Time, Rotations, Energy, Avg Cadence, Avg Power\n");
+    }
+    else
+    {
+        fprintf(fp1, "Record Time, Rotations, Energy, Avg Cadence, Avg Power\n");
+    }
     return TRUE;
 }
 
@@ -356,10 +412,18 @@ void Example::Close()
     if (pclSerialObject)
         pclSerialObject->Close();
 
+    if (pclLatencyTrace)
+    {
+        pclMessageObject->SetTrace((DSILatencyTrace*)NULL);
+        delete pclLatencyTrace;
+        pclLatencyTrace = (DSILatencyTrace*)NULL;
+    }
+
 #if defined(DEBUG_FILE)
     DSIDebug::Close();
 #endif
 
+    DSIStats::Close();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -444,6 +508,27 @@ void Example::Start()
             pclMessageObject->SendRequest(MESG_CHANNEL_ID_ID, USER_ANTCHANNEL, &stResponse, 0);
             break;
         }
+        case 'h':
+        case 'H':
+        {
+            // Print decoder health counters
+            PrintDecoderStats();
+            break;
+        }
+        case 'a':
+        case 'A':
+        {
+            // Print allocation counts
+            PrintAllocAudit();
+            break;
+        }
+        case 'l':
+        case 'L':
+        {
+            // Print message latencies
+            PrintLatency();
+            break;
+        }
         case 'd':
         case 'D':
         {
@@ -542,6 +627,8 @@ void Example::MessageThread()
     USHORT usSize;
     bDone = FALSE;
 
+    DSI_ALLOC_THREAD("message", DSI_ALLOC_DECODER);
+
     while (!bDone)
     {
         if (pclMessageObject->WaitForMessage(1000))
@@ -609,7 +696,7 @@ void Example::ProcessMessage(ANT_MESSAGE stMessage, USHORT usSize_)
             {
                 bStatus = pclMessageObject->AssignChannel(USER_ANTCHANNEL, PARAMETER_TX_NOT_RX, 0, MESSAGE_TIMEOUT);
             }
-            else if (ucChannelType == CHANNEL_TYPE_SLAVE)
+            else if (ucChannelType == CHANNEL_TYPE_SLAVE || ucChannelType == CHANNEL_TYPE_SCAN)
             {
                 bStatus = pclMessageObject->AssignChannel(USER_ANTCHANNEL, 0, 0, MESSAGE_TIMEOUT);
             }
@@ -650,6 +737,16 @@ void Example::ProcessMessage(ANT_MESSAGE stMessage, USHORT usSize_)
                 break;
             }
             printf("Radio Frequency set\n");
+
+            if (ucChannelType == CHANNEL_TYPE_SCAN)
+            {
+                // Scan mode has no channel period, but the device id is needed to
+                // tell the power meters apart.
+                printf("Enabling extended messages...\n");
+                pclMessageObject->SetLibConfig(ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID | ANT_LIB_CONFIG_MESG_OUT_INC_RSSI | ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP, MESSAGE_TIMEOUT);
+                break;
+            }
+
             printf("Setting Channel Period...\n");
             bStatus = pclMessageObject->SetChannelPeriod(USER_ANTCHANNEL, 8182, MESSAGE_TIMEOUT);
             break;
@@ -680,6 +777,8 @@ void Example::ProcessMessage(ANT_MESSAGE stMessage, USHORT usSize_)
             printf("Channel opened\n");
 
             // We register the power record receiver and initialize the bike power decoders after the channel has opened
+            // Decoding is timed for the health counters.
+            SetPowerDecoderTiming(TRUE);
             InitPowerDecoder(dRecordInterval, dTimeBase, dReSyncInterval, RecordReceiver);
             bPowerDecoderInitialized = TRUE;
             printf("Power record decode library initialized\n");
@@ -704,6 +803,30 @@ void Example::ProcessMessage(ANT_MESSAGE stMessage, USHORT usSize_)
                 break;
             }
             printf("Extended messages enabled\n");
+
+            if (ucChannelType == CHANNEL_TYPE_SCAN)
+            {
+                // Every device heard gets its own decoder.
+                PowerScan_Init(pstPowerScan, dRecordInterval, dTimeBase, dReSyncInterval, ScanRecordReceiver);
+                PowerScan_SetPowerMeterType(pstPowerScan, ucPowerMeterType);
+                PowerScan_SetTiming(pstPowerScan, TRUE);
+                bPowerDecoderInitialized = TRUE;
+                printf("Power record decode library initialized\n");
+
+                printf("Opening scan mode...\n");
+                bStatus = pclMessageObject->OpenRxScanMode(MESSAGE_TIMEOUT);
+            }
+            break;
+        }
+
+        case MESG_OPEN_RX_SCAN_ID:
+        {
+            if (stMessage.aucData[2] != RESPONSE_NO_ERROR)
+            {
+                printf("Error opening scan mode: Code 0%d\n", stMessage.aucData[2]);
+                break;
+            }
+            printf("Scan mode opened\n");
             break;
         }
 
@@ -985,41 +1108,48 @@ void Example::ProcessMessage(ANT_MESSAGE stMessage, USHORT usSize_)
         if (usSize_ > MESG_DATA_SIZE)
         {
             UCHAR ucFlag = stMessage.aucData[MESSAGE_BUFFER_DATA10_INDEX];
+            DOUBLE dRxTime = 0;
 
             if (ucFlag & ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP && ucFlag & ANT_EXT_MESG_BITFIELD_DEVICE_ID)
             {
-                // In case we miss messages for 2 seconds or longer, we use the system time from the standard C time library to calculate rollovers
-                time_t currentRxTime = time(NULL);
-                if (currentRxTime - previousRxTime >= 2)
+                if (ucChannelType == CHANNEL_TYPE_SCAN)
                 {
-                    ulNewEventTime += (currentRxTime - previousRxTime) / 2 * 32768;
+                    // The timestamp comes from the receiver's clock so it is shared by all devices.
+                    // The scan library unwraps it and routes each device to its own decoder.
+                    if (bPowerDecoderInitialized)
+                    {
+                        PowerScan_RxMessage(pstPowerScan, DSIThread_GetSystemTime(), stMessage.aucData, (UCHAR)usSize_);
+                    }
                 }
-                previousRxTime = currentRxTime;
-
-                unsigned short usCurrentEventTime = stMessage.aucData[MESSAGE_BUFFER_DATA15_INDEX] | (stMessage.aucData[MESSAGE_BUFFER_DATA16_INDEX] << 8);
-                unsigned short usDeltaEventTime = usCurrentEventTime - usPreviousEventTime;
-                ulNewEventTime += usDeltaEventTime;
-                usPreviousEventTime = usCurrentEventTime;
-                printf("%f-", (double)ulNewEventTime / 32768);
-
-                // NOTE: In this example we use the incoming message timestamp as it typically has the most accuracy
-                // NOTE: The library will handle the received time discrepancy caused by power only event count linked messages
-                if (bPowerDecoderInitialized)
+                else
                 {
-                    DecodePowerMessage((double)ulNewEventTime / 32768, &stMessage.aucData[ucDataOffset]);
+                    // The 32768 Hz timestamp rolls over every 2 seconds; the system time is only used to count
+                    // rollovers while messages are missed, so host load doesn't affect the decoded times.
+                    USHORT usCurrentEventTime = stMessage.aucData[MESSAGE_BUFFER_DATA15_INDEX] | (stMessage.aucData[MESSAGE_BUFFER_DATA16_INDEX] << 8);
+                    ULLONG ullRxTicks = RxTimeBase_Update(&stRxTimeBase, usCurrentEventTime, DSIThread_GetSystemTime());
+                    printf("%f-", RxTimeBase_Seconds(ullRxTicks));
+
+                    // NOTE: In this example we use the incoming message timestamp as it typically has the most accuracy
+                    // NOTE: The library will handle the received time discrepancy caused by power only event count linked messages
+                    if (bPowerDecoderInitialized)
+                    {
+                        DecodePowerMessageTicks(ullRxTicks, &stMessage.aucData[ucDataOffset]);
+                    }
+
+                    dRxTime = RxTimeBase_Seconds(ullRxTicks);
                 }
 
                 // NOTE: We must compensate for the power only event count/rx time discrepance here, because the library does not decode Te/Ps
                 // The torque effectiveness/pedal smoothness page is tied to the power only page and vice versa,
                 // so both pages share the same "received time" depending on which page was received first and if the event count updated.
-                if (stMessage.aucData[ucDataOffset] == ANT_TEPS || stMessage.aucData[ucDataOffset] == ANT_POWERONLY)
+                if (ucChannelType != CHANNEL_TYPE_SCAN && (stMessage.aucData[ucDataOffset] == ANT_TEPS || stMessage.aucData[ucDataOffset] == ANT_POWERONLY))
                 {
                     UCHAR ucNewPowerOnlyUpdateEventCount = stMessage.aucData[ucDataOffset + 1];
 
                     if (ucNewPowerOnlyUpdateEventCount != ucPowerOnlyUpdateEventCount)
                     {
                         ucPowerOnlyUpdateEventCount = ucNewPowerOnlyUpdateEventCount;
-                        dRxTimeTePs = (double)ulNewEventTime / 32768;
+                        dRxTimeTePs = dRxTime;
                     }
 
                     if (stMessage.aucData[ucDataOffset] == ANT_TEPS)
@@ -1146,10 +1276,27 @@ void Example::ProcessMessage(ANT_MESSAGE stMessage, USHORT usSize_)
 ////////////////////////////////////////////////////////////////////////////////
 void Example::RecordReceiver(double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
 {
+    MarkStartupDone();
+    if (pclLatencyTrace)
+        pclLatencyTrace->RecordEmitted();
     fprintf(fp1, "%lf, %lf, %lf, %f, %f\n",
         dLastRecordTime_, dTotalRotation_, dTotalEnergy_, fAverageCadence_, fAveragePower_);
 }
 ////////////////////////////////////////////////////////////////////////////////
+// ScanRecordReceiver
+//
+// Handle new records from power recording library in scan mode.
+//
+////////////////////////////////////////////////////////////////////////////////
+void Example::ScanRecordReceiver(POWERSCAN_DEVICE *pstDevice_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    MarkStartupDone();
+    if (pclLatencyTrace)
+        pclLatencyTrace->RecordEmitted();
+    fprintf(fp1, "%u, %u, %lf, %lf, %lf, %f, %f\n",
+        pstDevice_->usDeviceNumber, pstDevice_->ucTransmissionType, dLastRecordTime_, dTotalRotation_, dTotalEnergy_, fAverageCadence_, fAveragePower_);
+}
+////////////////////////////////////////////////////////////////////////////////
 // TePsReceiver
 //
 // Handle new torque effectiveness and pedal smoothness data page.
@@ -1173,6 +1320,182 @@ void Example::PowerBalanceReceiver(double dRxTime_, float fPowerBalance_, bool b
         dRxTime_, fPowerBalance_, bPowerBalanceRightPedalIndicator_);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// PrintDecoderStats
+//
+// Print the health counters of the power decoder, or of each device decoder
+// in scan mode.
+//
+////////////////////////////////////////////////////////////////////////////////
+void Example::PrintDecoderStats()
+{
+    POWERDECODER_STATS stStats;
+
+    if (!bPowerDecoderInitialized)
+    {
+        printf("Power decoder not initialized\n");
+        return;
+    }
+
+    printf("Device, Pages, Duplicates, Resyncs, Gap Records, Invalid Deltas, Calibrations, Decode CPU Time (us)\n");
+
+    if (ucChannelType == CHANNEL_TYPE_SCAN)
+    {
+        for (int i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+        {
+            POWERSCAN_DEVICE *pstDevice = &pstPowerScan->astDevices[i];
+
+            if (!pstDevice->bInUse)
+                continue;
+
+            PowerDecoder_GetStats(&pstDevice->stDecoder, &stStats);
+            printf("%u/%u, %lu, %lu, %lu, %lu, %lu, %lu, %llu\n", pstDevice->usDeviceNumber, pstDevice->ucTransmissionType,
+                stStats.ulPagesSeen, stStats.ulDuplicates, stStats.ulResyncs, stStats.ulGapRecords, stStats.ulInvalidDeltas, stStats.ulCalibrationUpdates, stStats.ullDecodeTime / 1000);
+        }
+        printf("Dropped messages: %lu\n", pstPowerScan->ulDroppedMessages);
+    }
+    else
+    {
+        GetPowerDecoderStats(&stStats);
+        printf("%u, %lu, %lu, %lu, %lu, %lu, %lu, %llu\n", usAntDeviceNumber,
+            stStats.ulPagesSeen, stStats.ulDuplicates, stStats.ulResyncs, stStats.ulGapRecords, stStats.ulInvalidDeltas, stStats.ulCalibrationUpdates, stStats.ullDecodeTime / 1000);
+    }
+    fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MarkStartupDone
+//
+// Called for each record. The first one ends start up for the allocation
+// audit; allocations after it are counted as steady state.
+//
+////////////////////////////////////////////////////////////////////////////////
+void Example::MarkStartupDone()
+{
+    if (bStartupDone)
+        return;
+
+    DSIAllocAudit::MarkSteady();
+    bStartupDone = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PrintAllocAudit
+//
+// Print the allocation counts for each thread (DSI_ALLOC_AUDIT builds).
+//
+////////////////////////////////////////////////////////////////////////////////
+void Example::PrintAllocAudit()
+{
+    static char acReport[16384];
+
+    DSIAllocAudit::Format(acReport, sizeof(acReport));
+    printf("%s", acReport);
+    fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PrintLatency
+//
+// Print the latency of each stage between the serial read and the record,
+// across all channels.
+//
+////////////////////////////////////////////////////////////////////////////////
+void Example::PrintLatency()
+{
+    static const char *apcStages[DSI_LATENCY_STAGES] = { "Read to framed", "Framed to dequeued", "Dequeued to emitted", "Read to dequeued", "Read to emitted" };
+    DSI_LATENCY_PERCENTILES stPercentiles;
+
+    if (!pclLatencyTrace)
+    {
+        printf("Latency trace not running\n");
+        return;
+    }
+
+    printf("Stage, Count, Min, Mean, P50, P90, P99, P99.9, Max (us)\n");
+    for (UCHAR i = 0; i < DSI_LATENCY_STAGES; i++)
+    {
+        if (!pclLatencyTrace->GetPercentiles(i, DSI_LATENCY_ALL_CHANNELS, &stPercentiles))
+            continue;
+
+        printf("%s, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu\n", apcStages[i], stPercentiles.ulCount, stPercentiles.ulMin, stPercentiles.ulMean,
+            stPercentiles.ulP50, stPercentiles.ulP90, stPercentiles.ulP99, stPercentiles.ulP999, stPercentiles.ulMax);
+    }
+    fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DecoderStatsCollector
+//
+// Write the power decoder health counters in the stats exposition format,
+// labelled by device. Runs on the stats server thread; the counters are
+// read without locking so they may lag the decoders slightly.
+//
+////////////////////////////////////////////////////////////////////////////////
+static double GetDecoderStat(const POWERDECODER_STATS *pstStats_, int iStat_)
+{
+    switch (iStat_)
+    {
+    case 0: return (double)pstStats_->ulPagesSeen;
+    case 1: return (double)pstStats_->ulDuplicates;
+    case 2: return (double)pstStats_->ulResyncs;
+    case 3: return (double)pstStats_->ulGapRecords;
+    case 4: return (double)pstStats_->ulInvalidDeltas;
+    case 5: return (double)pstStats_->ulCalibrationUpdates;
+    default: return (double)pstStats_->ullDecodeTime / 1e9;
+    }
+}
+
+ULONG Example::DecoderStatsCollector(void *pvContext_, char *pcBuffer_, ULONG ulSize_)
+{
+    static const char *apcNames[] = { "power_decoder_pages_total", "power_decoder_duplicates_total", "power_decoder_resyncs_total",
+        "power_decoder_gap_records_total", "power_decoder_invalid_deltas_total", "power_decoder_calibration_updates_total", "power_decoder_decode_cpu_seconds_total" };
+    Example *pclExample = (Example*)pvContext_;
+    POWERDECODER_STATS stStats;
+    ULONG ulLength = 0;
+    int iLength;
+
+    if (!pclExample->bPowerDecoderInitialized)
+        return 0;
+
+    for (int i = 0; i < (int)(sizeof(apcNames) / sizeof(apcNames[0])); i++)
+    {
+        iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "# TYPE %s counter\n", apcNames[i]);
+        if (iLength < 0 || ulLength + iLength >= ulSize_ - 1)
+            return ulLength;
+        ulLength += iLength;
+
+        if (pclExample->ucChannelType == CHANNEL_TYPE_SCAN)
+        {
+            for (int j = 0; j < POWER_SCAN_TABLE_SIZE; j++)
+            {
+                POWERSCAN_DEVICE *pstDevice = &pclExample->pstPowerScan->astDevices[j];
+
+                if (!pstDevice->bInUse)
+                    continue;
+
+                PowerDecoder_GetStats(&pstDevice->stDecoder, &stStats);
+                iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "%s{device=\"%u\",transmission_type=\"%u\"} %.9g\n",
+                    apcNames[i], pstDevice->usDeviceNumber, pstDevice->ucTransmissionType, GetDecoderStat(&stStats, i));
+                if (iLength < 0 || ulLength + iLength >= ulSize_ - 1)
+                    return ulLength;
+                ulLength += iLength;
+            }
+        }
+        else
+        {
+            GetPowerDecoderStats(&stStats);
+            iLength = SNPRINTF(pcBuffer_ + ulLength, ulSize_ - ulLength, "%s{device=\"%u\"} %.9g\n",
+                apcNames[i], pclExample->usAntDeviceNumber, GetDecoderStat(&stStats, i));
+            if (iLength < 0 || ulLength + iLength >= ulSize_ - 1)
+                return ulLength;
+            ulLength += iLength;
+        }
+    }
+
+    return ulLength;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // PrintMenu
 //
@@ -1191,6 +1514,9 @@ void Example::PrintMenu()
     printf("S - Request Status\n");
     printf("U - Request USB Descriptor\n");
     printf("D - Toggle Display\n");
+    printf("H - Print Decoder Health\n");
+    printf("A - Print Allocation Audit\n");
+    printf("L - Print Message Latency\n");
     printf("Q - Quit\n");
     printf("\n");
     fflush(stdout);
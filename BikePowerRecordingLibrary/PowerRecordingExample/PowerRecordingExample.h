@@ -15,9 +15,14 @@ All rights reserved.
 #include "dsi_thread.h"
 #include "dsi_serial_generic.hpp"
 
+extern "C" {
+#include "PowerScan.h"
+}
+
 #define CHANNEL_TYPE_MASTER   (0)
 #define CHANNEL_TYPE_SLAVE		(1)
 #define CHANNEL_TYPE_INVALID	(2)
+#define CHANNEL_TYPE_SCAN		(3)   // Continuous scan mode, decodes every power meter in range
 
 
 
@@ -43,6 +48,9 @@ private:
     //Receiver for the power records from the power decoder
     static void RecordReceiver(double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
 
+    //Receiver for the power records of each device heard in scan mode
+    static void ScanRecordReceiver(POWERSCAN_DEVICE *pstDevice_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+
     //Receiver for Torque Effectiveness/Pedal Smoothness data
     void Example::TePsReceiver(double dRxTime_, float fLeftTorqEff_, float fRightTorqEff_, float fLeftOrCPedSmth_, float fRightPedSmth_);
 
@@ -52,6 +60,21 @@ private:
     // print user menu
     void PrintMenu();
 
+    // print the power decoder health counters
+    void PrintDecoderStats();
+
+    // print the allocation counts
+    void PrintAllocAudit();
+
+    // print the latency of each stage between the serial read and the record
+    void PrintLatency();
+
+    // ends start up for the allocation audit when records start
+    static void MarkStartupDone();
+
+    //Writes the power decoder health counters for the stats endpoint
+    static ULONG DecoderStatsCollector(void *pvContext_, char *pcBuffer_, ULONG ulSize_);
+
     BOOL bBursting; //holds whether the bursting phase of the test has started
     BOOL bBroadcasting;
     BOOL bMyDone;
@@ -62,12 +85,13 @@ private:
     DOUBLE dRecordInterval;
     DOUBLE dTimeBase;
     DOUBLE dReSyncInterval;
+    UCHAR ucPowerMeterType;
     DSISerialGeneric* pclSerialObject;
     DSIFramerANT* pclMessageObject;
+    POWERSCAN* pstPowerScan;
     DSI_THREAD_ID uiDSIThread;
     DSI_CONDITION_VAR condTestDone;
     DSI_MUTEX mutexTestDone;
-    time_t previousRxTime;
     UCHAR ucPowerOnlyUpdateEventCount;
     DOUBLE dRxTimeTePs;
 
@@ -75,8 +99,7 @@ private:
 
     UCHAR aucTransmitBuffer[ANT_STANDARD_DATA_PAYLOAD_SIZE];
 
-    unsigned long ulNewEventTime;
-    unsigned short usPreviousEventTime;
+    RXTIMEBASE stRxTimeBase;    // Unwraps the receiver timestamps of the single device channel
 };
 
 #endif
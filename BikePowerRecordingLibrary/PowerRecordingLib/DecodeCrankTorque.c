@@ -14,15 +14,10 @@ All rights reserved.
 #include "math.h"
 
 #include "RecordOutput.h"
+#include "PowerProbe.h"
 #include "PowerDecoder.h"
 #include "DecodeCrankTorque.h"
 
-static BPSAMPLER stState;
-static PowerRecordReceiver prrPtr;
-
-static double dRecordInterval;
-static double dReSyncInterval;
-
 #define UPDATE_EVENT_BYTE  1
 #define CRANK_TICKS_BYTE 2
 #define INST_CADENCE_BYTE  3
@@ -32,7 +27,7 @@ static double dReSyncInterval;
 #define ACCUM_TORQUE_MSB  7
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorque_Init(double dRecordInterval_, double dTimeBase_)
+// void DecodeCrankTorque_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_)
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Call this to initialize the decoder.
@@ -40,16 +35,13 @@ static double dReSyncInterval;
 // the timebase value is assumed to be the sensor message update rate.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorque_Init(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+void DecodeCrankTorque_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
 {
-    ResamplerOutput_Init(&stState, (int)(dRecordInterval_ * CT_TIME_QUANTIZATION), dRecordInterval_, (int)(dTimeBase_ * CT_TIME_QUANTIZATION));
-    dRecordInterval = dRecordInterval_;
-    prrPtr = powerRecordReceiverPtr_;
-    dReSyncInterval = dReSyncInterval_;
+    ResamplerOutput_Init(pstState_, CT_TIME_QUANTIZATION, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorque_Message(double dTime_, unsigned char aucByte_[])
+// void DecodeCrankTorque_Message(BPSAMPLER *pstState_, double dTime_, unsigned char aucByte_[])
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Message event handler interface.
@@ -57,47 +49,54 @@ void DecodeCrankTorque_Init(double dRecordInterval_, double dTimeBase_, double d
 // detect data gaps or duplicates, etc.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorque_Message(double dTime_, unsigned char aucByte_[])
+void DecodeCrankTorque_Message(BPSAMPLER *pstState_, double dTime_, unsigned char aucByte_[])
 {
     // see if the message is new.
-    if (stState.ucLastEventCount != aucByte_[UPDATE_EVENT_BYTE])
+    if (pstState_->ucLastEventCount != aucByte_[UPDATE_EVENT_BYTE])
     {
-        if ((dTime_ - stState.dLastMessageTime) > dReSyncInterval)
+        if ((dTime_ - pstState_->dLastMessageTime) > pstState_->dReSyncInterval)
         {
-            DecodeCrankTorque_Resync(dTime_, aucByte_);
+            DecodeCrankTorque_Resync(pstState_, dTime_, aucByte_);
         }
         else
         {
-            DecodeCrankTorque(dTime_, aucByte_);
+            DecodeCrankTorque(pstState_, dTime_, aucByte_);
         }
-        stState.dLastMessageTime = dTime_;
+        pstState_->dLastMessageTime = dTime_;
+    }
+    else
+    {
+        pstState_->stStats.ulDuplicates++;
     }
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorque_Resync(double dCurrentTime_, unsigned char aucByte_[])
+// void DecodeCrankTorque_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char aucByte_[])
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Re-establish data baseline.
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorque_Resync(double dCurrentTime_, unsigned char aucByte_[])
+void DecodeCrankTorque_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char aucByte_[])
 {
     unsigned short usCurrentAccumTorque;
     unsigned short usCurrentAccumPeriod;
     // CurrentRecordEpoch is the last time that we should have had a data record.
-    double dCurrentRecordEpoch = (floor(dCurrentTime_ / dRecordInterval)) * dRecordInterval;
+    double dCurrentRecordEpoch = RecordOutput_GetEpoch(pstState_, dCurrentTime_);
+
+    pstState_->stStats.ulResyncs++;
+    POWER_PROBE2(resync, pstState_, POWER_PROBE_TIME(dCurrentTime_));
 
-    if ((stState.dLastRecordTime != 0) && (dCurrentRecordEpoch - stState.dLastRecordTime < MAXIMUM_TIME_GAP))
+    if ((pstState_->dLastRecordTime != 0) && (dCurrentRecordEpoch - pstState_->dLastRecordTime < MAXIMUM_TIME_GAP))
     {
         // Figure out how many records we missed based on the receive timestamps.
-        stState.ucRecordGapCount = (unsigned char)((dCurrentRecordEpoch - stState.dLastRecordTime + 0.5 * dRecordInterval)
-            / (dRecordInterval));      // We need to fill in the gap with records.
+        pstState_->ulRecordGapCount = (unsigned long)((dCurrentRecordEpoch - pstState_->dLastRecordTime + 0.5 * pstState_->dRecordInterval)
+            / (pstState_->dRecordInterval));      // We need to fill in the gap with records.
         // Transfer the accumulated data to the gap.
-        stState.fGapEnergy = stState.fAccumEnergy;
-        stState.fGapRotation = stState.fAccumRotation;
+        pstState_->fGapEnergy = pstState_->fAccumEnergy;
+        pstState_->fGapRotation = pstState_->fAccumRotation;
 
-        RecordOutput_FillGap(prrPtr, &stState);
+        RecordOutput_FillGap(pstState_);
     }
 
     usCurrentAccumPeriod = aucByte_[ACCUM_PERIOD_LSB];
@@ -106,36 +105,36 @@ void DecodeCrankTorque_Resync(double dCurrentTime_, unsigned char aucByte_[])
     usCurrentAccumTorque = aucByte_[ACCUM_TORQUE_LSB];
     usCurrentAccumTorque += ((unsigned short)aucByte_[ACCUM_TORQUE_MSB]) << 8;
 
-    stState.ucCadence = aucByte_[INST_CADENCE_BYTE];
+    pstState_->ucCadence = aucByte_[INST_CADENCE_BYTE];
 
-    stState.fAccumEnergy = 0;
-    stState.fPendingEnergy = 0;
-    stState.fGapEnergy = 0;
+    pstState_->fAccumEnergy = 0;
+    pstState_->fPendingEnergy = 0;
+    pstState_->fGapEnergy = 0;
 
-    stState.fAccumRotation = 0;
-    stState.fPendingRotation = 0;
-    stState.fGapRotation = 0;
-    stState.ucRecordGapCount = 0;
+    pstState_->fAccumRotation = 0;
+    pstState_->fPendingRotation = 0;
+    pstState_->fGapRotation = 0;
+    pstState_->ulRecordGapCount = 0;
 
-    stState.ulEventTime = 0;
-    stState.ulLastRecordTime = 0;
+    pstState_->ulEventTime = 0;
+    pstState_->ulLastRecordTime = 0;
 
-    stState.dLastMessageTime = dCurrentTime_;
+    pstState_->dLastMessageTime = dCurrentTime_;
 
     // Update our saved state.
-    stState.dLastRecordTime = dCurrentRecordEpoch;
+    RecordOutput_SetTime(pstState_, dCurrentTime_);
 
-    stState.usLastAccumTorque = usCurrentAccumTorque;
-    stState.usLastAccumPeriod = usCurrentAccumPeriod;
-    stState.ucLastRotationTicks = aucByte_[CRANK_TICKS_BYTE];
-    stState.ucLastEventCount = aucByte_[UPDATE_EVENT_BYTE];
+    pstState_->usLastAccumTorque = usCurrentAccumTorque;
+    pstState_->usLastAccumPeriod = usCurrentAccumPeriod;
+    pstState_->ucLastRotationTicks = aucByte_[CRANK_TICKS_BYTE];
+    pstState_->ucLastEventCount = aucByte_[UPDATE_EVENT_BYTE];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorque(double dTime_, unsigned char aucByte_[])
+void DecodeCrankTorque(BPSAMPLER *pstState_, double dTime_, unsigned char aucByte_[])
 {
     unsigned long ulNewEventTime;
     unsigned long ulEventCadence;
@@ -143,6 +142,7 @@ void DecodeCrankTorque(double dTime_, unsigned char aucByte_[])
     unsigned short usCurrentAccumTorque;
     unsigned short usCurrentAccumPeriod;
     unsigned short usDeltaTorque;
+    unsigned long ulDeltaPeriod;
     unsigned short usDeltaPeriod;
     unsigned char ucDeltaEventCount;
     unsigned char ucDeltaTicks;
@@ -154,91 +154,115 @@ void DecodeCrankTorque(double dTime_, unsigned char aucByte_[])
     usCurrentAccumTorque = aucByte_[ACCUM_TORQUE_LSB];
     usCurrentAccumTorque += ((unsigned short)aucByte_[ACCUM_TORQUE_MSB]) << 8;
 
-    usDeltaTorque = usCurrentAccumTorque - stState.usLastAccumTorque; // make sure this is done in 16 bit word width!
-    usDeltaPeriod = usCurrentAccumPeriod - stState.usLastAccumPeriod; // make sure this is done in 16 bit word width!
-    ucDeltaEventCount = aucByte_[UPDATE_EVENT_BYTE] - stState.ucLastEventCount;
-    ucDeltaTicks = aucByte_[CRANK_TICKS_BYTE] - stState.ucLastRotationTicks;
-    stState.ucCadence = aucByte_[INST_CADENCE_BYTE];
+    usDeltaTorque = usCurrentAccumTorque - pstState_->usLastAccumTorque; // make sure this is done in 16 bit word width!
+    usDeltaPeriod = usCurrentAccumPeriod - pstState_->usLastAccumPeriod; // make sure this is done in 16 bit word width!
+    ulDeltaPeriod = (unsigned long)usDeltaPeriod * pstState_->ulTimeScale;
+    ucDeltaEventCount = aucByte_[UPDATE_EVENT_BYTE] - pstState_->ucLastEventCount;
+    ucDeltaTicks = aucByte_[CRANK_TICKS_BYTE] - pstState_->ucLastRotationTicks;
+    pstState_->ucCadence = aucByte_[INST_CADENCE_BYTE];
 
     // 65535 is an invalid value.
     if (usDeltaTorque == 65535)
     {
         usDeltaTorque = 0;
+        pstState_->stStats.ulInvalidDeltas++;
     }
 
     if (usDeltaPeriod && (usDeltaPeriod != 0xFFFF))
     {
-        ulNewEventTime = stState.ulEventTime + (unsigned long)usDeltaPeriod;
+        ulNewEventTime = pstState_->ulEventTime + ulDeltaPeriod;
 
         ulEventPower = ((long)(M_PI*2048.0 + 0.5) * usDeltaTorque / usDeltaPeriod + 8) >> 4;
         ulEventCadence = ((long)ucDeltaTicks * 60L * CT_TIME_QUANTIZATION + (usDeltaPeriod >> 1)) / usDeltaPeriod;
         fEventEnergy = (float)(M_PI * (float)usDeltaTorque / 16.0);
+        RecordOutput_AddEvent(pstState_, (float)ulEventPower);
+
+        if (pstState_->pevPtr != NULL)
+        {
+            // The torque accumulates once per update event, which is a revolution for an event
+            // synchronous meter but a fixed time for a time synchronous one.
+            RecordOutput_Event(pstState_, usDeltaPeriod, (float)usDeltaTorque / 32.0f / (ucDeltaEventCount ? ucDeltaEventCount : 1), fEventEnergy, ucDeltaTicks);
+        }
     }
     else
     {
         // This is basically a non-event.
+        if (usDeltaPeriod == 0xFFFF)
+        {
+            pstState_->stStats.ulInvalidDeltas++;
+        }
         ulEventPower = 0;
         ulEventCadence = 0;
         fEventEnergy = 0;
-        ulNewEventTime = stState.ulEventTime;
+        ulNewEventTime = pstState_->ulEventTime;
+    }
+
+    if (pstState_->pevPtr != NULL)
+    {
+        // The event has gone out as it is, so there is nothing to resample.
+        pstState_->ucLastEventCount = aucByte_[UPDATE_EVENT_BYTE];
+        pstState_->ucLastRotationTicks = aucByte_[CRANK_TICKS_BYTE];
+        pstState_->usLastAccumPeriod = usCurrentAccumPeriod;
+        pstState_->usLastAccumTorque = usCurrentAccumTorque;
+        return;
     }
 
-    if (((unsigned short)(ulNewEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((ulNewEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
         // The event occurred after the end of the current record epoch.
         // First, figure out the number of records in a gap if it exists. This calculation uses
         // implicit truncation in the division so the subtraction can't be done first.
-        stState.ucRecordGapCount = (unsigned char)((ulNewEventTime / stState.usRecordInterval) - (stState.ulLastRecordTime / stState.usRecordInterval) - 1);
+        pstState_->ulRecordGapCount = (unsigned long)((ulNewEventTime / pstState_->ulRecordInterval) - (pstState_->ulLastRecordTime / pstState_->ulRecordInterval) - 1);
 
         // Pending energy goes towards the partial accumulated record we currently have.
-        stState.fPendingEnergy = stState.fAccumEnergy + fEventEnergy * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPeriod);
+        pstState_->fPendingEnergy = pstState_->fAccumEnergy + fEventEnergy * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPeriod);
 
         // accumulated energy goes towards the *next* event.
-        stState.fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPeriod);
+        pstState_->fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPeriod);
 
         // Gap energy fills the remainder.
-        stState.fGapEnergy = fEventEnergy * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPeriod);
+        pstState_->fGapEnergy = fEventEnergy * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPeriod);
 
         //Same for rotation.
-        stState.fPendingRotation = stState.fAccumRotation + (float)ucDeltaTicks * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPeriod);
-        stState.fAccumRotation = (float)ucDeltaTicks * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPeriod);
-        stState.fGapRotation = (float)((float)ucDeltaTicks * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPeriod));
+        pstState_->fPendingRotation = pstState_->fAccumRotation + (float)ucDeltaTicks * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPeriod);
+        pstState_->fAccumRotation = (float)ucDeltaTicks * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPeriod);
+        pstState_->fGapRotation = (float)((float)ucDeltaTicks * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPeriod));
     }
     else
     {
         // This event came in before the next record epoch started - this
         // will happen when the event period is less than the recording period.
-        stState.fAccumEnergy += fEventEnergy;
-        stState.fAccumRotation += (float)ucDeltaTicks;
-        stState.fPendingEnergy = 0;
-        stState.fPendingRotation = 0;
-        stState.ucRecordGapCount = 0;
+        pstState_->fAccumEnergy += fEventEnergy;
+        pstState_->fAccumRotation += (float)ucDeltaTicks;
+        pstState_->fPendingEnergy = 0;
+        pstState_->fPendingRotation = 0;
+        pstState_->ulRecordGapCount = 0;
     }
-    stState.ulEventTime += (unsigned long)usDeltaPeriod;
+    pstState_->ulEventTime += ulDeltaPeriod;
 
-    if (((unsigned short)(stState.ulEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((pstState_->ulEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
-        RecordOutput(prrPtr, &stState);
+        RecordOutput(pstState_);
     }
     else
     {
         // We've had an event that either didn't have a rotation associated
         // with it (no event time increment) or else it was within the
         // recording interval.
-        if ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+        if ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
         {
-            while ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+            while ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
             {
-                stState.dLastRecordTime += dRecordInterval;
-                (prrPtr)(stState.dLastRecordTime, stState.dTotalRotation, stState.dTotalEnergy, 0.0, 0.0);
+                RecordOutput_AdvanceTime(pstState_, 1);
+                RecordOutput_Emit(pstState_, 0.0f, 0.0f);
             }
         }
     }
 
     // Propagate the message state information.
-    stState.ucLastEventCount = aucByte_[UPDATE_EVENT_BYTE];
-    stState.ucLastRotationTicks = aucByte_[CRANK_TICKS_BYTE];
-    stState.usLastAccumPeriod = usCurrentAccumPeriod;
-    stState.usLastAccumTorque = usCurrentAccumTorque;
+    pstState_->ucLastEventCount = aucByte_[UPDATE_EVENT_BYTE];
+    pstState_->ucLastRotationTicks = aucByte_[CRANK_TICKS_BYTE];
+    pstState_->usLastAccumPeriod = usCurrentAccumPeriod;
+    pstState_->usLastAccumTorque = usCurrentAccumTorque;
 }
 
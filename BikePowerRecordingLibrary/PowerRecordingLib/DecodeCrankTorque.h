@@ -14,12 +14,12 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 
-void DecodeCrankTorque_Init(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
+void DecodeCrankTorque_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
 void DecodeCrankTorque_End(void);
 
-void DecodeCrankTorque_Message(double dTime_, unsigned char messagePayload_[]);
-void DecodeCrankTorque_Resync(double dTime_, unsigned char messagePayload_[]);
-void DecodeCrankTorque(double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorque_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorque_Resync(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorque(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
 
 void RecordCrankTorque(void);
 void RecordCrankTorque_Resync(double dLastRecordTime);
@@ -15,14 +15,9 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 #include "RecordOutput.h"
+#include "PowerProbe.h"
 #include "DecodeCrankTorqueFrequency.h"
 
-static BPSAMPLER stState;
-static PowerRecordReceiver prrPtr;
-
-static double dRecordInterval;
-static double dReSyncInterval;
-
 #define UPDATE_EVENT_BYTE  1
 #define SLOPE_MSB 2
 #define SLOPE_LSB  3
@@ -32,7 +27,7 @@ static double dReSyncInterval;
 #define TORQUE_TICKS_LSB  7
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorqueFreq_Init(double dRecordInterval_, double dTimeBase_)
+// void DecodeCrankTorqueFreq_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_)
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Call this to initialize the decoder.
@@ -40,17 +35,14 @@ static double dReSyncInterval;
 // the timebase value is assumed to be the sensor message update rate.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorqueFreq_Init(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+void DecodeCrankTorqueFreq_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
 {
-    ResamplerOutput_Init(&stState, (int)(dRecordInterval_ * CTF_TIME_QUANTIZATION), dRecordInterval_, (int)(dTimeBase_ * CTF_TIME_QUANTIZATION));
-    stState.usTorqueOffset = 500; // This is a nominal cal point for the SRM's we've seen.
-    prrPtr = powerRecordReceiverPtr_;
-    dRecordInterval = dRecordInterval_;
-    dReSyncInterval = dReSyncInterval_;
+    ResamplerOutput_Init(pstState_, CTF_TIME_QUANTIZATION, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
+    pstState_->usTorqueOffset = 500; // This is a nominal cal point for the SRM's we've seen.
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorqueFreq_Message(double dTime_, unsigned char messagePayload_[])
+// void DecodeCrankTorqueFreq_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Message event handler interface.
@@ -58,49 +50,56 @@ void DecodeCrankTorqueFreq_Init(double dRecordInterval_, double dTimeBase_, doub
 // detect data gaps or duplicates, etc.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorqueFreq_Message(double dTime_, unsigned char messagePayload_[])
+void DecodeCrankTorqueFreq_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     // see if the message is new.
-    if (stState.ucLastEventCount != messagePayload_[UPDATE_EVENT_BYTE])
+    if (pstState_->ucLastEventCount != messagePayload_[UPDATE_EVENT_BYTE])
     {
-        if ((dTime_ - stState.dLastMessageTime) > dReSyncInterval)
+        if ((dTime_ - pstState_->dLastMessageTime) > pstState_->dReSyncInterval)
         {
-            DecodeCrankTorqueFreq_Resync(dTime_, messagePayload_);
+            DecodeCrankTorqueFreq_Resync(pstState_, dTime_, messagePayload_);
         }
         else
         {
-            DecodeCrankTorqueFreq(dTime_, messagePayload_);
+            DecodeCrankTorqueFreq(pstState_, dTime_, messagePayload_);
         }
-        stState.dLastMessageTime = dTime_;
+        pstState_->dLastMessageTime = dTime_;
+    }
+    else
+    {
+        pstState_->stStats.ulDuplicates++;
     }
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorqueFreq_Resync(double dCurrentTime_, unsigned char messagePayload_[])
+// void DecodeCrankTorqueFreq_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char messagePayload_[])
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Re-establish data baseline.
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorqueFreq_Resync(double dCurrentTime_, unsigned char messagePayload_[])
+void DecodeCrankTorqueFreq_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char messagePayload_[])
 {
     unsigned short usCurrentTorqueTicks;
     unsigned short usCurrentTimeStamp;
     // CurrentRecordEpoch is the last time that we should have had a data record.
-    double dCurrentRecordEpoch = (floor(dCurrentTime_ / dRecordInterval)) * dRecordInterval;
+    double dCurrentRecordEpoch = RecordOutput_GetEpoch(pstState_, dCurrentTime_);
+
+    pstState_->stStats.ulResyncs++;
+    POWER_PROBE2(resync, pstState_, POWER_PROBE_TIME(dCurrentTime_));
 
-    if ((stState.dLastRecordTime != 0) && (dCurrentRecordEpoch - stState.dLastRecordTime < MAXIMUM_TIME_GAP))
+    if ((pstState_->dLastRecordTime != 0) && (dCurrentRecordEpoch - pstState_->dLastRecordTime < MAXIMUM_TIME_GAP))
     {
         // Figure out how many records we missed.
-        stState.ucRecordGapCount = (unsigned char)((dCurrentRecordEpoch - stState.dLastRecordTime + dRecordInterval * 0.5)
-            / dRecordInterval);
+        pstState_->ulRecordGapCount = (unsigned long)((dCurrentRecordEpoch - pstState_->dLastRecordTime + pstState_->dRecordInterval * 0.5)
+            / pstState_->dRecordInterval);
 
         // Transfer the accumulated data to the gap.
-        stState.fGapEnergy = stState.fAccumEnergy;
-        stState.fGapRotation = stState.fAccumRotation;
+        pstState_->fGapEnergy = pstState_->fAccumEnergy;
+        pstState_->fGapRotation = pstState_->fAccumRotation;
 
         // We need to fill in the gap with records.
-        RecordOutput_FillGap(prrPtr, &stState);
+        RecordOutput_FillGap(pstState_);
     }
 
     usCurrentTimeStamp = messagePayload_[TIME_STAMP_LSB];
@@ -109,34 +108,34 @@ void DecodeCrankTorqueFreq_Resync(double dCurrentTime_, unsigned char messagePay
     usCurrentTorqueTicks = messagePayload_[TORQUE_TICKS_LSB];
     usCurrentTorqueTicks += ((unsigned short)messagePayload_[TORQUE_TICKS_MSB]) << 8;
 
-    stState.fAccumEnergy = 0;
-    stState.fPendingEnergy = 0;
-    stState.fGapEnergy = 0;
+    pstState_->fAccumEnergy = 0;
+    pstState_->fPendingEnergy = 0;
+    pstState_->fGapEnergy = 0;
 
-    stState.fAccumRotation = 0;
-    stState.fPendingRotation = 0;
-    stState.fGapRotation = 0;
-    stState.ucRecordGapCount = 0;
+    pstState_->fAccumRotation = 0;
+    pstState_->fPendingRotation = 0;
+    pstState_->fGapRotation = 0;
+    pstState_->ulRecordGapCount = 0;
 
-    stState.ulEventTime = 0;
-    stState.ulLastRecordTime = 0;
+    pstState_->ulEventTime = 0;
+    pstState_->ulLastRecordTime = 0;
 
-    stState.dLastMessageTime = dCurrentTime_;
+    pstState_->dLastMessageTime = dCurrentTime_;
 
     // Update our saved state.
-    stState.dLastRecordTime = dCurrentRecordEpoch;
+    RecordOutput_SetTime(pstState_, dCurrentTime_);
 
-    stState.usLastAccumTorque = usCurrentTorqueTicks;
-    stState.usLastAccumPeriod = usCurrentTimeStamp;
-    stState.ucLastRotationTicks = messagePayload_[UPDATE_EVENT_BYTE];
-    stState.ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->usLastAccumTorque = usCurrentTorqueTicks;
+    pstState_->usLastAccumPeriod = usCurrentTimeStamp;
+    pstState_->ucLastRotationTicks = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeCrankTorqueFreq(double dTime_, unsigned char messagePayload_[])
+void DecodeCrankTorqueFreq(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     unsigned long ulNewEventTime;
     unsigned long ulEventCadence;
@@ -144,6 +143,7 @@ void DecodeCrankTorqueFreq(double dTime_, unsigned char messagePayload_[])
     unsigned short usCurrentTorqueTicks;
     unsigned short usCurrentTimeStamp;
     unsigned short usDeltaTorque;
+    unsigned long ulDeltaPeriod;
     unsigned short usDeltaPeriod;
     unsigned char ucCurrentEventCount = messagePayload_[UPDATE_EVENT_BYTE];
     unsigned char ucDeltaEventCount;
@@ -159,20 +159,22 @@ void DecodeCrankTorqueFreq(double dTime_, unsigned char messagePayload_[])
     usCurrentTorqueTicks = messagePayload_[TORQUE_TICKS_LSB];
     usCurrentTorqueTicks += ((unsigned short)messagePayload_[TORQUE_TICKS_MSB]) << 8;
 
-    usDeltaTorque = usCurrentTorqueTicks - stState.usLastAccumTorque;    // make sure this is done in 16 bit word width!
-    usDeltaPeriod = usCurrentTimeStamp - stState.usLastAccumPeriod;       // make sure this is done in 16 bit word width!
-    ucDeltaEventCount = ucCurrentEventCount - stState.ucLastEventCount;
+    usDeltaTorque = usCurrentTorqueTicks - pstState_->usLastAccumTorque;    // make sure this is done in 16 bit word width!
+    usDeltaPeriod = usCurrentTimeStamp - pstState_->usLastAccumPeriod;       // make sure this is done in 16 bit word width!
+    ulDeltaPeriod = (unsigned long)usDeltaPeriod * pstState_->ulTimeScale;
+    ucDeltaEventCount = ucCurrentEventCount - pstState_->ucLastEventCount;
 
     // 65535 is an invalid value.
     if (usDeltaTorque == 65535)
     {
         usDeltaTorque = 0;
+        pstState_->stStats.ulInvalidDeltas++;
     }
 
     if (usDeltaPeriod && (usDeltaPeriod != 0xFFFF))
     {
         unsigned long ulTempTorque;
-        ulNewEventTime = stState.ulEventTime + (unsigned long)usDeltaPeriod;
+        ulNewEventTime = pstState_->ulEventTime + ulDeltaPeriod;
 
 #if defined (TIMEBASE_DRIFT_CORRECTION)
         // This is a correction for cases where the sensor timebase is fast compared to the
@@ -180,16 +182,16 @@ void DecodeCrankTorqueFreq(double dTime_, unsigned char messagePayload_[])
         if ((dTime_ - (dLastRecordTime + (double)usDeltaPeriod/CTF_TIME_QUANTIZATION)) > (RECORD_INTERVAL))
         {
             //create a gap to fill.
-            ulNewEventTime += usRecordInterval;
+            ulNewEventTime += ulRecordInterval;
         }
 #endif
 
         // We multiply this up by 32 so that we end up with the torque quantized to 1/32 N*m
         // like it is for the other crank-torque sensors.
         ulTempTorque = ((unsigned long)usDeltaTorque * CTF_TIME_QUANTIZATION * 32) / usDeltaPeriod;
-        if (ulTempTorque > ((unsigned long)stState.usTorqueOffset * 32))
+        if (ulTempTorque > ((unsigned long)pstState_->usTorqueOffset * 32))
         {
-            ulTempTorque -= (unsigned long)stState.usTorqueOffset * 32;
+            ulTempTorque -= (unsigned long)pstState_->usTorqueOffset * 32;
         }
         else
         {
@@ -201,77 +203,95 @@ void DecodeCrankTorqueFreq(double dTime_, unsigned char messagePayload_[])
         ulEventPower = ((long)(M_PI*2000.0 + 0.5) * ulTempTorque / usDeltaPeriod + 8) >> 4;
         ulEventCadence = ((long)ucDeltaEventCount * 60L * CTF_TIME_QUANTIZATION + (usDeltaPeriod >> 1)) / usDeltaPeriod;
         fEventEnergy = (float)(M_PI * (float)ulTempTorque / 16.0f);
+        RecordOutput_AddEvent(pstState_, (float)ulEventPower);
+
+        if (pstState_->pevPtr != NULL)
+            RecordOutput_Event(pstState_, usDeltaPeriod, (float)ulTempTorque / 32.0f, fEventEnergy, ucDeltaEventCount);
     }
     else
     {
         // This is basically a non-event.
+        if (usDeltaPeriod == 0xFFFF)
+        {
+            pstState_->stStats.ulInvalidDeltas++;
+        }
         ulEventPower = 0;
         ulEventCadence = 0;
         fEventEnergy = 0;
-        ulNewEventTime = stState.ulEventTime;
+        ulNewEventTime = pstState_->ulEventTime;
+    }
+
+    if (pstState_->pevPtr != NULL)
+    {
+        // The event has gone out as it is, so there is nothing to resample.
+        pstState_->ucLastEventCount = ucCurrentEventCount;
+        pstState_->ucLastRotationTicks = ucCurrentEventCount;
+        pstState_->usLastAccumPeriod = usCurrentTimeStamp;
+        pstState_->usLastAccumTorque = usCurrentTorqueTicks;
+        return;
     }
 
-    if (((unsigned short)(ulNewEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((ulNewEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
         // The event occurred after the end of the current record epoch.
         // First, figure out the number of records in a gap if it exists. This calculation uses
         // implicit truncation in the division so the subtraction can't be done first.
-        stState.ucRecordGapCount = (unsigned char)((ulNewEventTime / stState.usRecordInterval) - (stState.ulLastRecordTime / stState.usRecordInterval) - 1);
+        pstState_->ulRecordGapCount = (unsigned long)((ulNewEventTime / pstState_->ulRecordInterval) - (pstState_->ulLastRecordTime / pstState_->ulRecordInterval) - 1);
 
         // Pending energy goes towards the partial accumulated record we currently have.
-        stState.fPendingEnergy = stState.fAccumEnergy + fEventEnergy * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPeriod);
+        pstState_->fPendingEnergy = pstState_->fAccumEnergy + fEventEnergy * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPeriod);
 
         // accumulated energy goes towards the *next* event.
-        stState.fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPeriod);
+        pstState_->fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPeriod);
 
         // Gap energy fills the remainder.
-        stState.fGapEnergy = fEventEnergy * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPeriod);
+        pstState_->fGapEnergy = fEventEnergy * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPeriod);
 
         //Same for rotation.
-        stState.fPendingRotation = stState.fAccumRotation + (float)ucDeltaEventCount * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPeriod);
-        stState.fAccumRotation = (float)ucDeltaEventCount * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPeriod);
-        stState.fGapRotation = (float)ucDeltaEventCount * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPeriod);
+        pstState_->fPendingRotation = pstState_->fAccumRotation + (float)ucDeltaEventCount * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPeriod);
+        pstState_->fAccumRotation = (float)ucDeltaEventCount * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPeriod);
+        pstState_->fGapRotation = (float)ucDeltaEventCount * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPeriod);
     }
     else
     {
         // This event came in before the next record epoch started - this
         // will happen when the event period is less than the recording period.
-        stState.fAccumEnergy += fEventEnergy;
-        stState.fAccumRotation += (float)ucDeltaEventCount;
-        stState.fPendingEnergy = 0;
-        stState.fPendingRotation = 0;
-        stState.ucRecordGapCount = 0;
+        pstState_->fAccumEnergy += fEventEnergy;
+        pstState_->fAccumRotation += (float)ucDeltaEventCount;
+        pstState_->fPendingEnergy = 0;
+        pstState_->fPendingRotation = 0;
+        pstState_->ulRecordGapCount = 0;
     }
-    stState.ulEventTime += (unsigned long)usDeltaPeriod;
+    pstState_->ulEventTime += ulDeltaPeriod;
 
-    if (((unsigned short)(stState.ulEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((pstState_->ulEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
-        RecordOutput(prrPtr, &stState);
+        RecordOutput(pstState_);
     }
     else
     {
         // We've had an event that either didn't have a rotation associated
         // with it (no event time increment) or else it was within the
         // recording interval.
-        if ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+        if ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
         {
-            while ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+            while ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
             {
-                stState.dLastRecordTime += ((double)stState.usRecordInterval) / CTF_TIME_QUANTIZATION;
-                (prrPtr)(stState.dLastRecordTime, stState.dTotalRotation, stState.dTotalEnergy, 0.0, 0.0);
+                RecordOutput_AdvanceTime(pstState_, 1);
+                RecordOutput_Emit(pstState_, 0.0f, 0.0f);
             }
         }
     }
 
     // Propagate the message state information.
-    stState.ucLastEventCount = ucCurrentEventCount;
-    stState.ucLastRotationTicks = ucCurrentEventCount;
-    stState.usLastAccumPeriod = usCurrentTimeStamp;
-    stState.usLastAccumTorque = usCurrentTorqueTicks;
+    pstState_->ucLastEventCount = ucCurrentEventCount;
+    pstState_->ucLastRotationTicks = ucCurrentEventCount;
+    pstState_->usLastAccumPeriod = usCurrentTimeStamp;
+    pstState_->usLastAccumTorque = usCurrentTorqueTicks;
 }
 
 
-void DecodeCrankTorqueFreq_Calibration(double dTime_, unsigned char messagePayload_[])
+void DecodeCrankTorqueFreq_Calibration(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     if (messagePayload_[CALIBRATION_ID_BYTE] != ANT_CTF_CALIBRATION_ID)
     {
@@ -285,8 +305,9 @@ void DecodeCrankTorqueFreq_Calibration(double dTime_, unsigned char messagePaylo
         // Tricky part here is that we don't have a good way to qualify this
         // offset with respect to user actions, unless the input record were to
         // also capture head unit requests to the PM.
-        stState.usTorqueOffset = messagePayload_[ANT_CTF_CAL_ZERO_LSB_BYTE];
-        stState.usTorqueOffset += ((unsigned short)messagePayload_[ANT_CTF_CAL_ZERO_MSB_BYTE]) << 8;
+        pstState_->usTorqueOffset = messagePayload_[ANT_CTF_CAL_ZERO_LSB_BYTE];
+        pstState_->usTorqueOffset += ((unsigned short)messagePayload_[ANT_CTF_CAL_ZERO_MSB_BYTE]) << 8;
+        pstState_->stStats.ulCalibrationUpdates++;
         break;
     case ANT_CTF_CAL_SLOPE:
         break;
@@ -14,12 +14,12 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 
-void DecodeCrankTorqueFreq_Init(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
+void DecodeCrankTorqueFreq_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
 void DecodeCrankTorqueFreq_End(void);
 
-void DecodeCrankTorqueFreq_Message(double dTime_, unsigned char messagePayload_[]);
-void DecodeCrankTorqueFreq_Calibration(double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorqueFreq_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorqueFreq_Calibration(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
 
-void DecodeCrankTorqueFreq_Resync(double dTime_, unsigned char messagePayload_[]);
-void DecodeCrankTorqueFreq(double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorqueFreq_Resync(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
+void DecodeCrankTorqueFreq(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
 #endif
\ No newline at end of file
@@ -15,14 +15,9 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 #include "RecordOutput.h"
+#include "PowerProbe.h"
 #include "DecodePowerOnly.h"
 
-static BPSAMPLER stState;
-static PowerRecordReceiver prrPtr;
-
-static double dRecordInterval;
-static double dReSyncInterval;
-
 #define UPDATE_EVENT_BYTE  1
 #define PEDAL_BALANCE_BYTE 2
 #define INST_CADENCE_BYTE  3
@@ -32,33 +27,34 @@ static double dReSyncInterval;
 #define INST_POWER_MSB  7
 
 
-void DecodePowerOnly_Init(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+void DecodePowerOnly_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
 {
-    ResamplerOutput_Init(&stState, (int)(dRecordInterval_* PO_TIME_QUANTIZATION), dRecordInterval_, (int)(dTimeBase_ * PO_TIME_QUANTIZATION));
-    prrPtr = powerRecordReceiverPtr_;
-    dRecordInterval = dRecordInterval_;
-    dReSyncInterval = dReSyncInterval_;
+    ResamplerOutput_Init(pstState_, PO_TIME_QUANTIZATION, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
 }
 
 //
 // Message event handler interface.
 // This is intended to abstract away the top-level messiness of having to detect data gaps or duplicates, etc.
 //
-void DecodePowerOnly_Message(double dTime_, unsigned char messagePayload_[])
+void DecodePowerOnly_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     // see if the message is new.
-    if (stState.ucLastEventCount != messagePayload_[1])
+    if (pstState_->ucLastEventCount != messagePayload_[1])
     {
-        if ((dTime_ - stState.dLastMessageTime) > dReSyncInterval)
+        if ((dTime_ - pstState_->dLastMessageTime) > pstState_->dReSyncInterval)
         {
-            DecodePowerOnly_Resync(dTime_, messagePayload_);
+            DecodePowerOnly_Resync(pstState_, dTime_, messagePayload_);
         }
         else
         {
-            DecodePowerOnly(dTime_, messagePayload_);
+            DecodePowerOnly(pstState_, dTime_, messagePayload_);
         }
-        stState.dLastMessageTime = dTime_;
-        stState.ucLastEventCount = messagePayload_[1];
+        pstState_->dLastMessageTime = dTime_;
+        pstState_->ucLastEventCount = messagePayload_[1];
+    }
+    else
+    {
+        pstState_->stStats.ulDuplicates++;
     }
 }
 
@@ -69,77 +65,81 @@ void DecodePowerOnly_Message(double dTime_, unsigned char messagePayload_[])
 // total energy is properly calculated.
 //
 ///////////////////////////////////////////////////////////////////////
-void DecodePowerOnly_SetTimeBase(double dTimeBase_)
+void DecodePowerOnly_SetTimeBase(BPSAMPLER *pstState_, double dTimeBase_)
 {
     // reset the timebase
-    stState.usTimeBase = (int)(dTimeBase_ * PO_TIME_QUANTIZATION);
+    pstState_->ulTimeBase = ResamplerOutput_Ticks(pstState_, dTimeBase_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 //
 // Re-establish data baseline.
 ///////////////////////////////////////////////////////////////////////
-void DecodePowerOnly_Resync(double dCurrentTime_, unsigned char messagePayload_[])
+void DecodePowerOnly_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char messagePayload_[])
 {
     unsigned short usCurrentAccumPower;
     unsigned char ucCurrentEventCount = messagePayload_[UPDATE_EVENT_BYTE];
 
-    double dCurrentRecordEpoch = (floor(dCurrentTime_ / dRecordInterval)) * dRecordInterval;
+    double dCurrentRecordEpoch = RecordOutput_GetEpoch(pstState_, dCurrentTime_);
+
+    pstState_->stStats.ulResyncs++;
+    POWER_PROBE2(resync, pstState_, POWER_PROBE_TIME(dCurrentTime_));
 
-    if ((stState.dLastRecordTime != 0)
-        && (dCurrentRecordEpoch - stState.dLastRecordTime > 0)
-        && (dCurrentRecordEpoch - stState.dLastRecordTime < MAXIMUM_TIME_GAP))
+    if ((pstState_->dLastRecordTime != 0)
+        && (dCurrentRecordEpoch - pstState_->dLastRecordTime > 0)
+        && (dCurrentRecordEpoch - pstState_->dLastRecordTime < MAXIMUM_TIME_GAP))
     {
-        stState.ucRecordGapCount = (unsigned char)((dCurrentRecordEpoch - stState.dLastRecordTime + dRecordInterval * 0.5)
-            / dRecordInterval);
+        pstState_->ulRecordGapCount = (unsigned long)((dCurrentRecordEpoch - pstState_->dLastRecordTime + pstState_->dRecordInterval * 0.5)
+            / pstState_->dRecordInterval);
 
         // Transfer the accumulated data to the gap.
-        stState.fGapEnergy = stState.fAccumEnergy;
-        stState.fGapRotation = stState.fAccumRotation;
+        pstState_->fGapEnergy = pstState_->fAccumEnergy;
+        pstState_->fGapRotation = pstState_->fAccumRotation;
 
         // We need to fill in the gap with records.
-        RecordOutput_FillGap(prrPtr, &stState);
+        RecordOutput_FillGap(pstState_);
     }
 
     usCurrentAccumPower = messagePayload_[ACCUM_POWER_LSB];
     usCurrentAccumPower += ((unsigned short)messagePayload_[ACCUM_POWER_MSB]) << 8;
 
-    stState.ucCadence = messagePayload_[INST_CADENCE_BYTE];
+    pstState_->ucCadence = messagePayload_[INST_CADENCE_BYTE];
 
-    stState.fAccumEnergy = 0;
-    stState.fPendingEnergy = 0;
-    stState.fGapEnergy = 0;
+    pstState_->fAccumEnergy = 0;
+    pstState_->fPendingEnergy = 0;
+    pstState_->fGapEnergy = 0;
 
-    stState.fAccumRotation = 0;
-    stState.fPendingRotation = 0;
-    stState.fGapRotation = 0;
-    stState.ucRecordGapCount = 0;
+    pstState_->fAccumRotation = 0;
+    pstState_->fPendingRotation = 0;
+    pstState_->fGapRotation = 0;
+    pstState_->ulRecordGapCount = 0;
 
-    stState.ulEventTime = 0;
-    stState.ulLastRecordTime = 0;
+    pstState_->ulEventTime = 0;
+    pstState_->ulLastRecordTime = 0;
 
-    stState.dLastMessageTime = dCurrentTime_;
+    pstState_->dLastMessageTime = dCurrentTime_;
 
     // Update our saved state.
-    stState.dLastRecordTime = dCurrentRecordEpoch;
+    RecordOutput_SetTime(pstState_, dCurrentTime_);
 
-    stState.usLastAccumPeriod = 0;
-    stState.ucLastRotationTicks = messagePayload_[UPDATE_EVENT_BYTE];
-    stState.ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->usLastAccumPeriod = 0;
+    pstState_->ucLastRotationTicks = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
 
-    stState.usLastAccumTorque = usCurrentAccumPower; // use the accumtorque field to store the accum power data
+    pstState_->usLastAccumTorque = usCurrentAccumPower; // use the accumtorque field to store the accum power data
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodePowerOnly(double dTime_, unsigned char messagePayload_[])
+void DecodePowerOnly(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     unsigned long ulNewEventTime;
     unsigned short usCurrentAccumPower;
+    unsigned long ulDeltaPeriod;
+    unsigned long ulDeltaPowerPeriod;
     unsigned short usDeltaPeriod;
-    unsigned short usDeltaPowerPeriod;
     unsigned short usDeltaPower;
     unsigned short usInstPower;
     unsigned char ucEventBalance = messagePayload_[PEDAL_BALANCE_BYTE];
@@ -154,118 +154,123 @@ void DecodePowerOnly(double dTime_, unsigned char messagePayload_[])
     usInstPower = messagePayload_[INST_POWER_LSB];
     usInstPower += ((unsigned short)messagePayload_[INST_POWER_MSB]) << 8;
 
-    usDeltaPower = usCurrentAccumPower - stState.usLastAccumTorque; // make sure this is done in 16 bit word width!
-    ucDeltaTicks = messagePayload_[UPDATE_EVENT_BYTE] - stState.ucLastEventCount;
-    stState.ucCadence = messagePayload_[INST_CADENCE_BYTE];
+    usDeltaPower = usCurrentAccumPower - pstState_->usLastAccumTorque; // make sure this is done in 16 bit word width!
+    ucDeltaTicks = messagePayload_[UPDATE_EVENT_BYTE] - pstState_->ucLastEventCount;
+    pstState_->ucCadence = messagePayload_[INST_CADENCE_BYTE];
 
     // Sanity check on delta power vs. instantaneous.
     if ((usInstPower > 0) && (usDeltaPower > 100 * usInstPower))
     {
         usDeltaPower = usInstPower;
+        pstState_->stStats.ulInvalidDeltas++;
     }
 
-    if (stState.ucCadence > 0)
+    if (pstState_->ucCadence > 0)
     {
-        usDeltaPeriod = (unsigned short)(((unsigned long)ucDeltaTicks * PO_TIME_QUANTIZATION * 60L + (stState.ucCadence >> 1)) / stState.ucCadence);
+        usDeltaPeriod = (unsigned short)(((unsigned long)ucDeltaTicks * PO_TIME_QUANTIZATION * 60L + (pstState_->ucCadence >> 1)) / pstState_->ucCadence);
     }
     else
     {
         usDeltaPeriod = 0xFFFF;
         usDeltaPower = 0;
     }
+    ulDeltaPeriod = (unsigned long)usDeltaPeriod * pstState_->ulTimeScale;
 
-    if (stState.usTimeBase != 0)
+    if (pstState_->ulTimeBase != 0)
     {
         // time based messages.
-        ulNewEventTime = stState.ulEventTime + (unsigned long)stState.usTimeBase*ucDeltaTicks;
+        ulNewEventTime = pstState_->ulEventTime + (unsigned long)pstState_->ulTimeBase*ucDeltaTicks;
 
 #if defined (TIMEBASE_DRIFT_CORRECTION)
         // This is a correction for cases where the sensor timebase is fast compared to the
         // receiver timebase.
-        if ((dTime_ - stState.dLastRecordTime) > (RECORD_INTERVAL * 2))
+        if ((dTime_ - pstState_->dLastRecordTime) > (RECORD_INTERVAL * 2))
         {
             //create a gap to fill.
-            ulNewEventTime += stState.usRecordInterval;
+            ulNewEventTime += pstState_->ulRecordInterval;
         }
 #endif
 
         // Maybe we want to up the resolution on the power to energy
         // conversion. We round the power to the nearest watt so we
         // should be ok in the long term.
-        usDeltaPowerPeriod = stState.usTimeBase*ucDeltaTicks;
+        ulDeltaPowerPeriod = pstState_->ulTimeBase*ucDeltaTicks;
         fEventEnergy = (float)usDeltaPower;
     }
     else
     {
         // event based messages
-        usDeltaPowerPeriod = usDeltaPeriod;
-        ulNewEventTime = stState.ulEventTime + (unsigned long)usDeltaPeriod;
+        ulDeltaPowerPeriod = ulDeltaPeriod;
+        ulNewEventTime = pstState_->ulEventTime + ulDeltaPeriod;
         fEventEnergy = (float)usDeltaPower*usDeltaPeriod / PO_TIME_QUANTIZATION / ucDeltaTicks;
     }
 
-    if (((unsigned short)(ulNewEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    // Accumulated power goes up by the power of each update.
+    RecordOutput_AddEvent(pstState_, (float)usDeltaPower / ucDeltaTicks);
+
+    if ((ulNewEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
         // The event occurred after the end of the current record epoch.
         // First, figure out the number of records in a gap if it exists. This calculation uses
         // implicit truncation in the division so the subtraction can't be done first.
-        stState.ucRecordGapCount = (unsigned char)((ulNewEventTime / stState.usRecordInterval) - (stState.ulLastRecordTime / stState.usRecordInterval) - 1);
+        pstState_->ulRecordGapCount = (unsigned long)((ulNewEventTime / pstState_->ulRecordInterval) - (pstState_->ulLastRecordTime / pstState_->ulRecordInterval) - 1);
 
         // Pending energy goes towards the partial accumulated record we currently have.
-        stState.fPendingEnergy = stState.fAccumEnergy + fEventEnergy * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPowerPeriod);
+        pstState_->fPendingEnergy = pstState_->fAccumEnergy + fEventEnergy * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPowerPeriod);
 
         // accumulated energy goes towards the *next* event.
-        stState.fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPowerPeriod);
+        pstState_->fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPowerPeriod);
 
         // Gap energy fills the remainder.
-        stState.fGapEnergy = fEventEnergy * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPowerPeriod);
+        pstState_->fGapEnergy = fEventEnergy * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPowerPeriod);
 
         //Same for rotation.
-        stState.fPendingRotation = stState.fAccumRotation + (float)ucDeltaTicks * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPeriod);
-        stState.fAccumRotation = (float)ucDeltaTicks * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPeriod);
-        stState.fGapRotation = (float)ucDeltaTicks * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPeriod);
+        pstState_->fPendingRotation = pstState_->fAccumRotation + (float)ucDeltaTicks * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPeriod);
+        pstState_->fAccumRotation = (float)ucDeltaTicks * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPeriod);
+        pstState_->fGapRotation = (float)ucDeltaTicks * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPeriod);
     }
     else
     {
         // This event came in before the next record epoch started - this
         // will happen when the event period is less than the recording period.
-        stState.fAccumEnergy += fEventEnergy;
-        if (stState.usTimeBase != 0)
+        pstState_->fAccumEnergy += fEventEnergy;
+        if (pstState_->ulTimeBase != 0)
         {
-            stState.fAccumRotation += (float)ucDeltaTicks * (float)(stState.ucCadence) / 60.0f;
+            pstState_->fAccumRotation += (float)ucDeltaTicks * (float)(pstState_->ucCadence) / 60.0f;
         }
         else
         {
-            stState.fAccumRotation += (float)ucDeltaTicks;
+            pstState_->fAccumRotation += (float)ucDeltaTicks;
         }
 
-        stState.fPendingEnergy = 0;
-        stState.fPendingRotation = 0;
-        stState.ucRecordGapCount = 0;
+        pstState_->fPendingEnergy = 0;
+        pstState_->fPendingRotation = 0;
+        pstState_->ulRecordGapCount = 0;
     }
 
-    stState.ulEventTime = ulNewEventTime;
+    pstState_->ulEventTime = ulNewEventTime;
 
-    if (((unsigned short)(stState.ulEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((pstState_->ulEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
-        RecordOutput(prrPtr, &stState);
+        RecordOutput(pstState_);
     }
     else
     {
         // We've had an event that either didn't have a rotation associated
         // with it (no event time increment) or else it was within the
         // recording interval.
-        if ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+        if ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
         {
-            while ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+            while ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
             {
-                stState.dLastRecordTime += ((double)stState.usRecordInterval) / PO_TIME_QUANTIZATION;
-                (prrPtr)(stState.dLastRecordTime, stState.dTotalRotation, stState.dTotalEnergy, 0.0, 0.0);
+                RecordOutput_AdvanceTime(pstState_, 1);
+                RecordOutput_Emit(pstState_, 0.0f, 0.0f);
             }
         }
     }
 
     // Propagate the message state information.
-    stState.ucLastRotationTicks = messagePayload_[UPDATE_EVENT_BYTE];
-    stState.ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
-    stState.usLastAccumTorque = usCurrentAccumPower;
+    pstState_->ucLastRotationTicks = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->usLastAccumTorque = usCurrentAccumPower;
 }
@@ -9,13 +9,13 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 
-void DecodePowerOnly_Init(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
+void DecodePowerOnly_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
 void DecodePowerOnly_End(void);
 
 #define PO_TIME_QUANTIZATION (2048) // this is arbitrary, not defined by ANT+
 
-void DecodePowerOnly_Message(double dTime_, unsigned char messagePayload_[]);
-void DecodePowerOnly_SetTimeBase(double dTimeBase_);
+void DecodePowerOnly_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
+void DecodePowerOnly_SetTimeBase(BPSAMPLER *pstState_, double dTimeBase_);
 
-void DecodePowerOnly_Resync(double dTime_, unsigned char messagePayload_[]);
-void DecodePowerOnly(double dTime, unsigned char messagePayload_[]);
+void DecodePowerOnly_Resync(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[]);
+void DecodePowerOnly(BPSAMPLER *pstState_, double dTime, unsigned char messagePayload_[]);
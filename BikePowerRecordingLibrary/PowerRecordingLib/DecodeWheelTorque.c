@@ -15,16 +15,11 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 #include "RecordOutput.h"
+#include "PowerProbe.h"
 #include "DecodeWheelTorque.h"
 
 #define PROPAGATE_CADENCE
 
-static BPSAMPLER stState;
-static PowerRecordReceiver prrPtr;
-
-static double dRecordInterval;
-static double dReSyncInterval;
-
 #define UPDATE_EVENT_BYTE  1
 #define WHEEL_TICKS_BYTE 2
 #define INST_CADENCE_BYTE  3
@@ -34,16 +29,13 @@ static double dReSyncInterval;
 #define ACCUM_TORQUE_MSB  7
 
 
-void DecodeWheelTorque_Init(double dRecordInterval_, double dTimeBasedPeriod_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+void DecodeWheelTorque_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBasedPeriod_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
 {
-    ResamplerOutput_Init(&stState, (int)(dRecordInterval_ * WT_TIME_QUANTIZATION), dRecordInterval_, (int)(dTimeBasedPeriod_ * WT_TIME_QUANTIZATION));
-    prrPtr = powerRecordReceiverPtr_;
-    dRecordInterval = dRecordInterval_;
-    dReSyncInterval = dReSyncInterval_;
+    ResamplerOutput_Init(pstState_, WT_TIME_QUANTIZATION, dRecordInterval_, dTimeBasedPeriod_, dReSyncInterval_, powerRecordReceiverPtr_);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorque_Message(double dTime_, unsigned char messagePayload_[])
+// void DecodeCrankTorque_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Message event handler interface.
@@ -51,51 +43,58 @@ void DecodeWheelTorque_Init(double dRecordInterval_, double dTimeBasedPeriod_, d
 // detect data gaps or duplicates, etc.
 //
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeWheelTorque_Message(double dTime_, unsigned char messagePayload_[])
+void DecodeWheelTorque_Message(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     // see if the message is new.
-    if (stState.ucLastEventCount != messagePayload_[UPDATE_EVENT_BYTE])
+    if (pstState_->ucLastEventCount != messagePayload_[UPDATE_EVENT_BYTE])
     {
-        if ((dTime_ - stState.dLastMessageTime) > dReSyncInterval)
+        if ((dTime_ - pstState_->dLastMessageTime) > pstState_->dReSyncInterval)
         {
-            DecodeWheelTorque_Resync(dTime_, messagePayload_);
+            DecodeWheelTorque_Resync(pstState_, dTime_, messagePayload_);
         }
         else
         {
-            DecodeWheelTorque(dTime_, messagePayload_);
+            DecodeWheelTorque(pstState_, dTime_, messagePayload_);
         }
-        stState.dLastMessageTime = dTime_;
-        stState.ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+        pstState_->dLastMessageTime = dTime_;
+        pstState_->ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+    }
+    else
+    {
+        pstState_->stStats.ulDuplicates++;
     }
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeCrankTorque_Resync(double dCurrentTime_, unsigned char messagePayload_[])
+// void DecodeCrankTorque_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char messagePayload_[])
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Re-establish data baseline.
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeWheelTorque_Resync(double dCurrentTime_, unsigned char messagePayload_[])
+void DecodeWheelTorque_Resync(BPSAMPLER *pstState_, double dCurrentTime_, unsigned char messagePayload_[])
 {
     unsigned short usCurrentAccumTorque;
     unsigned short usCurrentAccumPeriod;
     // CurrentRecordEpoch is the last time that we should have had a data record.
-    double dCurrentRecordEpoch = (floor(dCurrentTime_ / dRecordInterval)) * dRecordInterval;
+    double dCurrentRecordEpoch = RecordOutput_GetEpoch(pstState_, dCurrentTime_);
+
+    pstState_->stStats.ulResyncs++;
+    POWER_PROBE2(resync, pstState_, POWER_PROBE_TIME(dCurrentTime_));
 
-    if ((stState.dLastRecordTime != 0) &&
-        (dCurrentRecordEpoch - stState.dLastRecordTime > 0) &&
-        (dCurrentRecordEpoch - stState.dLastRecordTime < MAXIMUM_TIME_GAP))
+    if ((pstState_->dLastRecordTime != 0) &&
+        (dCurrentRecordEpoch - pstState_->dLastRecordTime > 0) &&
+        (dCurrentRecordEpoch - pstState_->dLastRecordTime < MAXIMUM_TIME_GAP))
     {
-        stState.ucRecordGapCount = (unsigned char)(dCurrentRecordEpoch - stState.dLastRecordTime + dRecordInterval * 0.5)
-            / dRecordInterval;
+        pstState_->ulRecordGapCount = (unsigned long)((dCurrentRecordEpoch - pstState_->dLastRecordTime + pstState_->dRecordInterval * 0.5)
+            / pstState_->dRecordInterval);
 
         // Transfer the accumulated data to the gap.
-        stState.fGapEnergy = stState.fAccumEnergy;
-        stState.fGapRotation = stState.fAccumRotation;
+        pstState_->fGapEnergy = pstState_->fAccumEnergy;
+        pstState_->fGapRotation = pstState_->fAccumRotation;
 
         // We need to fill in the gap with records.
-        RecordOutput_FillGap(prrPtr, &stState);
+        RecordOutput_FillGap(pstState_);
     }
 
     usCurrentAccumPeriod = messagePayload_[ACCUM_PERIOD_LSB];
@@ -104,33 +103,33 @@ void DecodeWheelTorque_Resync(double dCurrentTime_, unsigned char messagePayload
     usCurrentAccumTorque = messagePayload_[ACCUM_TORQUE_LSB];
     usCurrentAccumTorque += ((unsigned short)messagePayload_[ACCUM_TORQUE_MSB]) << 8;
 
-    stState.ucCadence = messagePayload_[INST_CADENCE_BYTE];
+    pstState_->ucCadence = messagePayload_[INST_CADENCE_BYTE];
 
-    stState.fAccumEnergy = 0;
-    stState.fPendingEnergy = 0;
-    stState.fGapEnergy = 0;
+    pstState_->fAccumEnergy = 0;
+    pstState_->fPendingEnergy = 0;
+    pstState_->fGapEnergy = 0;
 
-    stState.fAccumRotation = 0;
-    stState.fPendingRotation = 0;
-    stState.fGapRotation = 0;
-    stState.ucRecordGapCount = 0;
+    pstState_->fAccumRotation = 0;
+    pstState_->fPendingRotation = 0;
+    pstState_->fGapRotation = 0;
+    pstState_->ulRecordGapCount = 0;
 
-    stState.ulEventTime = 0;
-    stState.ulLastRecordTime = 0;
+    pstState_->ulEventTime = 0;
+    pstState_->ulLastRecordTime = 0;
 
-    stState.dLastMessageTime = dCurrentTime_;
+    pstState_->dLastMessageTime = dCurrentTime_;
 
     // Update our saved state.
-    stState.dLastRecordTime = dCurrentRecordEpoch;
+    RecordOutput_SetTime(pstState_, dCurrentTime_);
 
-    stState.usLastAccumTorque = usCurrentAccumTorque;
-    stState.usLastAccumPeriod = usCurrentAccumPeriod;
-    stState.ucLastRotationTicks = messagePayload_[WHEEL_TICKS_BYTE];
-    stState.ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->usLastAccumTorque = usCurrentAccumTorque;
+    pstState_->usLastAccumPeriod = usCurrentAccumPeriod;
+    pstState_->ucLastRotationTicks = messagePayload_[WHEEL_TICKS_BYTE];
+    pstState_->ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// void DecodeWheelTorque(double dTime_, unsigned char messagePayload_[])
+// void DecodeWheelTorque(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 ///////////////////////////////////////////////////////////////////////////////
 // This is the main decoding function for wheel torque messages.
 // Emphasis is placed at this point on handling the specific data
@@ -147,7 +146,7 @@ void DecodeWheelTorque_Resync(double dCurrentTime_, unsigned char messagePayload
 // The wheel output can be handled by a separate decoder or eventually
 // as a special case... code is left here to illustrate the general method.
 ///////////////////////////////////////////////////////////////////////////////
-void DecodeWheelTorque(double dTime_, unsigned char messagePayload_[])
+void DecodeWheelTorque(BPSAMPLER *pstState_, double dTime_, unsigned char messagePayload_[])
 {
     unsigned long ulNewEventTime;
     unsigned long ulEventWheelRPM;
@@ -155,8 +154,9 @@ void DecodeWheelTorque(double dTime_, unsigned char messagePayload_[])
     unsigned short usCurrentAccumTorque;
     unsigned short usCurrentAccumPeriod;
     unsigned short usDeltaTorque;
+    unsigned long ulDeltaPeriod;
+    unsigned long ulDeltaPowerPeriod;
     unsigned short usDeltaPeriod;
-    unsigned short usDeltaPowerPeriod;
     unsigned char ucDeltaEventCount;
     unsigned char ucDeltaTicks;
     float fEventEnergy;
@@ -167,53 +167,56 @@ void DecodeWheelTorque(double dTime_, unsigned char messagePayload_[])
     usCurrentAccumTorque = messagePayload_[ACCUM_TORQUE_LSB];
     usCurrentAccumTorque += ((unsigned short)messagePayload_[ACCUM_TORQUE_MSB]) << 8;
 
-    usDeltaTorque = usCurrentAccumTorque - stState.usLastAccumTorque; // make sure this is done in 16 bit word width!
-    usDeltaPeriod = usCurrentAccumPeriod - stState.usLastAccumPeriod; // make sure this is done in 16 bit word width!
-    usDeltaPowerPeriod = usDeltaPeriod;
+    usDeltaTorque = usCurrentAccumTorque - pstState_->usLastAccumTorque; // make sure this is done in 16 bit word width!
+    usDeltaPeriod = usCurrentAccumPeriod - pstState_->usLastAccumPeriod; // make sure this is done in 16 bit word width!
+    ulDeltaPeriod = (unsigned long)usDeltaPeriod * pstState_->ulTimeScale;
+    ulDeltaPowerPeriod = ulDeltaPeriod;
 
-    stState.ucCadence = messagePayload_[INST_CADENCE_BYTE];
+    pstState_->ucCadence = messagePayload_[INST_CADENCE_BYTE];
 
-    ucDeltaEventCount = messagePayload_[UPDATE_EVENT_BYTE] - stState.ucLastEventCount;
-    ucDeltaTicks = messagePayload_[WHEEL_TICKS_BYTE] - stState.ucLastRotationTicks;
+    ucDeltaEventCount = messagePayload_[UPDATE_EVENT_BYTE] - pstState_->ucLastEventCount;
+    ucDeltaTicks = messagePayload_[WHEEL_TICKS_BYTE] - pstState_->ucLastRotationTicks;
     if (ucDeltaTicks > 200)
     {
         // Unlikely to be right...
         ucDeltaTicks = 0;
+        pstState_->stStats.ulInvalidDeltas++;
     }
 
     // 65535 is an invalid value.
     if (usDeltaTorque == 65535)
     {
         usDeltaTorque = 0;
+        pstState_->stStats.ulInvalidDeltas++;
     }
 
     if (usDeltaPeriod && (usDeltaPeriod != 0xFFFF))
     {
         ulEventPower = ((long)(M_PI*2048.0 + 0.5) * usDeltaTorque / usDeltaPeriod + 8) >> 4;
 
-        if (stState.usTimeBase != 0)
+        if (pstState_->ulTimeBase != 0)
         {
             // time based messages.
-            ulNewEventTime = stState.ulEventTime + (unsigned long)stState.usTimeBase * ucDeltaEventCount;
+            ulNewEventTime = pstState_->ulEventTime + (unsigned long)pstState_->ulTimeBase * ucDeltaEventCount;
 
 #if defined (TIMEBASE_DRIFT_CORRECTION)
             // This is a correction for cases where the sensor timebase is fast compared to the
             // receiver timebase.
-            if ((dTime_ - stState.dLastRecordTime) > (RECORD_INTERVAL * 2))
+            if ((dTime_ - pstState_->dLastRecordTime) > (RECORD_INTERVAL * 2))
             {
                 //create a gap to fill.
-                ulNewEventTime += stState.usRecordInterval;
+                ulNewEventTime += pstState_->ulRecordInterval;
             }
 #endif
 
             // Maybe we want to up the resolution on the power to energy
             // conversion. We round the power to the nearest watt so we
             // should be ok in the long term.
-            usDeltaPowerPeriod = stState.usTimeBase;
+            ulDeltaPowerPeriod = pstState_->ulTimeBase;
             fEventEnergy = (float)ulEventPower;
             // the reported data reflects one revolution for each message update.
 #if defined (PROPAGATE_CADENCE)
-            if (stState.ucCadence)
+            if (pstState_->ucCadence)
             {
                 ucDeltaTicks = ucDeltaEventCount;
             }
@@ -228,89 +231,94 @@ void DecodeWheelTorque(double dTime_, unsigned char messagePayload_[])
         else
         {
             // event based messages
-            ulNewEventTime = stState.ulEventTime + (unsigned long)usDeltaPeriod;
+            ulNewEventTime = pstState_->ulEventTime + ulDeltaPeriod;
             fEventEnergy = (float)(M_PI * (float)usDeltaTorque / 16.0);
         }
 
         // This is actually the wheel rotation speed.
         ulEventWheelRPM = ((long)ucDeltaTicks * 60L * WT_TIME_QUANTIZATION + (usDeltaPeriod >> 1)) / usDeltaPeriod;
+        RecordOutput_AddEvent(pstState_, (float)ulEventPower);
     }
     else
     {
         // This is basically a non-event.
+        if (usDeltaPeriod == 0xFFFF)
+        {
+            pstState_->stStats.ulInvalidDeltas++;
+        }
         ulEventPower = 0;
         ulEventWheelRPM = 0;
         fEventEnergy = 0;
-        ulNewEventTime = stState.ulEventTime;
+        ulNewEventTime = pstState_->ulEventTime;
     }
 
-    if (((unsigned short)(ulNewEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((ulNewEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
         // The event occurred after the end of the current record epoch.
         // First, figure out the number of records in a gap if it exists. This calculation uses
         // implicit truncation in the division so the subtraction can't be done first.
-        stState.ucRecordGapCount = (unsigned char)((ulNewEventTime / stState.usRecordInterval) - (stState.ulLastRecordTime / stState.usRecordInterval) - 1);
+        pstState_->ulRecordGapCount = (unsigned long)((ulNewEventTime / pstState_->ulRecordInterval) - (pstState_->ulLastRecordTime / pstState_->ulRecordInterval) - 1);
 
         // Pending energy goes towards the partial accumulated record we currently have.
-        stState.fPendingEnergy = stState.fAccumEnergy + fEventEnergy * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)usDeltaPowerPeriod);
+        pstState_->fPendingEnergy = pstState_->fAccumEnergy + fEventEnergy * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)ulDeltaPowerPeriod);
 
         // accumulated energy goes towards the *next* event.
-        stState.fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)usDeltaPowerPeriod);
+        pstState_->fAccumEnergy = fEventEnergy * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)ulDeltaPowerPeriod);
 
         // Gap energy fills the remainder.
-        stState.fGapEnergy = fEventEnergy * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPowerPeriod);
+        pstState_->fGapEnergy = fEventEnergy * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPowerPeriod);
 
         //Same for rotation. Within this framework we can propagate either the wheel speed or the cycling cadence...
 #if defined (PROPAGATE_CADENCE)
-        stState.fPendingRotation = stState.fAccumRotation + (float)ucDeltaTicks * (float)(stState.ucCadence) / 60.0f * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval))) / ((float)WT_TIME_QUANTIZATION);
-        stState.fAccumRotation = (float)ucDeltaTicks * (float)(stState.ucCadence) / 60.0f * ((float)(ulNewEventTime % stState.usRecordInterval)) / ((float)WT_TIME_QUANTIZATION);
-        stState.fGapRotation = (float)ucDeltaTicks * (float)(stState.ucCadence) / 60.0f * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)WT_TIME_QUANTIZATION);
+        pstState_->fPendingRotation = pstState_->fAccumRotation + (float)ucDeltaTicks * (float)(pstState_->ucCadence) / 60.0f * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval))) / ((float)pstState_->ulTicksPerSecond);
+        pstState_->fAccumRotation = (float)ucDeltaTicks * (float)(pstState_->ucCadence) / 60.0f * ((float)(ulNewEventTime % pstState_->ulRecordInterval)) / ((float)pstState_->ulTicksPerSecond);
+        pstState_->fGapRotation = (float)ucDeltaTicks * (float)(pstState_->ucCadence) / 60.0f * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)pstState_->ulTicksPerSecond);
 #else
-        stState.fPendingRotation = stState.fAccumRotation + (float)ucDeltaTicks * ((float)(stState.usRecordInterval - (stState.ulEventTime % stState.usRecordInterval)))/((float)usDeltaPeriod);
-        stState.fAccumRotation = (float)ucDeltaTicks * ((float)(ulNewEventTime % stState.usRecordInterval))/((float)usDeltaPeriod);
-        stState.fGapRotation = (float)ucDeltaTicks * ((unsigned short)stState.ucRecordGapCount * stState.usRecordInterval) / ((float)usDeltaPeriod);
+        pstState_->fPendingRotation = pstState_->fAccumRotation + (float)ucDeltaTicks * ((float)(pstState_->ulRecordInterval - (pstState_->ulEventTime % pstState_->ulRecordInterval)))/((float)ulDeltaPeriod);
+        pstState_->fAccumRotation = (float)ucDeltaTicks * ((float)(ulNewEventTime % pstState_->ulRecordInterval))/((float)ulDeltaPeriod);
+        pstState_->fGapRotation = (float)ucDeltaTicks * (pstState_->ulRecordGapCount * pstState_->ulRecordInterval) / ((float)ulDeltaPeriod);
 #endif
     }
     else
     {
         // This event came in before the next record epoch started - this
         // will happen when the event period is less than the recording period.
-        stState.fAccumEnergy += fEventEnergy;
+        pstState_->fAccumEnergy += fEventEnergy;
 #if defined (PROPAGATE_CADENCE)
-        stState.fAccumRotation += (float)ucDeltaTicks * (float)(stState.ucCadence) / 60.0f;
+        pstState_->fAccumRotation += (float)ucDeltaTicks * (float)(pstState_->ucCadence) / 60.0f;
 #else
-        stState.fAccumRotation += (float)ucDeltaTicks;
+        pstState_->fAccumRotation += (float)ucDeltaTicks;
 #endif
 
-        stState.fPendingEnergy = 0;
-        stState.fPendingRotation = 0;
-        stState.ucRecordGapCount = 0;
+        pstState_->fPendingEnergy = 0;
+        pstState_->fPendingRotation = 0;
+        pstState_->ulRecordGapCount = 0;
     }
 
-    stState.ulEventTime = ulNewEventTime;
+    pstState_->ulEventTime = ulNewEventTime;
 
-    if (((unsigned short)(stState.ulEventTime - stState.ulLastRecordTime)) >= stState.usRecordInterval)
+    if ((pstState_->ulEventTime - pstState_->ulLastRecordTime) >= pstState_->ulRecordInterval)
     {
-        RecordOutput(prrPtr, &stState);
+        RecordOutput(pstState_);
     }
     else
     {
         // We've had an event that either didn't have a rotation associated
         // with it (no event time increment) or else it was within the
         // recording interval.
-        if ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+        if ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
         {
-            while ((dTime_ - stState.dLastRecordTime) > dRecordInterval)
+            while ((dTime_ - pstState_->dLastRecordTime) > pstState_->dRecordInterval)
             {
-                stState.dLastRecordTime += ((double)stState.usRecordInterval) / WT_TIME_QUANTIZATION;
-                (prrPtr)(stState.dLastRecordTime, stState.dTotalRotation, stState.dTotalEnergy, 0.0, 0.0);
+                RecordOutput_AdvanceTime(pstState_, 1);
+                RecordOutput_Emit(pstState_, 0.0f, 0.0f);
             }
         }
     }
 
     // Propagate the message state information.
-    stState.ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
-    stState.ucLastRotationTicks = messagePayload_[WHEEL_TICKS_BYTE];
-    stState.usLastAccumPeriod = usCurrentAccumPeriod;
-    stState.usLastAccumTorque = usCurrentAccumTorque;
+    pstState_->ucLastEventCount = messagePayload_[UPDATE_EVENT_BYTE];
+    pstState_->ucLastRotationTicks = messagePayload_[WHEEL_TICKS_BYTE];
+    pstState_->usLastAccumPeriod = usCurrentAccumPeriod;
+    pstState_->usLastAccumTorque = usCurrentAccumTorque;
 }
\ No newline at end of file
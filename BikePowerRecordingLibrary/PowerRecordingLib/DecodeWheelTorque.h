@@ -14,10 +14,10 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 
-void DecodeWheelTorque_Init(double dRecordInterval_, double dTimeBasedPeriod, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
+void DecodeWheelTorque_Init(BPSAMPLER *pstState_, double dRecordInterval_, double dTimeBasedPeriod, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
 void DecodeWheelTorque_End(void);
 
-void DecodeWheelTorque_Message(double dTime_, unsigned char aucByte_[]);
-void DecodeWheelTorque_Resync(double dTime_, unsigned char aucByte_[]);
-void DecodeWheelTorque(double dTime_, unsigned char aucByte_[]);
+void DecodeWheelTorque_Message(BPSAMPLER *pstState_, double dTime_, unsigned char aucByte_[]);
+void DecodeWheelTorque_Resync(BPSAMPLER *pstState_, double dTime_, unsigned char aucByte_[]);
+void DecodeWheelTorque(BPSAMPLER *pstState_, double dTime_, unsigned char aucByte_[]);
 #endif
\ No newline at end of file
@@ -0,0 +1,355 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "math.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "MeanMax.h"
+#include "PowerAlloc.h"
+
+// Work for one thread of MeanMax_ComputeRides: every ulStride'th ride from ulFirst.
+typedef struct _MEAN_MAX_WORK_t_
+{
+    MEAN_MAX *pastCurves;
+    const MEAN_MAX_RIDE *pastRides;
+    unsigned long ulRides;
+    unsigned long ulFirst;
+    unsigned long ulStride;
+
+} MEAN_MAX_WORK;
+
+static unsigned long MeanMax_DefaultDurations(double adDurations_[]);
+static void MeanMax_ComputeWork(MEAN_MAX_WORK *pstWork_);
+
+static unsigned long MeanMax_DefaultDurations(double adDurations_[])
+{
+    // Duration the step size applies up to, and the step (s).
+    static const double adSteps[][2] = { { 60, 1 }, { 300, 5 }, { 1200, 15 }, { 3600, 60 }, { 18000, 300 } };
+    unsigned long ulCount = 0;
+    double dDuration = 0;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(adSteps) / sizeof(adSteps[0])); i++)
+    {
+        while ((dDuration + adSteps[i][1] <= adSteps[i][0]) && (ulCount < MEAN_MAX_DURATIONS))
+        {
+            dDuration += adSteps[i][1];
+            adDurations_[ulCount++] = dDuration;
+        }
+    }
+
+    return ulCount;
+}
+
+///////////////////////////////////////////////////////////////////////
+// bool MeanMax_Init(MEAN_MAX *pstCurve_, double dRecordInterval_, const double *pdDurations_, unsigned long ulDurations_)
+///////////////////////////////////////////////////////////////////////
+//
+// Live updates need the totals as far back as the longest duration.
+//
+///////////////////////////////////////////////////////////////////////
+bool MeanMax_Init(MEAN_MAX *pstCurve_, double dRecordInterval_, const double *pdDurations_, unsigned long ulDurations_)
+{
+    double adDefaults[MEAN_MAX_DURATIONS];
+    unsigned long ulRecords;
+    unsigned long i;
+
+    memset(pstCurve_, 0, sizeof(MEAN_MAX));
+    pstCurve_->dRecordInterval = dRecordInterval_;
+
+    if (pdDurations_ == NULL)
+    {
+        ulDurations_ = MeanMax_DefaultDurations(adDefaults);
+        pdDurations_ = adDefaults;
+    }
+
+    for (i = 0; (i < ulDurations_) && (pstCurve_->ulDurations < MEAN_MAX_DURATIONS); i++)
+    {
+        ulRecords = (unsigned long)(pdDurations_[i] / dRecordInterval_ + 0.5);
+        if ((ulRecords == 0) || ((pstCurve_->ulDurations > 0) && (ulRecords <= pstCurve_->aulRecords[pstCurve_->ulDurations - 1])))
+            continue;
+
+        pstCurve_->aulRecords[pstCurve_->ulDurations] = ulRecords;
+        pstCurve_->adScale[pstCurve_->ulDurations] = 1.0 / (ulRecords * dRecordInterval_);
+        pstCurve_->ulDurations++;
+    }
+
+    return TotalsRing_Init(&pstCurve_->stTotals, dRecordInterval_, (pstCurve_->ulDurations > 0) ? pstCurve_->aulRecords[pstCurve_->ulDurations - 1] : 0);
+}
+
+void MeanMax_Free(MEAN_MAX *pstCurve_)
+{
+    TotalsRing_Free(&pstCurve_->stTotals);
+}
+
+void MeanMax_Reset(MEAN_MAX *pstCurve_)
+{
+    TotalsRing_Reset(&pstCurve_->stTotals);
+}
+
+void MeanMax_Clear(MEAN_MAX *pstCurve_)
+{
+    MeanMax_Reset(pstCurve_);
+    memset(pstCurve_->afPower, 0, sizeof(pstCurve_->afPower));
+}
+
+///////////////////////////////////////////////////////////////////////
+// void MeanMax_Add(MEAN_MAX *pstCurve_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_)
+///////////////////////////////////////////////////////////////////////
+//
+// Missing records are filled with the last total; a window ending in
+// a gap can't beat the one ending where the gap started, so they are
+// not checked.
+//
+///////////////////////////////////////////////////////////////////////
+void MeanMax_Add(MEAN_MAX *pstCurve_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_)
+{
+    unsigned long long ullSteps;
+    double dPower;
+    unsigned long ulRecords;
+    unsigned long i;
+
+    ullSteps = TotalsRing_Steps(&pstCurve_->stTotals, dLastRecordTime_, dTotalEnergy_, fAveragePower_);
+    if (ullSteps == 0)
+        return;
+
+    TotalsRing_Fill(&pstCurve_->stTotals, ullSteps - 1);
+    TotalsRing_Push(&pstCurve_->stTotals, dTotalEnergy_);
+
+    for (i = 0; i < pstCurve_->ulDurations; i++)
+    {
+        ulRecords = pstCurve_->aulRecords[i];
+        if (ulRecords >= pstCurve_->stTotals.ullCount)
+            break;
+
+        dPower = (dTotalEnergy_ - TotalsRing_Get(&pstCurve_->stTotals, ulRecords)) * pstCurve_->adScale[i];
+        if (dPower > pstCurve_->afPower[i])
+            pstCurve_->afPower[i] = (float)dPower;
+    }
+}
+
+void MeanMax_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    MeanMax_Add((MEAN_MAX*)pvContext_, dLastRecordTime_, dTotalEnergy_, fAveragePower_);
+}
+
+void MeanMax_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    PowerRecordRun_Deliver(pstRun_, MeanMax_Receiver, pvContext_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// void MeanMax_Compute(MEAN_MAX *pstCurve_, const double *pdTotalEnergy_, unsigned long ulCount_)
+///////////////////////////////////////////////////////////////////////
+//
+// With the whole ride at hand, each duration is one pass of
+// subtractions over the totals, which the compiler can vectorize.
+// O(records x durations): well under 100 ms for 6 h at 1 Hz.
+//
+///////////////////////////////////////////////////////////////////////
+void MeanMax_Compute(MEAN_MAX *pstCurve_, const double *pdTotalEnergy_, unsigned long ulCount_)
+{
+    unsigned long ulRecords;
+    unsigned long i;
+    unsigned long j;
+    double dBest;
+    double dEnergy;
+
+    for (i = 0; i < pstCurve_->ulDurations; i++)
+    {
+        ulRecords = pstCurve_->aulRecords[i];
+        if (ulRecords >= ulCount_)
+            break;
+
+        dBest = 0;
+        for (j = ulRecords; j < ulCount_; j++)
+        {
+            dEnergy = pdTotalEnergy_[j] - pdTotalEnergy_[j - ulRecords];
+            dBest = (dEnergy > dBest) ? dEnergy : dBest;
+        }
+
+        dBest *= pstCurve_->adScale[i];
+        if (dBest > pstCurve_->afPower[i])
+            pstCurve_->afPower[i] = (float)dBest;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// bool MeanMax_ComputeIndex(MEAN_MAX *pstCurve_, const RECORD_INDEX *pstIndex_)
+///////////////////////////////////////////////////////////////////////
+//
+// Lays the records out one interval apart, holding the total over
+// any stretch without records.
+//
+///////////////////////////////////////////////////////////////////////
+bool MeanMax_ComputeIndex(MEAN_MAX *pstCurve_, const RECORD_INDEX *pstIndex_)
+{
+    const RECORD_INDEX_ENTRY *pastEntries = pstIndex_->pastEntries;
+    double *pdTotals;
+    double dStartTime;
+    unsigned long ulCount;
+    unsigned long ulSlot;
+    unsigned long ulFilled = 0;
+    unsigned long i;
+
+    if (pstIndex_->ulCount < 2)
+        return true;
+
+    dStartTime = pastEntries[0].dTime;
+    ulCount = (unsigned long)((pastEntries[pstIndex_->ulCount - 1].dTime - dStartTime) / pstCurve_->dRecordInterval + 0.5) + 1;
+
+    pdTotals = (double*)POWER_MALLOC(ulCount * sizeof(double));
+    if (pdTotals == NULL)
+        return false;
+
+    for (i = 0; i < pstIndex_->ulCount; i++)
+    {
+        ulSlot = (unsigned long)((pastEntries[i].dTime - dStartTime) / pstCurve_->dRecordInterval + 0.5);
+        if (ulSlot >= ulCount)
+            ulSlot = ulCount - 1;
+
+        while (ulFilled < ulSlot)
+        {
+            pdTotals[ulFilled] = pdTotals[ulFilled - 1];
+            ulFilled++;
+        }
+
+        pdTotals[ulSlot] = pastEntries[i].dTotalEnergy;
+        ulFilled = ulSlot + 1;
+    }
+
+    MeanMax_Compute(pstCurve_, pdTotals, ulFilled);
+    POWER_FREE(pdTotals);
+    return true;
+}
+
+static void MeanMax_ComputeWork(MEAN_MAX_WORK *pstWork_)
+{
+    unsigned long i;
+
+    for (i = pstWork_->ulFirst; i < pstWork_->ulRides; i += pstWork_->ulStride)
+        MeanMax_Compute(&pstWork_->pastCurves[i], pstWork_->pastRides[i].pdTotalEnergy, pstWork_->pastRides[i].ulCount);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI MeanMax_ComputeThread(LPVOID pvWork_)
+{
+    MeanMax_ComputeWork((MEAN_MAX_WORK*)pvWork_);
+    return 0;
+}
+#else
+static void* MeanMax_ComputeThread(void *pvWork_)
+{
+    MeanMax_ComputeWork((MEAN_MAX_WORK*)pvWork_);
+    return NULL;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// bool MeanMax_ComputeRides(MEAN_MAX *pastCurves_, const MEAN_MAX_RIDE *pastRides_, unsigned long ulRides_, unsigned long ulThreads_)
+///////////////////////////////////////////////////////////////////////
+//
+// Rides are independent, so each thread takes every n'th one. The
+// calling thread does a share of its own.
+//
+///////////////////////////////////////////////////////////////////////
+bool MeanMax_ComputeRides(MEAN_MAX *pastCurves_, const MEAN_MAX_RIDE *pastRides_, unsigned long ulRides_, unsigned long ulThreads_)
+{
+    MEAN_MAX_WORK astWork[MEAN_MAX_MAX_THREADS];
+#if defined(_WIN32)
+    HANDLE ahThreads[MEAN_MAX_MAX_THREADS];
+#else
+    pthread_t astThreads[MEAN_MAX_MAX_THREADS];
+#endif
+    unsigned long ulStarted = 1;
+    bool bSuccess = true;
+    unsigned long i;
+
+    if (ulThreads_ > MEAN_MAX_MAX_THREADS)
+        ulThreads_ = MEAN_MAX_MAX_THREADS;
+    if (ulThreads_ > ulRides_)
+        ulThreads_ = ulRides_;
+    if (ulThreads_ == 0)
+        ulThreads_ = 1;
+
+    for (i = 0; i < ulThreads_; i++)
+    {
+        astWork[i].pastCurves = pastCurves_;
+        astWork[i].pastRides = pastRides_;
+        astWork[i].ulRides = ulRides_;
+        astWork[i].ulFirst = i;
+        astWork[i].ulStride = ulThreads_;
+    }
+
+    for (; ulStarted < ulThreads_; ulStarted++)
+    {
+#if defined(_WIN32)
+        ahThreads[ulStarted] = CreateThread(NULL, 0, MeanMax_ComputeThread, &astWork[ulStarted], 0, NULL);
+        if (ahThreads[ulStarted] == NULL)
+            break;
+#else
+        if (pthread_create(&astThreads[ulStarted], NULL, MeanMax_ComputeThread, &astWork[ulStarted]) != 0)
+            break;
+#endif
+    }
+
+    MeanMax_ComputeWork(&astWork[0]);
+
+    // Rides of threads that failed to start are done here.
+    for (i = ulStarted; i < ulThreads_; i++)
+    {
+        MeanMax_ComputeWork(&astWork[i]);
+        bSuccess = false;
+    }
+
+    for (i = 1; i < ulStarted; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(ahThreads[i], INFINITE);
+        CloseHandle(ahThreads[i]);
+#else
+        pthread_join(astThreads[i], NULL);
+#endif
+    }
+
+    return bSuccess;
+}
+
+void MeanMax_Merge(MEAN_MAX *pstCurve_, const MEAN_MAX *pstOther_)
+{
+    unsigned long i;
+
+    for (i = 0; (i < pstCurve_->ulDurations) && (i < pstOther_->ulDurations); i++)
+    {
+        if (pstOther_->afPower[i] > pstCurve_->afPower[i])
+            pstCurve_->afPower[i] = pstOther_->afPower[i];
+    }
+}
+
+float MeanMax_GetPower(const MEAN_MAX *pstCurve_, double dDuration_)
+{
+    unsigned long ulRecords = (unsigned long)(dDuration_ / pstCurve_->dRecordInterval + 0.5);
+    unsigned long i;
+
+    for (i = 0; i < pstCurve_->ulDurations; i++)
+    {
+        if (pstCurve_->aulRecords[i] == ulRecords)
+            return pstCurve_->afPower[i];
+    }
+
+    return 0;
+}
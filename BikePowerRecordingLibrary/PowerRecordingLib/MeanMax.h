@@ -0,0 +1,88 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (MEAN_MAX_H)
+#define MEAN_MAX_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+#include "RecordIndex.h"
+#include "TotalsRing.h"
+
+// The mean-max power curve is the best average power held for each of a set
+// of durations. The average over the n records ending at record i is
+// (E[i] - E[i - n]) / duration, where E is the total energy of the records,
+// so each record costs one subtraction per duration rather than a sum.
+//
+// The default durations run from 1 s to 5 h: every second to 1 min, 5 s to
+// 5 min, 15 s to 20 min, 1 min to 1 h and 5 min to 5 h. Durations are
+// rounded to whole records; ones that round to nothing or to the same
+// number of records as the one before are dropped.
+#define MEAN_MAX_DURATIONS              (256)           // Most durations in a curve
+#define MEAN_MAX_MAX_THREADS            (64)            // Most threads used by MeanMax_ComputeRides
+
+typedef struct _MEAN_MAX_t_
+{
+    double dRecordInterval;             // Recording interval (s)
+    unsigned long ulDurations;          // Durations in use
+    unsigned long aulRecords[MEAN_MAX_DURATIONS];       // Duration in records, ascending
+    double adScale[MEAN_MAX_DURATIONS]; // 1 / duration (s)
+    float afPower[MEAN_MAX_DURATIONS];  // Best average power (W), 0 until a ride is that long
+
+    TOTALS_RING stTotals;               // Energy totals of the latest records, for live updates
+
+} MEAN_MAX;
+
+// A ride's energy totals, evenly spaced one recording interval apart.
+// The first is the total before the first record.
+typedef struct _MEAN_MAX_RIDE_t_
+{
+    const double *pdTotalEnergy;
+    unsigned long ulCount;
+
+} MEAN_MAX_RIDE;
+
+// Initializes an empty curve. pdDurations_ lists ulDurations_ durations (s) in ascending
+// order, or is NULL for the default ones. Returns false if out of memory.
+bool MeanMax_Init(MEAN_MAX *pstCurve_, double dRecordInterval_, const double *pdDurations_, unsigned long ulDurations_);
+
+// Frees the curve's record history.
+void MeanMax_Free(MEAN_MAX *pstCurve_);
+
+// Starts a new ride. The curve keeps its best powers; use MeanMax_Clear to drop them too.
+void MeanMax_Reset(MEAN_MAX *pstCurve_);
+void MeanMax_Clear(MEAN_MAX *pstCurve_);
+
+// Updates the curve with a record as it arrives. Time without records counts as zero power.
+void MeanMax_Add(MEAN_MAX *pstCurve_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_);
+
+// Receivers that feed a decoder's records to a curve, with the curve as the context (see PowerDecoder_InitContext).
+void MeanMax_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+void MeanMax_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+// Updates the curve from a whole ride at once. Faster than adding its records one at a time.
+void MeanMax_Compute(MEAN_MAX *pstCurve_, const double *pdTotalEnergy_, unsigned long ulCount_);
+
+// As above, from the records of an index. The first record only serves as the starting total.
+// Returns false if out of memory.
+bool MeanMax_ComputeIndex(MEAN_MAX *pstCurve_, const RECORD_INDEX *pstIndex_);
+
+// Computes a curve for each of ulRides_ rides over up to ulThreads_ threads.
+// The curves must be initialized. They are computed either way; returns false if
+// some of the threads couldn't be started.
+bool MeanMax_ComputeRides(MEAN_MAX *pastCurves_, const MEAN_MAX_RIDE *pastRides_, unsigned long ulRides_, unsigned long ulThreads_);
+
+// Raises a curve to the best of itself and another with the same durations (eg. a season's best).
+void MeanMax_Merge(MEAN_MAX *pstCurve_, const MEAN_MAX *pstOther_);
+
+// Best average power (W) for a duration (s) of the curve, or 0 if the curve doesn't have it.
+float MeanMax_GetPower(const MEAN_MAX *pstCurve_, double dDuration_);
+
+#endif
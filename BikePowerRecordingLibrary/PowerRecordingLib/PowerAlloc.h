@@ -0,0 +1,38 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+#if !defined(POWER_ALLOC_H)
+#define POWER_ALLOC_H
+
+#include "stdlib.h"
+
+// Heap allocations of the library.
+//
+// Build with DSI_ALLOC_AUDIT defined, and link an ANT_LIB built the same
+// way, to count them in its allocation audit (see dsi_alloc.h); the
+// record index grows while records arrive, so the audit needs to see it.
+// Without DSI_ALLOC_AUDIT they are the C library calls.
+
+#if defined(DSI_ALLOC_AUDIT)
+    void* DSIAlloc_Malloc(size_t size_);
+    void* DSIAlloc_Calloc(size_t count_, size_t size_);
+    void* DSIAlloc_Realloc(void *pvMemory_, size_t size_);
+    void DSIAlloc_Free(void *pvMemory_);
+
+    #define POWER_MALLOC(size)                  DSIAlloc_Malloc(size)
+    #define POWER_CALLOC(count, size)           DSIAlloc_Calloc(count, size)
+    #define POWER_REALLOC(memory, size)         DSIAlloc_Realloc(memory, size)
+    #define POWER_FREE(memory)                  DSIAlloc_Free(memory)
+#else
+    #define POWER_MALLOC(size)                  malloc(size)
+    #define POWER_CALLOC(count, size)           calloc(count, size)
+    #define POWER_REALLOC(memory, size)         realloc(memory, size)
+    #define POWER_FREE(memory)                  free(memory)
+#endif
+
+#endif
@@ -20,42 +20,296 @@
 #include "stdlib.h"
 #include "math.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include "DecodeCrankTorque.h"
 #include "DecodeCrankTorqueFrequency.h"
 #include "DecodePowerOnly.h"
 #include "DecodeWheelTorque.h"
 #include "PowerDecoder.h"
+#include "PowerProbe.h"
+#include "RecordOutput.h"
+#include "RxTimeBase.h"
+
+// Decoder instance behind the single meter API (InitPowerDecoder/DecodePowerMessage)
+static POWERDECODER stDefaultDecoder;
+static unsigned char ucDefaultPowerMeterType = 255;
+static PowerRecordRunReceiver prunDefault = NULL;
+static PowerRecordStatsReceiver prsrDefault = NULL;
+static PowerEventReceiver pevDefault = NULL;
+static unsigned char bDefaultGridAligned = false;
+static unsigned char bDefaultTimed = false;
+static double dDefaultGridOrigin = 0;
+
+///////////////////////////////////////////////////////////////////////
+// void PowerDecoder_Init(POWERDECODER *pstDecoder_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+///////////////////////////////////////////////////////////////////////
+//
+// Initializes all of the data stream decoders of one power meter.
+// The power meter type starts out unknown.
+//
+///////////////////////////////////////////////////////////////////////
+void PowerDecoder_Init(POWERDECODER *pstDecoder_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+{
+    DecodePowerOnly_Init(&pstDecoder_->stPowerOnly, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
+    DecodeCrankTorque_Init(&pstDecoder_->stCrankTorque, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
+    DecodeCrankTorqueFreq_Init(&pstDecoder_->stCrankTorqueFreq, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
+    DecodeWheelTorque_Init(&pstDecoder_->stWheelTorque, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
+
+    pstDecoder_->ucPowerMeterType = 255;
+    pstDecoder_->ucPowerOnlyEventCount = 255;
+    pstDecoder_->bResyncPowerChannel = true;
+    pstDecoder_->bResyncPowerOnlyChannel = true;
+    pstDecoder_->dPowerOnlyBundleRxTime = -1;
+
+    memset(&pstDecoder_->stStats, 0, sizeof(POWERDECODER_STATS));
+    pstDecoder_->bTimed = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void PowerDecoder_InitContext(POWERDECODER *pstDecoder_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_)
+///////////////////////////////////////////////////////////////////////
+//
+// As PowerDecoder_Init, for callers that run several decoders and
+// need to know which one a record came from.
+//
+///////////////////////////////////////////////////////////////////////
+void PowerDecoder_InitContext(POWERDECODER *pstDecoder_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_)
+{
+    BPSAMPLER *apstStreams[] = { &pstDecoder_->stPowerOnly, &pstDecoder_->stWheelTorque, &pstDecoder_->stCrankTorque, &pstDecoder_->stCrankTorqueFreq };
+    int i;
+
+    PowerDecoder_Init(pstDecoder_, dRecordInterval_, dTimeBase_, dReSyncInterval_, NULL);
+
+    for (i = 0; i < (int)(sizeof(apstStreams) / sizeof(apstStreams[0])); i++)
+    {
+        apstStreams[i]->prcrPtr = powerRecordReceiverPtr_;
+        apstStreams[i]->pvRecordContext = pvContext_;
+    }
+}
+
+// 16 = Power Only, 17 = Wheel Torque, 18 = Crank Torque, 32 = Crank Torque Frequency, 255 = Unknown
+void PowerDecoder_SetPowerMeterType(POWERDECODER *pstDecoder_, unsigned char ucPowerMeterType_)
+{
+    pstDecoder_->ucPowerMeterType = ucPowerMeterType_;
+}
+
+void PowerDecoder_SetRunReceiver(POWERDECODER *pstDecoder_, PowerRecordRunReceiver powerRecordRunReceiverPtr_)
+{
+    pstDecoder_->stPowerOnly.prunPtr = powerRecordRunReceiverPtr_;
+    pstDecoder_->stWheelTorque.prunPtr = powerRecordRunReceiverPtr_;
+    pstDecoder_->stCrankTorque.prunPtr = powerRecordRunReceiverPtr_;
+    pstDecoder_->stCrankTorqueFreq.prunPtr = powerRecordRunReceiverPtr_;
+}
+
+void PowerDecoder_SetStatsReceiver(POWERDECODER *pstDecoder_, PowerRecordStatsReceiver powerRecordStatsReceiverPtr_)
+{
+    pstDecoder_->stPowerOnly.prsrPtr = powerRecordStatsReceiverPtr_;
+    pstDecoder_->stWheelTorque.prsrPtr = powerRecordStatsReceiverPtr_;
+    pstDecoder_->stCrankTorque.prsrPtr = powerRecordStatsReceiverPtr_;
+    pstDecoder_->stCrankTorqueFreq.prsrPtr = powerRecordStatsReceiverPtr_;
+}
+
+void PowerDecoder_SetEventReceiver(POWERDECODER *pstDecoder_, PowerEventReceiver powerEventReceiverPtr_)
+{
+    // Only the crank torque meters report whole events.
+    pstDecoder_->stCrankTorque.pevPtr = powerEventReceiverPtr_;
+    pstDecoder_->stCrankTorqueFreq.pevPtr = powerEventReceiverPtr_;
+}
+
+void PowerDecoder_SetTiming(POWERDECODER *pstDecoder_, unsigned char bTimed_)
+{
+    pstDecoder_->bTimed = bTimed_;
+    pstDecoder_->stPowerOnly.bTimed = bTimed_;
+    pstDecoder_->stWheelTorque.bTimed = bTimed_;
+    pstDecoder_->stCrankTorque.bTimed = bTimed_;
+    pstDecoder_->stCrankTorqueFreq.bTimed = bTimed_;
+}
+
+void PowerDecoder_SetGrid(POWERDECODER *pstDecoder_, double dGridOrigin_)
+{
+    RecordOutput_SetGrid(&pstDecoder_->stPowerOnly, dGridOrigin_);
+    RecordOutput_SetGrid(&pstDecoder_->stWheelTorque, dGridOrigin_);
+    RecordOutput_SetGrid(&pstDecoder_->stCrankTorque, dGridOrigin_);
+    RecordOutput_SetGrid(&pstDecoder_->stCrankTorqueFreq, dGridOrigin_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// void PowerDecoder_GetStats(const POWERDECODER *pstDecoder_, POWERDECODER_STATS *pstStats_)
+///////////////////////////////////////////////////////////////////////
+//
+// Totals the counters kept by each data stream. Only a handful of
+// additions, so this is cheap enough to poll for every device.
+//
+///////////////////////////////////////////////////////////////////////
+void PowerDecoder_GetStats(const POWERDECODER *pstDecoder_, POWERDECODER_STATS *pstStats_)
+{
+    const BPSAMPLER *apstStreams[] = { &pstDecoder_->stPowerOnly, &pstDecoder_->stWheelTorque, &pstDecoder_->stCrankTorque, &pstDecoder_->stCrankTorqueFreq };
+    unsigned long long ullReceiverTime = 0;
+    int i;
+
+    *pstStats_ = pstDecoder_->stStats;
+
+    for (i = 0; i < (int)(sizeof(apstStreams) / sizeof(apstStreams[0])); i++)
+    {
+        pstStats_->ulDuplicates += apstStreams[i]->stStats.ulDuplicates;
+        pstStats_->ulResyncs += apstStreams[i]->stStats.ulResyncs;
+        pstStats_->ulGapRecords += apstStreams[i]->stStats.ulGapRecords;
+        pstStats_->ulInvalidDeltas += apstStreams[i]->stStats.ulInvalidDeltas;
+        pstStats_->ulCalibrationUpdates += apstStreams[i]->stStats.ulCalibrationUpdates;
+        ullReceiverTime += apstStreams[i]->ullReceiverTime;
+    }
+
+    // Receivers run inside the decode timing window (eg. writing records to disk).
+    if (pstStats_->ullDecodeTime > ullReceiverTime)
+        pstStats_->ullDecodeTime -= ullReceiverTime;
+    else
+        pstStats_->ullDecodeTime = 0;
+}
 
-static PowerRecordReceiver prrPtr;
-static unsigned char ucPowerMeterChannel = 255;
-static unsigned char ucPowerMeterType = 255;
-static bool bResyncPowerChannel = true;
-static bool bResyncPowerOnlyChannel = true;
-static unsigned char ucPowerOnlyEventCount = 255;
-static double dPowerOnlyBundleRxTime = -1;
-static unsigned char ucNewPowerOnlyEventCount;
+///////////////////////////////////////////////////////////////////////
+// unsigned long long PowerDecoder_GetCpuTimeNs(void)
+///////////////////////////////////////////////////////////////////////
+unsigned long long PowerDecoder_GetCpuTimeNs(void)
+{
+#if defined(_WIN32)
+    FILETIME stCreation, stExit, stKernel, stUser;
+    ULARGE_INTEGER stKernelTime, stUserTime;
+
+    if (!GetThreadTimes(GetCurrentThread(), &stCreation, &stExit, &stKernel, &stUser))
+        return 0;
+
+    stKernelTime.LowPart = stKernel.dwLowDateTime;
+    stKernelTime.HighPart = stKernel.dwHighDateTime;
+    stUserTime.LowPart = stUser.dwLowDateTime;
+    stUserTime.HighPart = stUser.dwHighDateTime;
+
+    // In units of 100 ns.
+    return (stKernelTime.QuadPart + stUserTime.QuadPart) * 100ULL;
+#else
+    struct timespec stNow;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &stNow);
+    return (unsigned long long)stNow.tv_sec * 1000000000ULL + (unsigned long long)stNow.tv_nsec;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+// void PowerRecordRun_Deliver(const POWER_RECORD_RUN *pstRun_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_)
+///////////////////////////////////////////////////////////////////////
+//
+// Each record's time and totals are worked out from the start of the
+// run rather than added up, as in RecordOutput_FillGap.
+//
+///////////////////////////////////////////////////////////////////////
+void PowerRecordRun_Deliver(const POWER_RECORD_RUN *pstRun_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_)
+{
+    unsigned long i;
+
+    for (i = 0; i < pstRun_->ulCount; i++)
+    {
+        (*powerRecordReceiverPtr_)(pvContext_, pstRun_->dStartTime + pstRun_->dInterval * i,
+            pstRun_->dStartRotation + pstRun_->dIncRotation * i, pstRun_->dStartEnergy + pstRun_->dIncEnergy * i,
+            pstRun_->fAverageCadence, pstRun_->fAveragePower);
+    }
+}
 
 void InitPowerDecoder(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
 {
-    prrPtr = powerRecordReceiverPtr_;
-    DecodePowerOnly_Init(dRecordInterval_, dTimeBase_, dReSyncInterval_, prrPtr);
-    DecodeCrankTorque_Init(dRecordInterval_, dTimeBase_, dReSyncInterval_, prrPtr);
-    DecodeCrankTorqueFreq_Init(dRecordInterval_, dTimeBase_, dReSyncInterval_, prrPtr);
-    DecodeWheelTorque_Init(dRecordInterval_, dTimeBase_, dReSyncInterval_, prrPtr);
+    PowerDecoder_Init(&stDefaultDecoder, dRecordInterval_, dTimeBase_, dReSyncInterval_, powerRecordReceiverPtr_);
+
+    // The meter type and the other receivers may have been configured ahead of initialization.
+    stDefaultDecoder.ucPowerMeterType = ucDefaultPowerMeterType;
+    PowerDecoder_SetRunReceiver(&stDefaultDecoder, prunDefault);
+    PowerDecoder_SetStatsReceiver(&stDefaultDecoder, prsrDefault);
+    PowerDecoder_SetEventReceiver(&stDefaultDecoder, pevDefault);
+    if (bDefaultGridAligned)
+        PowerDecoder_SetGrid(&stDefaultDecoder, dDefaultGridOrigin);
+    PowerDecoder_SetTiming(&stDefaultDecoder, bDefaultTimed);
 }
 
 // 16 = Power Only, 17 = Wheel Torque, 18 = Crank Torque, 32 = Crank Torque Frequency, 255 = Unknown
 void SetPowerMeterType(unsigned char ucPowerMeterType_)
 {
-    ucPowerMeterType = ucPowerMeterType_;
+    ucDefaultPowerMeterType = ucPowerMeterType_;
+    PowerDecoder_SetPowerMeterType(&stDefaultDecoder, ucPowerMeterType_);
+}
+
+void SetPowerRecordRunReceiver(PowerRecordRunReceiver powerRecordRunReceiverPtr_)
+{
+    prunDefault = powerRecordRunReceiverPtr_;
+    PowerDecoder_SetRunReceiver(&stDefaultDecoder, powerRecordRunReceiverPtr_);
+}
+
+void SetPowerRecordStatsReceiver(PowerRecordStatsReceiver powerRecordStatsReceiverPtr_)
+{
+    prsrDefault = powerRecordStatsReceiverPtr_;
+    PowerDecoder_SetStatsReceiver(&stDefaultDecoder, powerRecordStatsReceiverPtr_);
+}
+
+void SetPowerEventReceiver(PowerEventReceiver powerEventReceiverPtr_)
+{
+    pevDefault = powerEventReceiverPtr_;
+    PowerDecoder_SetEventReceiver(&stDefaultDecoder, powerEventReceiverPtr_);
 }
 
-void DecodePowerMessage(double dRxTime_, unsigned char messagePayload_[8])
+void SetPowerRecordGrid(double dGridOrigin_)
 {
+    bDefaultGridAligned = true;
+    dDefaultGridOrigin = dGridOrigin_;
+    PowerDecoder_SetGrid(&stDefaultDecoder, dGridOrigin_);
+}
+
+void SetPowerDecoderTiming(unsigned char bTimed_)
+{
+    bDefaultTimed = bTimed_;
+    PowerDecoder_SetTiming(&stDefaultDecoder, bTimed_);
+}
+
+void GetPowerDecoderStats(POWERDECODER_STATS *pstStats_)
+{
+    PowerDecoder_GetStats(&stDefaultDecoder, pstStats_);
+}
+
+void DecodePowerMessage(double dRxTime_, unsigned char messagePayload_[])
+{
+    PowerDecoder_Message(&stDefaultDecoder, dRxTime_, messagePayload_);
+}
+
+void DecodePowerMessageTicks(unsigned long long ullRxTicks_, unsigned char messagePayload_[])
+{
+    PowerDecoder_MessageTicks(&stDefaultDecoder, ullRxTicks_, messagePayload_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// void PowerDecoder_MessageTicks(POWERDECODER *pstDecoder_, unsigned long long ullRxTicks_, unsigned char messagePayload_[])
+///////////////////////////////////////////////////////////////////////
+//
+// Ticks of the receiver clock convert to seconds without rounding, so
+// gap detection and record epochs don't pick up host timing jitter.
+//
+///////////////////////////////////////////////////////////////////////
+void PowerDecoder_MessageTicks(POWERDECODER *pstDecoder_, unsigned long long ullRxTicks_, unsigned char messagePayload_[])
+{
+    PowerDecoder_Message(pstDecoder_, RxTimeBase_Seconds(ullRxTicks_), messagePayload_);
+}
+
+void PowerDecoder_Message(POWERDECODER *pstDecoder_, double dRxTime_, unsigned char messagePayload_[])
+{
+    unsigned char ucNewPowerOnlyEventCount;
+    unsigned long long ullStartTime = pstDecoder_->bTimed ? PowerDecoder_GetCpuTimeNs() : 0;
+
+    pstDecoder_->stStats.ulPagesSeen++;
+    POWER_PROBE3(decode_entry, pstDecoder_, messagePayload_[0], POWER_PROBE_TIME(dRxTime_));
+
     // Initialize the received time for power only event count bundled messages or
     // if the received times differ greatly (we may have missed messages beyond the event count rollover)
-    if (dPowerOnlyBundleRxTime < 0 || (dRxTime_ - dPowerOnlyBundleRxTime) > 30)
-        dPowerOnlyBundleRxTime = dRxTime_;
+    if (pstDecoder_->dPowerOnlyBundleRxTime < 0 || (dRxTime_ - pstDecoder_->dPowerOnlyBundleRxTime) > 30)
+        pstDecoder_->dPowerOnlyBundleRxTime = dRxTime_;
 
     // do page decoding against the expected power pages.
     switch (messagePayload_[0])
@@ -63,103 +317,103 @@ void DecodePowerMessage(double dRxTime_, unsigned char messagePayload_[8])
         case ANT_POWERONLY:
             ucNewPowerOnlyEventCount = messagePayload_[1];
 
-            if (ucNewPowerOnlyEventCount != ucPowerOnlyEventCount)
+            if (ucNewPowerOnlyEventCount != pstDecoder_->ucPowerOnlyEventCount)
             {
-                ucPowerOnlyEventCount = ucNewPowerOnlyEventCount;
-                dPowerOnlyBundleRxTime = dRxTime_;
+                pstDecoder_->ucPowerOnlyEventCount = ucNewPowerOnlyEventCount;
+                pstDecoder_->dPowerOnlyBundleRxTime = dRxTime_;
             }
 
             // Don't grab the power decoding unless we're the
             // only power message type we've received so far.
-            if (ucPowerMeterType == 255)
+            if (pstDecoder_->ucPowerMeterType == 255)
             {
-                ucPowerMeterType = messagePayload_[0];
-                DecodePowerOnly_Resync(dPowerOnlyBundleRxTime, messagePayload_);
+                pstDecoder_->ucPowerMeterType = messagePayload_[0];
+                DecodePowerOnly_Resync(&pstDecoder_->stPowerOnly, pstDecoder_->dPowerOnlyBundleRxTime, messagePayload_);
             }
 
-            if (bResyncPowerOnlyChannel)
+            if (pstDecoder_->bResyncPowerOnlyChannel)
             {
-                DecodePowerOnly_Resync(dPowerOnlyBundleRxTime, messagePayload_);
-                bResyncPowerOnlyChannel = false;
+                DecodePowerOnly_Resync(&pstDecoder_->stPowerOnly, pstDecoder_->dPowerOnlyBundleRxTime, messagePayload_);
+                pstDecoder_->bResyncPowerOnlyChannel = false;
             }
 
             // For now we will only decode the power only page if it is the only bike power page we receive
-            if (ucPowerMeterType == ANT_POWERONLY)
-                DecodePowerOnly_Message(dPowerOnlyBundleRxTime, messagePayload_);
+            if (pstDecoder_->ucPowerMeterType == ANT_POWERONLY)
+                DecodePowerOnly_Message(&pstDecoder_->stPowerOnly, pstDecoder_->dPowerOnlyBundleRxTime, messagePayload_);
             break;
 
         case ANT_WHEELTORQUE:
-            if (ucPowerMeterType != messagePayload_[0])
+            if (pstDecoder_->ucPowerMeterType != messagePayload_[0])
             {
                 // set up the power only message in addition
                 // to the crank torque data stream.
-                DecodePowerOnly_Resync(dRxTime_, messagePayload_);
-                bResyncPowerOnlyChannel = false;
+                DecodePowerOnly_Resync(&pstDecoder_->stPowerOnly, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerOnlyChannel = false;
 
-                DecodeWheelTorque_Resync(dRxTime_, messagePayload_);
-                bResyncPowerChannel = false;
+                DecodeWheelTorque_Resync(&pstDecoder_->stWheelTorque, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerChannel = false;
 
-                ucPowerMeterType = messagePayload_[0];
+                pstDecoder_->ucPowerMeterType = messagePayload_[0];
             }
 
             // This is resolved here in order to handle decoder specific
             // resync requirements when a new message is available.
-            if (bResyncPowerChannel)
+            if (pstDecoder_->bResyncPowerChannel)
             {
-                DecodeWheelTorque_Resync(dRxTime_, messagePayload_);
-                bResyncPowerChannel = false;
+                DecodeWheelTorque_Resync(&pstDecoder_->stWheelTorque, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerChannel = false;
             }
 
-            DecodeWheelTorque_Message(dRxTime_, messagePayload_);
+            DecodeWheelTorque_Message(&pstDecoder_->stWheelTorque, dRxTime_, messagePayload_);
             break;
 
         case ANT_CRANKTORQUE:
-            if (ucPowerMeterType != messagePayload_[0])
+            if (pstDecoder_->ucPowerMeterType != messagePayload_[0])
             {
                 // set up the power only message in addition
                 // to the crank torque data stream.
-                DecodePowerOnly_Resync(dRxTime_, messagePayload_);
-                bResyncPowerOnlyChannel = false;
+                DecodePowerOnly_Resync(&pstDecoder_->stPowerOnly, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerOnlyChannel = false;
 
-                DecodeCrankTorque_Resync(dRxTime_, messagePayload_);
-                bResyncPowerChannel = false;
+                DecodeCrankTorque_Resync(&pstDecoder_->stCrankTorque, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerChannel = false;
 
-                ucPowerMeterType = messagePayload_[0];
+                pstDecoder_->ucPowerMeterType = messagePayload_[0];
             }
 
             // This is resolved here in order to handle decoder specific
             // resync requirements when a new message is available.
-            if (bResyncPowerChannel)
+            if (pstDecoder_->bResyncPowerChannel)
             {
-                DecodeCrankTorque_Resync(dRxTime_, messagePayload_);
-                bResyncPowerChannel = false;
+                DecodeCrankTorque_Resync(&pstDecoder_->stCrankTorque, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerChannel = false;
             }
 
-            DecodeCrankTorque_Message(dRxTime_, messagePayload_);
+            DecodeCrankTorque_Message(&pstDecoder_->stCrankTorque, dRxTime_, messagePayload_);
             break;
         case ANT_CRANKFREQ:
-            if (ucPowerMeterType != messagePayload_[0])
+            if (pstDecoder_->ucPowerMeterType != messagePayload_[0])
             {
                 // set up the power only message in addition
                 // to the crank torque data stream.
-                DecodePowerOnly_Resync(dRxTime_, messagePayload_);
-                bResyncPowerOnlyChannel = false;
+                DecodePowerOnly_Resync(&pstDecoder_->stPowerOnly, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerOnlyChannel = false;
 
-                DecodeCrankTorqueFreq_Resync(dRxTime_, messagePayload_);
-                bResyncPowerChannel = false;
+                DecodeCrankTorqueFreq_Resync(&pstDecoder_->stCrankTorqueFreq, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerChannel = false;
 
-                ucPowerMeterType = messagePayload_[0];
+                pstDecoder_->ucPowerMeterType = messagePayload_[0];
             }
 
             // This is resolved here in order to handle decoder specific
             // resync requirements when a new message is available.
-            if (bResyncPowerChannel)
+            if (pstDecoder_->bResyncPowerChannel)
             {
-                DecodeCrankTorqueFreq_Resync(dRxTime_, messagePayload_);
-                bResyncPowerChannel = false;
+                DecodeCrankTorqueFreq_Resync(&pstDecoder_->stCrankTorqueFreq, dRxTime_, messagePayload_);
+                pstDecoder_->bResyncPowerChannel = false;
             }
 
-            DecodeCrankTorqueFreq_Message(dRxTime_, messagePayload_);
+            DecodeCrankTorqueFreq_Message(&pstDecoder_->stCrankTorqueFreq, dRxTime_, messagePayload_);
             break;
 
         case ANT_TEPS:
@@ -168,19 +422,19 @@ void DecodePowerMessage(double dRxTime_, unsigned char messagePayload_[8])
             // We still need to correct for Rx Time because we do not know which power only event count shared message comes first.
             ucNewPowerOnlyEventCount = messagePayload_[1];
 
-            if (ucNewPowerOnlyEventCount != ucPowerOnlyEventCount)
+            if (ucNewPowerOnlyEventCount != pstDecoder_->ucPowerOnlyEventCount)
             {
-                ucPowerOnlyEventCount = ucNewPowerOnlyEventCount;
-                dPowerOnlyBundleRxTime = dRxTime_;
+                pstDecoder_->ucPowerOnlyEventCount = ucNewPowerOnlyEventCount;
+                pstDecoder_->dPowerOnlyBundleRxTime = dRxTime_;
             }
             break;
 
         case ANT_CALIBRATION_MESSAGE:
-            switch (ucPowerMeterType)
+            switch (pstDecoder_->ucPowerMeterType)
             {
             case ANT_CRANKFREQ:
                 // The only one that really matters is the crank torque frequency meter.
-                DecodeCrankTorqueFreq_Calibration(dRxTime_, messagePayload_);
+                DecodeCrankTorqueFreq_Calibration(&pstDecoder_->stCrankTorqueFreq, dRxTime_, messagePayload_);
                 break;
             default:
                 break;
@@ -190,4 +444,8 @@ void DecodePowerMessage(double dRxTime_, unsigned char messagePayload_[8])
             // Other pages are ignored in this example.
             break;
     }
+
+    if (pstDecoder_->bTimed)
+        pstDecoder_->stStats.ullDecodeTime += PowerDecoder_GetCpuTimeNs() - ullStartTime;
+    POWER_PROBE3(decode_exit, pstDecoder_, messagePayload_[0], pstDecoder_->ucPowerMeterType);
 }
@@ -35,15 +35,91 @@ All rights reserved.
 #define MAXIMUM_TIME_GAP (240.0) // This is the power-down interval for several power meters...
 
 
+// Power receiver signature
+typedef void(*PowerRecordReceiver) (double dLastRecordTime_, double  dTotalRotation_, double dTotalEnergy_, float  fAverageCadence_, float fAveragePower_);
+
+// Power receiver signature for decoder instances that carry a caller supplied context (eg. one decoder per device in scan mode)
+typedef void(*PowerRecordContextReceiver) (void *pvContext_, double dLastRecordTime_, double  dTotalRotation_, double dTotalEnergy_, float  fAverageCadence_, float fAveragePower_);
+
+// A run of records that share the same average power and cadence, as filled
+// in over a message gap. Record i (from 0) is at dStartTime + i * dInterval
+// with totals of dStartRotation + i * dIncRotation and dStartEnergy + i * dIncEnergy.
+typedef struct _POWER_RECORD_RUN_t_
+{
+    double dStartTime;                  // Time of the first record (s)
+    double dInterval;                   // Time between records (s)
+    unsigned long ulCount;              // Number of records
+    double dStartRotation;              // Totals at the first record
+    double dStartEnergy;
+    double dIncRotation;                // Added to the totals by each record
+    double dIncEnergy;
+    float fAverageCadence;
+    float fAveragePower;
+
+} POWER_RECORD_RUN;
+
+// Run receiver signature. pvContext_ is the context the decoder was initialized with, if any.
+typedef void(*PowerRecordRunReceiver) (void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+// Spread of the power meter event powers within a record. An event counts
+// towards every record it overlaps, and records filled in over a dropout
+// take the stats of the events before it. Records without any events have
+// their minimum and maximum at the record's average power. Records passed
+// to a run receiver (see PowerDecoder_SetRunReceiver) come without stats.
+typedef struct _POWER_RECORD_STATS_t_
+{
+    unsigned long ulEventCount;         // Events in the record
+    float fMinPower;                    // W
+    float fMaxPower;                    // W
+    float fPowerVariance;               // W^2, of the event powers (not weighted by event length)
+
+} POWER_RECORD_STATS;
+
+// Stats receiver signature, called with the stats of each record right after the record itself.
+typedef void(*PowerRecordStatsReceiver) (void *pvContext_, double dLastRecordTime_, const POWER_RECORD_STATS *pstStats_);
+
+// A crank torque or crank torque frequency event (usually one pedal revolution)
+// as the power meter reported it, without resampling.
+typedef struct _POWER_EVENT_t_
+{
+    unsigned long long ullEventTicks;   // End of the event in power meter ticks since the data baseline was established
+    double dEventTime;                  // End of the event (s): the baseline's receive time plus ullEventTicks
+    unsigned short usPeriod;            // Length of the event in power meter ticks
+    unsigned short usTicksPerSecond;    // Power meter ticks per second (2048 crank torque, 2000 crank torque frequency)
+    float fTorque;                      // Average torque (N m)
+    float fEnergy;                      // J
+    unsigned char ucRotations;          // Crank revolutions
+
+} POWER_EVENT;
+
+// Event receiver signature. pvContext_ is the context the decoder was initialized with, if any.
+typedef void(*PowerEventReceiver) (void *pvContext_, const POWER_EVENT *pstEvent_);
+
+// Health counters of a decoder instance. They only ever count up from
+// initialization, so a monitor can alert on their rate of change.
+typedef struct _POWERDECODER_STATS_t_
+{
+    unsigned long ulPagesSeen;          // Pages passed to the decoder
+    unsigned long ulDuplicates;         // Pages repeating the last event count
+    unsigned long ulResyncs;            // Data baselines re-established (first page, dropouts, meter type changes)
+    unsigned long ulGapRecords;         // Records synthesized to fill message gaps
+    unsigned long ulInvalidDeltas;      // Deltas discarded as invalid (0xFFFF torque or period, wheel ticks > 200, accumulated power)
+    unsigned long ulCalibrationUpdates; // Calibration pages that changed the decoder calibration
+    unsigned long long ullDecodeTime;   // Thread CPU time spent decoding (ns), not counting the record receiver. Only kept while timed (see PowerDecoder_SetTiming)
+
+} POWERDECODER_STATS;
+
 typedef struct _BPSAMPLER_t_
 {
     unsigned char ucPedalBalance;
     unsigned char ucCadence;
-    unsigned long  ulEventTime;         // Quantized time of current event
+    unsigned long  ulEventTime;         // Quantized time of current event, relative to the last resample output
     unsigned long  ulLastRecordTime;    // Quantized time of last resample output
-    unsigned short usRecordInterval;    // Quantized recording interval
-    unsigned short usTimeBase;          // Quantized event interval (for time based data)
-    unsigned char ucRecordGapCount;     // Number of resample outputs in message gap
+    unsigned long  ulRecordInterval;    // Quantized recording interval
+    unsigned long  ulTimeBase;          // Quantized event interval (for time based data)
+    unsigned long  ulTimeScale;         // Quantized ticks per power meter tick, so the recording interval is a whole number of them
+    unsigned long  ulTicksPerSecond;    // Quantized ticks per second
+    unsigned long  ulRecordGapCount;    // Number of resample outputs in message gap
 
     unsigned short usTorqueOffset;      // CTF specific parameter
 
@@ -51,13 +127,18 @@ typedef struct _BPSAMPLER_t_
     float  fGapRotation;                // Amount of rotation in message gap
     float  fAccumRotation;              // Amount of rotation to carry forwards to next message event
     double dTotalRotation;              // Total crank or wheel rotation (in rotations)
+    double dRotationCompensation;       // Rounding error carried from the last addition to dTotalRotation
 
     float  fPendingEnergy;              // Amount of rotation in latest event that will count towards the pending output
     float  fGapEnergy;                  // Amount of rotation in message gap
     float  fAccumEnergy;                // Amount of rotation to carry forwards to next message event
     double dTotalEnergy;                // Total crank or wheel rotation (in rotations)
+    double dEnergyCompensation;         // Rounding error carried from the last addition to dTotalEnergy
 
     double dLastRecordTime;             // absolute time (in seconds) of last resample output
+    unsigned long long ullRecordIndex;  // Recording intervals from the grid origin to the last resample output
+    double dGridOrigin;                 // Receive time (s) of a record boundary, within a recording interval before time zero
+    unsigned char bGridAligned;         // Records start on the grid at a resync, rather than a whole interval after it
     double dLastMessageTime;            // absolute time (in seconds) of last message
 
     unsigned short usLastAccumPeriod;   // Accumulated period or timestamp in last received message
@@ -65,18 +146,131 @@ typedef struct _BPSAMPLER_t_
     unsigned char ucLastEventCount;     // Message Event count in last received message
     unsigned char ucLastRotationTicks;  // Crank or Wheel rotation count in last received messsage
 
+    double dRecordInterval;             // Recording interval (in seconds)
+    double dReSyncInterval;             // Message dropout (in seconds) after which the data baseline is re-established
+    PowerRecordReceiver prrPtr;         // Record output
+    PowerRecordContextReceiver prcrPtr; // Record output with context, used in place of prrPtr when set
+    void *pvRecordContext;              // Context passed to prcrPtr, prunPtr, prsrPtr and pevPtr
+    PowerRecordRunReceiver prunPtr;     // Gap output as a single run, in place of a record each, when set
+    PowerRecordStatsReceiver prsrPtr;   // Event power stats of each record, only accumulated when set
+
+    unsigned long ulStatsEvents;        // Events so far in the pending record
+    float fStatsMinPower;
+    float fStatsMaxPower;
+    double dStatsMeanPower;             // Running mean and sum of squared differences from it (Welford)
+    double dStatsPowerM2;
+    float fLastEventPower;              // Power of the latest event, which may run on into the next record
+
+    PowerEventReceiver pevPtr;          // Event output in place of records, when set
+    unsigned long long ullEventTicks;   // Power meter ticks since the data baseline, for event output
+    double dEventBaseTime;              // Receive time (s) of the data baseline
+
+    POWERDECODER_STATS stStats;         // Data stream counters (pages seen and decode time are kept by the POWERDECODER)
+    unsigned long long ullReceiverTime; // Thread CPU time spent in the record receiver (ns)
+    unsigned char bTimed;               // Receivers are timed (see PowerDecoder_SetTiming)
+
 } BPSAMPLER;
 
-// Power receiver signature
-typedef void(*PowerRecordReceiver) (double dLastRecordTime_, double  dTotalRotation_, double dTotalEnergy_, float  fAverageCadence_, float fAveragePower_);
+// Complete decoder state for a single power meter.
+typedef struct _POWERDECODER_t_
+{
+    BPSAMPLER stPowerOnly;              // Power only (0x10) data stream
+    BPSAMPLER stWheelTorque;            // Wheel torque (0x11) data stream
+    BPSAMPLER stCrankTorque;            // Crank torque (0x12) data stream
+    BPSAMPLER stCrankTorqueFreq;        // Crank torque frequency (0x20) data stream
+
+    unsigned char ucPowerMeterType;     // 16 = Power Only, 17 = Wheel Torque, 18 = Crank Torque, 32 = Crank Torque Frequency, 255 = Unknown
+    unsigned char ucPowerOnlyEventCount;// Event count of the current power only/TEPS message bundle
+    unsigned char bResyncPowerChannel;
+    unsigned char bResyncPowerOnlyChannel;
+    double dPowerOnlyBundleRxTime;      // Received time of the current power only/TEPS message bundle
+
+    POWERDECODER_STATS stStats;         // Pages seen and decode time
+    unsigned char bTimed;               // Decoding is timed (see PowerDecoder_SetTiming)
+
+} POWERDECODER;
+
+// Initializes a decoder instance with the record interval (s) and the power meter timebase (s) or event base (0).
+void PowerDecoder_Init(POWERDECODER *pstDecoder_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
+
+// As above, but records are delivered to a receiver along with pvContext_.
+void PowerDecoder_InitContext(POWERDECODER *pstDecoder_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_);
+
+// Sets a receiver for runs of records filling message gaps, or NULL (the default) to have them
+// delivered as individual records. Either way the records are the same.
+void PowerDecoder_SetRunReceiver(POWERDECODER *pstDecoder_, PowerRecordRunReceiver powerRecordRunReceiverPtr_);
+
+// Sets a receiver for the event power stats of each record, or NULL (the default) to skip
+// collecting them. Costs a few operations per power meter event when set.
+void PowerDecoder_SetStatsReceiver(POWERDECODER *pstDecoder_, PowerRecordStatsReceiver powerRecordStatsReceiverPtr_);
+
+// Sets a receiver for crank torque and crank torque frequency events, or NULL (the default)
+// for records. While set, those meters output each event as it is and no records at all;
+// other meter types keep making records.
+void PowerDecoder_SetEventReceiver(POWERDECODER *pstDecoder_, PowerEventReceiver powerEventReceiverPtr_);
+
+// Puts the records of a decoder on a grid shared with other decoders: boundaries at
+// dGridOrigin_ (receive time, s) plus whole recording intervals, with each record covering
+// the time up to its boundary, whenever the decoder resyncs. Decoders on the same receiver
+// clock, interval and origin then output records for the same instants (see RecordGrid.h).
+// By default records are labelled on whole intervals from time zero but cover the recording
+// interval from the resync time.
+void PowerDecoder_SetGrid(POWERDECODER *pstDecoder_, double dGridOrigin_);
+
+// Times decoding into the ullDecodeTime counter, or not (the default). Costs two reads of the
+// thread CPU clock per page and two per record, which is more than decoding a page does.
+void PowerDecoder_SetTiming(POWERDECODER *pstDecoder_, unsigned char bTimed_);
+
+// Pass Bike Power messages for a decoder instance to process
+void PowerDecoder_Message(POWERDECODER *pstDecoder_, double dRxTime_, unsigned char messagePayload_[]);
+
+// As above, with the receive time in receiver ticks (1/32768 s, see RxTimeBase.h)
+void PowerDecoder_MessageTicks(POWERDECODER *pstDecoder_, unsigned long long ullRxTicks_, unsigned char messagePayload_[]);
+
+// 16 = Power Only, 17 = Wheel Torque, 18 = Crank Torque, 32 = Crank Torque Frequency, 255 = Unknown
+void PowerDecoder_SetPowerMeterType(POWERDECODER *pstDecoder_, unsigned char ucPowerMeterType_);
+
+// Copies the health counters of a decoder instance, totalled over its data streams.
+// Counters are not locked; called from another thread they may lag by a page.
+void PowerDecoder_GetStats(const POWERDECODER *pstDecoder_, POWERDECODER_STATS *pstStats_);
+
+// CPU time (ns) of the calling thread, used to time decoding. Time the thread is preempted
+// or blocked doesn't count. On Windows it advances in scheduler ticks (about 15 ms), so it is
+// only meaningful totalled over many pages.
+unsigned long long PowerDecoder_GetCpuTimeNs(void);
+
+// Hands the records of a run to a record receiver one at a time, for run receivers with
+// nothing faster to do with a run.
+void PowerRecordRun_Deliver(const POWER_RECORD_RUN *pstRun_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_);
 
 // Initializes the power decoder library with the record interval (s) and the power meter timebase (s) or event base (0).
 void InitPowerDecoder(double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
 
+// As PowerDecoder_SetRunReceiver, for the power decoder library. May be called ahead of InitPowerDecoder.
+void SetPowerRecordRunReceiver(PowerRecordRunReceiver powerRecordRunReceiverPtr_);
+
+// As PowerDecoder_SetStatsReceiver, for the power decoder library. May be called ahead of InitPowerDecoder.
+void SetPowerRecordStatsReceiver(PowerRecordStatsReceiver powerRecordStatsReceiverPtr_);
+
+// As PowerDecoder_SetEventReceiver, for the power decoder library. May be called ahead of InitPowerDecoder.
+void SetPowerEventReceiver(PowerEventReceiver powerEventReceiverPtr_);
+
+// As PowerDecoder_SetGrid, for the power decoder library. May be called ahead of InitPowerDecoder.
+void SetPowerRecordGrid(double dGridOrigin_);
+
+// As PowerDecoder_SetTiming, for the power decoder library. May be called ahead of InitPowerDecoder.
+void SetPowerDecoderTiming(unsigned char bTimed_);
+
 // Pass Bike Power messages for the power decoder library to process
 void DecodePowerMessage(double dRxTime_, unsigned char messagePayload_[]);
 
+// As above, with the receive time in receiver ticks (1/32768 s, see RxTimeBase.h)
+void DecodePowerMessageTicks(unsigned long long ullRxTicks_, unsigned char messagePayload_[]);
+
 // 16 = Power Only, 17 = Wheel Torque, 18 = Crank Torque, 32 = Crank Torque Frequency, 255 = Unknown
 void SetPowerMeterType(unsigned char ucPowerMeterType_);
 
+// Copies the health counters of the power decoder library.
+void GetPowerDecoderStats(POWERDECODER_STATS *pstStats_);
+
 #endif
@@ -0,0 +1,37 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (POWER_PROBE_H)
+#define POWER_PROBE_H
+
+// Static tracepoints for perf, bpftrace or SystemTap. Define POWER_USDT
+// (needs <sys/sdt.h>) to compile them in; otherwise they compile to nothing.
+// Times are in microseconds of receive time.
+//
+// Provider power_decoder:
+//    decode_entry(decoder, page, rx time)
+//    decode_exit(decoder, page, power meter type)
+//    resync(stream, rx time)                   A data stream re-established its baseline
+//    gap_fill(stream, records)                 Records were synthesized to fill a message gap
+
+#if defined(POWER_USDT)
+#include <sys/sdt.h>
+
+#define POWER_PROBE2(name, a1, a2)              DTRACE_PROBE2(power_decoder, name, a1, a2)
+#define POWER_PROBE3(name, a1, a2, a3)          DTRACE_PROBE3(power_decoder, name, a1, a2, a3)
+#else
+#define POWER_PROBE2(name, a1, a2)
+#define POWER_PROBE3(name, a1, a2, a3)
+#endif
+
+// Receive time argument: seconds to integer microseconds, since the probe
+// arguments are read as integers.
+#define POWER_PROBE_TIME(dTime_)                ((long long)((dTime_) * 1000000.0))
+
+#endif
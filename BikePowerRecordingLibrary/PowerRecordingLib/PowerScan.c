@@ -0,0 +1,354 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdlib.h"
+
+#include "PowerDecoder.h"
+#include "PowerScan.h"
+#include "RxTimeBase.h"
+
+static void PowerScan_RecordReceiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+static void PowerScan_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+static void PowerScan_StatsReceiver(void *pvContext_, double dLastRecordTime_, const POWER_RECORD_STATS *pstStats_);
+static void PowerScan_EventReceiver(void *pvContext_, const POWER_EVENT *pstEvent_);
+static POWERSCAN_DEVICE* PowerScan_Route(POWERSCAN *pstScan_, POWERSCAN_EXTDATA *pstExtData_, double dRxTime_, unsigned char aucMessage_[]);
+
+///////////////////////////////////////////////////////////////////////
+// void PowerScan_Init(POWERSCAN *pstScan_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerScanRecordReceiver powerScanRecordReceiverPtr_)
+///////////////////////////////////////////////////////////////////////
+//
+// Clears the device table. Decoders are set up as devices are heard.
+//
+///////////////////////////////////////////////////////////////////////
+void PowerScan_Init(POWERSCAN *pstScan_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerScanRecordReceiver powerScanRecordReceiverPtr_)
+{
+    int i;
+
+    for (i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+        pstScan_->astDevices[i].bInUse = false;
+
+    pstScan_->usDeviceCount = 0;
+    pstScan_->ulDroppedMessages = 0;
+    pstScan_->dRecordInterval = dRecordInterval_;
+    pstScan_->dTimeBase = dTimeBase_;
+    pstScan_->dReSyncInterval = dReSyncInterval_;
+    pstScan_->ucPowerMeterType = 255;
+    pstScan_->psrrPtr = powerScanRecordReceiverPtr_;
+    pstScan_->psrunPtr = NULL;
+    pstScan_->psrsPtr = NULL;
+    pstScan_->psevPtr = NULL;
+    pstScan_->bGridAligned = false;
+    pstScan_->dGridOrigin = 0;
+    pstScan_->bTimed = false;
+
+    RxTimeBase_Init(&pstScan_->stRxTimeBase, 0);
+}
+
+void PowerScan_SetPowerMeterType(POWERSCAN *pstScan_, unsigned char ucPowerMeterType_)
+{
+    pstScan_->ucPowerMeterType = ucPowerMeterType_;
+}
+
+void PowerScan_SetRunReceiver(POWERSCAN *pstScan_, PowerScanRecordRunReceiver powerScanRecordRunReceiverPtr_)
+{
+    int i;
+
+    pstScan_->psrunPtr = powerScanRecordRunReceiverPtr_;
+
+    for (i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+    {
+        if (pstScan_->astDevices[i].bInUse)
+            PowerDecoder_SetRunReceiver(&pstScan_->astDevices[i].stDecoder, (powerScanRecordRunReceiverPtr_ != NULL) ? PowerScan_RunReceiver : NULL);
+    }
+}
+
+void PowerScan_SetStatsReceiver(POWERSCAN *pstScan_, PowerScanRecordStatsReceiver powerScanRecordStatsReceiverPtr_)
+{
+    int i;
+
+    pstScan_->psrsPtr = powerScanRecordStatsReceiverPtr_;
+
+    for (i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+    {
+        if (pstScan_->astDevices[i].bInUse)
+            PowerDecoder_SetStatsReceiver(&pstScan_->astDevices[i].stDecoder, (powerScanRecordStatsReceiverPtr_ != NULL) ? PowerScan_StatsReceiver : NULL);
+    }
+}
+
+void PowerScan_SetEventReceiver(POWERSCAN *pstScan_, PowerScanEventReceiver powerScanEventReceiverPtr_)
+{
+    int i;
+
+    pstScan_->psevPtr = powerScanEventReceiverPtr_;
+
+    for (i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+    {
+        if (pstScan_->astDevices[i].bInUse)
+            PowerDecoder_SetEventReceiver(&pstScan_->astDevices[i].stDecoder, (powerScanEventReceiverPtr_ != NULL) ? PowerScan_EventReceiver : NULL);
+    }
+}
+
+void PowerScan_SetGrid(POWERSCAN *pstScan_, double dGridOrigin_)
+{
+    int i;
+
+    pstScan_->bGridAligned = true;
+    pstScan_->dGridOrigin = dGridOrigin_;
+
+    for (i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+    {
+        if (pstScan_->astDevices[i].bInUse)
+            PowerDecoder_SetGrid(&pstScan_->astDevices[i].stDecoder, dGridOrigin_);
+    }
+}
+
+void PowerScan_SetTiming(POWERSCAN *pstScan_, unsigned char bTimed_)
+{
+    int i;
+
+    pstScan_->bTimed = bTimed_;
+
+    for (i = 0; i < POWER_SCAN_TABLE_SIZE; i++)
+    {
+        if (pstScan_->astDevices[i].bInUse)
+            PowerDecoder_SetTiming(&pstScan_->astDevices[i].stDecoder, bTimed_);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// bool PowerScan_ParseExtData(unsigned char aucMessage_[], unsigned char ucSize_, POWERSCAN_EXTDATA *pstExtData_)
+///////////////////////////////////////////////////////////////////////
+//
+// The optional fields follow the flag byte in bit order (device id,
+// RSSI, timestamp). Flags for fields that were truncated are cleared.
+//
+///////////////////////////////////////////////////////////////////////
+bool PowerScan_ParseExtData(unsigned char aucMessage_[], unsigned char ucSize_, POWERSCAN_EXTDATA *pstExtData_)
+{
+    unsigned char ucIndex = POWER_SCAN_FLAG_OFFSET + 1;
+
+    memset(pstExtData_, 0, sizeof(POWERSCAN_EXTDATA));
+
+    if (ucSize_ <= POWER_SCAN_FLAG_OFFSET)
+        return false;
+
+    pstExtData_->ucFlags = aucMessage_[POWER_SCAN_FLAG_OFFSET];
+
+    if (pstExtData_->ucFlags & POWER_SCAN_FLAG_DEVICE_ID)
+    {
+        if (ucIndex + POWER_SCAN_DEVICE_ID_SIZE <= ucSize_)
+        {
+            pstExtData_->usDeviceNumber = aucMessage_[ucIndex];
+            pstExtData_->usDeviceNumber += ((unsigned short)aucMessage_[ucIndex + 1]) << 8;
+            pstExtData_->ucDeviceType = aucMessage_[ucIndex + 2];
+            pstExtData_->ucTransmissionType = aucMessage_[ucIndex + 3];
+        }
+        else
+        {
+            pstExtData_->ucFlags &= ~POWER_SCAN_FLAG_DEVICE_ID;
+        }
+        ucIndex += POWER_SCAN_DEVICE_ID_SIZE;
+    }
+
+    if (pstExtData_->ucFlags & POWER_SCAN_FLAG_RSSI)
+    {
+        if (ucIndex + POWER_SCAN_RSSI_SIZE <= ucSize_)
+            pstExtData_->scRSSI = (signed char)aucMessage_[ucIndex + 1];
+        else
+            pstExtData_->ucFlags &= ~POWER_SCAN_FLAG_RSSI;
+        ucIndex += POWER_SCAN_RSSI_SIZE;
+    }
+
+    if (pstExtData_->ucFlags & POWER_SCAN_FLAG_RX_TIMESTAMP)
+    {
+        if (ucIndex + POWER_SCAN_RX_TIMESTAMP_SIZE <= ucSize_)
+        {
+            pstExtData_->usRxTimeStamp = aucMessage_[ucIndex];
+            pstExtData_->usRxTimeStamp += ((unsigned short)aucMessage_[ucIndex + 1]) << 8;
+        }
+        else
+        {
+            pstExtData_->ucFlags &= ~POWER_SCAN_FLAG_RX_TIMESTAMP;
+        }
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static POWERSCAN_DEVICE* PowerScan_Lookup(POWERSCAN *pstScan_, unsigned long ulDeviceId_, bool bInsert_)
+///////////////////////////////////////////////////////////////////////
+//
+// Open addressing with linear probing. The home slot comes from a
+// multiplicative hash so that consecutive device numbers spread out.
+// Devices are never removed, so an empty slot ends the probe.
+//
+///////////////////////////////////////////////////////////////////////
+static POWERSCAN_DEVICE* PowerScan_Lookup(POWERSCAN *pstScan_, unsigned long ulDeviceId_, bool bInsert_)
+{
+    unsigned long ulSlot = ((ulDeviceId_ * 2654435769UL) & 0xFFFFFFFFUL) >> (32 - POWER_SCAN_TABLE_BITS);
+    POWERSCAN_DEVICE *pstDevice;
+
+    for (;;)
+    {
+        pstDevice = &pstScan_->astDevices[ulSlot];
+
+        if (!pstDevice->bInUse)
+            break;
+
+        if (pstDevice->ulDeviceId == ulDeviceId_)
+            return pstDevice;
+
+        ulSlot = (ulSlot + 1) & (POWER_SCAN_TABLE_SIZE - 1);
+    }
+
+    if (!bInsert_ || pstScan_->usDeviceCount >= POWER_SCAN_MAX_DEVICES)
+        return NULL;
+
+    // First message from this device; give it a decoder of its own.
+    pstDevice->bInUse = true;
+    pstDevice->ulDeviceId = ulDeviceId_;
+    pstDevice->usDeviceNumber = (unsigned short)(ulDeviceId_ & 0xFFFF);
+    pstDevice->ucDeviceType = (unsigned char)((ulDeviceId_ >> 16) & 0xFF);
+    pstDevice->ucTransmissionType = (unsigned char)((ulDeviceId_ >> 24) & 0xFF);
+    pstDevice->scLastRSSI = 0;
+    pstDevice->ulMessageCount = 0;
+    pstDevice->dLastRxTime = 0;
+    pstDevice->pstScan = pstScan_;
+
+    PowerDecoder_InitContext(&pstDevice->stDecoder, pstScan_->dRecordInterval, pstScan_->dTimeBase, pstScan_->dReSyncInterval, PowerScan_RecordReceiver, pstDevice);
+    PowerDecoder_SetPowerMeterType(&pstDevice->stDecoder, pstScan_->ucPowerMeterType);
+    if (pstScan_->psrunPtr != NULL)
+        PowerDecoder_SetRunReceiver(&pstDevice->stDecoder, PowerScan_RunReceiver);
+    if (pstScan_->psrsPtr != NULL)
+        PowerDecoder_SetStatsReceiver(&pstDevice->stDecoder, PowerScan_StatsReceiver);
+    if (pstScan_->psevPtr != NULL)
+        PowerDecoder_SetEventReceiver(&pstDevice->stDecoder, PowerScan_EventReceiver);
+    if (pstScan_->bGridAligned)
+        PowerDecoder_SetGrid(&pstDevice->stDecoder, pstScan_->dGridOrigin);
+    PowerDecoder_SetTiming(&pstDevice->stDecoder, pstScan_->bTimed);
+
+    pstScan_->usDeviceCount++;
+    return pstDevice;
+}
+
+POWERSCAN_DEVICE* PowerScan_FindDevice(POWERSCAN *pstScan_, unsigned short usDeviceNumber_, unsigned char ucDeviceType_, unsigned char ucTransmissionType_)
+{
+    return PowerScan_Lookup(pstScan_, PowerScan_DeviceId(usDeviceNumber_, ucDeviceType_, ucTransmissionType_), false);
+}
+
+///////////////////////////////////////////////////////////////////////
+// POWERSCAN_DEVICE* PowerScan_Message(POWERSCAN *pstScan_, double dRxTime_, unsigned char aucMessage_[], unsigned char ucSize_)
+///////////////////////////////////////////////////////////////////////
+//
+// Routes a flagged data message to the decoder of the device that
+// sent it. Messages must carry the device id to be routed.
+//
+///////////////////////////////////////////////////////////////////////
+POWERSCAN_DEVICE* PowerScan_Message(POWERSCAN *pstScan_, double dRxTime_, unsigned char aucMessage_[], unsigned char ucSize_)
+{
+    POWERSCAN_EXTDATA stExtData;
+
+    if (!PowerScan_ParseExtData(aucMessage_, ucSize_, &stExtData))
+    {
+        pstScan_->ulDroppedMessages++;
+        return NULL;
+    }
+
+    return PowerScan_Route(pstScan_, &stExtData, dRxTime_, aucMessage_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// POWERSCAN_DEVICE* PowerScan_RxMessage(POWERSCAN *pstScan_, unsigned long ulHostTime_, unsigned char aucMessage_[], unsigned char ucSize_)
+///////////////////////////////////////////////////////////////////////
+//
+// All devices are timed by the one receiver clock, so their records
+// share a common time base.
+//
+///////////////////////////////////////////////////////////////////////
+POWERSCAN_DEVICE* PowerScan_RxMessage(POWERSCAN *pstScan_, unsigned long ulHostTime_, unsigned char aucMessage_[], unsigned char ucSize_)
+{
+    POWERSCAN_EXTDATA stExtData;
+    unsigned long long ullRxTicks;
+
+    if (!PowerScan_ParseExtData(aucMessage_, ucSize_, &stExtData))
+    {
+        pstScan_->ulDroppedMessages++;
+        return NULL;
+    }
+
+    if (stExtData.ucFlags & POWER_SCAN_FLAG_RX_TIMESTAMP)
+        ullRxTicks = RxTimeBase_Update(&pstScan_->stRxTimeBase, stExtData.usRxTimeStamp, ulHostTime_);
+    else
+        ullRxTicks = RxTimeBase_UpdateHost(&pstScan_->stRxTimeBase, ulHostTime_);
+
+    return PowerScan_Route(pstScan_, &stExtData, RxTimeBase_Seconds(ullRxTicks), aucMessage_);
+}
+
+static POWERSCAN_DEVICE* PowerScan_Route(POWERSCAN *pstScan_, POWERSCAN_EXTDATA *pstExtData_, double dRxTime_, unsigned char aucMessage_[])
+{
+    POWERSCAN_DEVICE *pstDevice;
+
+    if (!(pstExtData_->ucFlags & POWER_SCAN_FLAG_DEVICE_ID))
+    {
+        pstScan_->ulDroppedMessages++;
+        return NULL;
+    }
+
+    pstDevice = PowerScan_Lookup(pstScan_, PowerScan_DeviceId(pstExtData_->usDeviceNumber, pstExtData_->ucDeviceType, pstExtData_->ucTransmissionType), true);
+    if (pstDevice == NULL)
+    {
+        pstScan_->ulDroppedMessages++;
+        return NULL;
+    }
+
+    if (pstExtData_->ucFlags & POWER_SCAN_FLAG_RSSI)
+        pstDevice->scLastRSSI = pstExtData_->scRSSI;
+
+    pstDevice->ulMessageCount++;
+    pstDevice->dLastRxTime = dRxTime_;
+
+    PowerDecoder_Message(&pstDevice->stDecoder, dRxTime_, &aucMessage_[POWER_SCAN_PAYLOAD_OFFSET]);
+
+    return pstDevice;
+}
+
+static void PowerScan_RecordReceiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    POWERSCAN_DEVICE *pstDevice = (POWERSCAN_DEVICE*)pvContext_;
+
+    if (pstDevice->pstScan->psrrPtr != NULL)
+        (*pstDevice->pstScan->psrrPtr)(pstDevice, dLastRecordTime_, dTotalRotation_, dTotalEnergy_, fAverageCadence_, fAveragePower_);
+}
+
+static void PowerScan_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    POWERSCAN_DEVICE *pstDevice = (POWERSCAN_DEVICE*)pvContext_;
+
+    if (pstDevice->pstScan->psrunPtr != NULL)
+        (*pstDevice->pstScan->psrunPtr)(pstDevice, pstRun_);
+}
+
+static void PowerScan_StatsReceiver(void *pvContext_, double dLastRecordTime_, const POWER_RECORD_STATS *pstStats_)
+{
+    POWERSCAN_DEVICE *pstDevice = (POWERSCAN_DEVICE*)pvContext_;
+
+    if (pstDevice->pstScan->psrsPtr != NULL)
+        (*pstDevice->pstScan->psrsPtr)(pstDevice, dLastRecordTime_, pstStats_);
+}
+
+static void PowerScan_EventReceiver(void *pvContext_, const POWER_EVENT *pstEvent_)
+{
+    POWERSCAN_DEVICE *pstDevice = (POWERSCAN_DEVICE*)pvContext_;
+
+    if (pstDevice->pstScan->psevPtr != NULL)
+        (*pstDevice->pstScan->psevPtr)(pstDevice, pstEvent_);
+}
@@ -0,0 +1,143 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (POWER_SCAN_H)
+#define POWER_SCAN_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+#include "RxTimeBase.h"
+
+// In continuous scan mode a single receiver hears every power meter in range.
+// Messages arrive as flagged extended data:
+//    [channel][8 byte payload][flag byte][device id][rssi][rx timestamp]
+// where each optional field is present only if its flag bit is set.
+#define POWER_SCAN_PAYLOAD_OFFSET       (1)
+#define POWER_SCAN_FLAG_OFFSET          (9)
+
+#define POWER_SCAN_FLAG_DEVICE_ID       (0x80)  // 4 bytes: device number LSB, MSB, device type, transmission type
+#define POWER_SCAN_FLAG_RSSI            (0x40)  // 3 bytes: measurement type, RSSI value (dBm), threshold
+#define POWER_SCAN_FLAG_RX_TIMESTAMP    (0x20)  // 2 bytes: 32768 Hz rx timestamp LSB, MSB
+
+#define POWER_SCAN_DEVICE_ID_SIZE       (4)
+#define POWER_SCAN_RSSI_SIZE            (3)
+#define POWER_SCAN_RX_TIMESTAMP_SIZE    (2)
+
+// Decoder table size (a power of two). The table is never filled
+// past POWER_SCAN_MAX_DEVICES so probe sequences stay short.
+#define POWER_SCAN_TABLE_BITS           (9)
+#define POWER_SCAN_TABLE_SIZE           (1 << POWER_SCAN_TABLE_BITS)
+#define POWER_SCAN_MAX_DEVICES          (POWER_SCAN_TABLE_SIZE * 3 / 4)
+
+// Decoded extended data of a single message.
+typedef struct _POWERSCAN_EXTDATA_t_
+{
+    unsigned char ucFlags;              // Flag byte as received
+    unsigned short usDeviceNumber;
+    unsigned char ucDeviceType;
+    unsigned char ucTransmissionType;
+    signed char scRSSI;                 // dBm, valid if POWER_SCAN_FLAG_RSSI is set
+    unsigned short usRxTimeStamp;       // 1/32768 s, valid if POWER_SCAN_FLAG_RX_TIMESTAMP is set
+
+} POWERSCAN_EXTDATA;
+
+struct _POWERSCAN_t_;
+
+// One entry per power meter heard.
+typedef struct _POWERSCAN_DEVICE_t_
+{
+    unsigned long ulDeviceId;           // Device number, device type and transmission type (see PowerScan_DeviceId)
+    unsigned char bInUse;
+    unsigned short usDeviceNumber;
+    unsigned char ucDeviceType;
+    unsigned char ucTransmissionType;
+    signed char scLastRSSI;
+    unsigned long ulMessageCount;
+    double dLastRxTime;
+    struct _POWERSCAN_t_ *pstScan;
+    POWERDECODER stDecoder;
+
+} POWERSCAN_DEVICE;
+
+// Scan record receiver signature
+typedef void(*PowerScanRecordReceiver) (POWERSCAN_DEVICE *pstDevice_, double dLastRecordTime_, double  dTotalRotation_, double dTotalEnergy_, float  fAverageCadence_, float fAveragePower_);
+
+// Scan run receiver signature (see POWER_RECORD_RUN)
+typedef void(*PowerScanRecordRunReceiver) (POWERSCAN_DEVICE *pstDevice_, const POWER_RECORD_RUN *pstRun_);
+
+// Scan stats receiver signature (see POWER_RECORD_STATS)
+typedef void(*PowerScanRecordStatsReceiver) (POWERSCAN_DEVICE *pstDevice_, double dLastRecordTime_, const POWER_RECORD_STATS *pstStats_);
+
+// Scan event receiver signature (see POWER_EVENT)
+typedef void(*PowerScanEventReceiver) (POWERSCAN_DEVICE *pstDevice_, const POWER_EVENT *pstEvent_);
+
+typedef struct _POWERSCAN_t_
+{
+    POWERSCAN_DEVICE astDevices[POWER_SCAN_TABLE_SIZE];
+    unsigned short usDeviceCount;
+    unsigned long ulDroppedMessages;    // Messages without a device id or from devices that didn't fit in the table
+
+    double dRecordInterval;
+    double dTimeBase;
+    double dReSyncInterval;
+    unsigned char ucPowerMeterType;     // Initial power meter type of new devices (255 = Unknown)
+    PowerScanRecordReceiver psrrPtr;
+    PowerScanRecordRunReceiver psrunPtr;// Gap runs, or NULL to have them delivered to psrrPtr a record at a time
+    PowerScanRecordStatsReceiver psrsPtr;   // Event power stats of each record, or NULL to skip them
+    PowerScanEventReceiver psevPtr;     // Crank torque events in place of records, or NULL for records
+    unsigned char bGridAligned;         // Devices put their records on the grid at dGridOrigin (see PowerDecoder_SetGrid)
+    unsigned char bTimed;               // Device decoders are timed (see PowerDecoder_SetTiming)
+    double dGridOrigin;
+
+    RXTIMEBASE stRxTimeBase;            // Receiver clock, shared by all devices
+
+} POWERSCAN;
+
+// Initializes the scan router. Every device heard gets its own decoder using these parameters.
+void PowerScan_Init(POWERSCAN *pstScan_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerScanRecordReceiver powerScanRecordReceiverPtr_);
+
+// Initial power meter type of devices heard after this call. 255 (Unknown) by default.
+void PowerScan_SetPowerMeterType(POWERSCAN *pstScan_, unsigned char ucPowerMeterType_);
+
+// Sets a receiver for runs of records filling message gaps, for every device. NULL by default.
+void PowerScan_SetRunReceiver(POWERSCAN *pstScan_, PowerScanRecordRunReceiver powerScanRecordRunReceiverPtr_);
+
+// Sets a receiver for the event power stats of each record, for every device. NULL by default.
+void PowerScan_SetStatsReceiver(POWERSCAN *pstScan_, PowerScanRecordStatsReceiver powerScanRecordStatsReceiverPtr_);
+
+// Sets a receiver for crank torque and crank torque frequency events, for every device (see PowerDecoder_SetEventReceiver). NULL by default.
+void PowerScan_SetEventReceiver(POWERSCAN *pstScan_, PowerScanEventReceiver powerScanEventReceiverPtr_);
+
+// Puts the records of every device on one grid (see PowerDecoder_SetGrid), so all riders have records
+// for the same instants. Devices already heard line up from their next resync.
+void PowerScan_SetGrid(POWERSCAN *pstScan_, double dGridOrigin_);
+
+// Times the decoder of every device (see PowerDecoder_SetTiming). Off by default.
+void PowerScan_SetTiming(POWERSCAN *pstScan_, unsigned char bTimed_);
+
+// Splits the extended data following the flag byte. Returns false if the message carries no flag byte.
+bool PowerScan_ParseExtData(unsigned char aucMessage_[], unsigned char ucSize_, POWERSCAN_EXTDATA *pstExtData_);
+
+// Pass a flagged broadcast message (channel byte onwards) to the decoder of the device that sent it.
+// Returns the device the message was routed to, or NULL if it was dropped.
+POWERSCAN_DEVICE* PowerScan_Message(POWERSCAN *pstScan_, double dRxTime_, unsigned char aucMessage_[], unsigned char ucSize_);
+
+// As PowerScan_Message, timed by the receiver timestamp when the message carries one.
+// ulHostTime_ is any millisecond clock (eg. DSIThread_GetSystemTime), used to count timestamp rollovers.
+POWERSCAN_DEVICE* PowerScan_RxMessage(POWERSCAN *pstScan_, unsigned long ulHostTime_, unsigned char aucMessage_[], unsigned char ucSize_);
+
+// Looks up a device by its channel id. Returns NULL if the device hasn't been heard.
+POWERSCAN_DEVICE* PowerScan_FindDevice(POWERSCAN *pstScan_, unsigned short usDeviceNumber_, unsigned char ucDeviceType_, unsigned char ucTransmissionType_);
+
+// Hash key of a channel id.
+#define PowerScan_DeviceId(usDeviceNumber_, ucDeviceType_, ucTransmissionType_) \
+    ((unsigned long)(usDeviceNumber_) | ((unsigned long)(ucDeviceType_) << 16) | ((unsigned long)(ucTransmissionType_) << 24))
+
+#endif
@@ -0,0 +1,409 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "math.h"
+
+#include "QuantileSketch.h"
+
+#define QUANTILE_SKETCH_LEVEL_RATIO     (2.0 / 3.0)     // Capacity of a level relative to the one above
+#define QUANTILE_SKETCH_MIN_CAPACITY    (2)
+#define QUANTILE_SKETCH_SEED            (0x2545F491UL)
+
+// Serialized layout: this header, a uint16_t value count for each level, then
+// the values of each level in turn. Native byte order, like the record index files.
+typedef struct _QUANTILE_SKETCH_HEADER_t_
+{
+    uint32_t ulFileId;
+    uint32_t ulVersion;
+    uint32_t ulK;
+    uint32_t ulLevels;
+    uint64_t ullCount;
+    float fMin;
+    float fMax;
+
+} QUANTILE_SKETCH_HEADER;
+
+static void QuantileSketch_SetLevels(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevels_);
+static void QuantileSketch_Insert(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevel_, float fValue_);
+static void QuantileSketch_Compact(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevel_);
+static int QuantileSketch_CompareValues(const void *pvA_, const void *pvB_);
+
+void QuantileSketch_Init(QUANTILE_SKETCH *pstSketch_)
+{
+    pstSketch_->ullCount = 0;
+    pstSketch_->fMin = 0;
+    pstSketch_->fMax = 0;
+    pstSketch_->ulRandom = QUANTILE_SKETCH_SEED;
+    memset(pstSketch_->ausCount, 0, sizeof(pstSketch_->ausCount));
+    QuantileSketch_SetLevels(pstSketch_, 1);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void QuantileSketch_SetLevels(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevels_)
+///////////////////////////////////////////////////////////////////////
+//
+// Sets the levels in use and their capacities. The top level holds K
+// values and each level below 2/3 as many as the one above, so adding a
+// level shrinks the ones below it; they compact when next added to.
+//
+///////////////////////////////////////////////////////////////////////
+static void QuantileSketch_SetLevels(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevels_)
+{
+    double dCapacity = QUANTILE_SKETCH_K;
+    int i;
+
+    pstSketch_->ucLevels = ucLevels_;
+    for (i = ucLevels_ - 1; i >= 0; i--)
+    {
+        pstSketch_->ausCapacity[i] = (dCapacity > QUANTILE_SKETCH_MIN_CAPACITY) ? (unsigned short)dCapacity : QUANTILE_SKETCH_MIN_CAPACITY;
+        dCapacity *= QUANTILE_SKETCH_LEVEL_RATIO;
+    }
+}
+
+static int QuantileSketch_CompareValues(const void *pvA_, const void *pvB_)
+{
+    float fA = *(const float*)pvA_;
+    float fB = *(const float*)pvB_;
+
+    return (fA > fB) - (fA < fB);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void QuantileSketch_Compact(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevel_)
+///////////////////////////////////////////////////////////////////////
+//
+// Sorts a level and moves every other value, starting from the first or
+// second at random, to the level above where it counts twice. With an odd
+// count the smallest value stays behind. The top level can't grow past
+// QUANTILE_SKETCH_LEVELS, so it compacts into itself; the values it drops
+// only shift the ranks by the weight of the values kept, and it takes
+// over 10^11 values to get there.
+//
+///////////////////////////////////////////////////////////////////////
+static void QuantileSketch_Compact(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevel_)
+{
+    float *pfValues = pstSketch_->aafValues[ucLevel_];
+    unsigned short usCount = pstSketch_->ausCount[ucLevel_];
+    unsigned short usKept = usCount & 1;
+    unsigned char ucTarget = ucLevel_ + 1;
+    unsigned short usTargetCount;
+    unsigned short i;
+
+    if (ucTarget == pstSketch_->ucLevels)
+    {
+        if (pstSketch_->ucLevels < QUANTILE_SKETCH_LEVELS)
+            QuantileSketch_SetLevels(pstSketch_, pstSketch_->ucLevels + 1);
+        else
+            ucTarget = ucLevel_;
+    }
+
+    qsort(pfValues, usCount, sizeof(float), QuantileSketch_CompareValues);
+
+    // xorshift32
+    pstSketch_->ulRandom ^= (pstSketch_->ulRandom << 13) & 0xFFFFFFFFUL;
+    pstSketch_->ulRandom ^= pstSketch_->ulRandom >> 17;
+    pstSketch_->ulRandom ^= (pstSketch_->ulRandom << 5) & 0xFFFFFFFFUL;
+
+    if (ucTarget == ucLevel_)
+    {
+        usTargetCount = usKept;
+        for (i = usKept + (unsigned short)(pstSketch_->ulRandom & 1); i < usCount; i += 2)
+            pfValues[usTargetCount++] = pfValues[i];
+        pstSketch_->ausCount[ucLevel_] = usTargetCount;
+        return;
+    }
+
+    usTargetCount = pstSketch_->ausCount[ucTarget];
+    for (i = usKept + (unsigned short)(pstSketch_->ulRandom & 1); i < usCount; i += 2)
+        pstSketch_->aafValues[ucTarget][usTargetCount++] = pfValues[i];
+
+    pstSketch_->ausCount[ucTarget] = usTargetCount;
+    pstSketch_->ausCount[ucLevel_] = usKept;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void QuantileSketch_Insert(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevel_, float fValue_)
+///////////////////////////////////////////////////////////////////////
+//
+// Adds a value standing for 2^ucLevel_ of the stream, then compacts full
+// levels from there up. Between calls every level holds under K values,
+// and a compaction moves up at most half of a level holding under 2K, so
+// no level reaches 2K.
+//
+///////////////////////////////////////////////////////////////////////
+static void QuantileSketch_Insert(QUANTILE_SKETCH *pstSketch_, unsigned char ucLevel_, float fValue_)
+{
+    if (ucLevel_ >= pstSketch_->ucLevels)
+        QuantileSketch_SetLevels(pstSketch_, ucLevel_ + 1);
+
+    pstSketch_->aafValues[ucLevel_][pstSketch_->ausCount[ucLevel_]++] = fValue_;
+
+    while ((ucLevel_ < pstSketch_->ucLevels) && (pstSketch_->ausCount[ucLevel_] >= pstSketch_->ausCapacity[ucLevel_]))
+    {
+        QuantileSketch_Compact(pstSketch_, ucLevel_);
+        ucLevel_++;
+    }
+}
+
+void QuantileSketch_Add(QUANTILE_SKETCH *pstSketch_, float fValue_)
+{
+    QuantileSketch_AddCount(pstSketch_, fValue_, 1);
+}
+
+void QuantileSketch_AddCount(QUANTILE_SKETCH *pstSketch_, float fValue_, unsigned long long ullCount_)
+{
+    unsigned long long ullTop;
+    unsigned char ucLevel;
+
+    if (ullCount_ == 0)
+        return;
+
+    if ((pstSketch_->ullCount == 0) || (fValue_ < pstSketch_->fMin))
+        pstSketch_->fMin = fValue_;
+    if ((pstSketch_->ullCount == 0) || (fValue_ > pstSketch_->fMax))
+        pstSketch_->fMax = fValue_;
+    pstSketch_->ullCount += ullCount_;
+
+    // One value per set bit of the count, at the level of that bit.
+    for (ucLevel = 0; (ucLevel < QUANTILE_SKETCH_LEVELS - 1) && (ullCount_ != 0); ucLevel++)
+    {
+        if (ullCount_ & 1)
+            QuantileSketch_Insert(pstSketch_, ucLevel, fValue_);
+        ullCount_ >>= 1;
+    }
+
+    for (ullTop = 0; ullTop < ullCount_; ullTop++)
+        QuantileSketch_Insert(pstSketch_, QUANTILE_SKETCH_LEVELS - 1, fValue_);
+}
+
+void QuantileSketch_Merge(QUANTILE_SKETCH *pstSketch_, const QUANTILE_SKETCH *pstOther_)
+{
+    unsigned char ucLevel;
+    unsigned short i;
+
+    if (pstOther_->ullCount == 0)
+        return;
+
+    if ((pstSketch_->ullCount == 0) || (pstOther_->fMin < pstSketch_->fMin))
+        pstSketch_->fMin = pstOther_->fMin;
+    if ((pstSketch_->ullCount == 0) || (pstOther_->fMax > pstSketch_->fMax))
+        pstSketch_->fMax = pstOther_->fMax;
+    pstSketch_->ullCount += pstOther_->ullCount;
+
+    for (ucLevel = 0; ucLevel < pstOther_->ucLevels; ucLevel++)
+    {
+        for (i = 0; i < pstOther_->ausCount[ucLevel]; i++)
+            QuantileSketch_Insert(pstSketch_, ucLevel, pstOther_->aafValues[ucLevel][i]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// float QuantileSketch_Quantile(QUANTILE_SKETCH *pstSketch_, double dQuantile_)
+///////////////////////////////////////////////////////////////////////
+//
+// Sorts each level and walks them together in value order, adding up the
+// weights until they reach the quantile's share of the total weight.
+//
+///////////////////////////////////////////////////////////////////////
+float QuantileSketch_Quantile(QUANTILE_SKETCH *pstSketch_, double dQuantile_)
+{
+    unsigned short ausNext[QUANTILE_SKETCH_LEVELS];
+    double dTotalWeight = 0;
+    double dTarget;
+    double dWeight = 0;
+    float fValue = pstSketch_->fMax;
+    int iLowest;
+    int i;
+
+    if (pstSketch_->ullCount == 0)
+        return 0;
+    if (dQuantile_ <= 0)
+        return pstSketch_->fMin;
+    if (dQuantile_ >= 1)
+        return pstSketch_->fMax;
+
+    for (i = 0; i < pstSketch_->ucLevels; i++)
+    {
+        qsort(pstSketch_->aafValues[i], pstSketch_->ausCount[i], sizeof(float), QuantileSketch_CompareValues);
+        dTotalWeight += ldexp((double)pstSketch_->ausCount[i], i);
+        ausNext[i] = 0;
+    }
+
+    dTarget = dQuantile_ * dTotalWeight;
+
+    while (dWeight < dTarget)
+    {
+        iLowest = -1;
+        for (i = 0; i < pstSketch_->ucLevels; i++)
+        {
+            if ((ausNext[i] < pstSketch_->ausCount[i])
+                && ((iLowest < 0) || (pstSketch_->aafValues[i][ausNext[i]] < pstSketch_->aafValues[iLowest][ausNext[iLowest]])))
+                iLowest = i;
+        }
+
+        if (iLowest < 0)
+            break;
+
+        fValue = pstSketch_->aafValues[iLowest][ausNext[iLowest]++];
+        dWeight += ldexp(1.0, iLowest);
+    }
+
+    return fValue;
+}
+
+double QuantileSketch_Rank(const QUANTILE_SKETCH *pstSketch_, float fValue_)
+{
+    double dTotalWeight = 0;
+    double dWeight = 0;
+    unsigned short i;
+    int iLevel;
+
+    for (iLevel = 0; iLevel < pstSketch_->ucLevels; iLevel++)
+    {
+        dTotalWeight += ldexp((double)pstSketch_->ausCount[iLevel], iLevel);
+        for (i = 0; i < pstSketch_->ausCount[iLevel]; i++)
+        {
+            if (pstSketch_->aafValues[iLevel][i] <= fValue_)
+                dWeight += ldexp(1.0, iLevel);
+        }
+    }
+
+    if (dTotalWeight == 0)
+        return 0;
+    return dWeight / dTotalWeight;
+}
+
+unsigned long QuantileSketch_GetSize(const QUANTILE_SKETCH *pstSketch_)
+{
+    unsigned long ulSize = sizeof(QUANTILE_SKETCH_HEADER) + pstSketch_->ucLevels * sizeof(uint16_t);
+    int i;
+
+    for (i = 0; i < pstSketch_->ucLevels; i++)
+        ulSize += pstSketch_->ausCount[i] * sizeof(float);
+
+    return ulSize;
+}
+
+unsigned long QuantileSketch_Serialize(const QUANTILE_SKETCH *pstSketch_, unsigned char *pucBuffer_, unsigned long ulSize_)
+{
+    QUANTILE_SKETCH_HEADER stHeader;
+    unsigned long ulOffset = sizeof(QUANTILE_SKETCH_HEADER);
+    uint16_t usCount;
+    int i;
+
+    if (ulSize_ < QuantileSketch_GetSize(pstSketch_))
+        return 0;
+
+    stHeader.ulFileId = QUANTILE_SKETCH_FILE_ID;
+    stHeader.ulVersion = QUANTILE_SKETCH_FILE_VERSION;
+    stHeader.ulK = QUANTILE_SKETCH_K;
+    stHeader.ulLevels = pstSketch_->ucLevels;
+    stHeader.ullCount = pstSketch_->ullCount;
+    stHeader.fMin = pstSketch_->fMin;
+    stHeader.fMax = pstSketch_->fMax;
+    memcpy(pucBuffer_, &stHeader, sizeof(stHeader));
+
+    for (i = 0; i < pstSketch_->ucLevels; i++)
+    {
+        usCount = pstSketch_->ausCount[i];
+        memcpy(pucBuffer_ + ulOffset, &usCount, sizeof(usCount));
+        ulOffset += sizeof(usCount);
+    }
+
+    for (i = 0; i < pstSketch_->ucLevels; i++)
+    {
+        memcpy(pucBuffer_ + ulOffset, pstSketch_->aafValues[i], pstSketch_->ausCount[i] * sizeof(float));
+        ulOffset += pstSketch_->ausCount[i] * sizeof(float);
+    }
+
+    return ulOffset;
+}
+
+bool QuantileSketch_Deserialize(QUANTILE_SKETCH *pstSketch_, const unsigned char *pucBuffer_, unsigned long ulSize_)
+{
+    QUANTILE_SKETCH_HEADER stHeader;
+    unsigned long ulOffset = sizeof(QUANTILE_SKETCH_HEADER);
+    unsigned long ulValuesSize = 0;
+    uint16_t usCount;
+    unsigned long i;
+
+    if (ulSize_ < sizeof(stHeader))
+        return false;
+
+    memcpy(&stHeader, pucBuffer_, sizeof(stHeader));
+    if ((stHeader.ulFileId != QUANTILE_SKETCH_FILE_ID)
+        || (stHeader.ulVersion != QUANTILE_SKETCH_FILE_VERSION)
+        || (stHeader.ulK != QUANTILE_SKETCH_K)
+        || (stHeader.ulLevels == 0)
+        || (stHeader.ulLevels > QUANTILE_SKETCH_LEVELS)
+        || (ulSize_ < ulOffset + stHeader.ulLevels * sizeof(uint16_t)))
+        return false;
+
+    QuantileSketch_Init(pstSketch_);
+    QuantileSketch_SetLevels(pstSketch_, (unsigned char)stHeader.ulLevels);
+
+    for (i = 0; i < stHeader.ulLevels; i++)
+    {
+        memcpy(&usCount, pucBuffer_ + ulOffset, sizeof(usCount));
+        ulOffset += sizeof(usCount);
+
+        // Between adds every level holds under K values (see QuantileSketch_Insert); one
+        // holding more could be compacted past the end of the level above.
+        if (usCount >= QUANTILE_SKETCH_K)
+        {
+            QuantileSketch_Init(pstSketch_);
+            return false;
+        }
+        pstSketch_->ausCount[i] = usCount;
+        ulValuesSize += usCount * sizeof(float);
+    }
+
+    if (ulSize_ < ulOffset + ulValuesSize)
+    {
+        QuantileSketch_Init(pstSketch_);
+        return false;
+    }
+
+    for (i = 0; i < stHeader.ulLevels; i++)
+    {
+        memcpy(pstSketch_->aafValues[i], pucBuffer_ + ulOffset, pstSketch_->ausCount[i] * sizeof(float));
+        ulOffset += pstSketch_->ausCount[i] * sizeof(float);
+    }
+
+    pstSketch_->ullCount = stHeader.ullCount;
+    pstSketch_->fMin = stHeader.fMin;
+    pstSketch_->fMax = stHeader.fMax;
+    return true;
+}
+
+void PowerDistribution_Init(POWER_DISTRIBUTION *pstDistribution_)
+{
+    QuantileSketch_Init(&pstDistribution_->stPower);
+    QuantileSketch_Init(&pstDistribution_->stCadence);
+}
+
+void PowerDistribution_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    POWER_DISTRIBUTION *pstDistribution = (POWER_DISTRIBUTION*)pvContext_;
+
+    QuantileSketch_Add(&pstDistribution->stPower, fAveragePower_);
+    QuantileSketch_Add(&pstDistribution->stCadence, fAverageCadence_);
+}
+
+void PowerDistribution_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    POWER_DISTRIBUTION *pstDistribution = (POWER_DISTRIBUTION*)pvContext_;
+
+    QuantileSketch_AddCount(&pstDistribution->stPower, pstRun_->fAveragePower, pstRun_->ulCount);
+    QuantileSketch_AddCount(&pstDistribution->stCadence, pstRun_->fAverageCadence, pstRun_->ulCount);
+}
@@ -0,0 +1,89 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (QUANTILE_SKETCH_H)
+#define QUANTILE_SKETCH_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+
+// A KLL quantile sketch: approximate percentiles of a stream in fixed
+// memory. Values are kept in levels; each value at level h stands for 2^h
+// of the stream. When a level fills it is sorted and every other value
+// (from a random start) moves up a level, so the rank of any value is off
+// by at most half the level's weight for each compaction. Lower levels
+// hold fewer values (2/3 of the level above), which keeps the rank error
+// around 1.7 / QUANTILE_SKETCH_K of the stream, about 1% here.
+//
+// Sketches with the same K merge into one that is as accurate as if it
+// had seen both streams, so per rider sketches can be combined into
+// fleet-wide percentiles.
+#define QUANTILE_SKETCH_K               (200)           // Capacity of the top level
+#define QUANTILE_SKETCH_LEVELS          (32)            // Enough for 2^31 x K (over 10^11) values
+#define QUANTILE_SKETCH_LEVEL_SIZE      (2 * QUANTILE_SKETCH_K)     // Room for a compaction landing on a full level
+
+#define QUANTILE_SKETCH_FILE_ID         (0x534C4B42UL)  // "BKLS"
+#define QUANTILE_SKETCH_FILE_VERSION    (1)
+
+typedef struct _QUANTILE_SKETCH_t_
+{
+    unsigned long long ullCount;        // Values seen
+    float fMin;
+    float fMax;
+    unsigned char ucLevels;             // Levels in use
+    unsigned long ulRandom;             // Picks which half of a level moves up
+    unsigned short ausCapacity[QUANTILE_SKETCH_LEVELS];
+    unsigned short ausCount[QUANTILE_SKETCH_LEVELS];
+    float aafValues[QUANTILE_SKETCH_LEVELS][QUANTILE_SKETCH_LEVEL_SIZE];
+
+} QUANTILE_SKETCH;
+
+// Power and cadence distributions of one rider.
+typedef struct _POWER_DISTRIBUTION_t_
+{
+    QUANTILE_SKETCH stPower;
+    QUANTILE_SKETCH stCadence;
+
+} POWER_DISTRIBUTION;
+
+// Initializes an empty sketch.
+void QuantileSketch_Init(QUANTILE_SKETCH *pstSketch_);
+
+// Adds a value, or ullCount_ copies of it.
+void QuantileSketch_Add(QUANTILE_SKETCH *pstSketch_, float fValue_);
+void QuantileSketch_AddCount(QUANTILE_SKETCH *pstSketch_, float fValue_, unsigned long long ullCount_);
+
+// Adds the values of another sketch.
+void QuantileSketch_Merge(QUANTILE_SKETCH *pstSketch_, const QUANTILE_SKETCH *pstOther_);
+
+// Value at a quantile (0 to 1, eg. 0.95 for the 95th percentile), or 0 if the sketch is empty.
+// Sorts the levels, so the sketch can't be shared with a thread adding to it.
+float QuantileSketch_Quantile(QUANTILE_SKETCH *pstSketch_, double dQuantile_);
+
+// Fraction of the values at or below fValue_.
+double QuantileSketch_Rank(const QUANTILE_SKETCH *pstSketch_, float fValue_);
+
+// Bytes needed to serialize the sketch; at most a few kB once it has seen a few thousand values.
+unsigned long QuantileSketch_GetSize(const QUANTILE_SKETCH *pstSketch_);
+
+// Writes the sketch to a buffer. Returns the bytes written, or 0 if the buffer is too small.
+unsigned long QuantileSketch_Serialize(const QUANTILE_SKETCH *pstSketch_, unsigned char *pucBuffer_, unsigned long ulSize_);
+
+// Reads a sketch written by QuantileSketch_Serialize. Returns false if the buffer doesn't hold one.
+bool QuantileSketch_Deserialize(QUANTILE_SKETCH *pstSketch_, const unsigned char *pucBuffer_, unsigned long ulSize_);
+
+// Initializes the power and cadence sketches.
+void PowerDistribution_Init(POWER_DISTRIBUTION *pstDistribution_);
+
+// Receivers that feed a decoder's records to a distribution, with the distribution as the context (see PowerDecoder_InitContext).
+void PowerDistribution_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+void PowerDistribution_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "math.h"
+
+#include "RecordGrid.h"
+#include "PowerAlloc.h"
+
+static void RecordGrid_Output(RECORD_GRID *pstGrid_);
+static bool RecordGrid_Complete(const RECORD_GRID *pstGrid_);
+
+///////////////////////////////////////////////////////////////////////
+// bool RecordGrid_Init(RECORD_GRID *pstGrid_, double dRecordInterval_, double dGridOrigin_, unsigned long ulRiders_, unsigned long ulLatency_, RecordGridRowReceiver recordGridRowReceiverPtr_, void *pvContext_)
+///////////////////////////////////////////////////////////////////////
+//
+// The origin is moved to the boundary in the interval up to time zero,
+// as the decoders do, so grid indexes are never negative.
+//
+///////////////////////////////////////////////////////////////////////
+bool RecordGrid_Init(RECORD_GRID *pstGrid_, double dRecordInterval_, double dGridOrigin_, unsigned long ulRiders_, unsigned long ulLatency_, RecordGridRowReceiver recordGridRowReceiverPtr_, void *pvContext_)
+{
+    unsigned long ulRows = 1;
+    unsigned long i;
+
+    memset(pstGrid_, 0, sizeof(RECORD_GRID));
+    pstGrid_->dRecordInterval = dRecordInterval_;
+    pstGrid_->dGridOrigin = dGridOrigin_ - ceil(dGridOrigin_ / dRecordInterval_) * dRecordInterval_;
+    if (pstGrid_->dGridOrigin <= -dRecordInterval_)
+        pstGrid_->dGridOrigin += dRecordInterval_;
+    pstGrid_->ulRiders = ulRiders_;
+    pstGrid_->ulLatency = ulLatency_;
+    pstGrid_->prowPtr = recordGridRowReceiverPtr_;
+    pstGrid_->pvContext = pvContext_;
+
+    while (ulRows <= ulLatency_)
+        ulRows *= 2;
+
+    pstGrid_->pastRiders = (RECORD_GRID_RIDER*)POWER_CALLOC(ulRiders_, sizeof(RECORD_GRID_RIDER));
+    pstGrid_->pastValues = (RECORD_GRID_VALUE*)POWER_CALLOC((size_t)ulRows * ulRiders_, sizeof(RECORD_GRID_VALUE));
+    pstGrid_->ulRowsMask = ulRows - 1;
+
+    if ((pstGrid_->pastRiders == NULL) || (pstGrid_->pastValues == NULL))
+    {
+        RecordGrid_Free(pstGrid_);
+        return false;
+    }
+
+    for (i = 0; i < ulRiders_; i++)
+    {
+        pstGrid_->pastRiders[i].pstGrid = pstGrid_;
+        pstGrid_->pastRiders[i].ulRider = i;
+    }
+
+    return true;
+}
+
+void RecordGrid_Free(RECORD_GRID *pstGrid_)
+{
+    POWER_FREE(pstGrid_->pastRiders);
+    POWER_FREE(pstGrid_->pastValues);
+    pstGrid_->pastRiders = NULL;
+    pstGrid_->pastValues = NULL;
+}
+
+void RecordGrid_Reset(RECORD_GRID *pstGrid_)
+{
+    unsigned long i;
+
+    for (i = 0; i < pstGrid_->ulRiders; i++)
+    {
+        pstGrid_->pastRiders[i].bStarted = false;
+        pstGrid_->pastRiders[i].ullLastIndex = 0;
+    }
+
+    memset(pstGrid_->pastValues, 0, (size_t)(pstGrid_->ulRowsMask + 1) * pstGrid_->ulRiders * sizeof(RECORD_GRID_VALUE));
+    pstGrid_->bStarted = false;
+    pstGrid_->ullStartIndex = 0;
+    pstGrid_->ullNextIndex = 0;
+    pstGrid_->ullNewestIndex = 0;
+    pstGrid_->ulLateRecords = 0;
+}
+
+void* RecordGrid_GetRider(RECORD_GRID *pstGrid_, unsigned long ulRider_)
+{
+    return &pstGrid_->pastRiders[ulRider_];
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordGrid_Output(RECORD_GRID *pstGrid_)
+///////////////////////////////////////////////////////////////////////
+//
+// Outputs the oldest row and clears it for reuse.
+//
+///////////////////////////////////////////////////////////////////////
+static void RecordGrid_Output(RECORD_GRID *pstGrid_)
+{
+    RECORD_GRID_VALUE *pstRow = &pstGrid_->pastValues[(size_t)(pstGrid_->ullNextIndex & pstGrid_->ulRowsMask) * pstGrid_->ulRiders];
+
+    if (pstGrid_->prowPtr != NULL)
+        (*pstGrid_->prowPtr)(pstGrid_->pvContext, pstGrid_->dGridOrigin + (double)pstGrid_->ullNextIndex * pstGrid_->dRecordInterval, pstRow, pstGrid_->ulRiders);
+
+    memset(pstRow, 0, pstGrid_->ulRiders * sizeof(RECORD_GRID_VALUE));
+    pstGrid_->ullNextIndex++;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static bool RecordGrid_Complete(const RECORD_GRID *pstGrid_)
+///////////////////////////////////////////////////////////////////////
+//
+// The oldest row is complete when every rider still recording has
+// reached it. A rider that has had nothing for the latency isn't
+// expected to fill it; one not heard yet counts from the first record.
+//
+///////////////////////////////////////////////////////////////////////
+static bool RecordGrid_Complete(const RECORD_GRID *pstGrid_)
+{
+    const RECORD_GRID_RIDER *pstRider;
+    unsigned long long ullLastIndex;
+    unsigned long i;
+
+    for (i = 0; i < pstGrid_->ulRiders; i++)
+    {
+        pstRider = &pstGrid_->pastRiders[i];
+        if (pstRider->bStarted && (pstRider->ullLastIndex >= pstGrid_->ullNextIndex))
+            continue;
+
+        ullLastIndex = pstRider->bStarted ? pstRider->ullLastIndex : pstGrid_->ullStartIndex;
+        if (ullLastIndex + pstGrid_->ulLatency >= pstGrid_->ullNewestIndex)
+            return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordGrid_Add(RECORD_GRID *pstGrid_, unsigned long ulRider_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+///////////////////////////////////////////////////////////////////////
+//
+// Rows are held from the oldest not yet output to the latest record of
+// any rider. A record further ahead than the latency pushes the oldest
+// rows out, complete or not.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordGrid_Add(RECORD_GRID *pstGrid_, unsigned long ulRider_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    RECORD_GRID_RIDER *pstRider;
+    RECORD_GRID_VALUE *pstValue;
+    double dIndex = floor((dLastRecordTime_ - pstGrid_->dGridOrigin) / pstGrid_->dRecordInterval + 0.5);
+    unsigned long long ullIndex;
+
+    if ((ulRider_ >= pstGrid_->ulRiders) || (dIndex < 0))
+        return;
+
+    ullIndex = (unsigned long long)dIndex;
+    pstRider = &pstGrid_->pastRiders[ulRider_];
+
+    if (!pstGrid_->bStarted)
+    {
+        pstGrid_->bStarted = true;
+        pstGrid_->ullStartIndex = ullIndex;
+        pstGrid_->ullNextIndex = ullIndex;
+        pstGrid_->ullNewestIndex = ullIndex;
+    }
+
+    if (ullIndex < pstGrid_->ullNextIndex)
+    {
+        pstGrid_->ulLateRecords++;
+        return;
+    }
+
+    if (ullIndex > pstGrid_->ullNewestIndex)
+        pstGrid_->ullNewestIndex = ullIndex;
+
+    while (pstGrid_->ullNewestIndex - pstGrid_->ullNextIndex > pstGrid_->ulLatency)
+        RecordGrid_Output(pstGrid_);
+
+    pstValue = &pstGrid_->pastValues[(size_t)(ullIndex & pstGrid_->ulRowsMask) * pstGrid_->ulRiders + ulRider_];
+    pstValue->dTotalRotation = dTotalRotation_;
+    pstValue->dTotalEnergy = dTotalEnergy_;
+    pstValue->fAverageCadence = fAverageCadence_;
+    pstValue->fAveragePower = fAveragePower_;
+    pstValue->bValid = true;
+
+    if (!pstRider->bStarted || (ullIndex > pstRider->ullLastIndex))
+        pstRider->ullLastIndex = ullIndex;
+    pstRider->bStarted = true;
+
+    while ((pstGrid_->ullNextIndex <= pstGrid_->ullNewestIndex) && RecordGrid_Complete(pstGrid_))
+        RecordGrid_Output(pstGrid_);
+}
+
+void RecordGrid_Flush(RECORD_GRID *pstGrid_)
+{
+    if (!pstGrid_->bStarted)
+        return;
+
+    while (pstGrid_->ullNextIndex <= pstGrid_->ullNewestIndex)
+        RecordGrid_Output(pstGrid_);
+}
+
+void RecordGrid_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    RECORD_GRID_RIDER *pstRider = (RECORD_GRID_RIDER*)pvContext_;
+
+    RecordGrid_Add(pstRider->pstGrid, pstRider->ulRider, dLastRecordTime_, dTotalRotation_, dTotalEnergy_, fAverageCadence_, fAveragePower_);
+}
+
+void RecordGrid_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    PowerRecordRun_Deliver(pstRun_, RecordGrid_Receiver, pvContext_);
+}
@@ -0,0 +1,104 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (RECORD_GRID_H)
+#define RECORD_GRID_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+
+// Merges the records of several riders into one row per grid boundary,
+// holding the values of every rider. The decoders share the grid so their
+// records fall on the same boundaries:
+//
+//    RecordGrid_Init(&stGrid, 1.0, dGridOrigin, ulRiders, 5, RowReceiver, pvFile);
+//    for (i = 0; i < ulRiders; i++)
+//    {
+//       PowerDecoder_InitContext(&astDecoders[i], 1.0, dTimeBase, dReSyncInterval, RecordGrid_Receiver, RecordGrid_GetRider(&stGrid, i));
+//       PowerDecoder_SetRunReceiver(&astDecoders[i], RecordGrid_RunReceiver);
+//       PowerDecoder_SetGrid(&astDecoders[i], dGridOrigin);
+//    }
+//
+// (with a POWERSCAN, PowerScan_SetGrid and RecordGrid_Add from the scan
+// receivers). A decoder only outputs a record once an event ends past it,
+// so riders reach each boundary at different times. A row is output as
+// soon as every rider still recording has reached it, or once it is
+// ulLatency_ records behind the latest, without the riders that are late.
+// Riders without records for ulLatency_ records (out of range, stopped,
+// or not heard since the first record of the session) aren't waited for.
+typedef struct _RECORD_GRID_VALUE_t_
+{
+    double dTotalRotation;
+    double dTotalEnergy;
+    float fAverageCadence;
+    float fAveragePower;
+    bool bValid;                        // The rider had a record at this boundary
+
+} RECORD_GRID_VALUE;
+
+// Row receiver signature: the values of every rider at dRecordTime_, in rider order.
+typedef void(*RecordGridRowReceiver) (void *pvContext_, double dRecordTime_, const RECORD_GRID_VALUE *pastValues_, unsigned long ulRiders_);
+
+struct _RECORD_GRID_t_;
+
+typedef struct _RECORD_GRID_RIDER_t_
+{
+    struct _RECORD_GRID_t_ *pstGrid;
+    unsigned long ulRider;              // Column in the rows
+    bool bStarted;                      // Had a record since the last reset
+    unsigned long long ullLastIndex;    // Grid index of the latest record
+
+} RECORD_GRID_RIDER;
+
+typedef struct _RECORD_GRID_t_
+{
+    double dRecordInterval;             // Recording interval (s)
+    double dGridOrigin;                 // Receive time (s) of the boundary with grid index 0
+    unsigned long ulRiders;
+    unsigned long ulLatency;            // Records a row waits for late riders
+    RecordGridRowReceiver prowPtr;      // Row output
+    void *pvContext;                    // Context passed to prowPtr
+
+    RECORD_GRID_RIDER *pastRiders;
+    RECORD_GRID_VALUE *pastValues;      // Rows held, ulRiders values each; grid index i in row i & ulRowsMask
+    unsigned long ulRowsMask;           // Rows held - 1
+
+    bool bStarted;                      // Had a record since the last reset
+    unsigned long long ullStartIndex;   // Grid index of the first record
+    unsigned long long ullNextIndex;    // Grid index of the oldest row not yet output
+    unsigned long long ullNewestIndex;  // Grid index of the latest record of any rider
+    unsigned long ulLateRecords;        // Records for rows already output, dropped
+
+} RECORD_GRID;
+
+// Initializes a grid with boundaries at dGridOrigin_ (s) plus whole recording intervals (s), for
+// ulRiders_ riders. Returns false if the rows can't be allocated.
+bool RecordGrid_Init(RECORD_GRID *pstGrid_, double dRecordInterval_, double dGridOrigin_, unsigned long ulRiders_, unsigned long ulLatency_, RecordGridRowReceiver recordGridRowReceiverPtr_, void *pvContext_);
+
+// Frees the rows of a grid.
+void RecordGrid_Free(RECORD_GRID *pstGrid_);
+
+// Starts a new session, dropping the rows held.
+void RecordGrid_Reset(RECORD_GRID *pstGrid_);
+
+// Context for the decoder of a rider, to use with the receivers below (see PowerDecoder_InitContext).
+void* RecordGrid_GetRider(RECORD_GRID *pstGrid_, unsigned long ulRider_);
+
+// Adds a record of a rider.
+void RecordGrid_Add(RECORD_GRID *pstGrid_, unsigned long ulRider_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+
+// Outputs the rows held, eg. at the end of a session.
+void RecordGrid_Flush(RECORD_GRID *pstGrid_);
+
+// Receivers that feed a decoder's records to a grid, with RecordGrid_GetRider as the context.
+void RecordGrid_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+void RecordGrid_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+#endif
@@ -0,0 +1,327 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "math.h"
+
+#include "RecordIndex.h"
+#include "PowerAlloc.h"
+
+#define RECORD_INDEX_TIME_TOLERANCE     (1e-6)          // Fraction of an interval within which record times match
+
+// File layout: this header followed by ulCount RECORD_INDEX_ENTRYs.
+typedef struct _RECORD_INDEX_FILE_HEADER_t_
+{
+    uint32_t ulFileId;
+    uint32_t ulVersion;
+    uint32_t ulCount;
+    uint32_t ulEntrySize;
+    double dRecordInterval;
+
+} RECORD_INDEX_FILE_HEADER;
+
+static bool RecordIndex_Reserve(RECORD_INDEX *pstIndex_, unsigned long ulCount_);
+static unsigned long RecordIndex_Find(const RECORD_INDEX *pstIndex_, double dTime_);
+static void RecordIndex_Totals(const RECORD_INDEX *pstIndex_, double dTime_, double *pdRotation_, double *pdEnergy_);
+static FILE* RecordIndex_Open(const char *pcPath_, const char *pcMode_);
+
+bool RecordIndex_Init(RECORD_INDEX *pstIndex_, double dRecordInterval_, unsigned long ulCapacity_)
+{
+    pstIndex_->pastEntries = NULL;
+    pstIndex_->ulCount = 0;
+    pstIndex_->ulCapacity = 0;
+    pstIndex_->dRecordInterval = dRecordInterval_;
+    pstIndex_->bRegular = true;
+
+    return RecordIndex_Reserve(pstIndex_, (ulCapacity_ > 0) ? ulCapacity_ : 1);
+}
+
+void RecordIndex_Free(RECORD_INDEX *pstIndex_)
+{
+    POWER_FREE(pstIndex_->pastEntries);
+    pstIndex_->pastEntries = NULL;
+    pstIndex_->ulCount = 0;
+    pstIndex_->ulCapacity = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static bool RecordIndex_Reserve(RECORD_INDEX *pstIndex_, unsigned long ulCount_)
+///////////////////////////////////////////////////////////////////////
+//
+// Doubles the capacity until ulCount_ records fit, so appending stays
+// cheap however long the recording.
+//
+///////////////////////////////////////////////////////////////////////
+static bool RecordIndex_Reserve(RECORD_INDEX *pstIndex_, unsigned long ulCount_)
+{
+    unsigned long ulCapacity = (pstIndex_->ulCapacity > 0) ? pstIndex_->ulCapacity : 1;
+    RECORD_INDEX_ENTRY *pastEntries;
+
+    if (ulCount_ <= pstIndex_->ulCapacity)
+        return true;
+
+    while (ulCapacity < ulCount_)
+        ulCapacity *= 2;
+
+    pastEntries = (RECORD_INDEX_ENTRY*)POWER_REALLOC(pstIndex_->pastEntries, ulCapacity * sizeof(RECORD_INDEX_ENTRY));
+    if (pastEntries == NULL)
+        return false;
+
+    pstIndex_->pastEntries = pastEntries;
+    pstIndex_->ulCapacity = ulCapacity;
+    return true;
+}
+
+bool RecordIndex_Add(RECORD_INDEX *pstIndex_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_)
+{
+    RECORD_INDEX_ENTRY *pstEntry;
+    double dStep;
+
+    if (pstIndex_->ulCount > 0)
+    {
+        dStep = dLastRecordTime_ - pstIndex_->pastEntries[pstIndex_->ulCount - 1].dTime;
+        if (dStep <= 0)
+            return false;
+
+        if (fabs(dStep - pstIndex_->dRecordInterval) > pstIndex_->dRecordInterval * RECORD_INDEX_TIME_TOLERANCE)
+            pstIndex_->bRegular = false;
+    }
+
+    if (!RecordIndex_Reserve(pstIndex_, pstIndex_->ulCount + 1))
+        return false;
+
+    pstEntry = &pstIndex_->pastEntries[pstIndex_->ulCount++];
+    pstEntry->dTime = dLastRecordTime_;
+    pstEntry->dTotalRotation = dTotalRotation_;
+    pstEntry->dTotalEnergy = dTotalEnergy_;
+    return true;
+}
+
+bool RecordIndex_AddRun(RECORD_INDEX *pstIndex_, const POWER_RECORD_RUN *pstRun_)
+{
+    unsigned long ulCount = pstIndex_->ulCount;
+
+    if (!RecordIndex_Reserve(pstIndex_, pstIndex_->ulCount + pstRun_->ulCount))
+        return false;
+
+    PowerRecordRun_Deliver(pstRun_, RecordIndex_Receiver, pstIndex_);
+    return (pstIndex_->ulCount == ulCount + pstRun_->ulCount);
+}
+
+void RecordIndex_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    RecordIndex_Add((RECORD_INDEX*)pvContext_, dLastRecordTime_, dTotalRotation_, dTotalEnergy_);
+}
+
+void RecordIndex_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    RecordIndex_AddRun((RECORD_INDEX*)pvContext_, pstRun_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static unsigned long RecordIndex_Find(const RECORD_INDEX *pstIndex_, double dTime_)
+///////////////////////////////////////////////////////////////////////
+//
+// Returns the first record later than dTime_, which is the record
+// covering it if there is one, or ulCount if there are none.
+// While the records are regular this is worked out from the time;
+// otherwise it takes a binary search.
+//
+///////////////////////////////////////////////////////////////////////
+static unsigned long RecordIndex_Find(const RECORD_INDEX *pstIndex_, double dTime_)
+{
+    const RECORD_INDEX_ENTRY *pastEntries = pstIndex_->pastEntries;
+    unsigned long ulLow = 0;
+    unsigned long ulHigh = pstIndex_->ulCount;
+    unsigned long ulMid;
+    double dPosition;
+
+    if (dTime_ < pastEntries[0].dTime)
+        return 0;
+
+    if (pstIndex_->bRegular)
+    {
+        dPosition = floor((dTime_ - pastEntries[0].dTime) / pstIndex_->dRecordInterval) + 1;
+        if (dPosition >= (double)pstIndex_->ulCount)
+            return pstIndex_->ulCount;
+
+        ulMid = (unsigned long)dPosition;
+
+        // The division can land a record either side of an exact record time.
+        if (pastEntries[ulMid].dTime <= dTime_)
+            return ulMid + 1;
+        if (pastEntries[ulMid - 1].dTime > dTime_)
+            return ulMid - 1;
+        return ulMid;
+    }
+
+    while (ulLow < ulHigh)
+    {
+        ulMid = ulLow + (ulHigh - ulLow) / 2;
+        if (pastEntries[ulMid].dTime <= dTime_)
+            ulLow = ulMid + 1;
+        else
+            ulHigh = ulMid;
+    }
+
+    return ulLow;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordIndex_Totals(const RECORD_INDEX *pstIndex_, double dTime_, double *pdRotation_, double *pdEnergy_)
+///////////////////////////////////////////////////////////////////////
+//
+// Totals at any time. Within a record they rise at its average rate,
+// over the interval that ends at the record time. Across a stretch
+// without records they hold at the last record's totals.
+//
+///////////////////////////////////////////////////////////////////////
+static void RecordIndex_Totals(const RECORD_INDEX *pstIndex_, double dTime_, double *pdRotation_, double *pdEnergy_)
+{
+    const RECORD_INDEX_ENTRY *pstBefore;
+    const RECORD_INDEX_ENTRY *pstAfter;
+    unsigned long ulNext = RecordIndex_Find(pstIndex_, dTime_);
+    double dFraction;
+
+    if (ulNext == 0)
+    {
+        pstAfter = &pstIndex_->pastEntries[0];
+        *pdRotation_ = pstAfter->dTotalRotation;
+        *pdEnergy_ = pstAfter->dTotalEnergy;
+        return;
+    }
+
+    pstBefore = &pstIndex_->pastEntries[ulNext - 1];
+    if (ulNext == pstIndex_->ulCount)
+    {
+        *pdRotation_ = pstBefore->dTotalRotation;
+        *pdEnergy_ = pstBefore->dTotalEnergy;
+        return;
+    }
+
+    pstAfter = &pstIndex_->pastEntries[ulNext];
+    dFraction = (dTime_ - (pstAfter->dTime - pstIndex_->dRecordInterval)) / pstIndex_->dRecordInterval;
+    if (dFraction < 0)
+        dFraction = 0;
+
+    *pdRotation_ = pstBefore->dTotalRotation + (pstAfter->dTotalRotation - pstBefore->dTotalRotation) * dFraction;
+    *pdEnergy_ = pstBefore->dTotalEnergy + (pstAfter->dTotalEnergy - pstBefore->dTotalEnergy) * dFraction;
+}
+
+bool RecordIndex_Query(const RECORD_INDEX *pstIndex_, double dStartTime_, double dEndTime_, RECORD_WINDOW_AVERAGE *pstAverage_)
+{
+    double dStartRotation;
+    double dStartEnergy;
+    double dEndRotation;
+    double dEndEnergy;
+    double dDuration = dEndTime_ - dStartTime_;
+
+    memset(pstAverage_, 0, sizeof(RECORD_WINDOW_AVERAGE));
+
+    if ((pstIndex_->ulCount == 0) || (dDuration <= 0))
+        return false;
+
+    RecordIndex_Totals(pstIndex_, dStartTime_, &dStartRotation, &dStartEnergy);
+    RecordIndex_Totals(pstIndex_, dEndTime_, &dEndRotation, &dEndEnergy);
+
+    pstAverage_->dEnergy = dEndEnergy - dStartEnergy;
+    pstAverage_->dRotation = dEndRotation - dStartRotation;
+    pstAverage_->fAveragePower = (float)(pstAverage_->dEnergy / dDuration);
+    pstAverage_->fAverageCadence = (float)(pstAverage_->dRotation * 60.0 / dDuration);
+    return true;
+}
+
+void RecordIndex_QueryBatch(const RECORD_INDEX *pstIndex_, const RECORD_WINDOW *pastWindows_, unsigned long ulCount_, RECORD_WINDOW_AVERAGE *pastAverages_)
+{
+    unsigned long i;
+
+    for (i = 0; i < ulCount_; i++)
+        RecordIndex_Query(pstIndex_, pastWindows_[i].dStartTime, pastWindows_[i].dEndTime, &pastAverages_[i]);
+}
+
+static FILE* RecordIndex_Open(const char *pcPath_, const char *pcMode_)
+{
+#if defined(_MSC_VER)
+    FILE *pfFile = NULL;
+
+    if (fopen_s(&pfFile, pcPath_, pcMode_) != 0)
+        return NULL;
+    return pfFile;
+#else
+    return fopen(pcPath_, pcMode_);
+#endif
+}
+
+bool RecordIndex_Save(const RECORD_INDEX *pstIndex_, const char *pcPath_)
+{
+    RECORD_INDEX_FILE_HEADER stHeader;
+    FILE *pfFile = RecordIndex_Open(pcPath_, "wb");
+    bool bSuccess;
+
+    if (pfFile == NULL)
+        return false;
+
+    stHeader.ulFileId = RECORD_INDEX_FILE_ID;
+    stHeader.ulVersion = RECORD_INDEX_FILE_VERSION;
+    stHeader.ulCount = (uint32_t)pstIndex_->ulCount;
+    stHeader.ulEntrySize = (uint32_t)sizeof(RECORD_INDEX_ENTRY);
+    stHeader.dRecordInterval = pstIndex_->dRecordInterval;
+
+    bSuccess = (fwrite(&stHeader, sizeof(stHeader), 1, pfFile) == 1)
+        && (fwrite(pstIndex_->pastEntries, sizeof(RECORD_INDEX_ENTRY), pstIndex_->ulCount, pfFile) == pstIndex_->ulCount);
+
+    if (fclose(pfFile) != 0)
+        bSuccess = false;
+    return bSuccess;
+}
+
+///////////////////////////////////////////////////////////////////////
+// bool RecordIndex_Load(RECORD_INDEX *pstIndex_, const char *pcPath_)
+///////////////////////////////////////////////////////////////////////
+//
+// The records are added one at a time so a damaged file can't leave
+// them out of order.
+//
+///////////////////////////////////////////////////////////////////////
+bool RecordIndex_Load(RECORD_INDEX *pstIndex_, const char *pcPath_)
+{
+    RECORD_INDEX_FILE_HEADER stHeader;
+    RECORD_INDEX_ENTRY stEntry;
+    FILE *pfFile = RecordIndex_Open(pcPath_, "rb");
+    bool bSuccess;
+    unsigned long i;
+
+    if (pfFile == NULL)
+        return false;
+
+    bSuccess = (fread(&stHeader, sizeof(stHeader), 1, pfFile) == 1)
+        && (stHeader.ulFileId == RECORD_INDEX_FILE_ID)
+        && (stHeader.ulVersion == RECORD_INDEX_FILE_VERSION)
+        && (stHeader.ulEntrySize == sizeof(RECORD_INDEX_ENTRY))
+        && (stHeader.dRecordInterval > 0);
+
+    if (bSuccess)
+    {
+        RecordIndex_Free(pstIndex_);
+        bSuccess = RecordIndex_Init(pstIndex_, stHeader.dRecordInterval, stHeader.ulCount);
+
+        for (i = 0; bSuccess && (i < stHeader.ulCount); i++)
+        {
+            bSuccess = (fread(&stEntry, sizeof(stEntry), 1, pfFile) == 1)
+                && RecordIndex_Add(pstIndex_, stEntry.dTime, stEntry.dTotalRotation, stEntry.dTotalEnergy);
+        }
+    }
+
+    fclose(pfFile);
+    return bSuccess;
+}
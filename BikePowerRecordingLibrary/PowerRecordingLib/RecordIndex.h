@@ -0,0 +1,94 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (RECORD_INDEX_H)
+#define RECORD_INDEX_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+
+// Every record carries the total energy and rotation since the decoder
+// started, so the energy in any window is the difference of the totals at
+// its ends. The index keeps the record times and totals, and answers
+// average power and cadence for a window without looking at the records
+// in between.
+//
+// A record covers the interval that ends at its time. Window ends that fall
+// inside a record are interpolated at its average power. No energy is
+// counted for time without records (eg. a dropout that resynced the decoder)
+// or outside the indexed records.
+#define RECORD_INDEX_FILE_ID            (0x49525042UL)  // "BPRI"
+#define RECORD_INDEX_FILE_VERSION       (1)
+
+typedef struct _RECORD_INDEX_ENTRY_t_
+{
+    double dTime;                       // Record time (s)
+    double dTotalRotation;              // Totals as output with the record
+    double dTotalEnergy;
+
+} RECORD_INDEX_ENTRY;
+
+typedef struct _RECORD_INDEX_t_
+{
+    RECORD_INDEX_ENTRY *pastEntries;
+    unsigned long ulCount;
+    unsigned long ulCapacity;
+    double dRecordInterval;             // Recording interval (s)
+    bool bRegular;                      // Each record follows the last by one interval, so a time's record can be worked out
+
+} RECORD_INDEX;
+
+// A window [dStartTime, dEndTime) to average over.
+typedef struct _RECORD_WINDOW_t_
+{
+    double dStartTime;
+    double dEndTime;
+
+} RECORD_WINDOW;
+
+typedef struct _RECORD_WINDOW_AVERAGE_t_
+{
+    double dEnergy;                     // Energy (J) and rotation in the window
+    double dRotation;
+    float fAveragePower;
+    float fAverageCadence;
+
+} RECORD_WINDOW_AVERAGE;
+
+// Initializes an empty index with room for ulCapacity_ records (it grows as needed).
+// Returns false if out of memory.
+bool RecordIndex_Init(RECORD_INDEX *pstIndex_, double dRecordInterval_, unsigned long ulCapacity_);
+
+// Frees the records.
+void RecordIndex_Free(RECORD_INDEX *pstIndex_);
+
+// Appends a record. Returns false if it isn't later than the last record or out of memory.
+bool RecordIndex_Add(RECORD_INDEX *pstIndex_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_);
+
+// Appends the records of a gap run. Returns false if out of memory or any of them isn't later than the record before it.
+bool RecordIndex_AddRun(RECORD_INDEX *pstIndex_, const POWER_RECORD_RUN *pstRun_);
+
+// Receivers that index a decoder's records, with the index as the context (see PowerDecoder_InitContext).
+void RecordIndex_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+void RecordIndex_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+// Averages over a window. Returns false if the window is empty or the index has no records.
+bool RecordIndex_Query(const RECORD_INDEX *pstIndex_, double dStartTime_, double dEndTime_, RECORD_WINDOW_AVERAGE *pstAverage_);
+
+// Averages over each of ulCount_ windows. Windows that can't be averaged get zeros.
+void RecordIndex_QueryBatch(const RECORD_INDEX *pstIndex_, const RECORD_WINDOW *pastWindows_, unsigned long ulCount_, RECORD_WINDOW_AVERAGE *pastAverages_);
+
+// Writes the index to a file. Returns false if the file can't be written.
+bool RecordIndex_Save(const RECORD_INDEX *pstIndex_, const char *pcPath_);
+
+// Replaces the index with one read from a file. Returns false if the file can't be read or isn't an index.
+bool RecordIndex_Load(RECORD_INDEX *pstIndex_, const char *pcPath_);
+
+#endif
@@ -8,16 +8,45 @@ All rights reserved.
 */
 
 #include "string.h"
+#include "stdbool.h"
 #include "stdlib.h"
 #include "math.h"
 
 #include "PowerDecoder.h"
 #include "RecordOutput.h"
+#include "PowerProbe.h"
 
-static double dRecordInterval;
+static void RecordOutput_GetStats(const BPSAMPLER *pstDecoder_, float fAveragePower_, POWER_RECORD_STATS *pstStats_);
+static void RecordOutput_Deliver(BPSAMPLER *pstDecoder_, float fAverageCadence_, float fAveragePower_, const POWER_RECORD_STATS *pstStats_);
+static unsigned long long RecordOutput_StartTiming(const BPSAMPLER *pstDecoder_);
+static void RecordOutput_StopTiming(BPSAMPLER *pstDecoder_, unsigned long long ullStartTime_);
 
-void ResamplerOutput_Init(BPSAMPLER *pstDecoder_, unsigned short usRecordInterval_, double dRecordInterval_, unsigned short usTimeBase_)
+///////////////////////////////////////////////////////////////////////
+// void ResamplerOutput_Init(BPSAMPLER *pstDecoder_, unsigned long ulTimeQuantization_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
+///////////////////////////////////////////////////////////////////////
+//
+// Record boundaries are found in quantized ticks, so the recording
+// interval has to be a whole number of them. Short intervals rarely
+// are at the power meter's own rate (0.02 s is 40.96 ticks at 2048 Hz),
+// so time is counted in a multiple of its ticks that makes it one
+// (25 ticks per power meter tick makes 0.02 s exactly 1024).
+//
+///////////////////////////////////////////////////////////////////////
+void ResamplerOutput_Init(BPSAMPLER *pstDecoder_, unsigned long ulTimeQuantization_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_)
 {
+    unsigned long ulTimeScale;
+    double dTicks;
+
+    memset(pstDecoder_, 0, sizeof(BPSAMPLER));
+
+    // Failing an exact fit, the largest scale keeps the rounding error down.
+    for (ulTimeScale = 1; ulTimeScale < MAXIMUM_TIME_SCALE; ulTimeScale++)
+    {
+        dTicks = dRecordInterval_ * ulTimeQuantization_ * ulTimeScale;
+        if (fabs(dTicks - floor(dTicks + 0.5)) < 1e-6)
+            break;
+    }
+
     pstDecoder_->ucCadence = 0;
     pstDecoder_->dTotalEnergy = 0;
     pstDecoder_->fAccumEnergy = 0;
@@ -29,43 +58,326 @@ void ResamplerOutput_Init(BPSAMPLER *pstDecoder_, unsigned short usRecordInterva
     pstDecoder_->fPendingRotation = 0;
     pstDecoder_->fGapRotation = 0;
     pstDecoder_->ulEventTime = 0;
-    pstDecoder_->ucRecordGapCount = 0;
+    pstDecoder_->ulRecordGapCount = 0;
     pstDecoder_->dLastRecordTime = 0;
     pstDecoder_->dLastMessageTime = 0;
 
-    pstDecoder_->usRecordInterval = usRecordInterval_;
-    pstDecoder_->usTimeBase = usTimeBase_;
+    pstDecoder_->ulTimeScale = ulTimeScale;
+    pstDecoder_->ulTicksPerSecond = ulTimeQuantization_ * ulTimeScale;
+    pstDecoder_->ulRecordInterval = ResamplerOutput_Ticks(pstDecoder_, dRecordInterval_);
+    if (pstDecoder_->ulRecordInterval == 0)
+        pstDecoder_->ulRecordInterval = 1;
+    pstDecoder_->ulTimeBase = ResamplerOutput_Ticks(pstDecoder_, dTimeBase_);
+
+    pstDecoder_->dRecordInterval = dRecordInterval_;
+    pstDecoder_->dReSyncInterval = dReSyncInterval_;
+    pstDecoder_->prrPtr = powerRecordReceiverPtr_;
+    pstDecoder_->prcrPtr = NULL;
+    pstDecoder_->pvRecordContext = NULL;
+    pstDecoder_->prunPtr = NULL;
+    pstDecoder_->prsrPtr = NULL;
+    pstDecoder_->pevPtr = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+// unsigned long ResamplerOutput_Ticks(BPSAMPLER *pstDecoder_, double dTime_)
+///////////////////////////////////////////////////////////////////////
+unsigned long ResamplerOutput_Ticks(BPSAMPLER *pstDecoder_, double dTime_)
+{
+    return (unsigned long)(dTime_ * pstDecoder_->ulTicksPerSecond + 0.5);
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordOutput_SetTime(BPSAMPLER *pstDecoder_, double dTime_)
+///////////////////////////////////////////////////////////////////////
+//
+// Record times are counted in whole recording intervals and only
+// converted to seconds as they are output, so adding up intervals
+// can't make them drift however long the decoder runs.
+//
+// On a grid, the event time starts where the resync falls in the
+// recording interval, so the records end on the grid boundaries
+// rather than a whole interval after the resync.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordOutput_SetTime(BPSAMPLER *pstDecoder_, double dTime_)
+{
+    pstDecoder_->ullRecordIndex = (unsigned long long)floor((dTime_ - pstDecoder_->dGridOrigin) / pstDecoder_->dRecordInterval);
+    pstDecoder_->dLastRecordTime = pstDecoder_->dGridOrigin + (double)pstDecoder_->ullRecordIndex * pstDecoder_->dRecordInterval;
+
+    if (pstDecoder_->bGridAligned)
+    {
+        pstDecoder_->ulEventTime = ResamplerOutput_Ticks(pstDecoder_, dTime_ - pstDecoder_->dLastRecordTime);
+        if (pstDecoder_->ulEventTime >= pstDecoder_->ulRecordInterval)
+            pstDecoder_->ulEventTime = pstDecoder_->ulRecordInterval - 1;
+    }
+
+    // Starting over, so no events in the pending record yet.
+    pstDecoder_->ulStatsEvents = 0;
+
+    pstDecoder_->ullEventTicks = 0;
+    pstDecoder_->dEventBaseTime = dTime_;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordOutput_AdvanceTime(BPSAMPLER *pstDecoder_, unsigned long ulRecords_)
+///////////////////////////////////////////////////////////////////////
+void RecordOutput_AdvanceTime(BPSAMPLER *pstDecoder_, unsigned long ulRecords_)
+{
+    pstDecoder_->ullRecordIndex += ulRecords_;
+    pstDecoder_->dLastRecordTime = pstDecoder_->dGridOrigin + (double)pstDecoder_->ullRecordIndex * pstDecoder_->dRecordInterval;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordOutput_SetGrid(BPSAMPLER *pstDecoder_, double dGridOrigin_)
+///////////////////////////////////////////////////////////////////////
+//
+// Any boundary will do as the origin. It's kept as the one in the
+// interval up to time zero, so receive times are never before it and
+// record indexes stay positive.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordOutput_SetGrid(BPSAMPLER *pstDecoder_, double dGridOrigin_)
+{
+    double dRecordInterval = pstDecoder_->dRecordInterval;
+    double dGridOrigin = dGridOrigin_ - ceil(dGridOrigin_ / dRecordInterval) * dRecordInterval;
+
+    if (dGridOrigin <= -dRecordInterval)
+        dGridOrigin += dRecordInterval;
+
+    pstDecoder_->dGridOrigin = dGridOrigin;
+    pstDecoder_->bGridAligned = true;
+}
+
+double RecordOutput_GetEpoch(const BPSAMPLER *pstDecoder_, double dTime_)
+{
+    return pstDecoder_->dGridOrigin + floor((dTime_ - pstDecoder_->dGridOrigin) / pstDecoder_->dRecordInterval) * pstDecoder_->dRecordInterval;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordOutput_Sum(double *pdTotal_, double *pdCompensation_, double dValue_)
+///////////////////////////////////////////////////////////////////////
+//
+// Adds to a running total with Kahan summation. The small per record
+// amounts would otherwise lose their low order bits to a total that
+// has grown over weeks of recording.
+//
+///////////////////////////////////////////////////////////////////////
+static void RecordOutput_Sum(double *pdTotal_, double *pdCompensation_, double dValue_)
+{
+    double dValue = dValue_ - *pdCompensation_;
+    double dTotal = *pdTotal_ + dValue;
+
+    *pdCompensation_ = (dTotal - *pdTotal_) - dValue;
+    *pdTotal_ = dTotal;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordOutput_AddEvent(BPSAMPLER *pstDecoder_, float fEventPower_)
+///////////////////////////////////////////////////////////////////////
+//
+// The variance is kept with Welford's running mean rather than a sum of
+// squares, which would cancel out at steady power.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordOutput_AddEvent(BPSAMPLER *pstDecoder_, float fEventPower_)
+{
+    double dDelta;
+
+    if (pstDecoder_->prsrPtr == NULL)
+        return;
+
+    pstDecoder_->fLastEventPower = fEventPower_;
+
+    if (pstDecoder_->ulStatsEvents++ == 0)
+    {
+        pstDecoder_->fStatsMinPower = fEventPower_;
+        pstDecoder_->fStatsMaxPower = fEventPower_;
+        pstDecoder_->dStatsMeanPower = fEventPower_;
+        pstDecoder_->dStatsPowerM2 = 0;
+        return;
+    }
+
+    if (fEventPower_ < pstDecoder_->fStatsMinPower)
+        pstDecoder_->fStatsMinPower = fEventPower_;
+    if (fEventPower_ > pstDecoder_->fStatsMaxPower)
+        pstDecoder_->fStatsMaxPower = fEventPower_;
+
+    dDelta = fEventPower_ - pstDecoder_->dStatsMeanPower;
+    pstDecoder_->dStatsMeanPower += dDelta / pstDecoder_->ulStatsEvents;
+    pstDecoder_->dStatsPowerM2 += dDelta * (fEventPower_ - pstDecoder_->dStatsMeanPower);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordOutput_GetStats(const BPSAMPLER *pstDecoder_, float fAveragePower_, POWER_RECORD_STATS *pstStats_)
+///////////////////////////////////////////////////////////////////////
+static void RecordOutput_GetStats(const BPSAMPLER *pstDecoder_, float fAveragePower_, POWER_RECORD_STATS *pstStats_)
+{
+    pstStats_->ulEventCount = pstDecoder_->ulStatsEvents;
+
+    if (pstDecoder_->ulStatsEvents == 0)
+    {
+        pstStats_->fMinPower = fAveragePower_;
+        pstStats_->fMaxPower = fAveragePower_;
+        pstStats_->fPowerVariance = 0;
+    }
+    else
+    {
+        pstStats_->fMinPower = pstDecoder_->fStatsMinPower;
+        pstStats_->fMaxPower = pstDecoder_->fStatsMaxPower;
+        pstStats_->fPowerVariance = (float)(pstDecoder_->dStatsPowerM2 / pstDecoder_->ulStatsEvents);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordOutput_Event(BPSAMPLER *pstDecoder_, unsigned short usPeriod_, float fTorque_, float fEnergy_, unsigned char ucRotations_)
+///////////////////////////////////////////////////////////////////////
+//
+// Event times are counted in whole power meter ticks from the data
+// baseline, so they stay exact however many events follow.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordOutput_Event(BPSAMPLER *pstDecoder_, unsigned short usPeriod_, float fTorque_, float fEnergy_, unsigned char ucRotations_)
+{
+    POWER_EVENT stEvent;
+    unsigned long ulTicksPerSecond = pstDecoder_->ulTicksPerSecond / pstDecoder_->ulTimeScale;
+    unsigned long long ullStartTime;
+
+    pstDecoder_->ullEventTicks += usPeriod_;
+
+    stEvent.ullEventTicks = pstDecoder_->ullEventTicks;
+    stEvent.dEventTime = pstDecoder_->dEventBaseTime + (double)pstDecoder_->ullEventTicks / ulTicksPerSecond;
+    stEvent.usPeriod = usPeriod_;
+    stEvent.usTicksPerSecond = (unsigned short)ulTicksPerSecond;
+    stEvent.fTorque = fTorque_;
+    stEvent.fEnergy = fEnergy_;
+    stEvent.ucRotations = ucRotations_;
 
-    dRecordInterval = dRecordInterval_;
+    ullStartTime = RecordOutput_StartTiming(pstDecoder_);
+    (*pstDecoder_->pevPtr)(pstDecoder_->pvRecordContext, &stEvent);
+    RecordOutput_StopTiming(pstDecoder_, ullStartTime);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// void RecordOutput(FILE *pfOut_, BPRESAMPLER *pstDecoder_)
+// void RecordOutput_Emit(BPSAMPLER *pstDecoder_, float fAverageCadence_, float fAveragePower_)
+///////////////////////////////////////////////////////////////////////
+//
+// Hands the current record (time and totals) to the receiver
+// registered with this decoder. These are records without any events
+// (time passing between messages), so their stats are just the average.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordOutput_Emit(BPSAMPLER *pstDecoder_, float fAverageCadence_, float fAveragePower_)
+{
+    POWER_RECORD_STATS stStats;
+
+    if (pstDecoder_->prsrPtr != NULL)
+    {
+        stStats.ulEventCount = 0;
+        stStats.fMinPower = fAveragePower_;
+        stStats.fMaxPower = fAveragePower_;
+        stStats.fPowerVariance = 0;
+    }
+
+    RecordOutput_Deliver(pstDecoder_, fAverageCadence_, fAveragePower_, &stStats);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordOutput_Deliver(BPSAMPLER *pstDecoder_, float fAverageCadence_, float fAveragePower_, const POWER_RECORD_STATS *pstStats_)
+///////////////////////////////////////////////////////////////////////
+static void RecordOutput_Deliver(BPSAMPLER *pstDecoder_, float fAverageCadence_, float fAveragePower_, const POWER_RECORD_STATS *pstStats_)
+{
+    unsigned long long ullStartTime = RecordOutput_StartTiming(pstDecoder_);
+
+    if (pstDecoder_->prcrPtr != NULL)
+    {
+        (*pstDecoder_->prcrPtr)(pstDecoder_->pvRecordContext, pstDecoder_->dLastRecordTime, pstDecoder_->dTotalRotation, pstDecoder_->dTotalEnergy, fAverageCadence_, fAveragePower_);
+    }
+    else if (pstDecoder_->prrPtr != NULL)
+    {
+        (*pstDecoder_->prrPtr)(pstDecoder_->dLastRecordTime, pstDecoder_->dTotalRotation, pstDecoder_->dTotalEnergy, fAverageCadence_, fAveragePower_);
+    }
+
+    if (pstDecoder_->prsrPtr != NULL)
+        (*pstDecoder_->prsrPtr)(pstDecoder_->pvRecordContext, pstDecoder_->dLastRecordTime, pstStats_);
+
+    // Not part of the decode time.
+    RecordOutput_StopTiming(pstDecoder_, ullStartTime);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static unsigned long long RecordOutput_StartTiming(const BPSAMPLER *pstDecoder_)
+///////////////////////////////////////////////////////////////////////
+//
+// Reads the thread CPU clock before a receiver is called, if the
+// decoder is timed (see PowerDecoder_SetTiming).
+//
+///////////////////////////////////////////////////////////////////////
+static unsigned long long RecordOutput_StartTiming(const BPSAMPLER *pstDecoder_)
+{
+    return pstDecoder_->bTimed ? PowerDecoder_GetCpuTimeNs() : 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordOutput_StopTiming(BPSAMPLER *pstDecoder_, unsigned long long ullStartTime_)
+///////////////////////////////////////////////////////////////////////
+static void RecordOutput_StopTiming(BPSAMPLER *pstDecoder_, unsigned long long ullStartTime_)
+{
+    if (pstDecoder_->bTimed)
+        pstDecoder_->ullReceiverTime += PowerDecoder_GetCpuTimeNs() - ullStartTime_;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordOutput(BPSAMPLER *pstDecoder_)
 ///////////////////////////////////////////////////////////////////////
 //
 // This function pushes output records to catch up to the latest event.
 // It also updates the state as required.
 //
+// The latest event ends past this record. If it also runs on into a
+// gap or the next record, it counts towards their stats too.
+//
 ///////////////////////////////////////////////////////////////////////
-void RecordOutput(PowerRecordReceiver powerRecordReceiverPtr_, BPSAMPLER *pstDecoder_)
+void RecordOutput(BPSAMPLER *pstDecoder_)
 {
+    double dRecordInterval = pstDecoder_->dRecordInterval;
+    POWER_RECORD_STATS stStats;
+
     // Calculate average power and cadence over the recording interval.
     float fAveragePower = (float)(pstDecoder_->fPendingEnergy / dRecordInterval);
     float fAverageCadence = (float)(pstDecoder_->fPendingRotation * 60.0 / dRecordInterval);
 
-    pstDecoder_->dTotalEnergy += pstDecoder_->fPendingEnergy;
-    pstDecoder_->dTotalRotation += pstDecoder_->fPendingRotation;
-    pstDecoder_->dLastRecordTime += dRecordInterval;
-    pstDecoder_->ulLastRecordTime = (pstDecoder_->ulEventTime / pstDecoder_->usRecordInterval)*pstDecoder_->usRecordInterval;
+    RecordOutput_Sum(&pstDecoder_->dTotalEnergy, &pstDecoder_->dEnergyCompensation, pstDecoder_->fPendingEnergy);
+    RecordOutput_Sum(&pstDecoder_->dTotalRotation, &pstDecoder_->dRotationCompensation, pstDecoder_->fPendingRotation);
+    RecordOutput_AdvanceTime(pstDecoder_, 1);
+    pstDecoder_->ulLastRecordTime = (pstDecoder_->ulEventTime / pstDecoder_->ulRecordInterval)*pstDecoder_->ulRecordInterval;
 
-    (*powerRecordReceiverPtr_)(pstDecoder_->dLastRecordTime, pstDecoder_->dTotalRotation, pstDecoder_->dTotalEnergy, fAverageCadence, fAveragePower);
+    // Only the time since the last output matters, so count from there.
+    // This keeps the event time from wrapping at the finer time scales.
+    pstDecoder_->ulEventTime -= pstDecoder_->ulLastRecordTime;
+    pstDecoder_->ulLastRecordTime = 0;
+
+    if (pstDecoder_->prsrPtr != NULL)
+    {
+        RecordOutput_GetStats(pstDecoder_, fAveragePower, &stStats);
+
+        pstDecoder_->ulStatsEvents = 0;
+        if ((pstDecoder_->ulRecordGapCount > 0) || (pstDecoder_->ulEventTime != 0))
+            RecordOutput_AddEvent(pstDecoder_, pstDecoder_->fLastEventPower);
+    }
+
+    RecordOutput_Deliver(pstDecoder_, fAverageCadence, fAveragePower, &stStats);
 
     // If there was any recovered message outage, fill in here.
-    RecordOutput_FillGap(powerRecordReceiverPtr_, pstDecoder_);
+    RecordOutput_FillGap(pstDecoder_);
+
+    // Ended on the boundary after the gap.
+    if (pstDecoder_->ulEventTime == 0)
+        pstDecoder_->ulStatsEvents = 0;
 }
 
 ///////////////////////////////////////////////////////////////////////
-// double RecordOutput_FillGap(FILE *pfOut_, BPRESAMPLER *pstDecoder_)
+// void RecordOutput_FillGap(BPSAMPLER *pstDecoder_)
 ///////////////////////////////////////////////////////////////////////
 //
 // This function is called to fill the data record with energy/
@@ -73,32 +385,80 @@ void RecordOutput(PowerRecordReceiver powerRecordReceiverPtr_, BPSAMPLER *pstDec
 // If the gap is _too_ long then we shouldn't do this because
 // otherwise it could cause some pretty huge files to be generated.
 //
+// At short record intervals a gap can be thousands of records, so each
+// record's totals and time are worked out from the start of the gap
+// rather than added up, which would lose the energy to rounding.
+// A run receiver gets the whole gap in one call instead.
+//
+// The gap records take the stats of the events they were filled from:
+// the event spanning them, or at a resync those before the dropout.
+//
 ///////////////////////////////////////////////////////////////////////
-void RecordOutput_FillGap(PowerRecordReceiver powerRecordReceiverPtr_, BPSAMPLER *pstDecoder_)
+void RecordOutput_FillGap(BPSAMPLER *pstDecoder_)
 {
-    int i;
-    float fIncEnergy;
-    float fIncRotation;
+    unsigned long i;
+    unsigned long ulGapCount = (pstDecoder_->pevPtr == NULL) ? pstDecoder_->ulRecordGapCount : 0;  // No records in event output
+    double dRecordInterval = pstDecoder_->dRecordInterval;
+    double dStartEnergy = pstDecoder_->dTotalEnergy;
+    double dStartRotation = pstDecoder_->dTotalRotation;
+    double dIncEnergy;
+    double dIncRotation;
     float fAveragePower;
     float fAverageCadence;
+    POWER_RECORD_RUN stRun;
+    POWER_RECORD_STATS stStats;
+    unsigned long long ullStartTime;
 
-    if (pstDecoder_->ucRecordGapCount > 0)
+    if (ulGapCount > 0)
     {
-        fIncEnergy = (float)(pstDecoder_->fGapEnergy / pstDecoder_->ucRecordGapCount);
-        fIncRotation = (float)(pstDecoder_->fGapRotation / pstDecoder_->ucRecordGapCount);
+        dIncEnergy = pstDecoder_->fGapEnergy / (double)ulGapCount;
+        dIncRotation = pstDecoder_->fGapRotation / (double)ulGapCount;
         // These two things are broken out here for clarity.
         // With respect to the output generation they can simply be combined.
-        fAveragePower = fIncEnergy / dRecordInterval;
-        fAverageCadence = fIncRotation * 60.0f / dRecordInterval;
+        fAveragePower = (float)(dIncEnergy / dRecordInterval);
+        fAverageCadence = (float)(dIncRotation * 60.0 / dRecordInterval);
+
+        pstDecoder_->stStats.ulGapRecords += ulGapCount;
+        POWER_PROBE2(gap_fill, pstDecoder_, ulGapCount);
 
-        for (i = 0; i < pstDecoder_->ucRecordGapCount; i++)
+        if (pstDecoder_->prunPtr != NULL)
         {
-            pstDecoder_->dTotalEnergy += fIncEnergy;
-            pstDecoder_->dTotalRotation += fIncRotation;
-            pstDecoder_->dLastRecordTime += dRecordInterval;
-            (*powerRecordReceiverPtr_)(pstDecoder_->dLastRecordTime, pstDecoder_->dTotalRotation, pstDecoder_->dTotalEnergy, fAverageCadence, fAveragePower);
+            stRun.dStartTime = pstDecoder_->dGridOrigin + (double)(pstDecoder_->ullRecordIndex + 1) * dRecordInterval;
+            stRun.dInterval = dRecordInterval;
+            stRun.ulCount = ulGapCount;
+            stRun.dStartRotation = dStartRotation + dIncRotation;
+            stRun.dStartEnergy = dStartEnergy + dIncEnergy;
+            stRun.dIncRotation = dIncRotation;
+            stRun.dIncEnergy = dIncEnergy;
+            stRun.fAverageCadence = fAverageCadence;
+            stRun.fAveragePower = fAveragePower;
+
+            ullStartTime = RecordOutput_StartTiming(pstDecoder_);
+            (*pstDecoder_->prunPtr)(pstDecoder_->pvRecordContext, &stRun);
+            RecordOutput_StopTiming(pstDecoder_, ullStartTime);
+
+            RecordOutput_AdvanceTime(pstDecoder_, ulGapCount);
         }
+        else
+        {
+            if (pstDecoder_->prsrPtr != NULL)
+                RecordOutput_GetStats(pstDecoder_, fAveragePower, &stStats);
+
+            for (i = 1; i <= ulGapCount; i++)
+            {
+                pstDecoder_->dTotalEnergy = dStartEnergy + dIncEnergy * i;
+                pstDecoder_->dTotalRotation = dStartRotation + dIncRotation * i;
+                RecordOutput_AdvanceTime(pstDecoder_, 1);
+                RecordOutput_Deliver(pstDecoder_, fAverageCadence, fAveragePower, &stStats);
+            }
+        }
+
+        // Exactly the gap, whatever the rounding above.
+        pstDecoder_->dTotalEnergy = dStartEnergy;
+        pstDecoder_->dTotalRotation = dStartRotation;
+        RecordOutput_Sum(&pstDecoder_->dTotalEnergy, &pstDecoder_->dEnergyCompensation, pstDecoder_->fGapEnergy);
+        RecordOutput_Sum(&pstDecoder_->dTotalRotation, &pstDecoder_->dRotationCompensation, pstDecoder_->fGapRotation);
 
-        pstDecoder_->ucRecordGapCount = 0;
+        pstDecoder_->ulRecordGapCount = 0;
     }
 }
@@ -16,9 +16,34 @@ All rights reserved.
 
 #include "PowerDecoder.h"
 
-void ResamplerOutput_Init(BPSAMPLER *pstDecoder_, unsigned short usRecordInterval_, double dRecordInterval_, unsigned short usTimeBase_);
+#define MAXIMUM_TIME_SCALE (125) // Largest quantized ticks per power meter tick (eg. 25 for 0.01 s records at 2048 Hz)
 
-void RecordOutput(PowerRecordReceiver powerRecordReceiver_, BPSAMPLER *pstDecoder_);
-void RecordOutput_FillGap(PowerRecordReceiver powerRecordReceiver_, BPSAMPLER *pstDecoder_);
+// Sets up the resampler for a power meter that counts ulTimeQuantization_ ticks per second.
+void ResamplerOutput_Init(BPSAMPLER *pstDecoder_, unsigned long ulTimeQuantization_, double dRecordInterval_, double dTimeBase_, double dReSyncInterval_, PowerRecordReceiver powerRecordReceiverPtr_);
+
+// Converts a time (s) to quantized ticks, eg. a time based power meter's event interval.
+unsigned long ResamplerOutput_Ticks(BPSAMPLER *pstDecoder_, double dTime_);
+
+// Sets the last resample output to the start of the recording interval holding dTime_ (s).
+void RecordOutput_SetTime(BPSAMPLER *pstDecoder_, double dTime_);
+
+// Puts the record boundaries on dGridOrigin_ (s) plus whole recording intervals, aligned at each resync.
+void RecordOutput_SetGrid(BPSAMPLER *pstDecoder_, double dGridOrigin_);
+
+// Start (s) of the recording interval holding dTime_.
+double RecordOutput_GetEpoch(const BPSAMPLER *pstDecoder_, double dTime_);
+
+// Moves the last resample output on by ulRecords_ recording intervals.
+void RecordOutput_AdvanceTime(BPSAMPLER *pstDecoder_, unsigned long ulRecords_);
+
+// Counts a power meter event (W) towards the stats of the pending record, if a stats receiver is set.
+void RecordOutput_AddEvent(BPSAMPLER *pstDecoder_, float fEventPower_);
+
+// Outputs a crank torque event to the event receiver, in place of resampling it into records.
+void RecordOutput_Event(BPSAMPLER *pstDecoder_, unsigned short usPeriod_, float fTorque_, float fEnergy_, unsigned char ucRotations_);
+
+void RecordOutput(BPSAMPLER *pstDecoder_);
+void RecordOutput_FillGap(BPSAMPLER *pstDecoder_);
+void RecordOutput_Emit(BPSAMPLER *pstDecoder_, float fAverageCadence_, float fAveragePower_);
 
 #endif
\ No newline at end of file
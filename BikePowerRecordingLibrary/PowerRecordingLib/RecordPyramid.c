@@ -0,0 +1,136 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "math.h"
+
+#include "RecordPyramid.h"
+
+#define RECORD_PYRAMID_RATIO_TOLERANCE  (1e-6)          // Fraction of a decoder record within which a level interval is a whole number of them
+
+static void RecordPyramid_Emit(RECORD_PYRAMID_LEVEL *pstLevel_, double dRecordInterval_, unsigned long long ullIndex_, double dTotalRotation_, double dTotalEnergy_);
+
+void RecordPyramid_Init(RECORD_PYRAMID *pstPyramid_, double dRecordInterval_)
+{
+    memset(pstPyramid_, 0, sizeof(RECORD_PYRAMID));
+    pstPyramid_->dRecordInterval = dRecordInterval_;
+}
+
+bool RecordPyramid_AddLevel(RECORD_PYRAMID *pstPyramid_, double dRecordInterval_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_)
+{
+    RECORD_PYRAMID_LEVEL *pstLevel;
+    double dRatio = dRecordInterval_ / pstPyramid_->dRecordInterval;
+
+    if ((pstPyramid_->ulLevels >= RECORD_PYRAMID_LEVELS)
+        || (dRatio < 0.5)
+        || (fabs(dRatio - floor(dRatio + 0.5)) > RECORD_PYRAMID_RATIO_TOLERANCE))
+        return false;
+
+    pstLevel = &pstPyramid_->astLevels[pstPyramid_->ulLevels++];
+    memset(pstLevel, 0, sizeof(RECORD_PYRAMID_LEVEL));
+    pstLevel->ulRatio = (unsigned long)floor(dRatio + 0.5);
+    pstLevel->dRecordInterval = pstLevel->ulRatio * pstPyramid_->dRecordInterval;
+    pstLevel->prcrPtr = powerRecordReceiverPtr_;
+    pstLevel->pvContext = pvContext_;
+    return true;
+}
+
+void RecordPyramid_Reset(RECORD_PYRAMID *pstPyramid_)
+{
+    pstPyramid_->bStarted = false;
+    pstPyramid_->ullLastIndex = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void RecordPyramid_Emit(RECORD_PYRAMID_LEVEL *pstLevel_, double dRecordInterval_, unsigned long long ullIndex_, double dTotalRotation_, double dTotalEnergy_)
+///////////////////////////////////////////////////////////////////////
+//
+// Outputs the level record ending at decoder record ullIndex_ and makes
+// it the level's new boundary.
+//
+///////////////////////////////////////////////////////////////////////
+static void RecordPyramid_Emit(RECORD_PYRAMID_LEVEL *pstLevel_, double dRecordInterval_, unsigned long long ullIndex_, double dTotalRotation_, double dTotalEnergy_)
+{
+    float fAveragePower = (float)((dTotalEnergy_ - pstLevel_->dLastEnergy) / pstLevel_->dRecordInterval);
+    float fAverageCadence = (float)((dTotalRotation_ - pstLevel_->dLastRotation) * 60.0 / pstLevel_->dRecordInterval);
+
+    if (pstLevel_->prcrPtr != NULL)
+        (*pstLevel_->prcrPtr)(pstLevel_->pvContext, (double)ullIndex_ * dRecordInterval_, dTotalRotation_, dTotalEnergy_, fAverageCadence, fAveragePower);
+
+    pstLevel_->ullLastIndex = ullIndex_;
+    pstLevel_->dLastRotation = dTotalRotation_;
+    pstLevel_->dLastEnergy = dTotalEnergy_;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void RecordPyramid_Add(RECORD_PYRAMID *pstPyramid_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+///////////////////////////////////////////////////////////////////////
+//
+// Decoder record i covers the time from record i - 1 to record i, so the
+// totals at its start are its own less its averages. Those are also the
+// totals at any boundary passed since the record before (nothing was
+// recorded in between), which closes the level record that was open and
+// restarts the level from the last boundary passed.
+//
+///////////////////////////////////////////////////////////////////////
+void RecordPyramid_Add(RECORD_PYRAMID *pstPyramid_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    double dRecordInterval = pstPyramid_->dRecordInterval;
+    double dStartRotation = dTotalRotation_ - fAverageCadence_ * dRecordInterval / 60.0;
+    double dStartEnergy = dTotalEnergy_ - fAveragePower_ * dRecordInterval;
+    unsigned long long ullIndex;
+    unsigned long long ullStart;
+    RECORD_PYRAMID_LEVEL *pstLevel;
+    unsigned long i;
+
+    if (dLastRecordTime_ < dRecordInterval)
+        return;
+
+    ullIndex = (unsigned long long)floor(dLastRecordTime_ / dRecordInterval + 0.5);
+    if (pstPyramid_->bStarted && (ullIndex <= pstPyramid_->ullLastIndex))
+        return;
+
+    ullStart = ullIndex - 1;
+
+    for (i = 0; i < pstPyramid_->ulLevels; i++)
+    {
+        pstLevel = &pstPyramid_->astLevels[i];
+
+        if (!pstPyramid_->bStarted)
+        {
+            // Part of the first level record may be before the first decoder record.
+            pstLevel->ullLastIndex = (ullStart / pstLevel->ulRatio) * pstLevel->ulRatio;
+            pstLevel->dLastRotation = dStartRotation;
+            pstLevel->dLastEnergy = dStartEnergy;
+        }
+        else if (ullStart >= pstLevel->ullLastIndex + pstLevel->ulRatio)
+        {
+            RecordPyramid_Emit(pstLevel, dRecordInterval, pstLevel->ullLastIndex + pstLevel->ulRatio, dStartRotation, dStartEnergy);
+            pstLevel->ullLastIndex = (ullStart / pstLevel->ulRatio) * pstLevel->ulRatio;
+        }
+
+        if ((ullIndex % pstLevel->ulRatio) == 0)
+            RecordPyramid_Emit(pstLevel, dRecordInterval, ullIndex, dTotalRotation_, dTotalEnergy_);
+    }
+
+    pstPyramid_->bStarted = true;
+    pstPyramid_->ullLastIndex = ullIndex;
+}
+
+void RecordPyramid_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    RecordPyramid_Add((RECORD_PYRAMID*)pvContext_, dLastRecordTime_, dTotalRotation_, dTotalEnergy_, fAverageCadence_, fAveragePower_);
+}
+
+void RecordPyramid_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    PowerRecordRun_Deliver(pstRun_, RecordPyramid_Receiver, pvContext_);
+}
@@ -0,0 +1,76 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (RECORD_PYRAMID_H)
+#define RECORD_PYRAMID_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+
+// Records at several intervals from one decoder. The decoder runs at the
+// finest interval with the pyramid as its receiver:
+//
+//    RecordPyramid_Init(&stPyramid, 0.25);
+//    RecordPyramid_AddLevel(&stPyramid, 0.25, SprintReceiver, pvSprints);
+//    RecordPyramid_AddLevel(&stPyramid, 1.0, FileReceiver, pvFile);
+//    RecordPyramid_AddLevel(&stPyramid, 60.0, DashboardReceiver, pvDashboard);
+//    PowerDecoder_InitContext(&stDecoder, 0.25, dTimeBase, dReSyncInterval, RecordPyramid_Receiver, &stPyramid);
+//    PowerDecoder_SetRunReceiver(&stDecoder, RecordPyramid_RunReceiver);
+//
+// Each level's intervals are a whole number of decoder records. A level
+// record carries the decoder's totals at its boundary, and its averages
+// are the difference from the totals at the boundary before, so the levels
+// add up exactly to the decoder records. Time without records counts as
+// zero power; intervals with no records at all (a long dropout) are skipped,
+// as the decoder skips them.
+#define RECORD_PYRAMID_LEVELS           (8)             // Most levels in a pyramid
+
+typedef struct _RECORD_PYRAMID_LEVEL_t_
+{
+    double dRecordInterval;             // Recording interval (s)
+    unsigned long ulRatio;              // Decoder records per record
+    PowerRecordContextReceiver prcrPtr; // Record output
+    void *pvContext;                    // Context passed to prcrPtr
+
+    unsigned long long ullLastIndex;    // Decoder record index of the last boundary
+    double dLastRotation;               // Totals at the last boundary
+    double dLastEnergy;
+
+} RECORD_PYRAMID_LEVEL;
+
+typedef struct _RECORD_PYRAMID_t_
+{
+    double dRecordInterval;             // Decoder recording interval (s)
+    unsigned long ulLevels;
+    RECORD_PYRAMID_LEVEL astLevels[RECORD_PYRAMID_LEVELS];
+
+    bool bStarted;                      // Had a record since the last reset
+    unsigned long long ullLastIndex;    // Index of the last decoder record (its time / interval)
+
+} RECORD_PYRAMID;
+
+// Initializes a pyramid without levels for a decoder with the given recording interval (s).
+void RecordPyramid_Init(RECORD_PYRAMID *pstPyramid_, double dRecordInterval_);
+
+// Adds a level sending records at dRecordInterval_ (s) to a receiver along with pvContext_.
+// Returns false if the interval isn't a whole number of decoder records or the pyramid is full.
+bool RecordPyramid_AddLevel(RECORD_PYRAMID *pstPyramid_, double dRecordInterval_, PowerRecordContextReceiver powerRecordReceiverPtr_, void *pvContext_);
+
+// Starts a new session. The levels are kept.
+void RecordPyramid_Reset(RECORD_PYRAMID *pstPyramid_);
+
+// Passes a decoder record up the levels.
+void RecordPyramid_Add(RECORD_PYRAMID *pstPyramid_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+
+// Receivers that feed a decoder's records to a pyramid, with the pyramid as the context (see PowerDecoder_InitContext).
+void RecordPyramid_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+void RecordPyramid_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+#endif
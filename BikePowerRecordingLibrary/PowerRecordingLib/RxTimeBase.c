@@ -0,0 +1,108 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+
+#include "RxTimeBase.h"
+
+void RxTimeBase_Init(RXTIMEBASE *pstTimeBase_, unsigned long long ullStartTicks_)
+{
+    pstTimeBase_->ullTicks = ullStartTicks_;
+    pstTimeBase_->usLastTimeStamp = 0;
+    pstTimeBase_->ulLastHostTime = 0;
+    pstTimeBase_->ulHostRemainder = 0;
+    pstTimeBase_->bStarted = false;
+    pstTimeBase_->bTimeStampValid = false;
+}
+
+///////////////////////////////////////////////////////////////////////
+// unsigned long long RxTimeBase_Update(RXTIMEBASE *pstTimeBase_, unsigned short usTimeStamp_, unsigned long ulHostTime_)
+///////////////////////////////////////////////////////////////////////
+//
+// The timestamp difference is exact modulo one rollover. The host clock
+// decides how many whole rollovers to add: the one that brings the
+// total closest to the elapsed host time.
+//
+///////////////////////////////////////////////////////////////////////
+unsigned long long RxTimeBase_Update(RXTIMEBASE *pstTimeBase_, unsigned short usTimeStamp_, unsigned long ulHostTime_)
+{
+    unsigned short usDeltaTimeStamp;
+    unsigned long ulHostElapsed;
+    unsigned long long ullHostTicks;
+    unsigned long long ullRollovers = 0;
+
+    if (!pstTimeBase_->bStarted)
+    {
+        pstTimeBase_->bStarted = true;
+        pstTimeBase_->bTimeStampValid = true;
+        pstTimeBase_->usLastTimeStamp = usTimeStamp_;
+        pstTimeBase_->ulLastHostTime = ulHostTime_;
+        return pstTimeBase_->ullTicks;
+    }
+
+    if (!pstTimeBase_->bTimeStampValid)
+    {
+        // Coming from host timed messages; the host clock is all there is to line the two up.
+        RxTimeBase_UpdateHost(pstTimeBase_, ulHostTime_);
+        pstTimeBase_->bTimeStampValid = true;
+        pstTimeBase_->usLastTimeStamp = usTimeStamp_;
+        return pstTimeBase_->ullTicks;
+    }
+
+    usDeltaTimeStamp = usTimeStamp_ - pstTimeBase_->usLastTimeStamp;   // make sure this is done in 16 bit word width!
+    ulHostElapsed = ulHostTime_ - pstTimeBase_->ulLastHostTime;
+    if ((long)ulHostElapsed < 0)
+        ulHostElapsed = 0;  // host clock stepped back
+    ullHostTicks = (unsigned long long)ulHostElapsed * RX_TIMESTAMP_FREQUENCY / 1000;
+
+    if (ullHostTicks > usDeltaTimeStamp)
+        ullRollovers = (ullHostTicks - usDeltaTimeStamp + RX_TIMESTAMP_ROLLOVER / 2) / RX_TIMESTAMP_ROLLOVER;
+
+    pstTimeBase_->ullTicks += usDeltaTimeStamp + ullRollovers * RX_TIMESTAMP_ROLLOVER;
+    pstTimeBase_->usLastTimeStamp = usTimeStamp_;
+    pstTimeBase_->ulLastHostTime = ulHostTime_;
+    pstTimeBase_->ulHostRemainder = 0;
+
+    return pstTimeBase_->ullTicks;
+}
+
+///////////////////////////////////////////////////////////////////////
+// unsigned long long RxTimeBase_UpdateHost(RXTIMEBASE *pstTimeBase_, unsigned long ulHostTime_)
+///////////////////////////////////////////////////////////////////////
+//
+// Fallback for receivers that don't timestamp messages. The sub-tick
+// remainder is carried so that the tick count doesn't drift from the
+// host clock.
+//
+///////////////////////////////////////////////////////////////////////
+unsigned long long RxTimeBase_UpdateHost(RXTIMEBASE *pstTimeBase_, unsigned long ulHostTime_)
+{
+    unsigned long ulHostElapsed;
+    unsigned long long ullScaled;
+
+    if (!pstTimeBase_->bStarted)
+    {
+        pstTimeBase_->bStarted = true;
+        pstTimeBase_->ulLastHostTime = ulHostTime_;
+        return pstTimeBase_->ullTicks;
+    }
+
+    ulHostElapsed = ulHostTime_ - pstTimeBase_->ulLastHostTime;
+    if ((long)ulHostElapsed < 0)
+        ulHostElapsed = 0;  // host clock stepped back
+    ullScaled = (unsigned long long)ulHostElapsed * RX_TIMESTAMP_FREQUENCY + pstTimeBase_->ulHostRemainder;
+
+    pstTimeBase_->ullTicks += ullScaled / 1000;
+    pstTimeBase_->ulHostRemainder = (unsigned long)(ullScaled % 1000);
+    pstTimeBase_->ulLastHostTime = ulHostTime_;
+    pstTimeBase_->bTimeStampValid = false;
+
+    return pstTimeBase_->ullTicks;
+}
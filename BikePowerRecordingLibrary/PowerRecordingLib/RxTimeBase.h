@@ -0,0 +1,48 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (RX_TIME_BASE_H)
+#define RX_TIME_BASE_H
+
+#include "stdbool.h"
+
+// The receiver stamps extended messages with the low 16 bits of a 32768 Hz
+// clock, which rolls over every 2 seconds. The time base unwraps these
+// stamps into a 64 bit tick count. The host clock is only used to count the
+// rollovers that happen while no messages are received, so host scheduling
+// jitter of up to a second has no effect on the decoded times.
+#define RX_TIMESTAMP_FREQUENCY      (32768)
+#define RX_TIMESTAMP_ROLLOVER       (65536)
+
+typedef struct _RXTIMEBASE_t_
+{
+    unsigned long long ullTicks;        // Unwrapped receive time of the last message (1/32768 s)
+    unsigned short usLastTimeStamp;     // Receiver timestamp of the last message
+    unsigned long ulLastHostTime;       // Host time (ms) of the last message
+    unsigned long ulHostRemainder;      // Sub-tick remainder of host time advances (1/1000 tick)
+    bool bStarted;
+    bool bTimeStampValid;               // usLastTimeStamp belongs to ullTicks
+
+} RXTIMEBASE;
+
+// Resets the time base. The first update starts the tick count at ullStartTicks_.
+void RxTimeBase_Init(RXTIMEBASE *pstTimeBase_, unsigned long long ullStartTicks_);
+
+// Unwraps a receiver timestamp. ulHostTime_ is any millisecond clock (eg. DSIThread_GetSystemTime).
+// Returns the receive time in ticks.
+unsigned long long RxTimeBase_Update(RXTIMEBASE *pstTimeBase_, unsigned short usTimeStamp_, unsigned long ulHostTime_);
+
+// Advances the time base from the host clock for messages without a receiver timestamp.
+// Returns the receive time in ticks.
+unsigned long long RxTimeBase_UpdateHost(RXTIMEBASE *pstTimeBase_, unsigned long ulHostTime_);
+
+// Converts ticks to seconds. This is exact for any realistic recording length.
+#define RxTimeBase_Seconds(ullTicks_)   ((double)(ullTicks_) / RX_TIMESTAMP_FREQUENCY)
+
+#endif
@@ -0,0 +1,100 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "math.h"
+
+#include "TotalsRing.h"
+#include "PowerAlloc.h"
+
+bool TotalsRing_Init(TOTALS_RING *pstRing_, double dRecordInterval_, unsigned long ulHistory_)
+{
+    unsigned long ulRingSize = 1;
+
+    memset(pstRing_, 0, sizeof(TOTALS_RING));
+    pstRing_->dRecordInterval = dRecordInterval_;
+
+    while (ulRingSize <= ulHistory_)
+        ulRingSize *= 2;
+
+    pstRing_->pdTotals = (double*)POWER_MALLOC(ulRingSize * sizeof(double));
+    pstRing_->ulMask = ulRingSize - 1;
+    return (pstRing_->pdTotals != NULL);
+}
+
+void TotalsRing_Free(TOTALS_RING *pstRing_)
+{
+    POWER_FREE(pstRing_->pdTotals);
+    pstRing_->pdTotals = NULL;
+}
+
+void TotalsRing_Reset(TOTALS_RING *pstRing_)
+{
+    pstRing_->ullCount = 0;
+    pstRing_->dLastRecordTime = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// unsigned long long TotalsRing_Steps(TOTALS_RING *pstRing_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_)
+///////////////////////////////////////////////////////////////////////
+//
+// The first record's power gives the total before it, so it counts
+// like any other.
+//
+///////////////////////////////////////////////////////////////////////
+unsigned long long TotalsRing_Steps(TOTALS_RING *pstRing_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_)
+{
+    double dSteps = 1;
+
+    if (pstRing_->ullCount == 0)
+    {
+        TotalsRing_Push(pstRing_, dTotalEnergy_ - fAveragePower_ * pstRing_->dRecordInterval);
+    }
+    else
+    {
+        dSteps = floor((dLastRecordTime_ - pstRing_->dLastRecordTime) / pstRing_->dRecordInterval + 0.5);
+        if (dSteps < 1)
+            return 0;
+    }
+
+    pstRing_->dLastRecordTime = dLastRecordTime_;
+    return (unsigned long long)dSteps;
+}
+
+void TotalsRing_Push(TOTALS_RING *pstRing_, double dTotalEnergy_)
+{
+    pstRing_->pdTotals[pstRing_->ullCount & pstRing_->ulMask] = dTotalEnergy_;
+    pstRing_->ullCount++;
+}
+
+///////////////////////////////////////////////////////////////////////
+// void TotalsRing_Fill(TOTALS_RING *pstRing_, unsigned long long ullRecords_)
+///////////////////////////////////////////////////////////////////////
+//
+// Once a ring's worth has been added the whole ring holds the last
+// total, so the rest of a long gap is only counted.
+//
+///////////////////////////////////////////////////////////////////////
+void TotalsRing_Fill(TOTALS_RING *pstRing_, unsigned long long ullRecords_)
+{
+    double dLastTotal = TotalsRing_Get(pstRing_, 0);
+    unsigned long long i;
+
+    for (i = 0; (i < ullRecords_) && (i <= pstRing_->ulMask); i++)
+        TotalsRing_Push(pstRing_, dLastTotal);
+
+    pstRing_->ullCount += ullRecords_ - i;
+}
+
+double TotalsRing_Get(const TOTALS_RING *pstRing_, unsigned long ulBack_)
+{
+    return pstRing_->pdTotals[(pstRing_->ullCount - 1 - ulBack_) & pstRing_->ulMask];
+}
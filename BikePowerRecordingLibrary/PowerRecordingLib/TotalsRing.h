@@ -0,0 +1,54 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (TOTALS_RING_H)
+#define TOTALS_RING_H
+
+#include "stdbool.h"
+
+// The energy totals of a ride's latest records, one recording interval
+// apart, for averages over a window of records ending at the latest one
+// (see MeanMax.h and TrainingLoad.h). Time without records holds the last
+// total, so it counts as zero power.
+typedef struct _TOTALS_RING_t_
+{
+    double dRecordInterval;             // Recording interval (s)
+    double *pdTotals;                   // Ring sized to a power of two
+    unsigned long ulMask;               // Ring size - 1
+    unsigned long long ullCount;        // Totals added since the start of the ride
+    double dLastRecordTime;
+
+} TOTALS_RING;
+
+// Initializes a ring holding the latest total and the ulHistory_ before it. Returns false if out of memory.
+bool TotalsRing_Init(TOTALS_RING *pstRing_, double dRecordInterval_, unsigned long ulHistory_);
+
+// Frees the ring.
+void TotalsRing_Free(TOTALS_RING *pstRing_);
+
+// Starts a new ride.
+void TotalsRing_Reset(TOTALS_RING *pstRing_);
+
+// Takes the time of a record, returning the recording intervals since the last one: 1, plus the
+// records missing in between. Returns 0 for a record that isn't after the last one, which should
+// be dropped. The first record of a ride adds the total before it, worked out from its power, and
+// returns 1.
+unsigned long long TotalsRing_Steps(TOTALS_RING *pstRing_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_);
+
+// Adds a total.
+void TotalsRing_Push(TOTALS_RING *pstRing_, double dTotalEnergy_);
+
+// Adds ullRecords_ missing records, holding the last total.
+void TotalsRing_Fill(TOTALS_RING *pstRing_, unsigned long long ullRecords_);
+
+// The total ulBack_ records before the latest one (0 for the latest). ulBack_ must be within the
+// history the ring was initialized with and less than the totals added.
+double TotalsRing_Get(const TOTALS_RING *pstRing_, unsigned long ulBack_);
+
+#endif
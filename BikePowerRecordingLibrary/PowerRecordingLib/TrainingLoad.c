@@ -0,0 +1,150 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "string.h"
+#include "stdbool.h"
+#include "stdlib.h"
+#include "math.h"
+
+#include "TrainingLoad.h"
+
+static void TrainingLoad_Push(TRAINING_LOAD *pstLoad_, double dTotalEnergy_, float fAveragePower_);
+static void TrainingLoad_Fill(TRAINING_LOAD *pstLoad_, unsigned long long ullRecords_);
+
+bool TrainingLoad_Init(TRAINING_LOAD *pstLoad_, double dRecordInterval_, double dFTP_)
+{
+    static const float afDefaultLimits[TRAINING_LOAD_ZONES - 1] = TRAINING_LOAD_DEFAULT_ZONE_LIMITS;
+
+    memset(pstLoad_, 0, sizeof(TRAINING_LOAD));
+    pstLoad_->dRecordInterval = dRecordInterval_;
+    pstLoad_->dFTP = dFTP_;
+    memcpy(pstLoad_->afZoneLimits, afDefaultLimits, sizeof(afDefaultLimits));
+
+    pstLoad_->ulRollingRecords = (unsigned long)(TRAINING_LOAD_ROLLING_TIME / dRecordInterval_ + 0.5);
+    if (pstLoad_->ulRollingRecords == 0)
+        pstLoad_->ulRollingRecords = 1;
+
+    return TotalsRing_Init(&pstLoad_->stTotals, dRecordInterval_, pstLoad_->ulRollingRecords);
+}
+
+void TrainingLoad_Free(TRAINING_LOAD *pstLoad_)
+{
+    TotalsRing_Free(&pstLoad_->stTotals);
+}
+
+void TrainingLoad_Reset(TRAINING_LOAD *pstLoad_)
+{
+    TotalsRing_Reset(&pstLoad_->stTotals);
+    pstLoad_->dFourthPowerSum = 0;
+    pstLoad_->ullRollingCount = 0;
+    memset(&pstLoad_->stMetrics, 0, sizeof(TRAINING_LOAD_METRICS));
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void TrainingLoad_Push(TRAINING_LOAD *pstLoad_, double dTotalEnergy_, float fAveragePower_)
+///////////////////////////////////////////////////////////////////////
+//
+// Counts one record: its zone, and the rolling average ending with it
+// once there are enough records for one.
+//
+///////////////////////////////////////////////////////////////////////
+static void TrainingLoad_Push(TRAINING_LOAD *pstLoad_, double dTotalEnergy_, float fAveragePower_)
+{
+    double dRollingPower;
+    int iZone = 0;
+
+    TotalsRing_Push(&pstLoad_->stTotals, dTotalEnergy_);
+
+    if (pstLoad_->stTotals.ullCount > pstLoad_->ulRollingRecords)
+    {
+        dRollingPower = (dTotalEnergy_ - TotalsRing_Get(&pstLoad_->stTotals, pstLoad_->ulRollingRecords))
+            / (pstLoad_->ulRollingRecords * pstLoad_->dRecordInterval);
+        dRollingPower *= dRollingPower;
+        pstLoad_->dFourthPowerSum += dRollingPower * dRollingPower;
+        pstLoad_->ullRollingCount++;
+    }
+
+    while ((iZone < TRAINING_LOAD_ZONES - 1) && (fAveragePower_ >= pstLoad_->afZoneLimits[iZone] * pstLoad_->dFTP))
+        iZone++;
+
+    pstLoad_->stMetrics.adZoneTime[iZone] += pstLoad_->dRecordInterval;
+    pstLoad_->stMetrics.dDuration += pstLoad_->dRecordInterval;
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void TrainingLoad_Fill(TRAINING_LOAD *pstLoad_, unsigned long long ullRecords_)
+///////////////////////////////////////////////////////////////////////
+//
+// Counts missing records at zero power. Once the rolling average has
+// dropped to zero (the window is all gap) the rest of a long gap adds
+// nothing to the fourth power sum, so it is counted in one go.
+//
+///////////////////////////////////////////////////////////////////////
+static void TrainingLoad_Fill(TRAINING_LOAD *pstLoad_, unsigned long long ullRecords_)
+{
+    double dLastTotal = TotalsRing_Get(&pstLoad_->stTotals, 0);
+    unsigned long i;
+
+    for (i = 0; (ullRecords_ > 0) && ((i < pstLoad_->ulRollingRecords) || (pstLoad_->stTotals.ullCount <= pstLoad_->ulRollingRecords)); i++)
+    {
+        TrainingLoad_Push(pstLoad_, dLastTotal, 0);
+        ullRecords_--;
+    }
+
+    if (ullRecords_ == 0)
+        return;
+
+    TotalsRing_Fill(&pstLoad_->stTotals, ullRecords_);
+    pstLoad_->ullRollingCount += ullRecords_;
+    pstLoad_->stMetrics.adZoneTime[0] += ullRecords_ * pstLoad_->dRecordInterval;
+    pstLoad_->stMetrics.dDuration += ullRecords_ * pstLoad_->dRecordInterval;
+}
+
+void TrainingLoad_Add(TRAINING_LOAD *pstLoad_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_)
+{
+    unsigned long long ullSteps;
+
+    ullSteps = TotalsRing_Steps(&pstLoad_->stTotals, dLastRecordTime_, dTotalEnergy_, fAveragePower_);
+    if (ullSteps == 0)
+        return;
+
+    if (ullSteps > 1)
+        TrainingLoad_Fill(pstLoad_, ullSteps - 1);
+
+    TrainingLoad_Push(pstLoad_, dTotalEnergy_, fAveragePower_);
+
+    pstLoad_->stMetrics.dWork += (dTotalEnergy_ - TotalsRing_Get(&pstLoad_->stTotals, 1)) / 1000.0;
+}
+
+void TrainingLoad_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    TrainingLoad_Add((TRAINING_LOAD*)pvContext_, dLastRecordTime_, dTotalEnergy_, fAveragePower_);
+}
+
+void TrainingLoad_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_)
+{
+    PowerRecordRun_Deliver(pstRun_, TrainingLoad_Receiver, pvContext_);
+}
+
+void TrainingLoad_GetMetrics(const TRAINING_LOAD *pstLoad_, TRAINING_LOAD_METRICS *pstMetrics_)
+{
+    *pstMetrics_ = pstLoad_->stMetrics;
+
+    if (pstMetrics_->dDuration > 0)
+        pstMetrics_->dAveragePower = pstMetrics_->dWork * 1000.0 / pstMetrics_->dDuration;
+
+    if (pstLoad_->ullRollingCount > 0)
+        pstMetrics_->dNormalizedPower = pow(pstLoad_->dFourthPowerSum / (double)pstLoad_->ullRollingCount, 0.25);
+
+    if (pstLoad_->dFTP > 0)
+    {
+        pstMetrics_->dIntensityFactor = pstMetrics_->dNormalizedPower / pstLoad_->dFTP;
+        pstMetrics_->dTrainingStressScore = pstMetrics_->dDuration / 3600.0 * pstMetrics_->dIntensityFactor * pstMetrics_->dIntensityFactor * 100.0;
+    }
+}
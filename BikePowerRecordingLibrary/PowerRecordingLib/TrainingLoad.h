@@ -0,0 +1,80 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#if !defined (TRAINING_LOAD_H)
+#define TRAINING_LOAD_H
+
+#include "stdbool.h"
+
+#include "PowerDecoder.h"
+#include "TotalsRing.h"
+
+// Training load metrics of a ride, kept up to date as records arrive:
+//    Normalized power (NP): fourth root of the mean fourth power of the
+//       30 s rolling average power.
+//    Intensity factor (IF): NP / FTP.
+//    Training stress score (TSS): duration (h) x IF^2 x 100.
+//    Work and time in each power zone.
+// The rolling average is the difference of the energy totals 30 s apart,
+// so each record takes the same few operations however long the ride.
+// Time without records counts as zero power.
+#define TRAINING_LOAD_ROLLING_TIME      (30.0)          // Rolling average for NP (s)
+#define TRAINING_LOAD_ZONES             (7)
+
+// Default zone upper limits as a fraction of FTP (active recovery, endurance,
+// tempo, threshold, VO2max, anaerobic; neuromuscular above).
+#define TRAINING_LOAD_DEFAULT_ZONE_LIMITS   { 0.55f, 0.75f, 0.90f, 1.05f, 1.20f, 1.50f }
+
+typedef struct _TRAINING_LOAD_METRICS_t_
+{
+    double dDuration;                   // Time covered by records and the gaps between them (s)
+    double dWork;                       // kJ
+    double dAveragePower;               // W
+    double dNormalizedPower;            // W, 0 until the first rolling average
+    double dIntensityFactor;
+    double dTrainingStressScore;
+    double adZoneTime[TRAINING_LOAD_ZONES];             // s
+
+} TRAINING_LOAD_METRICS;
+
+typedef struct _TRAINING_LOAD_t_
+{
+    double dRecordInterval;             // Recording interval (s)
+    double dFTP;                        // Functional threshold power (W)
+    float afZoneLimits[TRAINING_LOAD_ZONES - 1];        // Upper limit of each zone but the last (fraction of FTP)
+
+    TOTALS_RING stTotals;               // Energy totals of the latest records, for the rolling average
+    unsigned long ulRollingRecords;     // Records in the rolling average
+
+    double dFourthPowerSum;             // Sum of the rolling averages to the fourth power
+    unsigned long long ullRollingCount; // Rolling averages in the sum
+    TRAINING_LOAD_METRICS stMetrics;    // All but NP, IF and TSS, which are worked out as they are read
+
+} TRAINING_LOAD;
+
+// Initializes a calculator for a ride. Returns false if out of memory.
+bool TrainingLoad_Init(TRAINING_LOAD *pstLoad_, double dRecordInterval_, double dFTP_);
+
+// Frees the rolling average history.
+void TrainingLoad_Free(TRAINING_LOAD *pstLoad_);
+
+// Starts a new ride.
+void TrainingLoad_Reset(TRAINING_LOAD *pstLoad_);
+
+// Updates the metrics with a record.
+void TrainingLoad_Add(TRAINING_LOAD *pstLoad_, double dLastRecordTime_, double dTotalEnergy_, float fAveragePower_);
+
+// Receivers that feed a decoder's records to a calculator, with the calculator as the context (see PowerDecoder_InitContext).
+void TrainingLoad_Receiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_);
+void TrainingLoad_RunReceiver(void *pvContext_, const POWER_RECORD_RUN *pstRun_);
+
+// Copies the metrics so far. Not locked; called from another thread they may lag by a record.
+void TrainingLoad_GetMetrics(const TRAINING_LOAD *pstLoad_, TRAINING_LOAD_METRICS *pstMetrics_);
+
+#endif
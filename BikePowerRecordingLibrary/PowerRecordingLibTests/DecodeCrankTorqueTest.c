@@ -0,0 +1,162 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "stdio.h"
+#include "string.h"
+#include "math.h"
+
+#include "PowerDecoder.h"
+
+#define TEST_RECORD_INTERVAL    (1.0)           // s
+#define TEST_RESYNC_INTERVAL    (5.0)           // s
+#define TEST_MESSAGE_PERIOD     (0.25)          // s, the crank torque broadcast rate
+#define TEST_RIDE_TIME          (600.0)         // s
+#define TEST_TORQUE             (40.0)          // N m, a multiple of 1/32
+#define TEST_CADENCE            (80.0)          // rpm
+
+static int iFailures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); iFailures++; } } while (0)
+
+// The accumulators of a crank torque meter (page 0x12).
+typedef struct
+{
+    unsigned char ucEventCount;
+    unsigned char ucTicks;
+    unsigned short usPeriod;
+    unsigned short usTorque;
+
+} TEST_METER;
+
+// What the event receiver saw.
+typedef struct
+{
+    unsigned long ulEvents;
+    unsigned long ulRecords;
+    unsigned long ulRotations;
+    unsigned long long ullEventTicks;
+    double dEnergy;
+    float fMinTorque;
+    float fMaxTorque;
+
+} TEST_EVENTS;
+
+static void TestRecordReceiver(void *pvContext_, double dLastRecordTime_, double dTotalRotation_, double dTotalEnergy_, float fAverageCadence_, float fAveragePower_)
+{
+    ((TEST_EVENTS*)pvContext_)->ulRecords++;
+}
+
+static void TestEventReceiver(void *pvContext_, const POWER_EVENT *pstEvent_)
+{
+    TEST_EVENTS *pstEvents = (TEST_EVENTS*)pvContext_;
+
+    if ((pstEvents->ulEvents == 0) || (pstEvent_->fTorque < pstEvents->fMinTorque))
+        pstEvents->fMinTorque = pstEvent_->fTorque;
+    if ((pstEvents->ulEvents == 0) || (pstEvent_->fTorque > pstEvents->fMaxTorque))
+        pstEvents->fMaxTorque = pstEvent_->fTorque;
+
+    pstEvents->ulEvents++;
+    pstEvents->ulRotations += pstEvent_->ucRotations;
+    pstEvents->ullEventTicks = pstEvent_->ullEventTicks;
+    pstEvents->dEnergy += pstEvent_->fEnergy;
+}
+
+static void TestMeter_Page(const TEST_METER *pstMeter_, unsigned char aucPayload_[])
+{
+    aucPayload_[0] = ANT_CRANKTORQUE;
+    aucPayload_[1] = pstMeter_->ucEventCount;
+    aucPayload_[2] = pstMeter_->ucTicks;
+    aucPayload_[3] = (unsigned char)TEST_CADENCE;
+    aucPayload_[4] = (unsigned char)(pstMeter_->usPeriod & 0xFF);
+    aucPayload_[5] = (unsigned char)(pstMeter_->usPeriod >> 8);
+    aucPayload_[6] = (unsigned char)(pstMeter_->usTorque & 0xFF);
+    aucPayload_[7] = (unsigned char)(pstMeter_->usTorque >> 8);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void TestRide(double dUpdatePeriod_)
+///////////////////////////////////////////////////////////////////////
+//
+// Rides at a steady torque and cadence, with the meter updating once a
+// revolution (event synchronous, dUpdatePeriod_ = 0) or every
+// dUpdatePeriod_ seconds (time synchronous). Each update adds the crank
+// period and the torque, so its energy is the torque through one
+// revolution whichever way the meter updates. The events passed on
+// after the first message, the baseline, carry all of those updates.
+//
+///////////////////////////////////////////////////////////////////////
+static void TestRide(double dUpdatePeriod_)
+{
+    static POWERDECODER stDecoder;
+    TEST_EVENTS stEvents;
+    TEST_METER stMeter;
+    unsigned char aucPayload[8];
+    double dRevolutionPeriod = 60.0 / TEST_CADENCE;
+    double dUpdatePeriod = (dUpdatePeriod_ > 0) ? dUpdatePeriod_ : dRevolutionPeriod;
+    unsigned short usPeriodTicks = (unsigned short)(dRevolutionPeriod * 2048 + 0.5);
+    unsigned long ulUpdates = 0;
+    unsigned long ulBaselineUpdates = 0;
+    unsigned long ulBaselineRevolutions = 0;
+    unsigned long ulMessages = (unsigned long)(TEST_RIDE_TIME / TEST_MESSAGE_PERIOD);
+    unsigned long i;
+    double dTime;
+
+    memset(&stEvents, 0, sizeof(stEvents));
+    memset(&stMeter, 0, sizeof(stMeter));
+
+    PowerDecoder_InitContext(&stDecoder, TEST_RECORD_INTERVAL, 0, TEST_RESYNC_INTERVAL, TestRecordReceiver, &stEvents);
+    PowerDecoder_SetEventReceiver(&stDecoder, TestEventReceiver);
+
+    for (i = 1; i <= ulMessages; i++)
+    {
+        dTime = i * TEST_MESSAGE_PERIOD;
+
+        while ((ulUpdates + 1) * dUpdatePeriod <= dTime + 1e-9)
+        {
+            ulUpdates++;
+            stMeter.ucEventCount++;
+            stMeter.usPeriod += usPeriodTicks;
+            stMeter.usTorque += (unsigned short)(TEST_TORQUE * 32);
+            stMeter.ucTicks = (unsigned char)(ulUpdates * dUpdatePeriod / dRevolutionPeriod + 1e-9);
+        }
+
+        if (i == 1)
+        {
+            ulBaselineUpdates = ulUpdates;
+            ulBaselineRevolutions = (unsigned long)(ulUpdates * dUpdatePeriod / dRevolutionPeriod + 1e-9);
+        }
+
+        TestMeter_Page(&stMeter, aucPayload);
+        PowerDecoder_Message(&stDecoder, dTime, aucPayload);
+    }
+
+    CHECK(stEvents.ulRecords == 0);
+    CHECK(stEvents.ulEvents > 0);
+    CHECK(fabs(stEvents.dEnergy - (ulUpdates - ulBaselineUpdates) * 2 * M_PI * TEST_TORQUE) < 1e-6 * stEvents.dEnergy);
+    CHECK(stEvents.ullEventTicks == (unsigned long long)(ulUpdates - ulBaselineUpdates) * usPeriodTicks);
+    CHECK(stEvents.ulRotations == (unsigned long)(ulUpdates * dUpdatePeriod / dRevolutionPeriod + 1e-9) - ulBaselineRevolutions);
+    CHECK(stEvents.fMinTorque == (float)TEST_TORQUE);
+    CHECK(stEvents.fMaxTorque == (float)TEST_TORQUE);
+}
+
+int main(void)
+{
+    TestRide(0);                // Event synchronous: an update a revolution, so under one a message
+    TestRide(0.125);            // Time synchronous: two updates a message, under one revolution
+
+    if (iFailures)
+    {
+        printf("DecodeCrankTorqueTest: %d check(s) failed\n", iFailures);
+        return 1;
+    }
+
+    printf("DecodeCrankTorqueTest: passed\n");
+    return 0;
+}
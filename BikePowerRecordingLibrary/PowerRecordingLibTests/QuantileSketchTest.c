@@ -0,0 +1,129 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+#include "stdio.h"
+#include "string.h"
+#include "stdint.h"
+#include "stdlib.h"
+
+#include "QuantileSketch.h"
+
+#define TEST_VALUES             (100000)
+#define TEST_BUFFER_SIZE        (64 * 1024)
+
+static int iFailures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); iFailures++; } } while (0)
+
+static QUANTILE_SKETCH stSketch;
+static QUANTILE_SKETCH stCopy;
+static unsigned char aucBuffer[TEST_BUFFER_SIZE];
+
+///////////////////////////////////////////////////////////////////////
+// static void TestRoundTrip(void)
+///////////////////////////////////////////////////////////////////////
+//
+// A sketch read back answers every query the same as the one written,
+// and keeps adding from where it left off.
+//
+///////////////////////////////////////////////////////////////////////
+static void TestRoundTrip(void)
+{
+    unsigned long ulSize;
+    unsigned long i;
+
+    QuantileSketch_Init(&stSketch);
+    for (i = 0; i < TEST_VALUES; i++)
+        QuantileSketch_Add(&stSketch, (float)((i * 7919) % 1000));
+
+    ulSize = QuantileSketch_Serialize(&stSketch, aucBuffer, sizeof(aucBuffer));
+    CHECK(ulSize != 0);
+    CHECK(ulSize == QuantileSketch_GetSize(&stSketch));
+
+    CHECK(QuantileSketch_Deserialize(&stCopy, aucBuffer, ulSize));
+    CHECK(stCopy.ullCount == stSketch.ullCount);
+    CHECK(stCopy.fMin == stSketch.fMin);
+    CHECK(stCopy.fMax == stSketch.fMax);
+    CHECK(stCopy.ucLevels == stSketch.ucLevels);
+    for (i = 0; i <= 20; i++)
+        CHECK(QuantileSketch_Quantile(&stCopy, i / 20.0) == QuantileSketch_Quantile(&stSketch, i / 20.0));
+
+    for (i = 0; i < TEST_VALUES; i++)
+        QuantileSketch_Add(&stCopy, (float)(i % 1000));
+    CHECK(stCopy.ullCount == 2 * TEST_VALUES);
+    for (i = 0; i < stCopy.ucLevels; i++)
+        CHECK(stCopy.ausCount[i] < QUANTILE_SKETCH_K);
+}
+
+///////////////////////////////////////////////////////////////////////
+// static void TestBadBuffers(void)
+///////////////////////////////////////////////////////////////////////
+//
+// Truncated buffers and level counts a sketch never holds are rejected,
+// leaving an empty sketch.
+//
+///////////////////////////////////////////////////////////////////////
+static void TestBadBuffers(void)
+{
+    unsigned long ulSize;
+    unsigned long ulLevelsOffset;
+    uint16_t usCount;
+    unsigned long i;
+
+    QuantileSketch_Init(&stSketch);
+    for (i = 0; i < TEST_VALUES; i++)
+        QuantileSketch_Add(&stSketch, (float)(i % 500));
+
+    CHECK(QuantileSketch_Serialize(&stSketch, aucBuffer, QuantileSketch_GetSize(&stSketch) - 1) == 0);
+    ulSize = QuantileSketch_Serialize(&stSketch, aucBuffer, sizeof(aucBuffer));
+    CHECK(ulSize != 0);
+
+    for (i = 0; i < ulSize; i++)
+        CHECK(!QuantileSketch_Deserialize(&stCopy, aucBuffer, i));
+
+    // The level counts sit between the header and the values.
+    ulLevelsOffset = ulSize - stSketch.ucLevels * sizeof(uint16_t);
+    for (i = 0; i < stSketch.ucLevels; i++)
+        ulLevelsOffset -= stSketch.ausCount[i] * sizeof(float);
+
+    usCount = QUANTILE_SKETCH_K;
+    memcpy(aucBuffer + ulLevelsOffset, &usCount, sizeof(usCount));
+    CHECK(!QuantileSketch_Deserialize(&stCopy, aucBuffer, sizeof(aucBuffer)));
+    CHECK(stCopy.ullCount == 0);
+
+    usCount = QUANTILE_SKETCH_LEVEL_SIZE;
+    memcpy(aucBuffer + ulLevelsOffset, &usCount, sizeof(usCount));
+    CHECK(!QuantileSketch_Deserialize(&stCopy, aucBuffer, sizeof(aucBuffer)));
+    CHECK(stCopy.ullCount == 0);
+
+    // The largest count a level can hold still reads, and adding to it stays in bounds.
+    usCount = QUANTILE_SKETCH_K - 1;
+    memcpy(aucBuffer + ulLevelsOffset, &usCount, sizeof(usCount));
+    CHECK(QuantileSketch_Deserialize(&stCopy, aucBuffer, sizeof(aucBuffer)));
+    for (i = 0; i < TEST_VALUES; i++)
+        QuantileSketch_Add(&stCopy, (float)(i % 500));
+    for (i = 0; i < stCopy.ucLevels; i++)
+        CHECK(stCopy.ausCount[i] < QUANTILE_SKETCH_K);
+}
+
+int main(void)
+{
+    TestRoundTrip();
+    TestBadBuffers();
+
+    if (iFailures)
+    {
+        printf("QuantileSketchTest: %d check(s) failed\n", iFailures);
+        return 1;
+    }
+
+    printf("QuantileSketchTest: passed\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except in compliance
+with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2014
+All rights reserved.
+*/
+
+////////////////////////////////////////////////////////////////////////////////
+// StickSimulator
+//
+// Runs a simulated ANT stick on a pseudo-terminal so that the serial, framer
+// and decoder stack can be load tested without hardware. The host opens the
+// printed pty path with DSISerialTTY (57600 baud) as if it were a stick.
+//
+// Usage: StickSimulator [meters] [speedup] [loss percent] [first device number] [ct]
+//
+//    meters               Number of simulated power meters (default 8)
+//    speedup              Simulated seconds per real second (default 10)
+//    loss percent         Share of messages dropped by each meter (default 0)
+//    first device number  Device number of the first meter (default 1000)
+//    ct                   Simulate crank torque meters instead of power only
+//
+// Linux only.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "types.h"
+
+#if defined(DSI_TYPES_LINUX)
+
+#include "dsi_stick_simulator.hpp"
+#include "dsi_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#define DEFAULT_METERS              8
+#define DEFAULT_SPEEDUP             10
+#define DEFAULT_DEVICE_NUMBER       1000
+
+// Simulated stick on the master side of a pty.
+class PtyStickSimulator : public DSIStickSimulator
+{
+public:
+    PtyStickSimulator(int iMaster_) { iMaster = iMaster_; }
+
+protected:
+    BOOL Transmit(UCHAR *pucData_, USHORT usSize_)
+    {
+        while (usSize_)
+        {
+            ssize_t iResult = write(iMaster, pucData_, usSize_);
+            if (iResult < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return FALSE;
+            }
+            pucData_ += iResult;
+            usSize_ -= (USHORT)iResult;
+        }
+        return TRUE;
+    }
+
+private:
+    int iMaster;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Opens a raw pty pair. The slave is held open here so the master keeps
+// working while the host opens and closes its side.
+////////////////////////////////////////////////////////////////////////////////
+static int OpenPty(int *piSlave_)
+{
+    struct termios stTermios;
+    int iMaster = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (iMaster < 0)
+        return -1;
+
+    if (grantpt(iMaster) != 0 || unlockpt(iMaster) != 0)
+    {
+        close(iMaster);
+        return -1;
+    }
+
+    *piSlave_ = open(ptsname(iMaster), O_RDWR | O_NOCTTY);
+    if (*piSlave_ < 0)
+    {
+        close(iMaster);
+        return -1;
+    }
+
+    if (tcgetattr(*piSlave_, &stTermios) == 0)
+    {
+        cfmakeraw(&stTermios);
+        tcsetattr(*piSlave_, TCSANOW, &stTermios);
+    }
+
+    return iMaster;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reports progress once a second.
+////////////////////////////////////////////////////////////////////////////////
+static DSI_THREAD_RETURN ReportThread(void *pvParameter_)
+{
+    DSIStickSimulator *pclSimulator = (DSIStickSimulator*)pvParameter_;
+    ULONG ulLastSent = 0;
+
+    for (;;)
+    {
+        ULONG ulSent;
+        ULONG ulLost;
+
+        DSIThread_Sleep(1000);
+        pclSimulator->GetCounts(&ulSent, &ulLost);
+        printf("Sent %lu (%lu/s), lost %lu\n", ulSent, ulSent - ulLastSent, ulLost);
+        fflush(stdout);
+        ulLastSent = ulSent;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    USHORT usMeters = DEFAULT_METERS;
+    ULONG ulSpeedup = DEFAULT_SPEEDUP;
+    UCHAR ucLossPercent = 0;
+    USHORT usDeviceNumber = DEFAULT_DEVICE_NUMBER;
+    UCHAR ucMeterType = DSI_SIMULATOR_POWER_ONLY;
+    UCHAR aucBuffer[256];
+    int iMaster;
+    int iSlave;
+
+    if (argc > 1 && strcmp(argv[argc - 1], "ct") == 0)
+    {
+        ucMeterType = DSI_SIMULATOR_CRANK_TORQUE;
+        argc--;
+    }
+
+    if (argc > 1)
+        usMeters = (USHORT)atoi(argv[1]);
+    if (argc > 2)
+        ulSpeedup = (ULONG)atoi(argv[2]);
+    if (argc > 3)
+        ucLossPercent = (UCHAR)atoi(argv[3]);
+    if (argc > 4)
+        usDeviceNumber = (USHORT)atoi(argv[4]);
+
+    iMaster = OpenPty(&iSlave);
+    if (iMaster < 0)
+    {
+        printf("Failed to open a pty (%s)\n", strerror(errno));
+        return 1;
+    }
+
+    PtyStickSimulator *pclSimulator = new PtyStickSimulator(iMaster);
+
+    if (!pclSimulator->Init(ulSpeedup))
+    {
+        printf("Invalid speedup\n");
+        return 1;
+    }
+
+    for (USHORT i = 0; i < usMeters; i++)
+    {
+        DSI_SIMULATOR_METER stMeter;
+
+        stMeter.usDeviceNumber = usDeviceNumber + i;
+        stMeter.ucTransmissionType = 5;
+        stMeter.ucMeterType = ucMeterType;
+        stMeter.usMessagePeriod = DSI_SIMULATOR_POWER_PERIOD;
+        stMeter.ucLossPercent = ucLossPercent;
+        stMeter.usPower = (USHORT)(150 + (i * 37) % 250);
+        stMeter.ucCadence = (UCHAR)(70 + (i * 13) % 40);
+
+        if (!pclSimulator->AddMeter(&stMeter))
+        {
+            printf("Only %u meters can be simulated\n", i);
+            break;
+        }
+    }
+
+    printf("Simulated stick on %s, %u meters at %lux\n", ptsname(iMaster), usMeters, ulSpeedup);
+    fflush(stdout);
+
+    pclSimulator->Start();
+    DSIThread_ReleaseThreadID(DSIThread_CreateThread(ReportThread, pclSimulator));
+
+    for (;;)
+    {
+        ssize_t iRead = read(iMaster, aucBuffer, sizeof(aucBuffer));
+
+        if (iRead > 0)
+            pclSimulator->HostBytes(aucBuffer, (ULONG)iRead);
+        else if (iRead < 0 && errno != EINTR)
+            break;
+    }
+
+    pclSimulator->Stop();
+    delete pclSimulator;
+    close(iSlave);
+    close(iMaster);
+
+    return 0;
+}
+
+#endif // defined(DSI_TYPES_LINUX)